@@ -26,6 +26,7 @@ int main() {
                 case DE_DICE:              puts("invalid number of dice sides"); break;
                 case DE_IGNORE:            puts("invalid number of ignores"); break;
                 case DE_OVERFLOW:          puts("integer overflow"); break;
+                case DE_LIMIT:             puts("too expensive"); break;
                 default:                   puts("unknown error");
             }
             goto clean_readline;
@@ -0,0 +1,446 @@
+#include <math.h>
+#include <assert.h>
+#include "approx.h"
+#include "dist.h"
+#include "eval.h"
+#include "expr.h"
+#include "numflow.h"
+#include "diceexpr.h"
+
+// Berry-Esseen constant for sums of independent values that aren't
+// identically distributed, by Shevtsova.
+#define BERRY_ESSEEN 0.56
+// Largest absolute values of phi(z) He2(z), phi(z) He3(z) and
+// phi(z) He5(z), where phi is the standard normal density and Hek are
+// Hermite polynomials, rounded up.
+#define SUP_HE2 0.399
+#define SUP_HE3 0.551
+#define SUP_HE5 2.308
+// Largest change of the standard normal CDF when z moves by 1 / 2, rounded
+// up.
+#define CONTINUITY 0.2
+#define SQRT_2PI 2.50662827463100050242
+
+static enum parse_error term_range(const struct term *t,
+                                   int_least64_t *low,
+                                   int_least64_t *high);
+static enum parse_error term_cumulants(const struct term *t,
+                                       double *n,
+                                       double *cumulants,
+                                       double *rho);
+static void kept_cumulants(const struct term *t,
+                           double *cumulants,
+                           double *rho);
+static void die_cumulants(const struct term *t,
+                          double low,
+                          double high,
+                          double *cumulants,
+                          double *rho);
+static void add_block(double p,
+                      double base,
+                      double m,
+                      double low,
+                      double high,
+                      double mean,
+                      double *sums);
+static void add_piece(double p,
+                      double center,
+                      double m,
+                      double mean,
+                      double *sums);
+static void bernoulli_cumulants(double p, double *cumulants, double *rho);
+static double die_quantile(const struct term *t, double u);
+static double die_trimmed(const struct term *t, double low, double high);
+static double counted(const struct term *t);
+static int die_block(const struct term *t,
+                     int_least64_t k,
+                     double *p,
+                     double *base,
+                     double *m);
+
+enum parse_error
+approx_range(const struct de_expr *e, int_least64_t *low, int_least64_t *high) {
+    assert(e != NULL);
+    assert(low != NULL);
+    assert(high != NULL);
+
+    *low = *high = 0;
+    for (size_t i = 0; i < e->nterms; i++) {
+        int_least64_t term_low, term_high;
+        enum parse_error retval = term_range(&e->terms[i], &term_low,
+                                             &term_high);
+        if (retval != 0)
+            return retval;
+        enum flow_type low_overflow, high_overflow;
+        NF_PLUS(*low, term_low, INT_LEAST64, low_overflow);
+        NF_PLUS(*high, term_high, INT_LEAST64, high_overflow);
+        if (low_overflow != 0 || high_overflow != 0)
+            return DE_OVERFLOW;
+        *low += term_low;
+        *high += term_high;
+    }
+
+    return 0;
+}
+
+enum parse_error
+approx_build(const struct de_expr *e, struct dist *d) {
+    assert(e != NULL);
+    assert(d != NULL);
+
+    enum parse_error retval = approx_range(e, &d->min, &d->max);
+    if (retval != 0)
+        return retval;
+    d->approximate = 1;
+
+    // Cumulants of independent values add up, odd ones change sign with
+    // the values.
+    for (size_t i = 0; i < e->nterms; i++) {
+        const struct term *t = &e->terms[i];
+        const double sign = t->negative ? -1 : 1;
+        double n, cumulants[4], rho;
+        if ((retval = term_cumulants(t, &n, cumulants, &rho)) != 0)
+            return retval;
+        d->cumulants[0] += sign * n * cumulants[0];
+        d->cumulants[1] += n * cumulants[1];
+        d->cumulants[2] += sign * n * cumulants[2];
+        d->cumulants[3] += n * cumulants[3];
+        d->rho += n * rho;
+    }
+
+    return 0;
+}
+
+double
+approx_at_most(const struct dist *d, int_least64_t x) {
+    assert(d != NULL);
+
+    if (x < d->min)
+        return 0;
+    if (x >= d->max)
+        return 1;
+    const double sigma = sqrt(d->cumulants[1]);
+    if (sigma == 0)
+        return x >= d->cumulants[0];
+
+    // Half is added, because the values are integers.
+    const double z = ((double) x + 0.5 - d->cumulants[0]) / sigma,
+        z2 = z * z,
+        g1 = d->cumulants[2] / (sigma * sigma * sigma),
+        g2 = d->cumulants[3] / (sigma * sigma * sigma * sigma),
+        he2 = z2 - 1,
+        he3 = z * (z2 - 3),
+        he5 = z * (z2 * z2 - 10 * z2 + 15);
+    const double p = 0.5 * erfc(-z / sqrt(2.0)) - exp(-z2 / 2) / SQRT_2PI *
+        (g1 / 6 * he2 + g2 / 24 * he3 + g1 * g1 / 72 * he5);
+
+    return p < 0 ? 0 : p > 1 ? 1 : p;
+}
+
+double
+approx_error(const struct dist *d) {
+    assert(d != NULL);
+
+    const double sigma = sqrt(d->cumulants[1]);
+    if (sigma == 0)
+        return 0;
+    const double sigma3 = sigma * sigma * sigma,
+        g1 = d->cumulants[2] / sigma3,
+        g2 = d->cumulants[3] / (sigma3 * sigma);
+    const double error = BERRY_ESSEEN * d->rho / sigma3 + CONTINUITY / sigma +
+        fabs(g1) / 6 * SUP_HE2 + fabs(g2) / 24 * SUP_HE3 +
+        g1 * g1 / 72 * SUP_HE5;
+
+    return error < 1 ? error : 1;
+}
+
+/* Smallest and largest value of a term.
+ * @return Zero on success, DE_OVERFLOW if either doesn't fit.
+ */
+static enum parse_error
+term_range(const struct term *t, int_least64_t *low, int_least64_t *high) {
+    if (t->type == TERM_CONSTANT)
+        *low = *high = t->constant;
+    else {
+        const int_least64_t kept = t->nrolls - t->small - t->large;
+        const int_least64_t min = t->count != COUNT_NONE ? 0 : t->reroll + 1,
+            max = t->count != COUNT_NONE ? 1 : eval_max_roll(t);
+        enum flow_type overflow;
+        NF_MULTIPLY(kept, max, INT_LEAST64, overflow);
+        if (overflow != 0)
+            return DE_OVERFLOW;
+        *low = kept * min;
+        *high = kept * max;
+    }
+    if (t->negative) {
+        if (*low == INT_LEAST64_MIN)
+            return DE_OVERFLOW;
+        const int_least64_t temp = *low;
+        *low = -*high;
+        *high = -temp;
+    }
+
+    return 0;
+}
+
+/* Cumulants of a term, not negated, as n independent values.
+ * @param n Used to store the number of values.
+ * @param cumulants Used to store the mean, the variance and the third and
+ * fourth cumulants of one value.
+ * @param rho Used to store the third absolute central moment, or a bound
+ * of it, of one value.
+ * @return Zero on success, enum parse_error of dist_term() otherwise.
+ */
+static enum parse_error
+term_cumulants(const struct term *t,
+               double *n,
+               double *cumulants,
+               double *rho) {
+    *n = 1;
+    if (t->type == TERM_CONSTANT) {
+        cumulants[0] = t->constant;
+        cumulants[1] = cumulants[2] = cumulants[3] = *rho = 0;
+        return 0;
+    }
+
+    // Kept rolls aren't independent, so the whole term is one value, unless
+    // it's too large to build.
+    if (t->small > 0 || t->large > 0) {
+        struct dist *exact = NULL;
+        enum parse_error retval = dist_term(t, &exact);
+        if (retval == DE_LIMIT) {
+            *n = t->nrolls;
+            kept_cumulants(t, cumulants, rho);
+            return 0;
+        }
+        if (retval != 0)
+            return retval;
+        for (int i = 0; i < 4; i++)
+            cumulants[i] = exact->cumulants[i];
+        *rho = exact->rho;
+        dist_free(exact);
+        return 0;
+    }
+
+    *n = t->nrolls;
+    if (t->count == COUNT_NONE)
+        die_cumulants(t, -INFINITY, INFINITY, cumulants, rho);
+    // Each roll is counted or not.
+    else
+        bernoulli_cumulants(counted(t), cumulants, rho);
+
+    return 0;
+}
+
+/* Cumulants of the sum of the kept rolls of a dice, per roll, when there
+ * are too many rolls to build it exactly.
+ * A trimmed sum of n rolls is asymptotically normal, Stigler 1973. Its
+ * mean is n times the integral of the quantile function of one roll over
+ * the kept fractions, and it varies like the sum of n rolls winsorized to
+ * the quantiles at the ends of the kept fractions, rolls outside them moved
+ * to the ends. The higher cumulants and rho are those of the winsorized
+ * rolls too.
+ */
+static void
+kept_cumulants(const struct term *t, double *cumulants, double *rho) {
+    const double n = t->nrolls;
+    double low = t->small / n, high = 1 - t->large / n;
+    if (t->count == COUNT_NONE) {
+        die_cumulants(t, die_quantile(t, low), die_quantile(t, high),
+                      cumulants, rho);
+        cumulants[0] = die_trimmed(t, low, high);
+        return;
+    }
+
+    // A counted roll is one or zero, in the order of the rolls when
+    // counting large rolls, in the opposite order otherwise.
+    const double p = counted(t);
+    if (t->count == COUNT_AT_MOST) {
+        const double temp = low;
+        low = 1 - high;
+        high = 1 - temp;
+    }
+    // Quantiles of a roll at low and high are equal if the kept rolls are
+    // all counted or all not.
+    if ((low > 1 - p) == (high > 1 - p))
+        cumulants[1] = cumulants[2] = cumulants[3] = *rho = 0;
+    else
+        bernoulli_cumulants(p, cumulants, rho);
+    cumulants[0] = high - (low > 1 - p ? low : 1 - p);
+    if (cumulants[0] < 0)
+        cumulants[0] = 0;
+}
+
+/* Cumulants of one roll of a dice, rerolling and exploding it, and moving
+ * rolls below low to low and above high to high.
+ * The central moments are summed over the blocks of the roll, using the
+ * moments of a uniform distribution of m values, (m^2 - 1) / 12 and
+ * (m^2 - 1)(3m^2 - 7) / 240, and the third absolute central moment is
+ * bounded with the fourth central moment.
+ */
+static void
+die_cumulants(const struct term *t,
+              double low,
+              double high,
+              double *cumulants,
+              double *rho) {
+    double p, base, m, first[4] = { 0 }, sums[4] = { 0 };
+    for (int_least64_t k = 0; die_block(t, k, &p, &base, &m); k++)
+        add_block(p, base, m, low, high, 0, first);
+    const double mean = first[0];
+    for (int_least64_t k = 0; die_block(t, k, &p, &base, &m); k++)
+        add_block(p, base, m, low, high, mean, sums);
+
+    cumulants[0] = mean;
+    cumulants[1] = sums[1];
+    cumulants[2] = sums[2];
+    cumulants[3] = sums[3] - 3 * sums[1] * sums[1];
+    *rho = pow(sums[3], 0.75);
+}
+
+/* Add a block of die_block() to sums, moving its rolls below low to low and
+ * above high to high.
+ */
+static void
+add_block(double p,
+          double base,
+          double m,
+          double low,
+          double high,
+          double mean,
+          double *sums) {
+    const double below = low - base - 1, above = base + m - high,
+        first = base + 1 > low ? base + 1 : low,
+        last = base + m < high ? base + m : high;
+    if (below > 0)
+        add_piece(p * (below < m ? below : m) / m, low, 1, mean, sums);
+    if (above > 0)
+        add_piece(p * (above < m ? above : m) / m, high, 1, mean, sums);
+    if (first <= last) {
+        add_piece(p * (last - first + 1) / m, (first + last) / 2,
+                  last - first + 1, mean, sums);
+    }
+}
+
+/* Add values uniform over m integers around center, with probability p, to
+ * the mean and to the second, third and fourth central moments about mean
+ * in sums.
+ */
+static void
+add_piece(double p, double center, double m, double mean, double *sums) {
+    const double d = center - mean,
+        v2 = (m * m - 1) / 12,
+        v4 = (m * m - 1) * (3 * m * m - 7) / 240;
+    sums[0] += p * center;
+    sums[1] += p * (d * d + v2);
+    sums[2] += p * (d * d * d + 3 * d * v2);
+    sums[3] += p * (d * d * d * d + 6 * d * d * v2 + v4);
+}
+
+/* Cumulants of a value one with probability p and zero otherwise.
+ */
+static void
+bernoulli_cumulants(double p, double *cumulants, double *rho) {
+    const double pq = p * (1 - p);
+    cumulants[0] = p;
+    cumulants[1] = pq;
+    cumulants[2] = pq * (1 - 2 * p);
+    cumulants[3] = pq * (1 - 6 * pq);
+    *rho = pq * (p * p + (1 - p) * (1 - p));
+}
+
+/* Quantile of one roll of a dice at u, the smallest roll r with
+ * P(roll <= r) >= u.
+ */
+static double
+die_quantile(const struct term *t, double u) {
+    double p, base, m, c = 0, largest = 0;
+    for (int_least64_t k = 0; die_block(t, k, &p, &base, &m); k++) {
+        if (u <= c + p) {
+            const double i = ceil((u - c) / (p / m));
+            return base + (i < 1 ? 1 : i > m ? m : i);
+        }
+        c += p;
+        largest = base + m;
+    }
+
+    // Left out blocks and rounding.
+    return largest;
+}
+
+/* Integral of the quantile function of one roll of a dice from low to high.
+ * Roll base + i of a block covers an interval of length p / m, so the
+ * integral over a block is a sum of the rolls between the first and the
+ * last roll, which cover the ends of the interval partly.
+ */
+static double
+die_trimmed(const struct term *t, double low, double high) {
+    double p, base, m, c = 0, sum = 0;
+    for (int_least64_t k = 0; die_block(t, k, &p, &base, &m); k++) {
+        const double s = p / m,
+            from = low > c ? low : c,
+            to = high < c + p ? high : c + p;
+        if (from < to) {
+            double i = ceil((from - c) / s), j = ceil((to - c) / s);
+            i = i < 1 ? 1 : i > m ? m : i;
+            j = j < i ? i : j > m ? m : j;
+            if (i == j)
+                sum += (base + i) * (to - from);
+            else {
+                sum += (base + i) * (c + i * s - from) +
+                    s * (j - i - 1) * (base + (i + j) / 2) +
+                    (base + j) * (to - c - (j - 1) * s);
+            }
+        }
+        c += p;
+    }
+
+    return sum;
+}
+
+/* Probability of one roll of a counted dice being counted.
+ */
+static double
+counted(const struct term *t) {
+    double p, base, m, q = 0;
+    for (int_least64_t k = 0; die_block(t, k, &p, &base, &m); k++) {
+        // Values of the block meeting the threshold.
+        double hits = t->count == COUNT_AT_LEAST ?
+            base + m - t->threshold + 1 : t->threshold - base;
+        hits = hits < 0 ? 0 : hits > m ? m : hits;
+        q += p * hits / m;
+    }
+
+    return q;
+}
+
+/* Rolls of a dice in block k are uniform from base + 1 to base + m, and in
+ * the block with probability p. An exploding dice has a block for each
+ * number of explosions, see eval_roll_die(), others have one block.
+ * Blocks too improbable to matter are left out.
+ * @return Non-zero if there's block k.
+ */
+static int
+die_block(const struct term *t,
+          int_least64_t k,
+          double *p,
+          double *base,
+          double *m) {
+    const int_least64_t sides = t->dice - t->reroll,
+        depth = eval_explode_depth();
+    if (!t->explode || sides == 1) {
+        // Only the largest side is left, it explodes as long as it can.
+        *p = 1;
+        *base = t->explode ? (double) t->dice * depth + t->reroll : t->reroll;
+        *m = sides;
+        return k == 0;
+    }
+    if (k > depth)
+        return 0;
+
+    *p = pow(1.0 / sides, (double) k) * (k < depth ? 1 - 1.0 / sides : 1);
+    *base = (double) t->dice * k + t->reroll;
+    *m = k < depth ? sides - 1 : sides;
+
+    return *p > 0;
+}
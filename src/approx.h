@@ -0,0 +1,58 @@
+#ifndef APPROX_H
+    #define APPROX_H
+#include <stdint.h>
+#include "expr.h"
+#include "dist.h"
+#include "diceexpr.h"
+
+/** @file
+ * Approximate distributions of expressions with too many values to build
+ * exactly. The cumulants of each term are derived from the distribution of
+ * one roll, so building takes time linear in the number of terms, and the
+ * sum is approximated with a normal distribution corrected with the first
+ * terms of its Edgeworth expansion.
+ */
+
+/** Smallest and largest value of an expression.
+ * @param e Can't be NULL.
+ * @param low Used to store the smallest value.
+ * @param high Used to store the largest value, or INT_LEAST64_MAX if the
+ * largest roll of an exploding dice doesn't fit.
+ * @return Zero on success, DE_OVERFLOW if either doesn't fit in
+ * int_least64_t.
+ */
+enum parse_error
+approx_range(const struct de_expr *e, int_least64_t *low, int_least64_t *high);
+
+/** Approximate the distribution of an expression.
+ * Terms ignoring rolls are built exactly with dist_term(), or approximated
+ * as trimmed sums if they are too large, the others need only the
+ * distribution of one roll. A trimmed sum is treated as a sum of
+ * independent winsorized rolls, so approx_error() of it is only an estimate
+ * of the error.
+ * @param e Can't be NULL.
+ * @param d Used to store the cumulants, the smallest and the largest value.
+ * @return Zero on success, DE_OVERFLOW or DE_MEMORY on error.
+ */
+enum parse_error
+approx_build(const struct de_expr *e, struct dist *d);
+
+/** Approximate probability of values at most x.
+ * @param d Distribution with cumulants, min and max, can't be NULL.
+ * @param x Value.
+ * @return Probability.
+ */
+double
+approx_at_most(const struct dist *d, int_least64_t x);
+
+/** Bound of the error of approx_at_most() for any x.
+ * The Berry-Esseen bound of the normal approximation, plus the largest
+ * changes the continuity and the Edgeworth corrections make. Only an
+ * estimate if a trimmed sum is approximated, see approx_build().
+ * @param d Distribution with cumulants, can't be NULL.
+ * @return Bound, at most 1.
+ */
+double
+approx_error(const struct dist *d);
+
+#endif // APPROX_H
@@ -0,0 +1,377 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "audit.h"
+#include "str.h"
+#include "scan.h"
+#include "expr.h"
+#include "eval.h"
+#include "diceexpr.h"
+
+#define MAGIC "DEAU"
+#define MAGIC_LEN 4
+#define VERSION 2
+// Magic, version and seed.
+#define HEADER_LEN (MAGIC_LEN + 1 + 8)
+// Record has a new expression.
+#define NEW_EXPR 0x80
+#define ERROR_MASK 0x7f
+#define DEFAULT_TABLE_SIZE 64
+#define FNV_OFFSET UINT64_C(14695981039346656037)
+#define FNV_PRIME UINT64_C(1099511628211)
+// Increment of the state of splitmix64.
+#define GAMMA UINT64_C(0x9e3779b97f4a7c15)
+
+// An expression of a log.
+struct entry {
+    // NULL if the slot is empty.
+    char *expr;
+    uint_least64_t hash;
+    uint_least64_t id;
+    // NULL if the expression didn't compile.
+    de_expr *compiled;
+    enum parse_error error;
+};
+
+struct de_audit {
+    uint_least64_t seed;
+    // Counter of the next record.
+    uint_least64_t counter;
+    // Records are buffered here and written to the sink.
+    str *log;
+    // Failing sink makes appending fail.
+    int failed;
+    de_sink sink;
+    void *data;
+    // Rolled expressions are written here and thrown away.
+    str *rolled;
+    // Open addressing hash table of expressions, size is a power of two.
+    struct entry *table;
+    size_t size;
+    size_t nexprs;
+};
+
+// Generator of the thread's audited call.
+static __thread int thread_active;
+static __thread uint_least64_t thread_state;
+
+static int write_sink(void *data, const char *chars, size_t len);
+static struct entry* find(de_audit *a, const char *expr, uint_least64_t hash);
+static struct entry* add(de_audit *a, const char *expr, uint_least64_t hash);
+static int append_byte(de_audit *a, unsigned char byte);
+static int append_varint(de_audit *a, uint_least64_t i);
+static int read_varint(struct de_audit_reader *r, uint_least64_t *i);
+static uint_least64_t mix(uint_least64_t z);
+
+enum parse_error
+de_audit_open(uint_least64_t seed,
+              de_sink sink,
+              void *data,
+              de_audit **audit) {
+    assert(sink != NULL);
+    assert(*audit == NULL);
+
+    de_audit *a = malloc(sizeof(*a));
+    if (a == NULL)
+        return DE_MEMORY;
+    a->seed = seed;
+    a->counter = 0;
+    a->failed = 0;
+    a->sink = sink;
+    a->data = data;
+    a->size = DEFAULT_TABLE_SIZE;
+    a->nexprs = 0;
+    a->log = str_new(NULL);
+    a->rolled = str_new(NULL);
+    a->table = calloc(a->size, sizeof(*a->table));
+    if (a->log == NULL || a->rolled == NULL || a->table == NULL) {
+        de_audit_close(a);
+        return DE_MEMORY;
+    }
+    str_set_sink(a->log, write_sink, a, DE_SINK_CHUNK);
+
+    int retval = str_append_chars(a->log, MAGIC) != 0 ||
+        append_byte(a, VERSION) != 0;
+    for (int i = 0; i < 8 && retval == 0; i++)
+        retval = append_byte(a, seed >> 8 * i & 0xff) != 0;
+    if (retval != 0) {
+        retval = a->failed ? DE_OUTPUT : DE_MEMORY;
+        de_audit_close(a);
+        return retval;
+    }
+    *audit = a;
+
+    return 0;
+}
+
+enum parse_error
+de_audit_parse(de_audit *audit, const char *expr, int_least64_t *value) {
+    assert(audit != NULL);
+    assert(expr != NULL);
+
+    uint_least64_t hash = FNV_OFFSET;
+    for (const char *c = expr; *c != '\0'; c++)
+        hash = (hash ^ (unsigned char) *c) * FNV_PRIME;
+    struct entry *e = find(audit, expr, hash);
+    const int new_expr = e == NULL;
+    if (new_expr && (e = add(audit, expr, hash)) == NULL)
+        return DE_MEMORY;
+
+    int_least64_t result = 0;
+    enum parse_error error = e->error;
+    if (e->compiled != NULL) {
+        str_erase(audit->rolled);
+        error = audit_eval(e->compiled, audit->rolled, audit->seed,
+                           audit->counter, &result);
+        if (error != 0)
+            result = 0;
+    }
+
+    int failed = append_byte(audit, error | (new_expr ? NEW_EXPR : 0)) != 0;
+    if (new_expr) {
+        failed = failed || append_varint(audit, strlen(expr)) != 0 ||
+            str_append_chars(audit->log, expr) != 0;
+    }
+    else
+        failed = failed || append_varint(audit, e->id) != 0;
+    // Zigzag, so that small negative values are short too.
+    failed = failed || append_varint(audit, (uint_least64_t) result << 1 ^
+                                     -(uint_least64_t) (result < 0)) != 0;
+    audit->counter++;
+    if (failed)
+        return audit->failed ? DE_OUTPUT : DE_MEMORY;
+
+    *value = result;
+
+    return error;
+}
+
+enum parse_error
+de_audit_close(de_audit *audit) {
+    if (audit == NULL)
+        return 0;
+
+    enum parse_error retval = 0;
+    if (audit->log != NULL) {
+        if (!audit->failed && str_flush(audit->log) != 0)
+            retval = DE_OUTPUT;
+        str_free(audit->log);
+    }
+    if (audit->failed)
+        retval = DE_OUTPUT;
+    if (audit->rolled != NULL)
+        str_free(audit->rolled);
+    if (audit->table != NULL) {
+        for (size_t i = 0; i < audit->size; i++) {
+            free(audit->table[i].expr);
+            de_free(audit->table[i].compiled);
+        }
+        free(audit->table);
+    }
+    free(audit);
+
+    return retval;
+}
+
+enum parse_error
+de_audit_eval(const de_expr *compiled_expression,
+              uint_least64_t seed,
+              uint_least64_t counter,
+              int_least64_t *value) {
+    assert(compiled_expression != NULL);
+
+    str *rolled = str_new(NULL);
+    if (rolled == NULL)
+        return DE_MEMORY;
+    enum parse_error retval = audit_eval(compiled_expression, rolled, seed,
+                                         counter, value);
+    str_free(rolled);
+
+    return retval;
+}
+
+enum parse_error
+de_audit_reader_init(struct de_audit_reader *reader,
+                     const char *log,
+                     size_t size) {
+    assert(reader != NULL);
+    assert(log != NULL);
+
+    if (size < HEADER_LEN || memcmp(log, MAGIC, MAGIC_LEN) != 0 ||
+        log[MAGIC_LEN] != VERSION)
+        return DE_SYNTAX_ERROR;
+    reader->log = log;
+    reader->size = size;
+    reader->offset = HEADER_LEN;
+    reader->seed = 0;
+    for (int i = 0; i < 8; i++) {
+        reader->seed |= (uint_least64_t) (unsigned char) log[MAGIC_LEN + 1 + i]
+            << 8 * i;
+    }
+    reader->counter = 0;
+    reader->id = 0;
+
+    return 0;
+}
+
+enum parse_error
+de_audit_read(struct de_audit_reader *reader, struct de_audit_record *record) {
+    assert(reader != NULL);
+    assert(reader->offset < reader->size);
+    assert(record != NULL);
+
+    const unsigned char tag = reader->log[reader->offset++];
+    record->error = tag & ERROR_MASK;
+    record->expr = NULL;
+    record->len = 0;
+    if (tag & NEW_EXPR) {
+        uint_least64_t len;
+        if (read_varint(reader, &len) != 0 ||
+            len > reader->size - reader->offset)
+            return DE_SYNTAX_ERROR;
+        record->expr = reader->log + reader->offset;
+        record->len = len;
+        record->id = reader->id;
+        reader->offset += len;
+    }
+    else if (read_varint(reader, &record->id) != 0 ||
+             record->id >= reader->id)
+        return DE_SYNTAX_ERROR;
+
+    uint_least64_t zigzag;
+    if (read_varint(reader, &zigzag) != 0)
+        return DE_SYNTAX_ERROR;
+    record->value = (int_least64_t) (zigzag >> 1 ^ -(zigzag & 1));
+    record->counter = reader->counter++;
+    if (tag & NEW_EXPR)
+        reader->id++;
+
+    return 0;
+}
+
+enum parse_error
+audit_eval(const struct de_expr *e,
+           str *rolled,
+           uint_least64_t seed,
+           uint_least64_t counter,
+           int_least64_t *value) {
+    assert(e != NULL);
+    assert(rolled != NULL);
+
+    thread_state = mix(seed + counter * GAMMA);
+    thread_active = 1;
+    enum parse_error retval = eval_expr(e, NULL, rolled, value);
+    thread_active = 0;
+
+    return retval;
+}
+
+int
+audit_take(int *word) {
+    if (!thread_active)
+        return 0;
+
+    thread_state += GAMMA;
+    *word = (int) ((mix(thread_state) >> 33) % ((uint_least64_t) RAND_MAX + 1));
+
+    return 1;
+}
+
+int
+audit_active(void) {
+    return thread_active;
+}
+
+/* Write buffered records to the log's sink.
+ */
+static int
+write_sink(void *data, const char *chars, size_t len) {
+    de_audit *a = data;
+    if (a->sink(a->data, chars, len) != 0)
+        a->failed = 1;
+
+    return a->failed;
+}
+
+/* Find an expression of a log.
+ * @return Expression, or NULL if it isn't in the log.
+ */
+static struct entry*
+find(de_audit *a, const char *expr, uint_least64_t hash) {
+    for (size_t i = hash & (a->size - 1); a->table[i].expr != NULL;
+         i = (i + 1) & (a->size - 1)) {
+        if (a->table[i].hash == hash && strcmp(a->table[i].expr, expr) == 0)
+            return &a->table[i];
+    }
+
+    return NULL;
+}
+
+/* Compile and add an expression to a log, growing the table when it's half
+ * full.
+ * @return Added expression, or NULL if memory can't be allocated.
+ */
+static struct entry*
+add(de_audit *a, const char *expr, uint_least64_t hash) {
+    if (2 * (a->nexprs + 1) > a->size) {
+        struct entry *table = calloc(2 * a->size, sizeof(*table));
+        if (table == NULL)
+            return NULL;
+        for (size_t i = 0; i < a->size; i++) {
+            if (a->table[i].expr == NULL)
+                continue;
+            size_t j = a->table[i].hash & (2 * a->size - 1);
+            while (table[j].expr != NULL)
+                j = (j + 1) & (2 * a->size - 1);
+            table[j] = a->table[i];
+        }
+        free(a->table);
+        a->table = table;
+        a->size *= 2;
+    }
+
+    size_t i = hash & (a->size - 1);
+    while (a->table[i].expr != NULL)
+        i = (i + 1) & (a->size - 1);
+    struct entry *e = &a->table[i];
+    if ((e->expr = malloc(strlen(expr) + 1)) == NULL)
+        return NULL;
+    strcpy(e->expr, expr);
+    e->hash = hash;
+    e->id = a->nexprs++;
+    e->compiled = NULL;
+    e->error = de_compile(expr, &e->compiled);
+    if (e->error == DE_MEMORY) {
+        free(e->expr);
+        e->expr = NULL;
+        a->nexprs--;
+        return NULL;
+    }
+
+    return e;
+}
+
+static int
+append_byte(de_audit *a, unsigned char byte) {
+    return str_append_char(a->log, byte);
+}
+
+static int
+append_varint(de_audit *a, uint_least64_t i) {
+    return str_append_varint(a->log, i);
+}
+
+static int
+read_varint(struct de_audit_reader *r, uint_least64_t *i) {
+    return scan_varint(r->log, r->size, &r->offset, i);
+}
+
+/* Finalizer of splitmix64.
+ */
+static uint_least64_t
+mix(uint_least64_t z) {
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+
+    return z ^ (z >> 31);
+}
@@ -0,0 +1,46 @@
+#ifndef AUDIT_H
+    #define AUDIT_H
+#include <stdint.h>
+#include "str.h"
+#include "expr.h"
+#include "diceexpr.h"
+
+/** @file
+ * Random numbers of audited calls, see de_audit_open(). While a thread
+ * evaluates an audited call, its random numbers come from the call's
+ * generator instead of the pool or rand().
+ */
+
+/** Evaluate an expression with the generator of an audited call.
+ * Calls aren't rolled with many threads, since whether a dice is depends
+ * on other threads. Counted dices are rolled one by one and dices explode
+ * at most DE_EXPLODE_DEPTH times, so that rolls don't depend on
+ * de_set_output() or de_set_explode_depth().
+ * @param e Can't be NULL.
+ * @param rolled Rolled expression is appended here, can't be NULL.
+ * @param seed Seed of the log.
+ * @param counter Counter of the call.
+ * @param value Used to store evaluated value.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+audit_eval(const struct de_expr *e,
+           str *rolled,
+           uint_least64_t seed,
+           uint_least64_t counter,
+           int_least64_t *value);
+
+/** Take a random number of the calling thread's audited call.
+ * @param word Used to store a number between 0 and RAND_MAX, inclusive.
+ * @return Non-zero if the thread evaluates an audited call, zero otherwise.
+ */
+int
+audit_take(int *word);
+
+/** Whether the calling thread evaluates an audited call.
+ * @return Non-zero if it does.
+ */
+int
+audit_active(void);
+
+#endif // AUDIT_H
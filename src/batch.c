@@ -0,0 +1,200 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+#include "str.h"
+#include "expr.h"
+#include "eval.h"
+#include "parse.h"
+#include "diceexpr.h"
+
+/* Expressions of a batch evaluated by one thread.
+ */
+struct part {
+    pthread_t thread;
+    // Non-zero if thread was created.
+    int started;
+    // Either exprs or compiled is NULL.
+    const char *const *exprs;
+    const de_expr *const *compiled;
+    struct de_batch *batch;
+    // Expressions [begin, end) of the batch.
+    size_t begin;
+    size_t end;
+    // Rolled expressions of the part. Offsets are relative to this until
+    // the parts are joined.
+    str *rolled;
+    // DE_MEMORY if the part couldn't be evaluated.
+    enum parse_error error;
+};
+
+static enum parse_error batch(const char *const *exprs,
+                              const de_expr *const *compiled,
+                              struct de_batch *b);
+static void *evaluate_part(void *arg);
+static enum parse_error join_rolled(struct part *parts, size_t nparts);
+
+enum parse_error
+de_parse_batch(const char *const *exprs, struct de_batch *b) {
+    assert(exprs != NULL);
+
+    return batch(exprs, NULL, b);
+}
+
+enum parse_error
+de_eval_batch(const de_expr *const *compiled, struct de_batch *b) {
+    assert(compiled != NULL);
+
+    return batch(NULL, compiled, b);
+}
+
+/* Evaluate a batch, split evenly to threads.
+ * @param exprs Expressions to parse, or NULL.
+ * @param compiled Compiled expressions, or NULL.
+ * @param b Can't be NULL.
+ * @return Zero on success, DE_MEMORY on error.
+ */
+static enum parse_error
+batch(const char *const *exprs,
+      const de_expr *const *compiled,
+      struct de_batch *b) {
+    assert(b != NULL);
+    assert(b->values != NULL);
+    assert(b->errors != NULL);
+    assert(b->rolled == NULL);
+
+    size_t nparts = b->nthreads > 0 ? b->nthreads : 1;
+    if (nparts > b->n)
+        nparts = b->n > 0 ? b->n : 1;
+    struct part *parts = calloc(nparts, sizeof(*parts));
+    if (parts == NULL)
+        return DE_MEMORY;
+
+    enum parse_error retval = 0;
+    for (size_t i = 0; i < nparts; i++) {
+        struct part *p = &parts[i];
+        p->exprs = exprs;
+        p->compiled = compiled;
+        p->batch = b;
+        p->begin = b->n * i / nparts;
+        p->end = b->n * (i + 1) / nparts;
+        if ((p->rolled = str_new(NULL)) == NULL) {
+            retval = DE_MEMORY;
+            goto free;
+        }
+    }
+
+    // The calling thread evaluates the first part, and the parts no thread
+    // could be created for.
+    for (size_t i = 1; i < nparts; i++) {
+        parts[i].started = pthread_create(&parts[i].thread, NULL,
+                                          evaluate_part, &parts[i]) == 0;
+    }
+    evaluate_part(&parts[0]);
+    for (size_t i = 1; i < nparts; i++) {
+        if (parts[i].started)
+            pthread_join(parts[i].thread, NULL);
+        else
+            evaluate_part(&parts[i]);
+    }
+
+    for (size_t i = 0; i < nparts; i++) {
+        if (parts[i].error != 0) {
+            retval = parts[i].error;
+            goto free;
+        }
+    }
+    if (b->offsets != NULL)
+        retval = join_rolled(parts, nparts);
+
+    free:
+        for (size_t i = 0; i < nparts; i++) {
+            if (parts[i].rolled != NULL)
+                str_free(parts[i].rolled);
+        }
+        free(parts);
+
+    return retval;
+}
+
+/* Evaluate the expressions of a part.
+ * @param arg Pointer to struct part.
+ * @return NULL.
+ */
+static void*
+evaluate_part(void *arg) {
+    struct part *p = arg;
+    struct de_batch *b = p->batch;
+    struct de_expr *e = NULL;
+    void *scanner = NULL;
+    if (p->exprs != NULL) {
+        if ((e = expr_new()) == NULL || scanner_new("", &scanner) != 0) {
+            p->error = DE_MEMORY;
+            goto free;
+        }
+    }
+
+    for (size_t i = p->begin; i < p->end; i++) {
+        const struct de_expr *c = p->compiled != NULL ? p->compiled[i] : e;
+        enum parse_error retval = 0;
+        if (p->exprs != NULL) {
+            expr_erase(e);
+            scanner_reset(scanner, p->exprs[i]);
+            retval = parse_compile(scanner, e);
+        }
+
+        // Without offsets, rolled expressions are thrown away.
+        if (b->offsets == NULL)
+            str_erase(p->rolled);
+        const size_t offset = p->rolled->len;
+        if (retval == 0)
+            retval = eval_expr(c, NULL, p->rolled, &b->values[i]);
+        if (retval != 0) {
+            b->values[i] = 0;
+            p->rolled->len = offset;
+            p->rolled->str[offset] = '\0';
+        }
+        b->errors[i] = retval;
+
+        if (b->offsets != NULL) {
+            b->offsets[i] = offset;
+            if (str_append_char(p->rolled, '\0') != 0) {
+                p->error = DE_MEMORY;
+                goto free;
+            }
+        }
+    }
+
+    free:
+        if (scanner != NULL)
+            scanner_free(scanner);
+        expr_free(e);
+
+    return NULL;
+}
+
+/* Copy rolled expressions of the parts to the batch, one after another.
+ * @return Zero on success, DE_MEMORY on error.
+ */
+static enum parse_error
+join_rolled(struct part *parts, size_t nparts) {
+    struct de_batch *b = parts[0].batch;
+    size_t len = 0;
+    for (size_t i = 0; i < nparts; i++)
+        len += parts[i].rolled->len;
+    // Empty batch gets an empty string.
+    if ((b->rolled = malloc(len > 0 ? len : 1)) == NULL)
+        return DE_MEMORY;
+    b->rolled[0] = '\0';
+
+    size_t start = 0;
+    for (size_t i = 0; i < nparts; i++) {
+        const struct part *p = &parts[i];
+        memcpy(b->rolled + start, p->rolled->str, p->rolled->len);
+        for (size_t j = p->begin; j < p->end; j++)
+            b->offsets[j] += start;
+        start += p->rolled->len;
+    }
+
+    return 0;
+}
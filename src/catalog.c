@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include "str.h"
+#include "expr.h"
+#include "dist.h"
+#include "diceexpr.h"
+
+#define MAGIC "DECT"
+#define MAGIC_LEN 4
+// Terms are written as they are in memory, increment this when struct term
+// changes.
+#define VERSION 1
+// Read as another number on a host of other byte order.
+#define BYTE_ORDER_MARK UINT32_C(0x01020304)
+// Magic, version, size of size_t, size of a term, byte order mark, four
+// reserved zeros and the number of expressions.
+#define HEADER_LEN 24
+// Records start at multiples of this, so that terms can be read in place.
+#define ALIGNMENT 8
+// Number of terms and of sign characters of a record.
+#define RECORD_HEADER_LEN 16
+
+struct de_catalog {
+    // Expressions whose terms and signs are in the catalog's memory.
+    struct de_expr *exprs;
+    // Sign characters of each expression.
+    str *signs;
+    size_t nexprs;
+};
+
+static uint_least64_t record_len(const struct de_expr *e);
+static int valid_expr(const struct term *terms,
+                      size_t nterms,
+                      const char *signs,
+                      size_t nsigns);
+static int valid_term(const struct term *t);
+static int append_bytes(str *s, const void *bytes, size_t len);
+static int append_native(str *s, uint_least64_t i);
+static uint_least64_t read_native(const char *chars);
+
+enum parse_error
+de_catalog_write(const de_expr *const *compiled_expressions,
+                 size_t n,
+                 de_sink sink,
+                 void *data) {
+    assert(compiled_expressions != NULL || n == 0);
+    assert(sink != NULL);
+
+    str *s = str_new(NULL);
+    if (s == NULL)
+        return DE_MEMORY;
+    str_set_sink(s, sink, data, DE_SINK_CHUNK);
+
+    const uint16_t term_size = sizeof(struct term);
+    const uint32_t mark = BYTE_ORDER_MARK, reserved = 0;
+    int retval = str_append_chars(s, MAGIC);
+    if (retval == 0)
+        retval = str_append_char(s, VERSION);
+    if (retval == 0)
+        retval = str_append_char(s, sizeof(size_t));
+    if (retval == 0)
+        retval = append_bytes(s, &term_size, sizeof(term_size));
+    if (retval == 0)
+        retval = append_bytes(s, &mark, sizeof(mark));
+    if (retval == 0)
+        retval = append_bytes(s, &reserved, sizeof(reserved));
+    if (retval == 0)
+        retval = append_native(s, n);
+
+    // Offsets of the records and of the end of the last one.
+    uint_least64_t offset = HEADER_LEN + 8 * ((uint_least64_t) n + 1);
+    for (size_t i = 0; i <= n && retval == 0; i++) {
+        retval = append_native(s, offset);
+        if (i < n)
+            offset += record_len(compiled_expressions[i]);
+    }
+    for (size_t i = 0; i < n && retval == 0; i++) {
+        const struct de_expr *e = compiled_expressions[i];
+        const uint_least64_t padding = record_len(e) - RECORD_HEADER_LEN -
+            e->nterms * sizeof(*e->terms) - e->signs->len;
+        const uint64_t zero = 0;
+        retval = append_native(s, e->nterms);
+        if (retval == 0)
+            retval = append_native(s, e->signs->len);
+        if (retval == 0)
+            retval = append_bytes(s, e->terms,
+                                  e->nterms * sizeof(*e->terms));
+        if (retval == 0)
+            retval = append_bytes(s, e->signs->str, e->signs->len);
+        if (retval == 0)
+            retval = append_bytes(s, &zero, padding);
+    }
+    if (retval == 0)
+        retval = str_flush(s);
+    str_free(s);
+
+    return retval == 0 ? 0 : retval == EIO ? DE_OUTPUT : DE_MEMORY;
+}
+
+enum parse_error
+de_catalog_open(const char *chars, size_t size, de_catalog **catalog) {
+    assert(chars != NULL);
+    assert((uintptr_t) chars % ALIGNMENT == 0);
+    assert(*catalog == NULL);
+
+    uint16_t term_size;
+    uint32_t mark;
+    if (size < HEADER_LEN || memcmp(chars, MAGIC, MAGIC_LEN) != 0 ||
+        chars[MAGIC_LEN] != VERSION || chars[MAGIC_LEN + 1] != sizeof(size_t))
+        return DE_SYNTAX_ERROR;
+    memcpy(&term_size, chars + MAGIC_LEN + 2, sizeof(term_size));
+    memcpy(&mark, chars + MAGIC_LEN + 4, sizeof(mark));
+    const uint_least64_t n = read_native(chars + HEADER_LEN - 8);
+    if (term_size != sizeof(struct term) || mark != BYTE_ORDER_MARK ||
+        n >= (size - HEADER_LEN) / 8)
+        return DE_SYNTAX_ERROR;
+
+    de_catalog *c = calloc(1, sizeof(*c));
+    if (c == NULL)
+        return DE_MEMORY;
+    enum parse_error retval = DE_MEMORY;
+    if ((c->exprs = calloc(n + 1, sizeof(*c->exprs))) == NULL ||
+        (c->signs = calloc(n + 1, sizeof(*c->signs))) == NULL)
+        goto free;
+
+    // Records follow each other from the end of the table of offsets to the
+    // end of the catalog.
+    retval = DE_SYNTAX_ERROR;
+    const char *offsets = chars + HEADER_LEN;
+    uint_least64_t begin = read_native(offsets);
+    if (begin != HEADER_LEN + 8 * (n + 1) || read_native(offsets + 8 * n) !=
+        size)
+        goto free;
+    for (; c->nexprs < n; c->nexprs++) {
+        const uint_least64_t end = read_native(offsets + 8 * (c->nexprs + 1));
+        if (end > size || end < begin || end - begin < RECORD_HEADER_LEN ||
+            (end - begin) % ALIGNMENT != 0)
+            goto free;
+        const uint_least64_t nterms = read_native(chars + begin),
+            nsigns = read_native(chars + begin + 8),
+            len = end - begin - RECORD_HEADER_LEN;
+        if (nterms > len / sizeof(struct term) ||
+            nsigns > len - nterms * sizeof(struct term))
+            goto free;
+        const struct term *terms =
+            (const struct term*) (chars + begin + RECORD_HEADER_LEN);
+        const char *signs = (const char*) (terms + nterms);
+        if (!valid_expr(terms, nterms, signs, nsigns))
+            goto free;
+
+        str *s = &c->signs[c->nexprs];
+        s->str = (char*) signs;
+        s->len = s->size = nsigns;
+        struct de_expr *e = &c->exprs[c->nexprs];
+        e->terms = (struct term*) terms;
+        e->nterms = e->size = nterms;
+        e->signs = s;
+        e->pending_signs = nsigns;
+        begin = end;
+    }
+    *catalog = c;
+    c = NULL;
+    retval = 0;
+
+    free:
+        de_catalog_free(c);
+
+    return retval;
+}
+
+size_t
+de_catalog_size(const de_catalog *catalog) {
+    assert(catalog != NULL);
+
+    return catalog->nexprs;
+}
+
+const de_expr*
+de_catalog_get(const de_catalog *catalog, size_t i) {
+    assert(catalog != NULL);
+    assert(i < catalog->nexprs);
+
+    return &catalog->exprs[i];
+}
+
+void
+de_catalog_free(de_catalog *catalog) {
+    if (catalog == NULL)
+        return;
+
+    for (size_t i = 0; i < catalog->nexprs; i++)
+        dist_free(catalog->exprs[i].dist);
+    free(catalog->exprs);
+    free(catalog->signs);
+    free(catalog);
+}
+
+/* Length of the record of an expression, with padding.
+ */
+static uint_least64_t
+record_len(const struct de_expr *e) {
+    const uint_least64_t len = RECORD_HEADER_LEN +
+        e->nterms * sizeof(*e->terms) + e->signs->len;
+
+    return (len + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+/* Check that terms and signs read from a catalog are an expression
+ * de_compile() could have compiled, so that evaluating it is safe.
+ * @return Non-zero if they are.
+ */
+static int
+valid_expr(const struct term *terms,
+           size_t nterms,
+           const char *signs,
+           size_t nsigns) {
+    if (nterms == 0)
+        return 0;
+
+    // Sign characters of each term follow the ones of the term before it,
+    // and terms after the first are added or subtracted.
+    size_t next = 0;
+    for (size_t i = 0; i < nterms; i++) {
+        const struct term *t = &terms[i];
+        if (t->signs != next || t->nsigns > nsigns - next ||
+            (i > 0 && t->nsigns == 0))
+            return 0;
+        int negative = 0;
+        for (; next < t->signs + t->nsigns; next++) {
+            if (signs[next] != '+' && signs[next] != '-')
+                return 0;
+            negative ^= signs[next] == '-';
+        }
+        if (t->negative != negative || !valid_term(t))
+            return 0;
+    }
+
+    return next == nsigns;
+}
+
+/* Check a term as the parser does.
+ * @return Non-zero if the term is valid.
+ */
+static int
+valid_term(const struct term *t) {
+    if (t->type == TERM_CONSTANT)
+        return t->constant >= 0;
+    if (t->type != TERM_DICE)
+        return 0;
+
+    return t->nrolls > 0 &&
+        (uint_least64_t) t->nrolls <= SIZE_MAX / sizeof(int_least64_t) &&
+        t->dice > 0 &&
+        t->small >= 0 && t->large >= 0 &&
+        t->small < t->nrolls && t->large < t->nrolls - t->small &&
+        t->reroll >= 0 && t->reroll < t->dice &&
+        (t->explode == 0 || t->explode == 1) &&
+        (t->count == COUNT_NONE ||
+         ((t->count == COUNT_AT_LEAST || t->count == COUNT_AT_MOST) &&
+          t->threshold >= 0));
+}
+
+static int
+append_bytes(str *s, const void *bytes, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        int retval = str_append_char(s, ((const unsigned char*) bytes)[i]);
+        if (retval != 0)
+            return retval;
+    }
+
+    return 0;
+}
+
+/* Append an 8-byte integer in the host's byte order.
+ */
+static int
+append_native(str *s, uint_least64_t i) {
+    const uint64_t native = i;
+
+    return append_bytes(s, &native, sizeof(native));
+}
+
+static uint_least64_t
+read_native(const char *chars) {
+    uint64_t i;
+    memcpy(&i, chars, sizeof(i));
+
+    return i;
+}
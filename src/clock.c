@@ -0,0 +1,10 @@
+#include <time.h>
+#include "clock.h"
+
+uint_least64_t
+clock_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint_least64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,15 @@
+#ifndef CLOCK_H
+    #define CLOCK_H
+#include <stdint.h>
+
+/** @file
+ * Reading the clock for time budgets, the slow log and hot expressions.
+ */
+
+/** Monotonic time in nanoseconds.
+ * @return Time since an unspecified point.
+ */
+uint_least64_t
+clock_now(void);
+
+#endif // CLOCK_H
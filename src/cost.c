@@ -0,0 +1,180 @@
+#include <assert.h>
+#include <stdint.h>
+#include "expr.h"
+#include "eval.h"
+#include "diceexpr.h"
+#include "numflow.h"
+
+// Limits used when none are given, zero means no limit.
+static struct de_cost default_limits;
+
+static uint_least64_t add(uint_least64_t a, uint_least64_t b);
+static uint_least64_t multiply(uint_least64_t a, uint_least64_t b);
+static uint_least64_t ndigits(int_least64_t i);
+static int exceeds(uint_least64_t cost, uint_least64_t limit);
+
+void
+de_estimate_term(const de_expr *e, size_t term, struct de_cost *cost) {
+    assert(e != NULL);
+    assert(term < e->nterms);
+    assert(cost != NULL);
+
+    const struct term *t = &e->terms[term];
+    cost->dice = 0;
+    cost->memory = 0;
+    cost->output = t->nsigns;
+    if (t->type == TERM_CONSTANT) {
+        cost->output = add(cost->output, ndigits(t->constant));
+        return;
+    }
+
+    uint_least64_t kept = t->nrolls - t->small - t->large;
+    if (t->count != COUNT_NONE) {
+        // ">=T: C)" after the rolls or "(NdX<small>large".
+        cost->output = add(cost->output, 5 + ndigits(t->threshold) +
+                           ndigits(kept));
+        if (eval_samples_count(t)) {
+            // "(NdX", no dices are rolled.
+            cost->output = add(cost->output, 2 + ndigits(t->nrolls) +
+                               ndigits(t->dice));
+            return;
+        }
+    }
+
+    // Exploding dices roll larger than their sides.
+    const int_least64_t max = eval_max_roll(t);
+    cost->dice = t->nrolls;
+    cost->memory = multiply(t->nrolls, eval_roll_width(max));
+    if (eval_counts_rolls(t->nrolls, max))
+        cost->memory = add(cost->memory, max * sizeof(size_t));
+    enum de_output_style style = eval_style(t->nrolls);
+    if (style == DE_OUTPUT_FULL) {
+        // Parentheses and kept rolls separated by '+'. Counted dices have
+        // their ')' already.
+        cost->output = add(cost->output, t->count != COUNT_NONE ? 1 : 2);
+        cost->output = add(cost->output,
+                           multiply(kept, ndigits(max) + 1) - 1);
+        return;
+    }
+
+    // "(NdXrR!<small>large".
+    cost->output = add(cost->output, 2 + ndigits(t->nrolls) + ndigits(t->dice));
+    if (t->reroll > 0)
+        cost->output = add(cost->output, 1 + ndigits(t->reroll));
+    if (t->explode)
+        cost->output = add(cost->output, 1);
+    if (t->small > 0)
+        cost->output = add(cost->output, 1 + ndigits(t->small));
+    if (t->large > 0)
+        cost->output = add(cost->output, 1 + ndigits(t->large));
+    if (t->count != COUNT_NONE)
+        return;
+
+    // ": " and ')'.
+    cost->output = add(cost->output, 3);
+    if (style == DE_OUTPUT_HISTOGRAM) {
+        // "facexcount" separated by ' ' for each kept face.
+        uint_least64_t faces = kept < (uint_least64_t) max ?
+            kept : (uint_least64_t) max;
+        cost->output = add(cost->output,
+                           multiply(faces, ndigits(max) + ndigits(kept) + 2)
+                           - 1);
+    }
+    else {
+        // "K kept, D dropped, sum S", sum has at most 19 digits.
+        cost->output = add(cost->output,
+                           ndigits(kept) + ndigits(t->nrolls - kept) + 19 +
+                           sizeof(" kept,  dropped, sum ") - 1);
+    }
+}
+
+void
+de_estimate(const de_expr *e, struct de_cost *cost) {
+    assert(e != NULL);
+    assert(cost != NULL);
+
+    cost->dice = 0;
+    cost->memory = 0;
+    cost->output = 0;
+    for (size_t i = 0; i < e->nterms; i++) {
+        struct de_cost term;
+        de_estimate_term(e, i, &term);
+        cost->dice = add(cost->dice, term.dice);
+        // Rolls of a term are freed before the next term is rolled.
+        if (term.memory > cost->memory)
+            cost->memory = term.memory;
+        cost->output = add(cost->output, term.output);
+    }
+}
+
+void
+de_set_limits(const struct de_cost *limits) {
+    if (limits == NULL) {
+        default_limits.dice = 0;
+        default_limits.memory = 0;
+        default_limits.output = 0;
+    }
+    else
+        default_limits = *limits;
+}
+
+enum parse_error
+de_check_limits(const de_expr *e, const struct de_cost *limits) {
+    assert(e != NULL);
+
+    if (limits == NULL)
+        limits = &default_limits;
+    if (limits->dice == 0 && limits->memory == 0 && limits->output == 0)
+        return 0;
+
+    struct de_cost cost;
+    de_estimate(e, &cost);
+    if (exceeds(cost.dice, limits->dice) ||
+        exceeds(cost.memory, limits->memory) ||
+        exceeds(cost.output, limits->output))
+        return DE_LIMIT;
+
+    return 0;
+}
+
+/* Add without overflowing.
+ * @return a + b or UINT_LEAST64_MAX if it overflows.
+ */
+static uint_least64_t
+add(uint_least64_t a, uint_least64_t b) {
+    enum flow_type overflow;
+    NF_UPLUS(a, b, UINT_LEAST64, overflow);
+
+    return overflow == 0 ? a + b : UINT_LEAST64_MAX;
+}
+
+/* Multiply without overflowing.
+ * @return a * b or UINT_LEAST64_MAX if it overflows.
+ */
+static uint_least64_t
+multiply(uint_least64_t a, uint_least64_t b) {
+    enum flow_type overflow;
+    NF_UMULTIPLY(a, b, UINT_LEAST64, overflow);
+
+    return overflow == 0 ? a * b : UINT_LEAST64_MAX;
+}
+
+/* Number of decimal digits in a non-negative integer.
+ */
+static uint_least64_t
+ndigits(int_least64_t i) {
+    assert(i >= 0);
+
+    uint_least64_t n = 1;
+    for (; i >= 10; i /= 10)
+        n++;
+
+    return n;
+}
+
+/* Whether cost exceeds limit, zero limit means no limit.
+ */
+static int
+exceeds(uint_least64_t cost, uint_least64_t limit) {
+    return limit != 0 && cost > limit;
+}
@@ -1,137 +1,177 @@
 %{
-#include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
-#include <limits.h>
+#include <string.h>
 #include <assert.h>
 #include <inttypes.h>
-#include "str.h"
+#include "expr.h"
+#include "parse.h"
+#include "scan.h"
+#include "probe.h"
+#include "slowlog.h"
+#include "hot.h"
 #include "diceexpr.h"
 #include "numflow.h"
 
-int yylex();
-void yyerror(const char *s);
-// Set dice expression as input for lexer. Can't be NULL.
-void set_scan_string(const char *expr);
-// Free lexer's buffer.
-void delete_buffer();
-static enum parse_error roll(int_least64_t nrolls,
-                             int_least64_t dice,
-                             int_least64_t small,
-                             int_least64_t large,
-                             int_least64_t *sum);
-static int sort_ascending(const void *a, const void *b);
-
-// Number of smallest and largest rolls to ignore.
-static int_least64_t ignore_small, ignore_large;
-// Dice expression after dices are rolled.
-static str *rolled_expr;
-// Evaluated result of a dice expression.
-static int_least64_t result;
-// Parser error.
-static enum parse_error parse_error;
+// State of a parse.
+struct parse_state {
+    // Compiled dice expression, NULL if the expression is only validated.
+    struct de_expr *compiled;
+    // Input of a validated expression not scanned yet, NULL if the
+    // expression is read from a scanner.
+    const char *input;
+    // Number of smallest and largest rolls to ignore.
+    int_least64_t ignore_small;
+    int_least64_t ignore_large;
+    // Rerolled rolls and whether dices explode.
+    int_least64_t reroll;
+    int explode;
+    // Whether and which rolls to count.
+    enum count_type count;
+    int_least64_t threshold;
+    // Parser error.
+    enum parse_error error;
+};
 %}
 
-%code requires { #define YYSTYPE int_least64_t }
+%code requires {
+    #define YYSTYPE int_least64_t
+    struct parse_state;
+}
+
+%code {
+    int yylex(YYSTYPE *lval, void *scanner);
+    // Tokens are read with lex(), which calls yylex() unless validating.
+    #define yylex(lval, scanner, state) lex(lval, scanner, state)
+    static int lex(YYSTYPE *lval, void *scanner, struct parse_state *state);
+    static int scan_token(YYSTYPE *lval, struct parse_state *state);
+    static enum parse_error run_parser(void *scanner,
+                                       struct parse_state *state);
+    void yyerror(void *scanner, struct parse_state *state, const char *s);
+    static enum parse_error check_dice(int_least64_t nrolls,
+                                       int_least64_t dice,
+                                       int_least64_t small,
+                                       int_least64_t large);
+}
+
+%define api.pure full
+%lex-param { void *scanner } { struct parse_state *state }
+%parse-param { void *scanner } { struct parse_state *state }
 
 %token INTEGER
 %token INVALID_CHARACTER OVERFLOW
+%token AT_LEAST AT_MOST
 
-%left '+' '-'
 %nonassoc 'd'
 %right '<' '>'
 
 %nonassoc IGNORE_EMPTY
-%nonassoc UMINUS UPLUS
 
 %%
 
 parse:
-    expr { result = $1; }
+    expr
     ;
 
+/* Sums and signs are left recursive, so the parser's stack doesn't grow
+ * with the number of terms or signs.
+ */
 expr:
-    INVALID_CHARACTER {
-        parse_error = DE_INVALID_CHARACTER;
-        YYERROR;
-    }
+    signed_term
 
-    | OVERFLOW {
-        parse_error = DE_OVERFLOW;
-        YYERROR;
-    }
-
-    | INTEGER {
-        if (str_append_format(rolled_expr, "%" PRIdLEAST64, $1) != 0) {
-            parse_error = DE_MEMORY;
+    | expr '-' {
+        if (state->compiled != NULL &&
+            expr_append_sign(state->compiled, '-')) {
+            state->error = DE_MEMORY;
             YYERROR;
         }
-        $$ = $1;
-    }
+    } signed_term
 
-    | '-' {
-        if (str_append_char(rolled_expr, '-')) {
-            parse_error = DE_MEMORY;
+    | expr '+' {
+        if (state->compiled != NULL &&
+            expr_append_sign(state->compiled, '+')) {
+            state->error = DE_MEMORY;
             YYERROR;
         }
-    } expr %prec UMINUS  {
-        enum flow_type overflow;
-        NF_MINUS(0, $3, INT_LEAST64, overflow);
-        if (overflow != 0) {
-            parse_error = DE_OVERFLOW;
+    } signed_term
+    ;
+
+signed_term:
+    signs term
+    ;
+
+signs:
+    /* No unary signs. */
+
+    | signs '-' {
+        if (state->compiled != NULL &&
+            expr_append_sign(state->compiled, '-')) {
+            state->error = DE_MEMORY;
             YYERROR;
         }
-        $$ = -$3;
     }
 
-    | '+' {
-        if (str_append_char(rolled_expr, '+')) {
-            parse_error = DE_MEMORY;
+    | signs '+' {
+        if (state->compiled != NULL &&
+            expr_append_sign(state->compiled, '+')) {
+            state->error = DE_MEMORY;
             YYERROR;
         }
-    } expr %prec UPLUS { $$ = $3; }
+    }
+    ;
 
-    | expr '-' {
-        if (str_append_char(rolled_expr, '-')) {
-            parse_error = DE_MEMORY;
-            YYERROR;
-        }
-    } expr {
-        enum flow_type overflow;
-        NF_MINUS($1, $4, INT_LEAST64, overflow);
-        if (overflow != 0) {
-            parse_error = DE_OVERFLOW;
-            YYERROR;
-        }
-        $$ = $1 - $4;
+term:
+    INVALID_CHARACTER {
+        state->error = DE_INVALID_CHARACTER;
+        YYERROR;
     }
 
-    | expr '+' {
-        if (str_append_char(rolled_expr, '+')) {
-            parse_error = DE_MEMORY;
-            YYERROR;
-        }
-    } expr {
-        enum flow_type overflow;
-        NF_PLUS($1, $4, INT_LEAST64, overflow);
-        if (overflow != 0) {
-            parse_error = DE_OVERFLOW;
+    | OVERFLOW {
+        state->error = DE_OVERFLOW;
+        YYERROR;
+    }
+
+    | INTEGER {
+        struct term t = { .type = TERM_CONSTANT, .constant = $1 };
+        if (state->compiled != NULL &&
+            expr_append_term(state->compiled, &t) != 0) {
+            state->error = DE_MEMORY;
             YYERROR;
         }
-        $$ = $1 + $4;
     }
 
-    | maybe_int 'd' INTEGER ignore_list {
-        int_least64_t sum;
+    | maybe_int 'd' INTEGER reroll explode ignore_list count {
         enum parse_error e =
-            roll($1, $3, ignore_small, ignore_large, &sum);
+            check_dice($1, $3, state->ignore_small, state->ignore_large);
         if (e != 0) {
-            parse_error = e;
+            state->error = e;
+            YYERROR;
+        }
+        // Some side must be left after rerolls.
+        if (state->reroll >= $3) {
+            state->error = DE_DICE;
             YYERROR;
         }
-        $$ = sum;
-        ignore_small = 0;
-        ignore_large = 0;
+        struct term t = {
+            .type = TERM_DICE,
+            .nrolls = $1,
+            .dice = $3,
+            .small = state->ignore_small,
+            .large = state->ignore_large,
+            .reroll = state->reroll,
+            .explode = state->explode,
+            .count = state->count,
+            .threshold = state->threshold
+        };
+        if (state->compiled != NULL &&
+            expr_append_term(state->compiled, &t) != 0) {
+            state->error = DE_MEMORY;
+            YYERROR;
+        }
+        state->ignore_small = 0;
+        state->ignore_large = 0;
+        state->reroll = 0;
+        state->explode = 0;
+        state->count = COUNT_NONE;
     }
     ;
 
@@ -141,6 +181,32 @@ maybe_int:
     |       { $$ = 1; }
     ;
 
+reroll:
+    /* No rerolls. */
+    | 'r' INTEGER {
+        state->reroll = $2;
+    }
+    ;
+
+explode:
+    /* Dices don't explode. */
+    | '!' {
+        state->explode = 1;
+    }
+    ;
+
+count:
+    /* Rolls are summed. */
+    | AT_LEAST INTEGER {
+        state->count = COUNT_AT_LEAST;
+        state->threshold = $2;
+    }
+    | AT_MOST INTEGER {
+        state->count = COUNT_AT_MOST;
+        state->threshold = $2;
+    }
+    ;
+
 ignore_list:
     ignore
     | ignore_list ignore
@@ -150,171 +216,235 @@ ignore_list:
 ignore:
     '<' {
         enum flow_type overflow;
-        NF_PLUS(ignore_small, 1, INT_LEAST64, overflow);
+        NF_PLUS(state->ignore_small, 1, INT_LEAST64, overflow);
         if (overflow != 0) {
-            parse_error = DE_OVERFLOW;
+            state->error = DE_OVERFLOW;
             YYERROR;
         }
-        ignore_small++;
+        state->ignore_small++;
     }
 
     | '>' {
         enum flow_type overflow;
-        NF_PLUS(ignore_large, 1, INT_LEAST64, overflow);
+        NF_PLUS(state->ignore_large, 1, INT_LEAST64, overflow);
         if (overflow != 0) {
-            parse_error = DE_OVERFLOW;
+            state->error = DE_OVERFLOW;
             YYERROR;
         }
-        ignore_large++;
+        state->ignore_large++;
     }
 
     | '<' INTEGER {
         enum flow_type overflow;
-        NF_PLUS(ignore_small, $2, INT_LEAST64, overflow);
+        NF_PLUS(state->ignore_small, $2, INT_LEAST64, overflow);
         if (overflow != 0) {
-            parse_error = DE_OVERFLOW;
+            state->error = DE_OVERFLOW;
             YYERROR;
         }
-        ignore_small += $2;
+        state->ignore_small += $2;
     }
 
     | '>' INTEGER {
         enum flow_type overflow;
-        NF_PLUS(ignore_large, $2, INT_LEAST64, overflow);
+        NF_PLUS(state->ignore_large, $2, INT_LEAST64, overflow);
         if (overflow != 0) {
-            parse_error = DE_OVERFLOW;
+            state->error = DE_OVERFLOW;
             YYERROR;
         }
-        ignore_large += $2;
+        state->ignore_large += $2;
     }
     ;
 
 %%
 
+enum parse_error
+de_compile(const char *expr, de_expr **compiled_expression) {
+    assert(expr != NULL);
+    assert(*compiled_expression == NULL);
+
+    struct de_expr *compiled = expr_new();
+    if (compiled == NULL)
+        return DE_MEMORY;
+
+    void *scanner;
+    if (scanner_new(expr, &scanner) != 0) {
+        expr_free(compiled);
+        return DE_MEMORY;
+    }
+
+    enum parse_error retval = parse_compile(scanner, compiled);
+    if (retval != 0)
+        expr_free(compiled);
+    else
+        *compiled_expression = compiled;
+
+    scanner_free(scanner);
+
+    return retval;
+}
+
+enum parse_error
+parse_compile(void *scanner, struct de_expr *compiled) {
+    assert(scanner != NULL);
+    assert(compiled != NULL);
+
+    PROBE(parse__start);
+    struct parse_state state = { .compiled = compiled };
+    enum parse_error retval = run_parser(scanner, &state);
+    PROBE2(parse__done, retval, compiled->nterms);
+
+    return retval;
+}
+
+enum parse_error
+de_validate(const char *expr) {
+    assert(expr != NULL);
+
+    struct parse_state state = { .input = expr };
+
+    return run_parser(NULL, &state);
+}
+
+void
+de_free(de_expr *compiled_expression) {
+    expr_free(compiled_expression);
+}
+
 enum parse_error
 de_parse(const char *expr, int_least64_t *value, char **rolled_expression) {
+    return de_parse_limited(expr, NULL, value, rolled_expression);
+}
+
+enum parse_error
+de_parse_limited(const char *expr,
+                 const struct de_cost *limits,
+                 int_least64_t *value,
+                 char **rolled_expression) {
     assert(expr != NULL);
     assert(*rolled_expression == NULL);
 
-    if ((rolled_expr = str_new(NULL)) == NULL)
-        return DE_MEMORY;
+    hot_start();
+    slowlog_start();
+    de_expr *e = NULL;
+    enum parse_error retval = de_compile(expr, &e);
+    slowlog_compiled(e);
+    if (retval == 0)
+        retval = de_eval_limited(e, limits, value, rolled_expression);
+    slowlog_finish(expr, retval);
+    hot_finish(expr);
+    de_free(e);
 
-    enum parse_error retval = 0;
+    return retval;
+}
 
-    set_scan_string(expr);
-    int parse_retval = yyparse();
-    // Any other error than bison's memory error.
-    if (parse_retval == 1) {
-        // If parse_error is set, then it's some other error than syntax error.
-        retval = parse_error == 0 ? DE_SYNTAX_ERROR : parse_error;
-        goto end;
-    }
-    else if (parse_retval == 2) {
-        retval = DE_MEMORY;
-        goto end;
-    }
-    *value = result;
-    if (str_copy_to_chars(rolled_expr, rolled_expression) != 0)
-        retval = DE_MEMORY;
-
-    end:
-        delete_buffer();
-        yylex_destroy();
-        str_free(rolled_expr);
-        // Initialize all file globals for the next call.
-        rolled_expr = NULL;
-        ignore_small = 0;
-        ignore_large = 0;
-        parse_error = 0;
-        result = 0;
+enum parse_error
+de_parse_sink(const char *expr,
+              de_sink sink,
+              void *data,
+              int_least64_t *value) {
+    assert(expr != NULL);
+
+    hot_start();
+    slowlog_start();
+    de_expr *e = NULL;
+    enum parse_error retval = de_compile(expr, &e);
+    slowlog_compiled(e);
+    if (retval == 0)
+        retval = de_eval_sink(e, sink, data, value);
+    slowlog_finish(expr, retval);
+    hot_finish(expr);
+    de_free(e);
 
     return retval;
 }
 
-/* Roll a dice.
- * Arguments must satisfy: ignore_small + ignore_large < nrolls.
- * @param nrolls Number of rolls for a dice. Must be > 0.
- * @param dice Number of sides in a dice. Must be > 0.
- * @param small Ignore this many smallest rolls.
- * @param large Ignore this many largest rolls.
- * @param dice_sum Sum of dices rolled.
- * @return Zero on success, enum parse_error otherwise.
+/* Check that a dice can be rolled.
+ * @param nrolls Number of rolls for a dice.
+ * @param dice Number of sides in a dice.
+ * @param small Number of smallest rolls to ignore.
+ * @param large Number of largest rolls to ignore.
+ * @return Zero if nrolls and dice are positive, small + large < nrolls and
+ * memory for the rolls can be allocated, enum parse_error otherwise.
  */
 static enum parse_error
-roll(int_least64_t nrolls,
-     int_least64_t dice,
-     int_least64_t small,
-     int_least64_t large,
-     int_least64_t *dice_sum) {
+check_dice(int_least64_t nrolls,
+           int_least64_t dice,
+           int_least64_t small,
+           int_least64_t large) {
     if (nrolls <= 0)
         return DE_NROLLS;
     if (dice <= 0)
         return DE_DICE;
-    if (small + large >= nrolls)
+    if (small >= nrolls || large >= nrolls - small)
         return DE_IGNORE;
 
     enum flow_type interror;
-    NF_UMULTIPLY(nrolls, sizeof(int_least64_t), SIZE, interror);
+    NF_UMULTIPLY((uint_least64_t) nrolls, sizeof(int_least64_t), SIZE,
+                 interror);
     if (interror != 0)
         return DE_OVERFLOW;
-    int_least64_t *rolls = malloc(nrolls * sizeof(*rolls));
-    if (rolls == NULL)
-        return DE_MEMORY;
 
-    for (int_least64_t i = 0; i < nrolls; i++)
-        rolls[i] = (int_least64_t) (rand() / (double) RAND_MAX * dice + 1);
-
-    qsort(rolls, nrolls, sizeof(int_least64_t), sort_ascending);
-
-    int retval = 0;
-    if (str_append_char(rolled_expr, '(') != 0) {
-        retval = DE_MEMORY;
-        goto free;
-    }
-
-    int_least64_t sum = 0;
-    int_least64_t nth_included_roll = 0;
-    for (int_least64_t i = small; i < nrolls - large; i++, nth_included_roll++) {
-        NF_PLUS(sum, rolls[i], INT_LEAST64, interror);
-        if (interror != 0) {
-            retval = DE_OVERFLOW;
-            goto free;
-        }
-        sum += rolls[i];
-
-        const char *format_with_plus_or_not =
-            nth_included_roll > 0 && nth_included_roll < nrolls - large ?
-                "+%" PRIdLEAST64 : "%" PRIdLEAST64;
-        if (str_append_format(rolled_expr, format_with_plus_or_not, rolls[i])
-            != 0) {
-            retval = DE_MEMORY;
-            goto free;
-        }
-    }
+    return 0;
+}
 
-    if (str_append_char(rolled_expr, ')') != 0) {
-        retval = DE_MEMORY;
-        goto free;
+/* Run the parser.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+static enum parse_error
+run_parser(void *scanner, struct parse_state *state) {
+    int parse_retval = yyparse(scanner, state);
+    // Any other error than bison's memory error.
+    if (parse_retval == 1) {
+        // If error is set, then it's some other error than syntax error.
+        return state->error == 0 ? DE_SYNTAX_ERROR : state->error;
     }
 
-    *dice_sum = sum;
-
-    free:
-        free(rolls);
+    return parse_retval == 2 ? DE_MEMORY : 0;
+}
 
-    return retval;
+/* Read the next token from the scanner, or from the input of a validated
+ * expression.
+ */
+static int
+lex(YYSTYPE *lval, void *scanner, struct parse_state *state) {
+    // Parenthesized, so that the macro renaming yylex isn't expanded.
+    return state->input != NULL ? scan_token(lval, state) :
+        (yylex)(lval, scanner);
 }
 
+/* Scan the next token of a validated expression as de.l does, without
+ * flex's buffers.
+ * @return Token, zero at the end of the input.
+ */
 static int
-sort_ascending(const void *a, const void *b) {
-    const int_least64_t *x = a;
-    const int_least64_t *y = b;
+scan_token(YYSTYPE *lval, struct parse_state *state) {
+    const char *c = state->input;
+    while (*c == ' ' || *c == '\t' || *c == '\n')
+        c++;
+    if (*c == '\0') {
+        state->input = c;
+        return 0;
+    }
+
+    if (*c >= '0' && *c <= '9') {
+        // A leading zero is an integer of its own.
+        size_t len = 1;
+        while (*c != '0' && c[len] >= '0' && c[len] <= '9')
+            len++;
+        state->input = c + len;
+        return scan_int(c, len, lval) != 0 ? OVERFLOW : INTEGER;
+    }
+    state->input = c + 1;
+    if ((*c == '>' || *c == '<') && c[1] == '=') {
+        state->input++;
+        return *c == '>' ? AT_LEAST : AT_MOST;
+    }
+    if (strchr("-+d<>r!", *c) != NULL)
+        return *c;
 
-    if (*x < *y)  return -1;
-    if (*x == *y) return 0;
-    else          return 1;
+    return *c == 'D' ? 'd' : INVALID_CHARACTER;
 }
 
 // Empty, because on syntax error we don't want to print anything.
 void
-yyerror(const char *s) { }
+yyerror(void *scanner, struct parse_state *state, const char *s) { }
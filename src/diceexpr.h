@@ -5,15 +5,51 @@
  *
  * @description A function for dice expressions. A dice expression consists of
  * dice rolls, possibly ignoring some of those rolls and constant modifiers.
+ * Instead of summing, kept rolls of a dice can be counted, e.g. "10d10>=8"
+ * is the number of rolls at least 8, and "6d6<=2" the number of rolls at
+ * most 2. A dice can reroll its smallest sides, e.g. in "4d6r1" no roll is
+ * 1, and explode, e.g. "3d6!" rolls again and adds every 6.
  *
  * Grammar for dice expression.
  * s      ::= expr
  * expr   ::= INTEGER | ('-'|'+') expr | expr '-' expr | expr '+' expr |
-              [INTEGER] ('d'|'D') INTEGER ignore
+              [INTEGER] ('d'|'D') INTEGER ['r' INTEGER] ['!'] ignore [count]
  * ignore ::= ('<' | '>' [INTEGER])*
+ * count  ::= ('>=' | '<=') INTEGER
+ *
+ * There's no limit for the number of terms or signs, e.g. "d6+d6+...+d6" or
+ * "---1". Parsing and evaluating take time linear in the length of the
+ * expression and the number of rolls, and the parser's stack doesn't grow
+ * with the length.
  */
 
+#include <stddef.h>
 #include <stdint.h>
+/** Number of characters de_eval_sink() collects before writing them to its
+ * sink.
+ */
+#define DE_SINK_CHUNK 4096
+
+/** Number of times a dice explodes at most by default, see
+ * de_set_explode_depth().
+ */
+#define DE_EXPLODE_DEPTH 100
+
+/** Number of values a distribution has at most to be built exactly by
+ * default, see de_set_exact_values().
+ */
+#define DE_EXACT_VALUES 100000
+
+/** Number of characters of an expression kept in the slow log, including
+ * the terminating '\0'.
+ */
+#define DE_SLOW_EXPR 128
+
+/** Number of characters of a normalized expression kept by the hot
+ * expression tracker, including the terminating '\0'.
+ */
+#define DE_HOT_EXPR 64
+
 /** @enum parse_error de_parse() return values on error.
  */
 enum parse_error {
@@ -21,11 +57,309 @@ enum parse_error {
 	DE_INVALID_CHARACTER,
 	DE_SYNTAX_ERROR,
     DE_NROLLS,              // Number of rolls is not positive.
-    DE_DICE,                // Number of sides for a dice is not positive.
+    DE_DICE,                // Number of sides for a dice is not positive,
+                            // or no sides are left after rerolls.
     DE_IGNORE,              // Number of ignores for a dice is too large.
-    DE_OVERFLOW             // Integer overflow.
+    DE_OVERFLOW,            // Integer overflow.
+    DE_LIMIT,               // Estimated cost exceeds a limit.
+    DE_IN_PROGRESS,         // Not an error, de_eval_continue() isn't done.
+    DE_OUTPUT,              // Writing rolled expression to a sink failed.
+    DE_MISMATCH             // Simulations of different expressions, seeds
+                            // or calls can't be merged.
+};
+
+/** @typedef de_sink Function rolled expressions are streamed to, see
+ * de_eval_sink().
+ * @param data Data given with the sink.
+ * @param chars Part of rolled expression, not null terminated.
+ * @param len Number of characters, > 0.
+ * @return Zero on success, non-zero to stop evaluating.
+ */
+typedef int (*de_sink)(void *data, const char *chars, size_t len);
+
+/** @struct de_cost Estimated cost of evaluating a dice expression, also used
+ * as limits for the cost. Zero limit means no limit.
+ */
+struct de_cost {
+    // Number of dices rolled.
+    uint_least64_t dice;
+    // Bytes of memory needed for rolls at most at a time.
+    uint_least64_t memory;
+    // Bytes in rolled expression at most, without '\0'.
+    uint_least64_t output;
+};
+
+/** @enum de_output_style How dices are written to rolled expressions.
+ */
+enum de_output_style {
+    // Every kept roll: "(3+4+6)".
+    DE_OUTPUT_FULL,
+    // Counts of kept faces: "(10000d6<1: 1x1671 2x1650 ...)".
+    DE_OUTPUT_HISTOGRAM,
+    // Numbers of kept and dropped rolls and their sum:
+    // "(10000d6<1: 9999 kept, 1 dropped, sum 35012)".
+    DE_OUTPUT_SUMMARY
+};
+
+/** @struct de_output Output style of dices.
+ */
+struct de_output {
+    enum de_output_style style;
+    // Dices with more rolls than this are written in style, others in full.
+    int_least64_t threshold;
+};
+
+/** @struct de_budget Work de_eval_continue() can do before returning. Zero
+ * means no limit.
+ */
+struct de_budget {
+    // Units of work, rolling a dice, sorting a roll, formatting a roll,
+    // starting a term or writing its sign is one unit.
+    uint_least64_t work;
+    // Time in nanoseconds. Checked after every few thousand units of work.
+    uint_least64_t nanoseconds;
+};
+
+/** @struct de_pool_config Configuration of the pool of random numbers.
+ */
+struct de_pool_config {
+    // Number of rings, each with its own producer thread. Threads rolling
+    // dices are assigned to rings in turns. Zero means one.
+    size_t nshards;
+    // Numbers in each ring, rounded up to a power of two. Zero means 4096
+    // and a watermark of half of it.
+    size_t size;
+    // Producer refills its ring when at most this many numbers are left.
+    // Must be less than size.
+    size_t watermark;
+};
+
+/** @struct de_pool_stats Statistics of the pool of random numbers.
+ */
+struct de_pool_stats {
+    size_t nshards;
+    size_t size;
+    size_t watermark;
+    // Numbers in all rings now.
+    uint_least64_t available;
+    // Numbers taken from the rings.
+    uint_least64_t hits;
+    // Numbers generated by rolling threads, because a ring was empty.
+    uint_least64_t misses;
+    // Times a producer was woken up to refill its ring.
+    uint_least64_t wakeups;
+};
+
+/** @struct de_parallel_config Configuration of rolling large dices with
+ * many threads.
+ */
+struct de_parallel_config {
+    // Threads rolling a dice, including the calling thread. Zero means the
+    // number of online processors.
+    size_t nthreads;
+    // Dices with fewer rolls are rolled by one thread. Zero means 1000000.
+    int_least64_t min_rolls;
+    // Rolls a thread takes at a time. Zero means 65536.
+    int_least64_t chunk;
+};
+
+/** @struct de_batch Outputs of evaluating a batch of dice expressions, see
+ * de_parse_batch(). Arrays are owned by the caller and have n elements.
+ */
+struct de_batch {
+    // Number of expressions.
+    size_t n;
+    // Values of expressions, zero on error.
+    int_least64_t *values;
+    // Zero or enum parse_error of each expression.
+    enum parse_error *errors;
+    // Offsets of rolled expressions in rolled. NULL if rolled expressions
+    // aren't wanted.
+    size_t *offsets;
+    // Used to store rolled expressions one after another, each terminated
+    // by '\0', if offsets isn't NULL. Must be NULL, caller should free it.
+    // Rolled expression of an expression with an error is empty.
+    char *rolled;
+    // Threads evaluating the batch, including the calling thread. Zero means
+    // one.
+    size_t nthreads;
+};
+
+/** @struct de_slow_log_config Configuration of logging slow calls, see
+ * de_slow_log_start().
+ */
+struct de_slow_log_config {
+    // Calls taking at least this many nanoseconds are logged. Zero means
+    // calls aren't logged for their time.
+    uint_least64_t nanoseconds;
+    // Calls of expressions with at least this many rolls of dices are
+    // logged, however fast they are. Zero means rolls aren't counted. If
+    // both thresholds are zero, every call is logged.
+    uint_least64_t dice;
+    // Calls kept, rounded up to a power of two. Zero means 64.
+    size_t size;
+};
+
+/** @enum de_slow_stage Stages of a call timed by the slow log.
+ */
+enum de_slow_stage {
+    // Compiling the expression.
+    DE_SLOW_PARSE,
+    // Rolling dices and writing rolled expression.
+    DE_SLOW_EVAL,
+    // Copying rolled expression to the caller or flushing it to a sink.
+    DE_SLOW_COPY,
+    // Number of stages.
+    DE_SLOW_STAGES
+};
+
+/** @struct de_slow_call A call in the slow log.
+ */
+struct de_slow_call {
+    // Expression, truncated to DE_SLOW_EXPR - 1 characters.
+    char expr[DE_SLOW_EXPR];
+    // Length of the expression before truncating.
+    size_t len;
+    // Zero or enum parse_error of the call.
+    enum parse_error error;
+    // Rolls of dices in the expression, zero if it didn't compile.
+    uint_least64_t dice;
+    // Time of the whole call and of each stage in nanoseconds. Stages not
+    // reached because of an error take zero.
+    uint_least64_t nanoseconds;
+    uint_least64_t stages[DE_SLOW_STAGES];
+};
+
+/** @struct de_hot_config Configuration of tracking hot expressions, see
+ * de_hot_start().
+ */
+struct de_hot_config {
+    // Expressions each thread keeps as candidates for the hottest. Zero
+    // means 32.
+    size_t k;
+    // Counters in each row of the sketches, rounded up to a power of two.
+    // Zero means 1024.
+    size_t width;
+    // Rows of the sketches. Zero means 4.
+    size_t depth;
+};
+
+/** @struct de_hot_expr A hot expression, see de_hot_top().
+ */
+struct de_hot_expr {
+    // Normalized expression, truncated to DE_HOT_EXPR - 1 characters.
+    char expr[DE_HOT_EXPR];
+    // Approximate number of calls, never less than the exact number.
+    uint_least64_t count;
+    // Approximate time of the calls in nanoseconds, never less than the
+    // exact time.
+    uint_least64_t nanoseconds;
+};
+
+/** @struct de_audit_record A record of an audit log, see de_audit_read().
+ */
+struct de_audit_record {
+    // Expressions are numbered from zero in the order they first appear.
+    uint_least64_t id;
+    // Text of the expression, not null terminated, if this is its first
+    // record. NULL otherwise.
+    const char *expr;
+    size_t len;
+    // Number of the record in the log, starting from zero. The call is
+    // replayed with the log's seed and this counter.
+    uint_least64_t counter;
+    // Zero or enum parse_error of the call.
+    enum parse_error error;
+    // Value of the call, zero on error.
+    int_least64_t value;
+};
+
+/** @struct de_audit_reader Reader of an audit log in memory, see
+ * de_audit_reader_init().
+ */
+struct de_audit_reader {
+    const char *log;
+    size_t size;
+    // Offset of the next record. The log is read when it's size.
+    size_t offset;
+    // Seed of the log.
+    uint_least64_t seed;
+    // Counter and id of the next record and expression.
+    uint_least64_t counter;
+    uint_least64_t id;
+};
+
+/** @struct de_sim_bin A value of a simulation and the number of calls it was
+ * rolled in.
+ */
+struct de_sim_bin {
+    int_least64_t value;
+    uint_least64_t count;
+};
+
+/** @struct de_sim_stats Summary of a simulation, see de_sim_stats().
+ */
+struct de_sim_stats {
+    // Hash of the simulated expression's terms.
+    uint_least64_t fingerprint;
+    uint_least64_t seed;
+    // Counters of the simulated calls are from begin to end, excluding end.
+    uint_least64_t begin;
+    uint_least64_t end;
+    // Calls that failed, e.g. with DE_OVERFLOW. They aren't in the
+    // histogram or the moments.
+    uint_least64_t nerrors;
+    // Number of distinct values.
+    size_t nbins;
+    // Smallest and largest value, zero if there are none.
+    int_least64_t min;
+    int_least64_t max;
+    double mean;
+    double variance;
+    double skewness;
+    // Excess kurtosis, zero for the normal distribution.
+    double kurtosis;
+};
+
+/** @struct de_versus Probabilities of a value of one expression being
+ * larger than, equal to and smaller than a value of another, see
+ * de_prob_versus().
+ */
+struct de_versus {
+    double win;
+    double tie;
+    double loss;
+    // Bound of the error of each probability, zero if they are exact.
+    double error;
 };
 
+/** @typedef de_expr Compiled dice expression.
+ */
+typedef struct de_expr de_expr;
+
+/** @typedef de_eval_state State of a resumable evaluation.
+ */
+typedef struct de_eval_state de_eval_state;
+
+/** @typedef de_audit Writer of an audit log, see de_audit_open().
+ */
+typedef struct de_audit de_audit;
+
+/** @typedef de_sim Partial or merged result of a simulation, see
+ * de_sim_run().
+ */
+typedef struct de_sim de_sim;
+
+/** @typedef de_catalog Compiled expressions evaluated in the memory they
+ * were read to, see de_catalog_open().
+ */
+typedef struct de_catalog de_catalog;
+
+/** @typedef de_roll Evaluated dice expression, which remembers the value and
+ * the rolled expression of each term, so that terms can be rolled again.
+ */
+typedef struct de_roll de_roll;
+
 /** Parse dice expression.
  * Caller must call srand() once before using this function. Memory for
  * rolled_expression is allocated, caller should free it.
@@ -37,4 +371,747 @@ enum parse_error {
 enum parse_error
 de_parse(const char *expr, int_least64_t *value, char **rolled_expression);
 
+/** Parse dice expression, failing if its cost exceeds limits.
+ * Same as de_parse(), but if the estimated cost of the expression exceeds
+ * limits, no dices are rolled and DE_LIMIT is returned.
+ * @param expr Dice expression, can't be NULL.
+ * @param limits Limits for the cost. If NULL, limits set with
+ * de_set_limits() are used.
+ * @param value Used to store evaluated value.
+ * @param rolled_expr Used to store dice expression after rolling dices.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+de_parse_limited(const char *expr,
+                 const struct de_cost *limits,
+                 int_least64_t *value,
+                 char **rolled_expression);
+
+/** Parse dice expression, streaming rolled expression to a sink.
+ * Same as de_parse(), but rolled expression is written to sink in parts while
+ * dices are rolled, instead of returning it at once. On error, part of
+ * rolled expression may have been written.
+ * @param expr Dice expression, can't be NULL.
+ * @param sink Can't be NULL.
+ * @param data Passed to sink.
+ * @param value Used to store evaluated value.
+ * @return Zero on success, DE_OUTPUT if sink fails, enum parse_error
+ * otherwise.
+ */
+enum parse_error
+de_parse_sink(const char *expr,
+              de_sink sink,
+              void *data,
+              int_least64_t *value);
+
+/** Compile dice expression for evaluating it many times.
+ * Syntax and dices are checked, but no dices are rolled. Memory for
+ * compiled_expression is allocated, free it with de_free().
+ * @param expr Dice expression, can't be NULL.
+ * @param compiled_expression Used to store compiled expression, must point
+ * to NULL.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+de_compile(const char *expr, de_expr **compiled_expression);
+
+/** Check a dice expression without compiling or evaluating it.
+ * Syntax and dices are checked as de_compile() checks them, returning the
+ * same errors, e.g. for rejecting expressions before forwarding them. No
+ * dices are rolled and no memory is allocated, so huge pools like
+ * "1000000000d6" are checked as fast as small ones.
+ * @param expr Dice expression, can't be NULL.
+ * @return Zero if the expression is valid, enum parse_error otherwise.
+ */
+enum parse_error
+de_validate(const char *expr);
+
+/** Evaluate compiled dice expression.
+ * Same as de_parse() for the expression compiled_expression was compiled
+ * from.
+ * @param compiled_expression Can't be NULL.
+ * @param value Used to store evaluated value.
+ * @param rolled_expr Used to store dice expression after rolling dices.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+de_eval(const de_expr *compiled_expression,
+        int_least64_t *value,
+        char **rolled_expression);
+
+/** Evaluate compiled dice expression, failing if its cost exceeds limits.
+ * @param compiled_expression Can't be NULL.
+ * @param limits Limits for the cost. If NULL, limits set with
+ * de_set_limits() are used.
+ * @param value Used to store evaluated value.
+ * @param rolled_expr Used to store dice expression after rolling dices.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+de_eval_limited(const de_expr *compiled_expression,
+                const struct de_cost *limits,
+                int_least64_t *value,
+                char **rolled_expression);
+
+/** Evaluate compiled dice expression, streaming rolled expression to a sink.
+ * Rolled expression is written to sink in parts of about DE_SINK_CHUNK
+ * characters, so only a part of it is kept in memory. Rolls of a dice are
+ * still kept until the dice is written, also when it's rolled with many
+ * threads. Limits set with de_set_limits() are checked.
+ * @param compiled_expression Can't be NULL.
+ * @param sink Can't be NULL.
+ * @param data Passed to sink.
+ * @param value Used to store evaluated value.
+ * @return Zero on success, DE_OUTPUT if sink fails, enum parse_error
+ * otherwise.
+ */
+enum parse_error
+de_eval_sink(const de_expr *compiled_expression,
+             de_sink sink,
+             void *data,
+             int_least64_t *value);
+
+/** A de_sink writing to a file descriptor.
+ * Writes all characters, retrying after partial writes and EINTR.
+ * @param fd Pointer to an int file descriptor.
+ * @param chars Characters to write.
+ * @param len Number of characters.
+ * @return Zero on success, -1 on error.
+ */
+int
+de_sink_fd(void *fd, const char *chars, size_t len);
+
+/** Parse a batch of dice expressions.
+ * Same as calling de_parse() for each expression, but one scanner and one
+ * compiled expression are reused for the whole batch by each thread, and
+ * the results are stored to the arrays of batch. With more than one thread,
+ * the order the expressions are rolled in isn't fixed, so srand() doesn't
+ * make the rolls repeatable. Limits set with de_set_limits() are checked
+ * for each expression.
+ * @param exprs batch->n dice expressions, none of them NULL.
+ * @param batch Can't be NULL.
+ * @return Zero if the batch was evaluated, even if some expressions had
+ * errors, DE_MEMORY otherwise.
+ */
+enum parse_error
+de_parse_batch(const char *const *exprs, struct de_batch *batch);
+
+/** Evaluate a batch of compiled dice expressions.
+ * Same as de_parse_batch(), but for compiled expressions.
+ * @param compiled_expressions batch->n compiled expressions, none of them
+ * NULL.
+ * @param batch Can't be NULL.
+ * @return Zero if the batch was evaluated, even if some expressions had
+ * errors, DE_MEMORY otherwise.
+ */
+enum parse_error
+de_eval_batch(const de_expr *const *compiled_expressions,
+              struct de_batch *batch);
+
+/** Start evaluating compiled dice expression in parts.
+ * No dices are rolled before de_eval_continue() is called.
+ * compiled_expression must not be freed before state. Limits set with
+ * de_set_limits() are checked.
+ * @param compiled_expression Can't be NULL.
+ * @param state Used to store the state, must point to NULL. Free it with
+ * de_eval_free().
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+de_eval_start(const de_expr *compiled_expression, de_eval_state **state);
+
+/** Continue evaluation started with de_eval_start().
+ * Dices are rolled in the same order as de_eval() rolls them, so with the
+ * same seed the value and rolled expression are the same as de_eval()
+ * gives, as long as nothing else calls rand() between the calls. A dice
+ * de_eval() rolls with many threads, see de_parallel_start(), is rolled at
+ * once in the same way.
+ * @param state Can't be NULL.
+ * @param budget Work to do before returning. If NULL, evaluation is
+ * finished.
+ * @param value Used to store evaluated value when done.
+ * @param rolled_expr Used to store dice expression after rolling dices when
+ * done.
+ * @return Zero when done, DE_IN_PROGRESS if the budget ran out before that,
+ * enum parse_error otherwise. After an error, the same error is returned
+ * again.
+ */
+enum parse_error
+de_eval_continue(de_eval_state *state,
+                 const struct de_budget *budget,
+                 int_least64_t *value,
+                 char **rolled_expression);
+
+/** Free state of resumable evaluation, cancelling the evaluation if it
+ * isn't done.
+ * @param state Can be NULL.
+ * @return void
+ */
+void
+de_eval_free(de_eval_state *state);
+
+/** Free compiled dice expression.
+ * @param compiled_expression Can be NULL.
+ * @return void
+ */
+void
+de_free(de_expr *compiled_expression);
+
+/** Estimate cost of evaluating compiled dice expression.
+ * The estimate is an upper bound and it's computed without rolling any dices.
+ * @param compiled_expression Can't be NULL.
+ * @param cost Used to store the estimate. Members which overflow are set to
+ * UINT_LEAST64_MAX.
+ * @return void
+ */
+void
+de_estimate(const de_expr *compiled_expression, struct de_cost *cost);
+
+/** Estimate cost of evaluating a term of compiled dice expression.
+ * @param compiled_expression Can't be NULL.
+ * @param term Index of the term, less than de_nterms().
+ * @param cost Used to store the estimate.
+ * @return void
+ */
+void
+de_estimate_term(const de_expr *compiled_expression,
+                 size_t term,
+                 struct de_cost *cost);
+
+/** Check estimated cost of compiled dice expression against limits.
+ * @param compiled_expression Can't be NULL.
+ * @param limits If NULL, limits set with de_set_limits() are used.
+ * @return Zero if no limit is exceeded, DE_LIMIT otherwise.
+ */
+enum parse_error
+de_check_limits(const de_expr *compiled_expression,
+                const struct de_cost *limits);
+
+/** Set limits used by de_parse(), de_eval() and de_roll_new().
+ * By default there are no limits. Set limits before calling the other
+ * functions from other threads.
+ * @param limits Limits to copy. NULL removes all limits.
+ * @return void
+ */
+void
+de_set_limits(const struct de_cost *limits);
+
+/** Set how dices with many rolls are written to rolled expressions.
+ * By default all rolls are written. Set the style before calling the other
+ * functions from other threads. de_estimate() takes the style into account.
+ * @param output Style to copy. NULL writes all rolls.
+ * @return void
+ */
+void
+de_set_output(const struct de_output *output);
+
+/** Set how many times an exploding dice is rolled again at most.
+ * A dice exploding depth times isn't rolled again even if it rolls its
+ * largest side, so each roll of "d6!" is at most 6 * (depth + 1). Set the
+ * depth before calling the other functions from other threads.
+ * de_estimate() takes the depth into account. Audited calls always use
+ * DE_EXPLODE_DEPTH.
+ * @param depth Zero or negative sets DE_EXPLODE_DEPTH.
+ * @return void
+ */
+void
+de_set_explode_depth(int_least64_t depth);
+
+/** Get number of terms in compiled dice expression.
+ * Terms are the constants and dices of the expression, numbered from left to
+ * right starting from zero.
+ * @param compiled_expression Can't be NULL.
+ * @return Number of terms.
+ */
+size_t
+de_nterms(const de_expr *compiled_expression);
+
+/** Evaluate compiled dice expression, remembering each term.
+ * The value and rolled expression are the same as de_eval() gives.
+ * compiled_expression must not be freed before roll. Limits set with
+ * de_set_limits() are checked, but not when terms are rolled again.
+ * @param compiled_expression Can't be NULL.
+ * @param roll Used to store the evaluated expression, must point to NULL.
+ * Free it with de_roll_free().
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+de_roll_new(const de_expr *compiled_expression, de_roll **roll);
+
+/** Free evaluated dice expression.
+ * @param roll Can be NULL.
+ * @return void
+ */
+void
+de_roll_free(de_roll *roll);
+
+/** Roll one term of evaluated dice expression again.
+ * Only the term is rolled and formatted again. Unless the sum of the
+ * absolute values of the terms overflows, the value of the expression is
+ * updated in constant time. On error, roll is not changed.
+ * @param roll Can't be NULL.
+ * @param term Index of the term, less than de_nterms().
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+de_reroll(de_roll *roll, size_t term);
+
+/** Get value of evaluated dice expression.
+ * @param roll Can't be NULL.
+ * @return Value.
+ */
+int_least64_t
+de_roll_value(const de_roll *roll);
+
+/** Get rolled expression of a term, including its sign characters.
+ * @param roll Can't be NULL.
+ * @param term Index of the term, less than de_nterms().
+ * @return Rolled expression of the term, valid until the term is rolled
+ * again or roll is freed.
+ */
+const char*
+de_roll_term_expression(const de_roll *roll, size_t term);
+
+/** Get rolled expression of evaluated dice expression.
+ * Memory for rolled_expression is allocated, caller should free it.
+ * @param roll Can't be NULL.
+ * @param rolled_expression Used to store the rolled expression, must point
+ * to NULL.
+ * @return Zero on success, DE_MEMORY on error.
+ */
+enum parse_error
+de_roll_expression(const de_roll *roll, char **rolled_expression);
+
+/** Roll a dice once.
+ * All dices rolled by the library are rolled with this function, so code
+ * calling it in the same order as de_parse() gets the same rolls with the
+ * same seed given to srand().
+ * @param dice Number of sides in a dice. Must be > 0.
+ * @return Roll between 1 and dice, inclusive.
+ */
+int_least64_t
+de_roll_die(int_least64_t dice);
+
+/** Start generating random numbers for de_roll_die() in the background.
+ * Producer threads call rand() and store the numbers to lock-free rings,
+ * from which de_roll_die() takes them instead of calling rand() itself. If a
+ * ring is empty, de_roll_die() calls rand(). With one thread rolling dices,
+ * the rolls are the same as without the pool if the ring never runs empty.
+ * @param config If NULL, defaults are used.
+ * @return Zero on success, DE_MEMORY on error.
+ */
+enum parse_error
+de_pool_start(const struct de_pool_config *config);
+
+/** Stop the pool started with de_pool_start().
+ * Must not be called while other threads roll dices.
+ * @return void
+ */
+void
+de_pool_stop(void);
+
+/** Start threads for rolling large dices.
+ * A dice with at least min_rolls rolls and at most 65536 sides, but not more
+ * sides than rolls, is split to chunks rolled by many threads. Each thread
+ * counts the faces it rolls, and the counts are merged before ignoring
+ * rolls. The rolls come from a generator seeded with rand() for each dice,
+ * so srand() makes them repeatable, and they don't depend on the number of
+ * threads. They aren't the rolls de_roll_die() would give. Only one dice is
+ * rolled with many threads at a time, others are rolled as usual.
+ * @param config If NULL, defaults are used.
+ * @return Zero on success, DE_MEMORY on error.
+ */
+enum parse_error
+de_parallel_start(const struct de_parallel_config *config);
+
+/** Stop threads started with de_parallel_start().
+ * Must not be called while other threads roll dices.
+ * @return void
+ */
+void
+de_parallel_stop(void);
+
+/** Get statistics of the pool.
+ * @param stats Used to store the statistics, all zero if the pool isn't
+ * started. Can't be NULL.
+ * @return void
+ */
+void
+de_pool_stats(struct de_pool_stats *stats);
+
+/** Start logging slow calls of de_parse(), de_parse_limited() and
+ * de_parse_sink().
+ * Calls exceeding a threshold are written to a lock-free ring, overwriting
+ * the oldest calls. While the log isn't started, a call only checks that
+ * it isn't. While it is, a call reads the clock when it starts, between
+ * stages and when it finishes, and compares its time to the threshold only
+ * when it finishes.
+ * @param config If NULL, defaults are used.
+ * @return Zero on success, DE_MEMORY on error.
+ */
+enum parse_error
+de_slow_log_start(const struct de_slow_log_config *config);
+
+/** Stop logging slow calls and forget logged calls.
+ * Must not be called while other threads parse expressions.
+ * @return void
+ */
+void
+de_slow_log_stop(void);
+
+/** Copy the newest logged calls, oldest first.
+ * Can be called while other threads parse expressions. A call being
+ * written or overwritten while it's copied is skipped.
+ * @param calls Used to store at most ncalls calls.
+ * @param ncalls Size of calls.
+ * @return Number of calls stored, zero if the log isn't started.
+ */
+size_t
+de_slow_log_dump(struct de_slow_call *calls, size_t ncalls);
+
+/** Start tracking the hottest expressions of de_parse(), de_parse_limited()
+ * and de_parse_sink().
+ * Expressions are normalized by removing whitespace and lowering 'D'. Each
+ * thread counts calls and their time in count-min sketches and keeps the k
+ * expressions with the largest counts. The sketches of all threads are
+ * merged when read with de_hot_top(). While tracking isn't started, a call
+ * only checks that it isn't.
+ * @param config If NULL, defaults are used.
+ * @return Zero on success, DE_MEMORY on error.
+ */
+enum parse_error
+de_hot_start(const struct de_hot_config *config);
+
+/** Stop tracking hot expressions and forget them.
+ * Must not be called while other threads parse expressions.
+ * @return void
+ */
+void
+de_hot_stop(void);
+
+/** Get the hottest expressions, hottest first.
+ * Can be called while other threads parse expressions.
+ * @param top Used to store at most n expressions.
+ * @param n Size of top.
+ * @return Number of expressions stored, zero if tracking isn't started or
+ * memory can't be allocated.
+ */
+size_t
+de_hot_top(struct de_hot_expr *top, size_t n);
+
+/** Open an audit log, which records calls compactly enough to keep every
+ * roll.
+ * The log is written to sink through a buffer of DE_SINK_CHUNK characters.
+ * It starts with a header of "DEAU", a version byte and the seed, followed
+ * by a record of each call of de_audit_parse(): a byte of the error, the
+ * expression's text the first time, its id otherwise, and the value. Ids
+ * and values are variable length integers, so a record of an expression
+ * seen before takes a few bytes however many dices it rolls.
+ * @param seed Seed of the log. Each call rolls dices from a generator
+ * seeded with the seed and the number of the call, instead of rand().
+ * @param sink Can't be NULL.
+ * @param data Passed to sink.
+ * @param audit Used to store the log. Must be NULL, close it with
+ * de_audit_close().
+ * @return Zero on success, DE_MEMORY or DE_OUTPUT on error.
+ */
+enum parse_error
+de_audit_open(uint_least64_t seed,
+              de_sink sink,
+              void *data,
+              de_audit **audit);
+
+/** Parse dice expression and record the call to an audit log.
+ * Same as de_parse(), but no rolled expression is returned. Expressions are
+ * compiled once per log. Rolls don't depend on the pool, threads rolling
+ * large dices, de_set_output() or de_set_explode_depth(), so that a log is
+ * replayed the same with any settings: counted dices are always rolled one
+ * by one, and dices explode at most DE_EXPLODE_DEPTH times.
+ * @param audit Can't be NULL.
+ * @param expr Dice expression, can't be NULL.
+ * @param value Used to store evaluated value.
+ * @return Zero on success, DE_OUTPUT if the record couldn't be written,
+ * enum parse_error otherwise.
+ */
+enum parse_error
+de_audit_parse(de_audit *audit, const char *expr, int_least64_t *value);
+
+/** Write buffered records and free an audit log.
+ * @param audit Can be NULL.
+ * @return Zero on success, DE_OUTPUT if the log couldn't be written.
+ */
+enum parse_error
+de_audit_close(de_audit *audit);
+
+/** Evaluate a compiled expression as a call of an audit log did.
+ * Can be called from many threads at once.
+ * @param compiled_expression Can't be NULL.
+ * @param seed Seed of the log.
+ * @param counter Counter of the call's record.
+ * @param value Used to store evaluated value.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+de_audit_eval(const de_expr *compiled_expression,
+              uint_least64_t seed,
+              uint_least64_t counter,
+              int_least64_t *value);
+
+/** Start reading an audit log.
+ * @param reader Can't be NULL.
+ * @param log Whole log, can't be NULL.
+ * @param size Size of the log.
+ * @return Zero on success, DE_SYNTAX_ERROR if log isn't an audit log.
+ */
+enum parse_error
+de_audit_reader_init(struct de_audit_reader *reader,
+                     const char *log,
+                     size_t size);
+
+/** Read the next record of an audit log.
+ * Must not be called when the reader's offset is the size of the log.
+ * @param reader Can't be NULL.
+ * @param record Used to store the record. Its expression points to the log.
+ * @return Zero on success, DE_SYNTAX_ERROR if the record is corrupted or
+ * truncated.
+ */
+enum parse_error
+de_audit_read(struct de_audit_reader *reader, struct de_audit_record *record);
+
+/** Simulate calls of a compiled expression.
+ * Call with counter c is evaluated as de_audit_eval() with seed and c does,
+ * so disjoint ranges of counters can be simulated in different processes
+ * and merged with de_sim_merge() to the same result as one simulation of
+ * all of them.
+ * @param compiled_expression Can't be NULL.
+ * @param seed Seed of the simulation.
+ * @param begin Counter of the first call.
+ * @param end Counter after the last call, >= begin.
+ * @param sim Used to store the result. Must be NULL, free it with
+ * de_sim_free().
+ * @return Zero on success, DE_MEMORY on error. Calls failing otherwise are
+ * counted in the result.
+ */
+enum parse_error
+de_sim_run(const de_expr *compiled_expression,
+           uint_least64_t seed,
+           uint_least64_t begin,
+           uint_least64_t end,
+           de_sim **sim);
+
+/** Merge a simulation into another.
+ * The result is exactly what one simulation of both ranges of calls gives,
+ * in whichever order partial results are merged, except for rounding of
+ * the moments.
+ * @param sim Merged into, can't be NULL.
+ * @param other Can't be NULL. Must have the same fingerprint and seed as
+ * sim, and its calls must come right before or after the calls of sim.
+ * @return Zero on success, DE_MISMATCH if other can't be merged into sim,
+ * DE_MEMORY on error. sim is unchanged on error.
+ */
+enum parse_error
+de_sim_merge(de_sim *sim, const de_sim *other);
+
+/** Summarize a simulation.
+ * @param sim Can't be NULL.
+ * @param stats Used to store the summary, can't be NULL.
+ * @return void
+ */
+void
+de_sim_stats(const de_sim *sim, struct de_sim_stats *stats);
+
+/** Histogram of a simulation.
+ * @param sim Can't be NULL.
+ * @param nbins Used to store the number of bins, can't be NULL.
+ * @return Bins in ascending order of values, owned by sim.
+ */
+const struct de_sim_bin*
+de_sim_histogram(const de_sim *sim, size_t *nbins);
+
+/** Write a simulation to a sink.
+ * The format is "DESM", a version byte, the fingerprint and the seed as
+ * 8-byte little-endian integers, the begin and end counters, the number of
+ * failed calls and of bins as variable length integers, the mean and the
+ * sums of second, third and fourth powers of differences from the mean as
+ * 8-byte little-endian IEEE 754 doubles, and the bins. The first bin's
+ * value is a zigzag encoded variable length integer, the others are
+ * differences from the previous value, each followed by its count.
+ * @param sim Can't be NULL.
+ * @param sink Can't be NULL.
+ * @param data Passed to sink.
+ * @return Zero on success, DE_MEMORY or DE_OUTPUT on error.
+ */
+enum parse_error
+de_sim_write(const de_sim *sim, de_sink sink, void *data);
+
+/** Read a simulation written with de_sim_write().
+ * @param chars Can't be NULL.
+ * @param size Number of characters.
+ * @param sim Used to store the simulation. Must be NULL, free it with
+ * de_sim_free().
+ * @return Zero on success, DE_SYNTAX_ERROR if chars isn't a valid
+ * simulation, DE_MEMORY on error.
+ */
+enum parse_error
+de_sim_read(const char *chars, size_t size, de_sim **sim);
+
+/** Free a simulation.
+ * @param sim Can be NULL.
+ * @return void
+ */
+void
+de_sim_free(de_sim *sim);
+
+/** Probability of a value of an expression at least threshold.
+ * The first query of an expression builds the distribution of its values
+ * from the distributions of its terms and keeps it in the compiled
+ * expression until it's freed, so later queries take constant time. The
+ * distribution depends on de_set_explode_depth() when it's built. It's
+ * exact, unless the expression has more values than de_set_exact_values()
+ * allows or they take too long to build, when it's approximated in time
+ * linear in the number of terms, see de_prob_error(). The sum of the kept
+ * rolls of a dice ignoring rolls is approximated as a trimmed sum, if it's
+ * too large to build exactly.
+ * @param compiled_expression Can't be NULL.
+ * @param threshold Smallest value.
+ * @param p Used to store the probability.
+ * @return Zero on success, DE_OVERFLOW if some value doesn't fit in
+ * int_least64_t, DE_MEMORY on error.
+ */
+enum parse_error
+de_prob_at_least(const de_expr *compiled_expression,
+                 int_least64_t threshold,
+                 double *p);
+
+/** Probabilities of a value of an expression beating, tying and losing to
+ * a value of another, e.g. an attack to a defence.
+ * Takes time linear in the number of values of a, after building the
+ * distributions as de_prob_at_least() does. If either distribution is
+ * approximated, the difference of the values is approximated, in constant
+ * time.
+ * @param a Can't be NULL.
+ * @param b Can't be NULL.
+ * @param versus Used to store the probabilities.
+ * @return Zero on success, enum parse_error of de_prob_at_least()
+ * otherwise.
+ */
+enum parse_error
+de_prob_versus(const de_expr *a, const de_expr *b, struct de_versus *versus);
+
+/** Probability of a value of an expression at most x.
+ * Takes constant time, after building the distribution as
+ * de_prob_at_least() does.
+ * @param compiled_expression Can't be NULL.
+ * @param x Largest value.
+ * @param p Used to store the probability.
+ * @return Zero on success, enum parse_error of de_prob_at_least()
+ * otherwise.
+ */
+enum parse_error
+de_cdf(const de_expr *compiled_expression, int_least64_t x, double *p);
+
+/** Smallest value of an expression whose probability of values at most it
+ * is at least q, e.g. the median for 0.5.
+ * Takes time logarithmic in the number of values, after building the
+ * distribution as de_prob_at_least() does.
+ * @param compiled_expression Can't be NULL.
+ * @param q Probability between 0 and 1, inclusive.
+ * @param x Used to store the value.
+ * @return Zero on success, enum parse_error of de_prob_at_least()
+ * otherwise.
+ */
+enum parse_error
+de_quantile(const de_expr *compiled_expression, double q, int_least64_t *x);
+
+/** Set how many values a distribution has at most to be built exactly.
+ * Larger distributions are approximated with a normal distribution
+ * corrected with the skewness and the kurtosis of the values, the first
+ * terms of its Edgeworth expansion. Set the number before calling the
+ * other functions from other threads. Distributions already built aren't
+ * changed.
+ * @param values Zero sets DE_EXACT_VALUES.
+ * @return void
+ */
+void
+de_set_exact_values(size_t values);
+
+/** Bound of the error of the probabilities of an expression.
+ * Zero if the distribution is exact, otherwise the largest difference of
+ * de_cdf() and de_prob_at_least() from the exact probabilities, by the
+ * Berry-Esseen theorem. The bound is loose, the approximation is usually
+ * much closer. If the kept rolls of a dice ignoring rolls are approximated,
+ * see de_prob_at_least(), the error is only an estimate: the kept rolls
+ * aren't independent, and their sum is only asymptotically normal.
+ * @param compiled_expression Can't be NULL.
+ * @param error Used to store the bound or the estimate, at most 1.
+ * @return Zero on success, enum parse_error of de_prob_at_least()
+ * otherwise.
+ */
+enum parse_error
+de_prob_error(const de_expr *compiled_expression, double *error);
+
+/** Write compiled expressions to a sink as a catalog.
+ * Terms are written as they are in memory, in the host's byte order, with
+ * offsets instead of pointers, so that de_catalog_open() can evaluate them
+ * where they are, e.g. in a file mapped with mmap(). A catalog can be read
+ * by processes of the same version of the library on hosts of the same
+ * byte order and sizes of integers.
+ * The format is "DECT", a version byte, a byte of sizeof(size_t), the size
+ * of a term as a 2-byte integer, a 4-byte byte order mark, four zeros and
+ * the number of expressions as an 8-byte integer, followed by 8-byte
+ * offsets of each record and of the end of the last one. A record has the
+ * number of terms and of sign characters as 8-byte integers, the terms,
+ * the sign characters and zeros up to a multiple of 8 bytes.
+ * @param compiled_expressions Can be NULL if n is zero.
+ * @param n Number of expressions.
+ * @param sink Can't be NULL.
+ * @param data Passed to sink.
+ * @return Zero on success, DE_MEMORY or DE_OUTPUT on error.
+ */
+enum parse_error
+de_catalog_write(const de_expr *const *compiled_expressions,
+                 size_t n,
+                 de_sink sink,
+                 void *data);
+
+/** Open a catalog written with de_catalog_write().
+ * The catalog is validated, but not copied or parsed, so opening takes
+ * time linear in the number of terms. The expressions are evaluated in
+ * chars, which must stay unchanged until the catalog is freed.
+ * @param chars Aligned to 8 bytes, as memory from malloc() and mmap() is.
+ * Can't be NULL.
+ * @param size Number of characters.
+ * @param catalog Used to store the catalog. Must be NULL, free it with
+ * de_catalog_free().
+ * @return Zero on success, DE_SYNTAX_ERROR if chars isn't a valid catalog
+ * of this version and host, DE_MEMORY on error.
+ */
+enum parse_error
+de_catalog_open(const char *chars, size_t size, de_catalog **catalog);
+
+/** Get number of expressions in a catalog.
+ * @param catalog Can't be NULL.
+ * @return Number of expressions.
+ */
+size_t
+de_catalog_size(const de_catalog *catalog);
+
+/** Get an expression of a catalog.
+ * The expression can be used as any compiled expression, but it's owned
+ * by the catalog and mustn't be freed with de_free().
+ * @param catalog Can't be NULL.
+ * @param i Index of the expression in the order they were written, less
+ * than de_catalog_size().
+ * @return Expression.
+ */
+const de_expr*
+de_catalog_get(const de_catalog *catalog, size_t i);
+
+/** Free a catalog and the distributions of its expressions.
+ * @param catalog Can be NULL.
+ * @return void
+ */
+void
+de_catalog_free(de_catalog *catalog);
+
 #endif
@@ -0,0 +1,718 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "dist.h"
+#include "approx.h"
+#include "eval.h"
+#include "expr.h"
+#include "numflow.h"
+#include "diceexpr.h"
+
+// Values a distribution has at most.
+#define MAX_LEN (1 << 20)
+// Multiplications building a distribution takes at most.
+#define MAX_WORK (UINT64_C(1) << 30)
+
+// Probabilities of values from min to min + len - 1, while building.
+struct pmf {
+    int_least64_t min;
+    size_t len;
+    double *p;
+};
+
+static enum parse_error build(const struct de_expr *e, struct dist *d);
+static enum parse_error build_exact(const struct de_expr *e, struct dist *d);
+static enum parse_error fill(struct pmf *p, struct dist *d);
+static enum parse_error term_pmf(const struct term *t,
+                                 struct pmf *p,
+                                 uint_least64_t *work);
+static enum parse_error die_pmf(const struct term *t, struct pmf *p);
+static enum parse_error count_pmf(const struct term *t,
+                                  const struct pmf *die,
+                                  struct pmf *p);
+static enum parse_error kept_pmf(const struct term *t,
+                                 const struct pmf *die,
+                                 struct pmf *p,
+                                 uint_least64_t *work);
+static enum parse_error binomial(int_least64_t n, double q, struct pmf *p);
+static enum parse_error power(const struct pmf *base,
+                              int_least64_t n,
+                              struct pmf *p,
+                              uint_least64_t *work);
+static enum parse_error convolve(const struct pmf *a,
+                                 const struct pmf *b,
+                                 struct pmf *c,
+                                 uint_least64_t *work);
+static enum parse_error pmf_new(int_least64_t min, size_t len, struct pmf *p);
+static void negate(struct pmf *p);
+static int_least64_t overlap(int_least64_t begin,
+                             int_least64_t end,
+                             int_least64_t kept_begin,
+                             int_least64_t kept_end);
+static int_least64_t saturated_minus(int_least64_t a, int_least64_t b);
+
+static size_t exact_values = DE_EXACT_VALUES;
+
+enum parse_error
+dist_get(const struct de_expr *e, const struct dist **d) {
+    assert(e != NULL);
+    assert(d != NULL);
+
+    struct dist *cached = __atomic_load_n(&e->dist, __ATOMIC_ACQUIRE);
+    if (cached == NULL) {
+        struct dist *built = calloc(1, sizeof(*built));
+        if (built == NULL)
+            return DE_MEMORY;
+        built->error = build(e, built);
+        if (built->error == DE_MEMORY) {
+            dist_free(built);
+            return DE_MEMORY;
+        }
+        // Another thread may have built it first, then keep that one.
+        struct de_expr *mutable_e = (struct de_expr*) e;
+        if (__atomic_compare_exchange_n(&mutable_e->dist, &cached, built, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            cached = built;
+        else
+            dist_free(built);
+    }
+    *d = cached;
+
+    return cached->error;
+}
+
+enum parse_error
+dist_term(const struct term *t, struct dist **d) {
+    assert(t != NULL);
+    assert(d != NULL);
+
+    struct dist *built = calloc(1, sizeof(*built));
+    if (built == NULL)
+        return DE_MEMORY;
+    struct term positive = *t;
+    positive.negative = 0;
+    uint_least64_t work = MAX_WORK;
+    struct pmf p = { 0 };
+    enum parse_error retval = term_pmf(&positive, &p, &work);
+    if (retval == 0)
+        retval = fill(&p, built);
+    free(p.p);
+    if (retval != 0) {
+        dist_free(built);
+        return retval;
+    }
+    *d = built;
+
+    return 0;
+}
+
+double
+dist_at_most(const struct dist *d, int_least64_t x) {
+    assert(d != NULL);
+    assert(d->error == 0);
+
+    if (d->approximate)
+        return approx_at_most(d, x);
+    if (x < d->min)
+        return 0;
+    if ((uint_least64_t) x - d->min >= d->len)
+        return 1;
+
+    return d->cdf[(uint_least64_t) x - d->min];
+}
+
+double
+dist_at_least(const struct dist *d, int_least64_t x) {
+    assert(d != NULL);
+    assert(d->error == 0);
+
+    if (x <= d->min)
+        return 1;
+    if (d->approximate)
+        return 1 - approx_at_most(d, x - 1);
+    if ((uint_least64_t) x - d->min >= d->len)
+        return 0;
+
+    return d->sf[(uint_least64_t) x - d->min];
+}
+
+void
+dist_free(struct dist *d) {
+    if (d == NULL)
+        return;
+
+    free(d->pmf);
+    free(d->cdf);
+    free(d->sf);
+    free(d);
+}
+
+enum parse_error
+de_prob_at_least(const de_expr *compiled_expression,
+                 int_least64_t threshold,
+                 double *p) {
+    assert(compiled_expression != NULL);
+    assert(p != NULL);
+
+    const struct dist *d;
+    enum parse_error retval = dist_get(compiled_expression, &d);
+    if (retval != 0)
+        return retval;
+    *p = dist_at_least(d, threshold);
+
+    return 0;
+}
+
+enum parse_error
+de_prob_versus(const de_expr *a, const de_expr *b, struct de_versus *versus) {
+    assert(a != NULL);
+    assert(b != NULL);
+    assert(versus != NULL);
+
+    const struct dist *x, *y;
+    enum parse_error retval = dist_get(a, &x);
+    if (retval != 0 || (retval = dist_get(b, &y)) != 0)
+        return retval;
+
+    // The difference of the values is approximated, if either is.
+    if (x->approximate || y->approximate) {
+        struct dist difference = { 0 };
+        difference.approximate = 1;
+        difference.min = saturated_minus(x->min, y->max);
+        difference.max = saturated_minus(x->max, y->min);
+        difference.cumulants[0] = x->cumulants[0] - y->cumulants[0];
+        difference.cumulants[1] = x->cumulants[1] + y->cumulants[1];
+        difference.cumulants[2] = x->cumulants[2] - y->cumulants[2];
+        difference.cumulants[3] = x->cumulants[3] + y->cumulants[3];
+        difference.rho = x->rho + y->rho;
+        const double loss = approx_at_most(&difference, -1),
+            not_win = approx_at_most(&difference, 0);
+        versus->win = 1 - not_win;
+        versus->tie = not_win > loss ? not_win - loss : 0;
+        versus->loss = loss;
+        versus->error = 2 * approx_error(&difference);
+        return 0;
+    }
+
+    // Each value of a is compared to the cumulative probabilities of b, so
+    // this is linear in the number of values of a.
+    double win = 0, tie = 0, loss = 0;
+    for (size_t i = 0; i < x->len; i++) {
+        if (x->pmf[i] == 0)
+            continue;
+        const int_least64_t value = x->min + (int_least64_t) i;
+        win += x->pmf[i] * (value > INT_LEAST64_MIN ?
+                            dist_at_most(y, value - 1) : 0);
+        loss += x->pmf[i] * (value < INT_LEAST64_MAX ?
+                             dist_at_least(y, value + 1) : 0);
+        if (value >= y->min && (uint_least64_t) value - y->min < y->len)
+            tie += x->pmf[i] * y->pmf[(uint_least64_t) value - y->min];
+    }
+    versus->win = win;
+    versus->tie = tie;
+    versus->loss = loss;
+    versus->error = 0;
+
+    return 0;
+}
+
+enum parse_error
+de_cdf(const de_expr *compiled_expression, int_least64_t x, double *p) {
+    assert(compiled_expression != NULL);
+    assert(p != NULL);
+
+    const struct dist *d;
+    enum parse_error retval = dist_get(compiled_expression, &d);
+    if (retval != 0)
+        return retval;
+    *p = dist_at_most(d, x);
+
+    return 0;
+}
+
+enum parse_error
+de_quantile(const de_expr *compiled_expression, double q, int_least64_t *x) {
+    assert(compiled_expression != NULL);
+    assert(q >= 0 && q <= 1);
+    assert(x != NULL);
+
+    const struct dist *d;
+    enum parse_error retval = dist_get(compiled_expression, &d);
+    if (retval != 0)
+        return retval;
+
+    if (d->approximate) {
+        int_least64_t low = d->min, high = d->max;
+        while (low < high) {
+            const int_least64_t middle = low + (int_least64_t)
+                (((uint_least64_t) high - (uint_least64_t) low) / 2);
+            if (approx_at_most(d, middle) < q)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        *x = low;
+        return 0;
+    }
+
+    // First value whose cumulative probability is at least q. Rounding can
+    // leave the last one a little below 1.
+    size_t low = 0, high = d->len - 1;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (d->cdf[middle] < q)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    *x = d->min + (int_least64_t) low;
+
+    return 0;
+}
+
+void
+de_set_exact_values(size_t values) {
+    exact_values = values > 0 ? values : DE_EXACT_VALUES;
+}
+
+enum parse_error
+de_prob_error(const de_expr *compiled_expression, double *error) {
+    assert(compiled_expression != NULL);
+    assert(error != NULL);
+
+    const struct dist *d;
+    enum parse_error retval = dist_get(compiled_expression, &d);
+    if (retval != 0)
+        return retval;
+    *error = d->approximate ? approx_error(d) : 0;
+
+    return 0;
+}
+
+/* Build the distribution of an expression, exactly if it has at most
+ * exact_values values and doesn't take too long, approximately otherwise.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+static enum parse_error
+build(const struct de_expr *e, struct dist *d) {
+    int_least64_t low, high;
+    enum parse_error retval = approx_range(e, &low, &high);
+    if (retval != 0)
+        return retval;
+    // As unsigned, the difference always fits.
+    if ((uint_least64_t) high - (uint_least64_t) low < exact_values &&
+        (retval = build_exact(e, d)) != DE_LIMIT)
+        return retval;
+
+    return approx_build(e, d);
+}
+
+/* Build the distribution of an expression by convolving the distributions
+ * of its terms.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+static enum parse_error
+build_exact(const struct de_expr *e, struct dist *d) {
+    uint_least64_t work = MAX_WORK;
+    struct pmf sum = { 0 }, term = { 0 }, next = { 0 };
+    enum parse_error retval = pmf_new(0, 1, &sum);
+    if (retval != 0)
+        return retval;
+    sum.p[0] = 1;
+    for (size_t i = 0; i < e->nterms; i++) {
+        if ((retval = term_pmf(&e->terms[i], &term, &work)) != 0 ||
+            (retval = convolve(&sum, &term, &next, &work)) != 0)
+            goto free;
+        free(sum.p);
+        free(term.p);
+        term.p = NULL;
+        sum = next;
+        next.p = NULL;
+    }
+    retval = fill(&sum, d);
+
+    free:
+        free(sum.p);
+        free(term.p);
+        free(next.p);
+
+    return retval;
+}
+
+/* Keep probabilities of values in a distribution, with the cumulative
+ * probabilities and the cumulants.
+ * @param p Probabilities, moved to d.
+ * @return Zero on success, DE_MEMORY on error.
+ */
+static enum parse_error
+fill(struct pmf *p, struct dist *d) {
+    d->min = p->min;
+    d->max = p->min + (int_least64_t) p->len - 1;
+    d->len = p->len;
+    d->pmf = p->p;
+    p->p = NULL;
+    if ((d->cdf = malloc(d->len * sizeof(*d->cdf))) == NULL ||
+        (d->sf = malloc(d->len * sizeof(*d->sf))) == NULL)
+        return DE_MEMORY;
+    double total = 0;
+    for (size_t i = 0; i < d->len; i++)
+        d->cdf[i] = total += d->pmf[i];
+    total = 0;
+    for (size_t i = d->len; i > 0; i--)
+        d->sf[i - 1] = total += d->pmf[i - 1];
+
+    // Moments about min first, so that large values don't lose precision.
+    double mean = 0, m2 = 0, m3 = 0, m4 = 0, rho = 0;
+    for (size_t i = 0; i < d->len; i++)
+        mean += d->pmf[i] * i;
+    for (size_t i = 0; i < d->len; i++) {
+        const double x = i - mean, x2 = x * x;
+        m2 += d->pmf[i] * x2;
+        m3 += d->pmf[i] * x2 * x;
+        m4 += d->pmf[i] * x2 * x2;
+        rho += d->pmf[i] * x2 * fabs(x);
+    }
+    d->cumulants[0] = d->min + mean;
+    d->cumulants[1] = m2;
+    d->cumulants[2] = m3;
+    d->cumulants[3] = m4 - 3 * m2 * m2;
+    d->rho = rho;
+
+    return 0;
+}
+
+/* Distribution of a term, negated if the term is subtracted.
+ * @param work Multiplications left, decreased by the ones done.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+static enum parse_error
+term_pmf(const struct term *t, struct pmf *p, uint_least64_t *work) {
+    enum parse_error retval;
+    struct pmf die = { 0 }, counted = { 0 };
+    if (t->type == TERM_CONSTANT) {
+        if ((retval = pmf_new(t->constant, 1, p)) != 0)
+            return retval;
+        p->p[0] = 1;
+    }
+    else if ((retval = die_pmf(t, &die)) != 0)
+        return retval;
+    else if (t->small > 0 || t->large > 0)
+        retval = kept_pmf(t, &die, p, work);
+    else if (t->count != COUNT_NONE) {
+        if ((retval = count_pmf(t, &die, &counted)) == 0)
+            retval = binomial(t->nrolls, counted.p[1], p);
+    }
+    else
+        retval = power(&die, t->nrolls, p, work);
+    free(die.p);
+    free(counted.p);
+
+    if (retval == 0 && t->negative)
+        negate(p);
+
+    return retval;
+}
+
+/* Distribution of one roll of a dice, rerolling and exploding it as
+ * eval_roll_die() does.
+ * @return Zero on success, DE_LIMIT if the dice has too many sides,
+ * DE_MEMORY on error.
+ */
+static enum parse_error
+die_pmf(const struct term *t, struct pmf *p) {
+    const int_least64_t max = eval_max_roll(t);
+    if (max - t->reroll > MAX_LEN)
+        return DE_LIMIT;
+    enum parse_error retval = pmf_new(t->reroll + 1, max - t->reroll, p);
+    if (retval != 0)
+        return retval;
+
+    const int_least64_t sides = t->dice - t->reroll;
+    if (!t->explode) {
+        for (int_least64_t i = 0; i < sides; i++)
+            p->p[i] = 1.0 / sides;
+        return 0;
+    }
+
+    // Largest side is rolled k times in a row with probability sides^-k,
+    // then another side, or any side after the last explosion.
+    const int_least64_t depth = eval_explode_depth();
+    double probability = 1.0 / sides;
+    for (int_least64_t k = 0; k <= depth; k++, probability /= sides) {
+        const int_least64_t last = k < depth ? sides - 1 : sides;
+        for (int_least64_t i = 0; i < last; i++)
+            p->p[t->dice * k + i] = probability;
+    }
+
+    return 0;
+}
+
+/* Distribution of whether one roll of a counted dice is counted.
+ * @return Zero on success, DE_MEMORY on error.
+ */
+static enum parse_error
+count_pmf(const struct term *t, const struct pmf *die, struct pmf *p) {
+    enum parse_error retval = pmf_new(0, 2, p);
+    if (retval != 0)
+        return retval;
+    for (size_t i = 0; i < die->len; i++) {
+        const int_least64_t roll = die->min + (int_least64_t) i;
+        const int counted = t->count == COUNT_AT_LEAST ?
+            roll >= t->threshold : roll <= t->threshold;
+        p->p[counted] += die->p[i];
+    }
+
+    return 0;
+}
+
+/* Distribution of the sum or count of the kept rolls of a dice ignoring
+ * some rolls.
+ * Rolls are placed from the smallest side up. After placing i rolls on
+ * sides below f, j rolls on side f get ranks i to i + j - 1 with
+ * probability C(n - i, j) q^j, where q is the probability of f, and the
+ * ones of them ranked between the ignored rolls are kept.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+static enum parse_error
+kept_pmf(const struct term *t,
+         const struct pmf *die,
+         struct pmf *p,
+         uint_least64_t *work) {
+    const int_least64_t n = t->nrolls;
+    const int_least64_t kept_end = n - t->large;
+    const int_least64_t kept = kept_end - t->small;
+    const int_least64_t max = t->count != COUNT_NONE ? 1 :
+        die->min + (int_least64_t) die->len - 1;
+    if (n >= MAX_LEN || kept > MAX_LEN / max)
+        return DE_LIMIT;
+    // Sums of kept rolls from zero to width - 1 for each number of rolls.
+    const size_t width = kept * max + 1;
+    const size_t size = (n + 1) * width;
+    if (size > MAX_LEN || die->len > *work / size / (n + 1))
+        return DE_LIMIT;
+    *work -= die->len * size * (n + 1);
+
+    enum parse_error retval = 0;
+    double *placed = calloc(size, sizeof(*placed)),
+        *next = malloc(size * sizeof(*next));
+    if (placed == NULL || next == NULL) {
+        retval = DE_MEMORY;
+        goto free;
+    }
+    placed[0] = 1;
+    for (size_t f = 0; f < die->len; f++) {
+        const double q = die->p[f];
+        if (q == 0)
+            continue;
+        const int_least64_t roll = die->min + (int_least64_t) f;
+        const int_least64_t value = t->count == COUNT_NONE ? roll :
+            t->count == COUNT_AT_LEAST ? roll >= t->threshold :
+            roll <= t->threshold;
+        memset(next, 0, size * sizeof(*next));
+        for (int_least64_t i = 0; i <= n; i++) {
+            const double *from = placed + i * width;
+            for (size_t s = 0; s < width; s++) {
+                if (from[s] == 0)
+                    continue;
+                double c = from[s];
+                for (int_least64_t j = 0; i + j <= n; j++) {
+                    const size_t sum = s + value *
+                        overlap(i, i + j, t->small, kept_end);
+                    next[(i + j) * width + sum] += c;
+                    c *= (double) (n - i - j) / (j + 1) * q;
+                }
+            }
+        }
+        double *temp = placed;
+        placed = next;
+        next = temp;
+    }
+
+    // Sums of kept rolls are at least kept times the smallest side.
+    const int_least64_t low = t->count != COUNT_NONE ? 0 : kept * die->min;
+    if ((retval = pmf_new(low, width - low, p)) != 0)
+        goto free;
+    memcpy(p->p, placed + n * width + low, p->len * sizeof(*p->p));
+
+    free:
+        free(placed);
+        free(next);
+
+    return retval;
+}
+
+/* Distribution of the number of successes in n trials with probability q
+ * of success.
+ * @return Zero on success, DE_LIMIT if n is too large, DE_MEMORY on error.
+ */
+static enum parse_error
+binomial(int_least64_t n, double q, struct pmf *p) {
+    if (n >= MAX_LEN)
+        return DE_LIMIT;
+    enum parse_error retval = pmf_new(0, n + 1, p);
+    if (retval != 0)
+        return retval;
+    if (q == 0 || q == 1) {
+        p->p[q == 0 ? 0 : n] = 1;
+        return 0;
+    }
+
+    // Logarithms, so that neither the coefficients nor the powers overflow.
+    const double lq = log(q), lr = log1p(-q), ln = lgamma(n + 1.0);
+    for (int_least64_t k = 0; k <= n; k++) {
+        p->p[k] = exp(ln - lgamma(k + 1.0) - lgamma(n - k + 1.0) + k * lq +
+                      (n - k) * lr);
+    }
+
+    return 0;
+}
+
+/* Distribution of the sum of n independent values.
+ * Computed by squaring, with about log2(n) convolutions.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+static enum parse_error
+power(const struct pmf *base,
+      int_least64_t n,
+      struct pmf *p,
+      uint_least64_t *work) {
+    // Count the multiplications first, so that too large sums fail before
+    // convolving.
+    if (base->len - 1 > (MAX_LEN - 1) / (uint_least64_t) n)
+        return DE_LIMIT;
+    uint_least64_t needed = 0;
+    size_t result_len = 1, square_len = base->len;
+    for (int_least64_t m = n; m > 0; m >>= 1) {
+        if (m & 1) {
+            needed += (uint_least64_t) result_len * square_len;
+            result_len += square_len - 1;
+        }
+        if (m > 1) {
+            needed += (uint_least64_t) square_len * square_len;
+            square_len = 2 * square_len - 1;
+        }
+        if (needed > *work)
+            return DE_LIMIT;
+    }
+
+    struct pmf result = { 0 }, square = { 0 }, next = { 0 };
+    enum parse_error retval = pmf_new(0, 1, &result);
+    if (retval != 0 || (retval = pmf_new(base->min, base->len, &square)) != 0)
+        goto free;
+    result.p[0] = 1;
+    memcpy(square.p, base->p, base->len * sizeof(*base->p));
+
+    while (n > 0) {
+        if (n & 1) {
+            if ((retval = convolve(&result, &square, &next, work)) != 0)
+                goto free;
+            free(result.p);
+            result = next;
+            next.p = NULL;
+        }
+        n >>= 1;
+        if (n > 0) {
+            if ((retval = convolve(&square, &square, &next, work)) != 0)
+                goto free;
+            free(square.p);
+            square = next;
+            next.p = NULL;
+        }
+    }
+    *p = result;
+    result.p = NULL;
+
+    free:
+        free(result.p);
+        free(square.p);
+        free(next.p);
+
+    return retval;
+}
+
+/* Distribution of the sum of two independent values.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+static enum parse_error
+convolve(const struct pmf *a,
+         const struct pmf *b,
+         struct pmf *c,
+         uint_least64_t *work) {
+    const size_t len = a->len + b->len - 1;
+    if (len > MAX_LEN || a->len > *work / b->len)
+        return DE_LIMIT;
+    *work -= a->len * b->len;
+
+    enum flow_type overflow;
+    NF_PLUS(a->min, b->min, INT_LEAST64, overflow);
+    if (overflow != 0)
+        return DE_OVERFLOW;
+    const int_least64_t min = a->min + b->min;
+    NF_PLUS(min, (int_least64_t) len - 1, INT_LEAST64, overflow);
+    if (overflow != 0)
+        return DE_OVERFLOW;
+
+    enum parse_error retval = pmf_new(min, len, c);
+    if (retval != 0)
+        return retval;
+    for (size_t i = 0; i < a->len; i++) {
+        if (a->p[i] == 0)
+            continue;
+        for (size_t j = 0; j < b->len; j++)
+            c->p[i + j] += a->p[i] * b->p[j];
+    }
+
+    return 0;
+}
+
+/* Allocate zeroed probabilities.
+ * @return Zero on success, DE_MEMORY on error.
+ */
+static enum parse_error
+pmf_new(int_least64_t min, size_t len, struct pmf *p) {
+    p->min = min;
+    p->len = len;
+    p->p = calloc(len, sizeof(*p->p));
+
+    return p->p == NULL ? DE_MEMORY : 0;
+}
+
+/* Negate the values of a distribution.
+ */
+static void
+negate(struct pmf *p) {
+    p->min = -(p->min + (int_least64_t) p->len - 1);
+    for (size_t i = 0, j = p->len - 1; i < j; i++, j--) {
+        const double temp = p->p[i];
+        p->p[i] = p->p[j];
+        p->p[j] = temp;
+    }
+}
+
+/* Number of ranks from begin to end, excluding end, that are kept.
+ */
+static int_least64_t
+overlap(int_least64_t begin,
+        int_least64_t end,
+        int_least64_t kept_begin,
+        int_least64_t kept_end) {
+    if (begin < kept_begin)
+        begin = kept_begin;
+    if (end > kept_end)
+        end = kept_end;
+
+    return end > begin ? end - begin : 0;
+}
+
+/* a - b, or the closest value that fits.
+ */
+static int_least64_t
+saturated_minus(int_least64_t a, int_least64_t b) {
+    if (b < 0 && a > INT_LEAST64_MAX + b)
+        return INT_LEAST64_MAX;
+    if (b > 0 && a < INT_LEAST64_MIN + b)
+        return INT_LEAST64_MIN;
+
+    return a - b;
+}
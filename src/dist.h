@@ -0,0 +1,85 @@
+#ifndef DIST_H
+    #define DIST_H
+#include <stddef.h>
+#include <stdint.h>
+#include "expr.h"
+#include "diceexpr.h"
+
+/** @file
+ * Distributions of values of compiled expressions. A distribution is built
+ * the first time it's needed and kept in the expression, so that later
+ * queries take constant time. It's exact, unless it has more values than
+ * de_set_exact_values() allows or is too costly to build, when it's
+ * approximated from the cumulants of the terms, see approx.h.
+ */
+
+/** Distribution of values of an expression.
+ */
+struct dist {
+    // Zero, or the error building the distribution failed with. Failures
+    // other than DE_MEMORY are kept, so that they aren't tried again.
+    enum parse_error error;
+    // Non-zero if the distribution is approximated. Then there are no
+    // probabilities of values and len is zero.
+    int approximate;
+    // Values are from min to max, min + len - 1 of an exact distribution.
+    int_least64_t min;
+    int_least64_t max;
+    size_t len;
+    // Probabilities of each value, of values at most it and of values at
+    // least it, len of each.
+    double *pmf;
+    double *cdf;
+    double *sf;
+    // Mean, variance and the third and fourth cumulants.
+    double cumulants[4];
+    // Sum of the third absolute central moments of the independent parts
+    // of the values, for the Berry-Esseen bound.
+    double rho;
+};
+
+/** Get the distribution of an expression, building it if it isn't yet.
+ * Can be called from many threads at once. The distribution depends on
+ * de_set_explode_depth() and de_set_exact_values() when it's built.
+ * @param e Can't be NULL.
+ * @param d Used to store the distribution, owned by e.
+ * @return Zero on success, DE_OVERFLOW if some value doesn't fit in
+ * int_least64_t, DE_MEMORY on error.
+ */
+enum parse_error
+dist_get(const struct de_expr *e, const struct dist **d);
+
+/** Build the exact distribution of a term, without keeping it.
+ * The term isn't negated, even if it's subtracted.
+ * @param t Can't be NULL.
+ * @param d Used to store the distribution, free it with dist_free().
+ * @return Zero on success, DE_LIMIT if the distribution is too large to
+ * build exactly, DE_OVERFLOW or DE_MEMORY on error.
+ */
+enum parse_error
+dist_term(const struct term *t, struct dist **d);
+
+/** Probability of values at most x.
+ * @param d Distribution built without error, can't be NULL.
+ * @param x Value.
+ * @return Probability.
+ */
+double
+dist_at_most(const struct dist *d, int_least64_t x);
+
+/** Probability of values at least x.
+ * @param d Distribution built without error, can't be NULL.
+ * @param x Value.
+ * @return Probability.
+ */
+double
+dist_at_least(const struct dist *d, int_least64_t x);
+
+/** Free a distribution.
+ * @param d Can be NULL.
+ * @return void
+ */
+void
+dist_free(struct dist *d);
+
+#endif // DIST_H
@@ -0,0 +1,802 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include "str.h"
+#include "expr.h"
+#include "eval.h"
+#include "pool.h"
+#include "parallel.h"
+#include "sample.h"
+#include "probe.h"
+#include "slowlog.h"
+#include "audit.h"
+#include "diceexpr.h"
+#include "numflow.h"
+
+// How dices are written to rolled expressions.
+static struct de_output output;
+// Times a dice can explode at most.
+static int_least64_t explode_depth = DE_EXPLODE_DEPTH;
+
+/* Loops over rolls stored in one of the widths of eval_roll_width(), see
+ * ROLL_LOOPS. The width is chosen once for a dice instead of for each roll.
+ */
+struct roll_loops {
+    // Roll all dices of t to rolls.
+    enum parse_error (*roll)(const struct term *t, void *rolls);
+    // Sort rolls by counting faces, counts is a zeroed array of dice members.
+    void (*count_sort)(void *rolls,
+                       int_least64_t nrolls,
+                       int_least64_t dice,
+                       size_t *counts);
+    int (*compare)(const void *a, const void *b);
+    // Add rolls from begin to end to sum.
+    enum parse_error (*sum)(const void *rolls,
+                            int_least64_t begin,
+                            int_least64_t end,
+                            int_least64_t *sum);
+    // See eval_rolls(), rolls aren't summed if sum is NULL.
+    enum parse_error (*append)(str *rolled_expr,
+                               const void *rolls,
+                               int_least64_t begin,
+                               int_least64_t end,
+                               int_least64_t first,
+                               int_least64_t *sum);
+    // Number of counted rolls of a counted dice from begin to end.
+    int_least64_t (*count)(const struct term *t,
+                           const void *rolls,
+                           int_least64_t begin,
+                           int_least64_t end);
+    // Index after the sorted rolls from i to end equal to rolls[i], which is
+    // stored to face.
+    int_least64_t (*face_end)(const void *rolls,
+                              int_least64_t i,
+                              int_least64_t end,
+                              int_least64_t *face);
+};
+
+// Sink of de_eval_sink().
+struct sink {
+    de_sink sink;
+    void *data;
+    // Non-zero if sink failed.
+    int failed;
+};
+
+static int write_sink(void *data, const char *chars, size_t len);
+static enum parse_error roll(str *rolled_expr,
+                             const struct term *t,
+                             int_least64_t *value);
+static int_least64_t success_faces(const struct term *t);
+static int is_success(const struct term *t, int_least64_t roll);
+static const struct roll_loops* roll_loops(size_t width);
+static int summary_header(str *rolled_expr, const struct term *t);
+static int summary_face(str *rolled_expr,
+                        int_least64_t face,
+                        uint_least64_t count,
+                        int first);
+static int summary_totals(str *rolled_expr,
+                          int_least64_t nrolls,
+                          int_least64_t kept,
+                          int_least64_t sum);
+static int sort_ascending_i64(const void *a, const void *b);
+static int sort_ascending_u8(const void *a, const void *b);
+static int sort_ascending_u16(const void *a, const void *b);
+static int sort_ascending_u32(const void *a, const void *b);
+
+int_least64_t
+de_roll_die(int_least64_t dice) {
+    assert(dice > 0);
+
+    int word;
+    if (!audit_take(&word) && !pool_take(&word))
+        word = rand();
+
+    // Divide by RAND_MAX + 1, so rand() returning RAND_MAX can't give
+    // dice + 1.
+    return (int_least64_t) (word / ((double) RAND_MAX + 1) * dice + 1);
+}
+
+enum parse_error
+de_eval(const de_expr *e, int_least64_t *value, char **rolled_expression) {
+    return de_eval_limited(e, NULL, value, rolled_expression);
+}
+
+enum parse_error
+de_eval_limited(const de_expr *e,
+                const struct de_cost *limits,
+                int_least64_t *value,
+                char **rolled_expression) {
+    assert(e != NULL);
+    assert(*rolled_expression == NULL);
+
+    str *rolled_expr = str_new(NULL);
+    if (rolled_expr == NULL)
+        return DE_MEMORY;
+
+    enum parse_error retval = eval_expr(e, limits, rolled_expr, value);
+    slowlog_stage(DE_SLOW_EVAL);
+    if (retval == 0) {
+        PROBE1(copy__start, rolled_expr->len);
+        if (str_copy_to_chars(rolled_expr, rolled_expression) != 0)
+            retval = DE_MEMORY;
+        PROBE1(copy__done, retval);
+        slowlog_stage(DE_SLOW_COPY);
+    }
+    str_free(rolled_expr);
+
+    return retval;
+}
+
+enum parse_error
+de_eval_sink(const de_expr *e, de_sink sink, void *data, int_least64_t *value) {
+    assert(e != NULL);
+    assert(sink != NULL);
+
+    str *rolled_expr = str_new(NULL);
+    if (rolled_expr == NULL)
+        return DE_MEMORY;
+    struct sink s = { sink, data, 0 };
+    str_set_sink(rolled_expr, write_sink, &s, DE_SINK_CHUNK);
+
+    enum parse_error retval = eval_expr(e, NULL, rolled_expr, value);
+    slowlog_stage(DE_SLOW_EVAL);
+    if (retval == 0) {
+        PROBE1(copy__start, rolled_expr->len);
+        if (str_flush(rolled_expr) != 0)
+            retval = DE_OUTPUT;
+        PROBE1(copy__done, retval);
+        slowlog_stage(DE_SLOW_COPY);
+    }
+    // Failing sink makes appending fail, which is reported as DE_MEMORY.
+    if (s.failed)
+        retval = DE_OUTPUT;
+    str_free(rolled_expr);
+
+    return retval;
+}
+
+int
+de_sink_fd(void *fd, const char *chars, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(*(int*) fd, chars, len);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        chars += written;
+        len -= written;
+    }
+
+    return 0;
+}
+
+void
+de_set_output(const struct de_output *o) {
+    if (o == NULL) {
+        output.style = DE_OUTPUT_FULL;
+        output.threshold = 0;
+    }
+    else
+        output = *o;
+}
+
+enum parse_error
+eval_expr(const struct de_expr *e,
+          const struct de_cost *limits,
+          str *rolled_expr,
+          int_least64_t *value) {
+    assert(e != NULL);
+    assert(rolled_expr != NULL);
+
+    PROBE1(eval__start, e->nterms);
+    enum parse_error retval = de_check_limits(e, limits);
+    if (retval != 0)
+        goto done;
+
+    int_least64_t result = 0;
+    for (size_t i = 0; i < e->nterms; i++) {
+        int_least64_t term_value;
+        retval = eval_term(e, &e->terms[i], rolled_expr, &term_value);
+        if (retval != 0)
+            goto done;
+
+        enum flow_type overflow;
+        NF_PLUS(result, term_value, INT_LEAST64, overflow);
+        if (overflow != 0) {
+            retval = DE_OVERFLOW;
+            goto done;
+        }
+        result += term_value;
+    }
+    *value = result;
+
+    done:
+        PROBE2(eval__done, retval, rolled_expr->len);
+
+    return retval;
+}
+
+enum parse_error
+eval_term(const struct de_expr *e,
+          const struct term *t,
+          str *rolled_expr,
+          int_least64_t *value) {
+    assert(e != NULL);
+    assert(t != NULL);
+    assert(rolled_expr != NULL);
+
+    if (eval_signs(e, t, rolled_expr) != 0)
+        return DE_MEMORY;
+
+    int_least64_t term_value;
+    if (t->type == TERM_CONSTANT) {
+        if (str_append_int(rolled_expr, t->constant) != 0)
+            return DE_MEMORY;
+        term_value = t->constant;
+    }
+    else {
+        enum parse_error retval = roll(rolled_expr, t, &term_value);
+        if (retval != 0)
+            return retval;
+    }
+
+    // Values of terms are never negative, so negating can't overflow.
+    *value = t->negative ? -term_value : term_value;
+
+    return 0;
+}
+
+enum parse_error
+eval_signs(const struct de_expr *e, const struct term *t, str *rolled_expr) {
+    const char *signs = expr_term_signs(e, t);
+    for (size_t j = 0; j < t->nsigns; j++) {
+        if (str_append_char(rolled_expr, signs[j]) != 0)
+            return DE_MEMORY;
+    }
+
+    return 0;
+}
+
+size_t
+eval_roll_width(int_least64_t dice) {
+    if (dice <= UINT8_MAX)
+        return sizeof(uint8_t);
+    if (dice <= UINT16_MAX)
+        return sizeof(uint16_t);
+    if (dice <= UINT32_MAX)
+        return sizeof(uint32_t);
+    return sizeof(int_least64_t);
+}
+
+int
+eval_counts_rolls(int_least64_t nrolls, int_least64_t dice) {
+    // Width is at most two bytes, so this can't overflow.
+    return dice <= UINT16_MAX && (uint_least64_t) dice * sizeof(size_t) <=
+        (uint_least64_t) nrolls * eval_roll_width(dice);
+}
+
+enum parse_error
+eval_rolls(str *rolled_expr,
+           const void *rolls,
+           size_t width,
+           int_least64_t begin,
+           int_least64_t end,
+           int_least64_t first,
+           int_least64_t *sum) {
+    return roll_loops(width)->append(rolled_expr, rolls, begin, end, first,
+                                     sum);
+}
+
+enum de_output_style
+eval_style(int_least64_t nrolls) {
+    return nrolls > output.threshold ? output.style : DE_OUTPUT_FULL;
+}
+
+enum parse_error
+eval_summary(str *rolled_expr,
+             const void *rolls,
+             size_t width,
+             const struct term *t,
+             int_least64_t *sum) {
+    const int_least64_t nrolls = t->nrolls;
+    const int_least64_t small = t->small;
+    const int_least64_t end = nrolls - t->large;
+    const struct roll_loops *loops = roll_loops(width);
+    int_least64_t total = 0;
+    if (loops->sum(rolls, small, end, &total) != 0)
+        return DE_OVERFLOW;
+
+    if (summary_header(rolled_expr, t) != 0 ||
+        str_append_chars(rolled_expr, ": ") != 0)
+        return DE_MEMORY;
+    if (eval_style(nrolls) == DE_OUTPUT_HISTOGRAM) {
+        // Rolls are sorted, so equal faces are next to each other.
+        for (int_least64_t i = small; i < end; ) {
+            int_least64_t face;
+            int_least64_t j = loops->face_end(rolls, i, end, &face);
+            if (summary_face(rolled_expr, face, j - i, i == small) != 0)
+                return DE_MEMORY;
+            i = j;
+        }
+    }
+    else if (summary_totals(rolled_expr, nrolls, end - small, total) != 0)
+        return DE_MEMORY;
+    if (str_append_char(rolled_expr, ')') != 0)
+        return DE_MEMORY;
+
+    *sum = total;
+
+    return 0;
+}
+
+enum parse_error
+eval_summary_counts(str *rolled_expr,
+                    const uint_least64_t *counts,
+                    int_least64_t nrolls,
+                    int_least64_t dice,
+                    int_least64_t small,
+                    int_least64_t large,
+                    int_least64_t sum) {
+    const struct term t = {
+        .type = TERM_DICE,
+        .nrolls = nrolls,
+        .dice = dice,
+        .small = small,
+        .large = large
+    };
+    if (summary_header(rolled_expr, &t) != 0 ||
+        str_append_chars(rolled_expr, ": ") != 0)
+        return DE_MEMORY;
+    if (eval_style(nrolls) == DE_OUTPUT_HISTOGRAM) {
+        int first = 1;
+        for (int_least64_t f = 0; f < dice; f++) {
+            if (counts[f] == 0)
+                continue;
+            if (summary_face(rolled_expr, f + 1, counts[f], first) != 0)
+                return DE_MEMORY;
+            first = 0;
+        }
+    }
+    else if (summary_totals(rolled_expr, nrolls, nrolls - small - large, sum)
+             != 0)
+        return DE_MEMORY;
+    if (str_append_char(rolled_expr, ')') != 0)
+        return DE_MEMORY;
+
+    return 0;
+}
+
+int
+eval_samples_count(const struct term *t) {
+    // Rolls of audited calls don't depend on the output style.
+    return t->count != COUNT_NONE && t->small == 0 && t->large == 0 &&
+        t->reroll == 0 && !t->explode &&
+        eval_style(t->nrolls) != DE_OUTPUT_FULL && !audit_active();
+}
+
+void
+de_set_explode_depth(int_least64_t depth) {
+    explode_depth = depth > 0 ? depth : DE_EXPLODE_DEPTH;
+}
+
+int_least64_t
+eval_explode_depth(void) {
+    return audit_active() ? DE_EXPLODE_DEPTH : explode_depth;
+}
+
+int_least64_t
+eval_max_roll(const struct term *t) {
+    if (!t->explode)
+        return t->dice;
+    const int_least64_t depth = eval_explode_depth();
+    if (depth >= INT_LEAST64_MAX / t->dice)
+        return INT_LEAST64_MAX;
+
+    return t->dice * (depth + 1);
+}
+
+enum parse_error
+eval_roll_die(const struct term *t, int_least64_t *roll) {
+    // Rolls at most reroll are rolled until they are larger, which is the
+    // same as rolling the rest of the sides once.
+    const int_least64_t sides = t->dice - t->reroll;
+    if (!t->explode) {
+        *roll = t->reroll + de_roll_die(sides);
+        return 0;
+    }
+
+    // Times the largest side is rolled in a row is geometric. The roll
+    // after them is any other side, unless the depth was reached.
+    const int_least64_t depth = eval_explode_depth();
+    const int_least64_t explosions = sample_geometric(1.0 / sides, depth);
+    const int_least64_t last = t->reroll + (explosions < depth ?
+                                            de_roll_die(sides - 1) :
+                                            de_roll_die(sides));
+    enum flow_type overflow;
+    NF_MULTIPLY(t->dice, explosions, INT_LEAST64, overflow);
+    if (overflow != 0)
+        return DE_OVERFLOW;
+    NF_PLUS(t->dice * explosions, last, INT_LEAST64, overflow);
+    if (overflow != 0)
+        return DE_OVERFLOW;
+    *roll = t->dice * explosions + last;
+
+    return 0;
+}
+
+enum parse_error
+eval_roll_parallel(str *rolled_expr,
+                   const struct term *t,
+                   int_least64_t *value,
+                   int *rolled) {
+    *rolled = 0;
+    // Whether an audited dice is rolled with many threads would depend on
+    // other threads.
+    if (t->count != COUNT_NONE || t->reroll != 0 || t->explode ||
+        audit_active())
+        return 0;
+
+    return parallel_roll(rolled_expr, t->nrolls, t->dice, t->small, t->large,
+                         value, rolled);
+}
+
+enum parse_error
+eval_count(str *rolled_expr,
+           const struct term *t,
+           const void *rolls,
+           size_t width,
+           int_least64_t *count) {
+    const int_least64_t end = t->nrolls - t->large;
+    int_least64_t n = 0;
+    if (rolls == NULL)
+        n = sample_binomial(t->nrolls, (double) success_faces(t) / t->dice);
+    else
+        n = roll_loops(width)->count(t, rolls, t->small, end);
+
+    if (rolls != NULL && eval_style(t->nrolls) == DE_OUTPUT_FULL) {
+        if (str_append_char(rolled_expr, '(') != 0 ||
+            roll_loops(width)->append(rolled_expr, rolls, t->small, end,
+                                      t->small, NULL) != 0)
+            return DE_MEMORY;
+    }
+    else if (summary_header(rolled_expr, t) != 0)
+        return DE_MEMORY;
+    if (str_append_chars(rolled_expr,
+                         t->count == COUNT_AT_LEAST ? ">=" : "<=") != 0 ||
+        str_append_int(rolled_expr, t->threshold) != 0 ||
+        str_append_chars(rolled_expr, ": ") != 0 ||
+        str_append_int(rolled_expr, n) != 0 ||
+        str_append_char(rolled_expr, ')') != 0)
+        return DE_MEMORY;
+
+    *count = n;
+
+    return 0;
+}
+
+/* str_sink passing characters to the sink of de_eval_sink().
+ * @param data Pointer to struct sink.
+ */
+static int
+write_sink(void *data, const char *chars, size_t len) {
+    struct sink *s = data;
+    if (s->sink(s->data, chars, len) != 0)
+        s->failed = 1;
+
+    return s->failed;
+}
+
+/* Roll a dice.
+ * @param rolled_expr Rolls are appended to this.
+ * @param t Term of type TERM_DICE, can't be NULL.
+ * @param value Sum or count of kept rolls.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+static enum parse_error
+roll(str *rolled_expr, const struct term *t, int_least64_t *value) {
+    const int_least64_t nrolls = t->nrolls;
+    const int_least64_t small = t->small;
+    const int_least64_t large = t->large;
+    PROBE3(roll__start, nrolls, t->dice, small + large);
+    enum probe_roll how = PROBE_ROLL_SAMPLED;
+    void *rolls = NULL;
+    size_t *counts = NULL;
+    int retval = 0;
+    if (eval_samples_count(t)) {
+        retval = eval_count(rolled_expr, t, NULL, 0, value);
+        goto free;
+    }
+
+    int rolled;
+    retval = eval_roll_parallel(rolled_expr, t, value, &rolled);
+    if (rolled) {
+        how = PROBE_ROLL_PARALLEL;
+        goto free;
+    }
+
+    // Rolls are stored in the narrowest type that fits the largest roll,
+    // and counting sort treats every roll up to it as a face.
+    const int_least64_t dice = eval_max_roll(t);
+    const size_t width = eval_roll_width(dice);
+    how = eval_counts_rolls(nrolls, dice) ? PROBE_ROLL_COUNTED :
+        PROBE_ROLL_QSORT;
+    if ((rolls = malloc(nrolls * width)) == NULL ||
+        (how == PROBE_ROLL_COUNTED &&
+         (counts = calloc(dice, sizeof(*counts))) == NULL)) {
+        retval = DE_MEMORY;
+        goto free;
+    }
+
+    const struct roll_loops *loops = roll_loops(width);
+    if ((retval = loops->roll(t, rolls)) != 0)
+        goto free;
+
+    PROBE2(sort__start, nrolls, width);
+    if (counts != NULL)
+        loops->count_sort(rolls, nrolls, dice, counts);
+    else
+        qsort(rolls, nrolls, width, loops->compare);
+    PROBE1(sort__done, how);
+
+    int_least64_t sum = 0;
+    if (t->count != COUNT_NONE) {
+        retval = eval_count(rolled_expr, t, rolls, width, &sum);
+        if (retval != 0)
+            goto free;
+    }
+    else if (eval_style(nrolls) != DE_OUTPUT_FULL) {
+        retval = eval_summary(rolled_expr, rolls, width, t, &sum);
+        if (retval != 0)
+            goto free;
+    }
+    else {
+        if (str_append_char(rolled_expr, '(') != 0) {
+            retval = DE_MEMORY;
+            goto free;
+        }
+        retval = eval_rolls(rolled_expr, rolls, width, small, nrolls - large,
+                            small, &sum);
+        if (retval != 0)
+            goto free;
+        if (str_append_char(rolled_expr, ')') != 0) {
+            retval = DE_MEMORY;
+            goto free;
+        }
+    }
+
+    *value = sum;
+
+    free:
+        free(rolls);
+        free(counts);
+        PROBE2(roll__done, how, retval);
+
+    return retval;
+}
+
+/* Append "(NdXrR!<small>large" of a summarized dice.
+ * @return Zero on success, non-zero on error.
+ */
+static int
+summary_header(str *rolled_expr, const struct term *t) {
+    if (str_append_format(rolled_expr, "(%" PRIdLEAST64 "d%" PRIdLEAST64,
+                          t->nrolls, t->dice) != 0)
+        return -1;
+    if (t->reroll > 0 &&
+        str_append_format(rolled_expr, "r%" PRIdLEAST64, t->reroll) != 0)
+        return -1;
+    if (t->explode && str_append_char(rolled_expr, '!') != 0)
+        return -1;
+    if (t->small > 0 &&
+        str_append_format(rolled_expr, "<%" PRIdLEAST64, t->small) != 0)
+        return -1;
+    if (t->large > 0 &&
+        str_append_format(rolled_expr, ">%" PRIdLEAST64, t->large) != 0)
+        return -1;
+
+    return 0;
+}
+
+/* Append "facexcount" of a histogram, separated by a space.
+ * @return Zero on success, non-zero on error.
+ */
+static int
+summary_face(str *rolled_expr,
+             int_least64_t face,
+             uint_least64_t count,
+             int first) {
+    return str_append_format(rolled_expr,
+                             first ? "%" PRIdLEAST64 "x%" PRIuLEAST64 :
+                                     " %" PRIdLEAST64 "x%" PRIuLEAST64,
+                             face, count);
+}
+
+/* Append "K kept, D dropped, sum S".
+ * @return Zero on success, non-zero on error.
+ */
+static int
+summary_totals(str *rolled_expr,
+               int_least64_t nrolls,
+               int_least64_t kept,
+               int_least64_t sum) {
+    return str_append_format(rolled_expr, "%" PRIdLEAST64 " kept, %"
+                             PRIdLEAST64 " dropped, sum %" PRIdLEAST64,
+                             kept, nrolls - kept, sum);
+}
+
+/* Number of faces of a counted dice which are counted.
+ */
+static int_least64_t
+success_faces(const struct term *t) {
+    if (t->count == COUNT_AT_MOST)
+        return t->threshold < t->dice ? t->threshold : t->dice;
+    if (t->threshold > t->dice)
+        return 0;
+
+    return t->threshold > 1 ? t->dice - t->threshold + 1 : t->dice;
+}
+
+/* Whether a roll of a counted dice is counted.
+ */
+static int
+is_success(const struct term *t, int_least64_t roll) {
+    return t->count == COUNT_AT_LEAST ? roll >= t->threshold :
+        roll <= t->threshold;
+}
+
+static int
+sort_ascending_u8(const void *a, const void *b) {
+    return *(const uint8_t*) a - *(const uint8_t*) b;
+}
+
+static int
+sort_ascending_u16(const void *a, const void *b) {
+    return *(const uint16_t*) a - *(const uint16_t*) b;
+}
+
+static int
+sort_ascending_u32(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t*) a;
+    const uint32_t y = *(const uint32_t*) b;
+
+    return (x > y) - (x < y);
+}
+
+static int
+sort_ascending_i64(const void *a, const void *b) {
+    const int_least64_t *x = a;
+    const int_least64_t *y = b;
+
+    if (*x < *y)  return -1;
+    if (*x == *y) return 0;
+    else          return 1;
+}
+
+/* Define the loops of struct roll_loops for rolls of type, with names ending
+ * in suffix.
+ */
+#define ROLL_LOOPS(suffix, type) \
+    static enum parse_error \
+    roll_dice_##suffix(const struct term *t, void *rolls) { \
+        type *r = rolls; \
+        for (int_least64_t i = 0; i < t->nrolls; i++) { \
+            int_least64_t roll; \
+            enum parse_error retval = eval_roll_die(t, &roll); \
+            if (retval != 0) \
+                return retval; \
+            r[i] = roll; \
+        } \
+    \
+        return 0; \
+    } \
+    \
+    static void \
+    count_sort_##suffix(void *rolls, \
+                        int_least64_t nrolls, \
+                        int_least64_t dice, \
+                        size_t *counts) { \
+        type *r = rolls; \
+        for (int_least64_t i = 0; i < nrolls; i++) \
+            counts[r[i] - 1]++; \
+    \
+        for (int_least64_t face = 1; face <= dice; face++) { \
+            for (size_t j = 0; j < counts[face - 1]; j++) \
+                *r++ = face; \
+        } \
+    } \
+    \
+    static enum parse_error \
+    sum_rolls_##suffix(const void *rolls, \
+                       int_least64_t begin, \
+                       int_least64_t end, \
+                       int_least64_t *sum) { \
+        const type *r = rolls; \
+        for (int_least64_t i = begin; i < end; i++) { \
+            enum flow_type interror; \
+            NF_PLUS(*sum, (int_least64_t) r[i], INT_LEAST64, interror); \
+            if (interror != 0) \
+                return DE_OVERFLOW; \
+            *sum += r[i]; \
+        } \
+    \
+        return 0; \
+    } \
+    \
+    static enum parse_error \
+    append_rolls_##suffix(str *rolled_expr, \
+                          const void *rolls, \
+                          int_least64_t begin, \
+                          int_least64_t end, \
+                          int_least64_t first, \
+                          int_least64_t *sum) { \
+        const type *r = rolls; \
+        for (int_least64_t i = begin; i < end; i++) { \
+            if (sum != NULL) { \
+                enum flow_type interror; \
+                NF_PLUS(*sum, (int_least64_t) r[i], INT_LEAST64, interror); \
+                if (interror != 0) \
+                    return DE_OVERFLOW; \
+                *sum += r[i]; \
+            } \
+            if (i > first && str_append_char(rolled_expr, '+') != 0) \
+                return DE_MEMORY; \
+            if (str_append_int(rolled_expr, r[i]) != 0) \
+                return DE_MEMORY; \
+        } \
+    \
+        return 0; \
+    } \
+    \
+    static int_least64_t \
+    count_rolls_##suffix(const struct term *t, \
+                         const void *rolls, \
+                         int_least64_t begin, \
+                         int_least64_t end) { \
+        const type *r = rolls; \
+        int_least64_t n = 0; \
+        for (int_least64_t i = begin; i < end; i++) \
+            n += is_success(t, r[i]); \
+    \
+        return n; \
+    } \
+    \
+    static int_least64_t \
+    face_end_##suffix(const void *rolls, \
+                      int_least64_t i, \
+                      int_least64_t end, \
+                      int_least64_t *face) { \
+        const type *r = rolls; \
+        const type f = r[i]; \
+        while (++i < end && r[i] == f) \
+            ; \
+        *face = f; \
+    \
+        return i; \
+    } \
+    \
+    static const struct roll_loops loops_##suffix = { \
+        roll_dice_##suffix, count_sort_##suffix, sort_ascending_##suffix, \
+        sum_rolls_##suffix, append_rolls_##suffix, count_rolls_##suffix, \
+        face_end_##suffix \
+    };
+
+ROLL_LOOPS(u8, uint8_t)
+ROLL_LOOPS(u16, uint16_t)
+ROLL_LOOPS(u32, uint32_t)
+ROLL_LOOPS(i64, int_least64_t)
+
+/* Loops over rolls of width bytes.
+ */
+static const struct roll_loops*
+roll_loops(size_t width) {
+    switch (width) {
+    case sizeof(uint8_t):  return &loops_u8;
+    case sizeof(uint16_t): return &loops_u16;
+    case sizeof(uint32_t): return &loops_u32;
+    default:               return &loops_i64;
+    }
+}
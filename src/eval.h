@@ -0,0 +1,195 @@
+#ifndef EVAL_H
+    #define EVAL_H
+#include <stdint.h>
+#include "str.h"
+#include "expr.h"
+#include "diceexpr.h"
+
+/** Evaluate a compiled expression.
+ * Rolled expression is appended to rolled_expr.
+ * @param e Can't be NULL.
+ * @param limits If NULL, limits set with de_set_limits() are used.
+ * @param rolled_expr Can't be NULL.
+ * @param value Used to store evaluated value.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+eval_expr(const struct de_expr *e,
+          const struct de_cost *limits,
+          str *rolled_expr,
+          int_least64_t *value);
+
+/** Evaluate a term of a compiled expression.
+ * Term's sign characters and the term after rolling dices are appended to
+ * rolled_expr.
+ * @param e Can't be NULL.
+ * @param t Term of e, can't be NULL.
+ * @param rolled_expr Can't be NULL.
+ * @param value Used to store value of the term, negated if the term is
+ * subtracted.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+eval_term(const struct de_expr *e,
+          const struct term *t,
+          str *rolled_expr,
+          int_least64_t *value);
+
+/** Append sign characters of a term.
+ * @param e Can't be NULL.
+ * @param t Term of e, can't be NULL.
+ * @param rolled_expr Can't be NULL.
+ * @return Zero on success, DE_MEMORY on error.
+ */
+enum parse_error
+eval_signs(const struct de_expr *e, const struct term *t, str *rolled_expr);
+
+/** Size of a roll of a dice in bytes.
+ * Rolls are stored in the narrowest of uint8_t, uint16_t, uint32_t and
+ * int_least64_t that fits the sides.
+ * @param dice Number of sides in a dice. Must be > 0.
+ * @return Size of a roll.
+ */
+size_t
+eval_roll_width(int_least64_t dice);
+
+/** Whether rolls of a dice are sorted by counting faces.
+ * Faces are counted when the counts take at most as much memory as the
+ * rolls.
+ * @param nrolls Number of rolls for a dice. Must be > 0.
+ * @param dice Number of sides in a dice. Must be > 0.
+ * @return Non-zero if faces are counted.
+ */
+int
+eval_counts_rolls(int_least64_t nrolls, int_least64_t dice);
+
+/** Sum and append sorted rolls from begin to end, separated by '+'.
+ * Rolls can be appended in parts, '+' is written before every roll except
+ * the one at first.
+ * @param rolled_expr Can't be NULL.
+ * @param rolls Sorted rolls.
+ * @param width Size of a roll, see eval_roll_width().
+ * @param begin Index of the first roll to append.
+ * @param end Index after the last roll to append.
+ * @param first Index of the first kept roll.
+ * @param sum Rolls are added to this.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+eval_rolls(str *rolled_expr,
+           const void *rolls,
+           size_t width,
+           int_least64_t begin,
+           int_least64_t end,
+           int_least64_t first,
+           int_least64_t *sum);
+
+/** Output style of a dice, see de_set_output().
+ * @param nrolls Number of rolls for a dice.
+ * @return Style.
+ */
+enum de_output_style
+eval_style(int_least64_t nrolls);
+
+/** Sum sorted rolls of a summarized dice and append the summary.
+ * @param rolled_expr Can't be NULL.
+ * @param rolls All sorted rolls.
+ * @param width Size of a roll, see eval_roll_width().
+ * @param t Term of type TERM_DICE, can't be NULL.
+ * @param sum Used to store sum of kept rolls.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+eval_summary(str *rolled_expr,
+             const void *rolls,
+             size_t width,
+             const struct term *t,
+             int_least64_t *sum);
+
+/** Append the summary of a summarized dice from counts of kept faces.
+ * @param rolled_expr Can't be NULL.
+ * @param counts Number of kept rolls of face i + 1, dice members.
+ * @param nrolls Number of rolls.
+ * @param dice Number of sides in a dice.
+ * @param small Ignore this many smallest rolls.
+ * @param large Ignore this many largest rolls.
+ * @param sum Sum of kept rolls.
+ * @return Zero on success, DE_MEMORY on error.
+ */
+enum parse_error
+eval_summary_counts(str *rolled_expr,
+                    const uint_least64_t *counts,
+                    int_least64_t nrolls,
+                    int_least64_t dice,
+                    int_least64_t small,
+                    int_least64_t large,
+                    int_least64_t sum);
+
+/** Whether the kept rolls of a counted dice are counted without rolling.
+ * Rolls of a summarized dice without ignored rolls aren't shown, so their
+ * count is sampled from the binomial distribution, except in audited calls.
+ * @param t Term of type TERM_DICE, can't be NULL.
+ * @return Non-zero if the count is sampled.
+ */
+int
+eval_samples_count(const struct term *t);
+
+/** Roll a dice with many threads and append it, if it's large enough, see
+ * de_parallel_start(). Counted, rerolled, exploding and audited dices are
+ * rolled by one thread.
+ * @param rolled_expr Can't be NULL.
+ * @param t Term of type TERM_DICE, can't be NULL.
+ * @param value Used to store sum of kept rolls.
+ * @param rolled Set to non-zero if the dice was rolled, zero if the caller
+ * should roll it.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+eval_roll_parallel(str *rolled_expr,
+                   const struct term *t,
+                   int_least64_t *value,
+                   int *rolled);
+
+/** Count kept rolls of a counted dice and append the dice.
+ * Appends "(3+5+6>=5: 2)" if rolls are given and the dice is written in
+ * full, "(NdX<small>large>=5: 2)" otherwise.
+ * @param rolled_expr Can't be NULL.
+ * @param t Term of type TERM_DICE with a count, can't be NULL.
+ * @param rolls Sorted rolls, or NULL to sample the count.
+ * @param width Size of a roll in bytes.
+ * @param count Used to store the count.
+ * @return Zero on success, DE_MEMORY on error.
+ */
+enum parse_error
+eval_count(str *rolled_expr,
+           const struct term *t,
+           const void *rolls,
+           size_t width,
+           int_least64_t *count);
+
+/** Largest roll of a dice.
+ * @param t Term of type TERM_DICE, can't be NULL.
+ * @return Sides of the dice, or of the dice exploding as many times as it
+ * can, INT_LEAST64_MAX if that doesn't fit.
+ */
+int_least64_t
+eval_max_roll(const struct term *t);
+
+/** Number of times a dice explodes at most, see de_set_explode_depth().
+ * Dices of audited calls explode at most DE_EXPLODE_DEPTH times.
+ * @return Depth, > 0.
+ */
+int_least64_t
+eval_explode_depth(void);
+
+/** Roll a dice once, rerolling and exploding it.
+ * Exploding dices sample the number of explosions, instead of rolling
+ * until the largest side isn't rolled.
+ * @param t Term of type TERM_DICE, can't be NULL.
+ * @param roll Used to store the roll.
+ * @return Zero on success, DE_OVERFLOW on error.
+ */
+enum parse_error
+eval_roll_die(const struct term *t, int_least64_t *roll);
+
+#endif // EVAL_H
@@ -0,0 +1,96 @@
+#include "expr.h"
+#include "dist.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#define DEFAULT_EXPR_SIZE 4
+#define SIZE_MULTIPLIER 2
+
+struct de_expr*
+expr_new() {
+    struct de_expr *e = malloc(sizeof(*e));
+    if (e == NULL)
+        return NULL;
+    e->nterms = 0;
+    e->pending_signs = 0;
+    e->dist = NULL;
+    e->size = DEFAULT_EXPR_SIZE;
+    e->terms = malloc(e->size * sizeof(*e->terms));
+    if (e->terms == NULL) {
+        free(e);
+        return NULL;
+    }
+    if ((e->signs = str_new(NULL)) == NULL) {
+        free(e->terms);
+        free(e);
+        return NULL;
+    }
+
+    return e;
+}
+
+void
+expr_free(struct de_expr *e) {
+    if (e == NULL)
+        return;
+
+    free(e->terms);
+    str_free(e->signs);
+    dist_free(e->dist);
+    free(e);
+}
+
+void
+expr_erase(struct de_expr *e) {
+    assert(e != NULL);
+
+    e->nterms = 0;
+    e->pending_signs = 0;
+    str_erase(e->signs);
+    dist_free(e->dist);
+    e->dist = NULL;
+}
+
+int
+expr_append_sign(struct de_expr *e, int sign) {
+    assert(e != NULL);
+    assert(sign == '+' || sign == '-');
+
+    return str_append_char(e->signs, sign);
+}
+
+int
+expr_append_term(struct de_expr *e, const struct term *t) {
+    assert(e != NULL);
+    assert(t != NULL);
+
+    if (e->nterms == e->size) {
+        struct term *temp =
+            realloc(e->terms, e->size * SIZE_MULTIPLIER * sizeof(*temp));
+        if (temp == NULL)
+            return ENOMEM;
+        e->terms = temp;
+        e->size *= SIZE_MULTIPLIER;
+    }
+
+    struct term *added = &e->terms[e->nterms++];
+    *added = *t;
+    added->signs = e->pending_signs;
+    added->nsigns = e->signs->len - e->pending_signs;
+    added->negative = 0;
+    for (size_t i = added->signs; i < e->signs->len; i++) {
+        if (e->signs->str[i] == '-')
+            added->negative = !added->negative;
+    }
+    e->pending_signs = e->signs->len;
+
+    return 0;
+}
+
+const char*
+expr_term_signs(const struct de_expr *e, const struct term *t) {
+    assert(e != NULL);
+    assert(t != NULL);
+
+    return e->signs->str + t->signs;
+}
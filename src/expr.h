@@ -0,0 +1,129 @@
+#ifndef EXPR_H
+    #define EXPR_H
+#include <stddef.h>
+#include <stdint.h>
+#include "str.h"
+
+/** @file
+ * Compiled form of a dice expression.
+ *
+ * A dice expression is a flat sum of signed terms. Each term is either an
+ * integer constant or a dice roll. The signs, both binary and unary, that
+ * precede a term in the expression are kept, so that the rolled expression
+ * can be reproduced exactly as de_parse() has always written it.
+ */
+
+/** @enum term_type Type of a term.
+ */
+enum term_type {
+    TERM_CONSTANT,
+    TERM_DICE
+};
+
+/** @enum count_type Whether kept rolls of a dice are summed or counted.
+ */
+enum count_type {
+    COUNT_NONE,
+    // Rolls at least threshold are counted.
+    COUNT_AT_LEAST,
+    // Rolls at most threshold are counted.
+    COUNT_AT_MOST
+};
+
+/** A term of a dice expression.
+ * Terms are written to catalogs as they are in memory, see
+ * de_catalog_write(), so changing this needs a new catalog version.
+ */
+struct term {
+    enum term_type type;
+    // Non-zero if the term is subtracted from the terms before it.
+    int negative;
+    // Offset and number of sign characters of the term in de_expr's signs.
+    size_t signs;
+    size_t nsigns;
+    // Value of a TERM_CONSTANT.
+    int_least64_t constant;
+    // Number of rolls, sides of the dice and number of smallest and largest
+    // rolls to ignore of a TERM_DICE.
+    int_least64_t nrolls;
+    int_least64_t dice;
+    int_least64_t small;
+    int_least64_t large;
+    // Rolls of a TERM_DICE at most reroll are rolled again, until they are
+    // larger. Zero means no rerolls.
+    int_least64_t reroll;
+    // Non-zero if a TERM_DICE rolling its largest side is rolled again and
+    // the rolls are added, at most de_set_explode_depth() times.
+    int explode;
+    // Value of a TERM_DICE is the number of kept rolls meeting threshold,
+    // unless count is COUNT_NONE.
+    enum count_type count;
+    int_least64_t threshold;
+};
+
+struct dist;
+
+/** Compiled dice expression.
+ */
+struct de_expr {
+    struct term *terms;
+    // Number of terms.
+    size_t nterms;
+    // Number of terms memory is allocated for.
+    size_t size;
+    // Sign characters of all terms.
+    str *signs;
+    // Start of sign characters in signs not yet given to a term.
+    size_t pending_signs;
+    // Distribution of values, built when it's first needed. NULL before.
+    struct dist *dist;
+};
+
+/** Create new empty expression.
+ * @return New expression or NULL if can't allocate memory.
+ */
+struct de_expr*
+expr_new();
+
+/** Free expression.
+ * @param e Can be NULL.
+ * @return void
+ */
+void
+expr_free(struct de_expr *e);
+
+/** Remove all terms, signs and the distribution, keeping the memory for
+ * reuse.
+ * @param e Can't be NULL.
+ * @return void
+ */
+void
+expr_erase(struct de_expr *e);
+
+/** Add a sign character for the next term.
+ * @param e Can't be NULL.
+ * @param sign '+' or '-'.
+ * @return Zero on success, ENOMEM on error.
+ */
+int
+expr_append_sign(struct de_expr *e, int sign);
+
+/** Add a term to the end of expression.
+ * Sign characters added after the previous term are given to the term and
+ * term's negative member is set according to them.
+ * @param e Can't be NULL.
+ * @param t Term to copy, can't be NULL.
+ * @return Zero on success, ENOMEM on error.
+ */
+int
+expr_append_term(struct de_expr *e, const struct term *t);
+
+/** Get sign characters of a term.
+ * @param e Can't be NULL.
+ * @param t Term of e, can't be NULL.
+ * @return Pointer to t->nsigns sign characters, not nul terminated.
+ */
+const char*
+expr_term_signs(const struct de_expr *e, const struct term *t);
+
+#endif // EXPR_H
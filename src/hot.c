@@ -0,0 +1,386 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <pthread.h>
+#include "clock.h"
+#include "hot.h"
+#include "diceexpr.h"
+
+#define DEFAULT_K 32
+#define DEFAULT_WIDTH 1024
+#define DEFAULT_DEPTH 4
+#define FNV_OFFSET UINT64_C(14695981039346656037)
+#define FNV_PRIME UINT64_C(1099511628211)
+
+// A candidate for the hottest expressions.
+struct entry {
+    uint_least64_t hash;
+    // Estimated count of the expression when it was counted last.
+    uint_least64_t count;
+    char expr[DE_HOT_EXPR];
+};
+
+/* Sketches and candidates of a thread.
+ *
+ * Only the thread writes its tracker, but de_hot_top() reads it, so both
+ * hold the tracker's mutex. The mutex is only contended while reading.
+ */
+struct tracker {
+    // Next tracker in the list of all trackers.
+    struct tracker *next;
+    pthread_mutex_t mutex;
+    // Count-min sketches of calls and their time, depth rows of width
+    // counters.
+    uint_least64_t *counts;
+    uint_least64_t *nanoseconds;
+    // Min-heap of at most k candidates by count.
+    struct entry *heap;
+    size_t nheap;
+};
+
+struct hot {
+    size_t k;
+    // Power of two.
+    size_t width;
+    size_t depth;
+    // Generation of the tracking, see thread_generation.
+    uint_least64_t generation;
+    // Protects the list of trackers.
+    pthread_mutex_t mutex;
+    struct tracker *trackers;
+};
+
+// NULL if tracking isn't started.
+static struct hot *hot;
+// Incremented every time tracking is started.
+static uint_least64_t generation;
+// Tracker of a thread is valid if the thread's generation is hot's, since
+// trackers are freed when tracking is stopped.
+static __thread struct tracker *thread_tracker;
+static __thread uint_least64_t thread_generation;
+// Start of the timed call, zero if the call isn't timed.
+static __thread uint_least64_t thread_start;
+
+static struct tracker* get_tracker(struct hot *h);
+static void free_tracker(struct tracker *t);
+static uint_least64_t normalize(const char *expr, char *normalized);
+static size_t counter(const struct hot *h, uint_least64_t hash, size_t row);
+static uint_least64_t estimate(const struct hot *h,
+                               const uint_least64_t *sketch,
+                               uint_least64_t hash);
+static void count(struct hot *h,
+                  struct tracker *t,
+                  uint_least64_t hash,
+                  const char *expr,
+                  uint_least64_t nanoseconds);
+static void sift_down(struct entry *heap, size_t n, size_t i);
+static int hotter(const void *a, const void *b);
+
+enum parse_error
+de_hot_start(const struct de_hot_config *config) {
+    assert(hot == NULL);
+
+    struct hot *h = malloc(sizeof(*h));
+    if (h == NULL)
+        return DE_MEMORY;
+    h->k = config != NULL && config->k > 0 ? config->k : DEFAULT_K;
+    size_t width = config != NULL && config->width > 0 ?
+        config->width : DEFAULT_WIDTH;
+    // Power of two, so that a counter is a mask of a hash.
+    for (h->width = 1; h->width < width; h->width *= 2)
+        ;
+    h->depth = config != NULL && config->depth > 0 ?
+        config->depth : DEFAULT_DEPTH;
+    h->generation = ++generation;
+    h->trackers = NULL;
+    pthread_mutex_init(&h->mutex, NULL);
+
+    __atomic_store_n(&hot, h, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void
+de_hot_stop(void) {
+    struct hot *h = hot;
+    if (h == NULL)
+        return;
+
+    __atomic_store_n(&hot, NULL, __ATOMIC_RELEASE);
+    while (h->trackers != NULL) {
+        struct tracker *t = h->trackers;
+        h->trackers = t->next;
+        free_tracker(t);
+    }
+    pthread_mutex_destroy(&h->mutex);
+    free(h);
+}
+
+size_t
+de_hot_top(struct de_hot_expr *top, size_t n) {
+    assert(top != NULL || n == 0);
+
+    struct hot *h = __atomic_load_n(&hot, __ATOMIC_ACQUIRE);
+    if (h == NULL || n == 0)
+        return 0;
+
+    const size_t size = h->depth * h->width;
+    uint_least64_t *counts = calloc(size, sizeof(*counts));
+    uint_least64_t *nanoseconds = calloc(size, sizeof(*nanoseconds));
+    struct entry *candidates = NULL;
+    size_t ncandidates = 0;
+    size_t ntop = 0;
+    if (counts == NULL || nanoseconds == NULL)
+        goto free;
+
+    // Sum the sketches and collect distinct candidates of all threads.
+    pthread_mutex_lock(&h->mutex);
+    size_t ntrackers = 0;
+    for (struct tracker *t = h->trackers; t != NULL; t = t->next)
+        ntrackers++;
+    // One more, so that malloc() isn't given zero without trackers.
+    candidates = malloc((ntrackers * h->k + 1) * sizeof(*candidates));
+    if (candidates == NULL) {
+        pthread_mutex_unlock(&h->mutex);
+        goto free;
+    }
+    for (struct tracker *t = h->trackers; t != NULL; t = t->next) {
+        pthread_mutex_lock(&t->mutex);
+        for (size_t i = 0; i < size; i++) {
+            counts[i] += t->counts[i];
+            nanoseconds[i] += t->nanoseconds[i];
+        }
+        for (size_t i = 0; i < t->nheap; i++) {
+            size_t j = 0;
+            while (j < ncandidates &&
+                   candidates[j].hash != t->heap[i].hash)
+                j++;
+            if (j == ncandidates)
+                candidates[ncandidates++] = t->heap[i];
+        }
+        pthread_mutex_unlock(&t->mutex);
+    }
+    pthread_mutex_unlock(&h->mutex);
+
+    for (size_t i = 0; i < ncandidates; i++)
+        candidates[i].count = estimate(h, counts, candidates[i].hash);
+    qsort(candidates, ncandidates, sizeof(*candidates), hotter);
+    for (; ntop < n && ntop < ncandidates; ntop++) {
+        memcpy(top[ntop].expr, candidates[ntop].expr, DE_HOT_EXPR);
+        top[ntop].count = candidates[ntop].count;
+        top[ntop].nanoseconds = estimate(h, nanoseconds,
+                                         candidates[ntop].hash);
+    }
+
+    free:
+        free(counts);
+        free(nanoseconds);
+        free(candidates);
+
+    return ntop;
+}
+
+void
+hot_start(void) {
+    if (__atomic_load_n(&hot, __ATOMIC_ACQUIRE) == NULL) {
+        thread_start = 0;
+        return;
+    }
+
+    thread_start = clock_now();
+}
+
+void
+hot_finish(const char *expr) {
+    assert(expr != NULL);
+
+    if (thread_start == 0)
+        return;
+    const uint_least64_t nanoseconds = clock_now() - thread_start;
+    thread_start = 0;
+
+    struct hot *h = __atomic_load_n(&hot, __ATOMIC_ACQUIRE);
+    if (h == NULL)
+        return;
+    struct tracker *t = get_tracker(h);
+    if (t == NULL)
+        return;
+
+    char normalized[DE_HOT_EXPR];
+    const uint_least64_t hash = normalize(expr, normalized);
+    pthread_mutex_lock(&t->mutex);
+    count(h, t, hash, normalized, nanoseconds);
+    pthread_mutex_unlock(&t->mutex);
+}
+
+/* Get the tracker of the calling thread, creating it at first.
+ * @return Tracker or NULL if memory can't be allocated.
+ */
+static struct tracker*
+get_tracker(struct hot *h) {
+    if (thread_generation == h->generation)
+        return thread_tracker;
+
+    struct tracker *t = malloc(sizeof(*t));
+    if (t == NULL)
+        return NULL;
+    const size_t size = h->depth * h->width;
+    t->counts = calloc(size, sizeof(*t->counts));
+    t->nanoseconds = calloc(size, sizeof(*t->nanoseconds));
+    t->heap = malloc(h->k * sizeof(*t->heap));
+    t->nheap = 0;
+    if (t->counts == NULL || t->nanoseconds == NULL || t->heap == NULL) {
+        free(t->counts);
+        free(t->nanoseconds);
+        free(t->heap);
+        free(t);
+        return NULL;
+    }
+    pthread_mutex_init(&t->mutex, NULL);
+
+    pthread_mutex_lock(&h->mutex);
+    t->next = h->trackers;
+    h->trackers = t;
+    pthread_mutex_unlock(&h->mutex);
+    thread_tracker = t;
+    thread_generation = h->generation;
+
+    return t;
+}
+
+static void
+free_tracker(struct tracker *t) {
+    pthread_mutex_destroy(&t->mutex);
+    free(t->counts);
+    free(t->nanoseconds);
+    free(t->heap);
+    free(t);
+}
+
+/* Normalize an expression and hash it with FNV-1a. Whitespace is removed
+ * and 'D' is lowered.
+ * @param normalized Used to store at most DE_HOT_EXPR - 1 characters of the
+ * normalized expression and '\0'.
+ * @return Hash of the whole normalized expression.
+ */
+static uint_least64_t
+normalize(const char *expr, char *normalized) {
+    uint_least64_t hash = FNV_OFFSET;
+    size_t len = 0;
+    for (; *expr != '\0'; expr++) {
+        if (isspace((unsigned char) *expr))
+            continue;
+        const char c = *expr == 'D' ? 'd' : *expr;
+        hash = (hash ^ (unsigned char) c) * FNV_PRIME;
+        if (len < DE_HOT_EXPR - 1)
+            normalized[len++] = c;
+    }
+    normalized[len] = '\0';
+
+    return hash;
+}
+
+/* Index of the counter of a hash in a row of a sketch. Rows hash with
+ * h1 + row * h2, where h1 and h2 are the halves of the hash.
+ */
+static size_t
+counter(const struct hot *h, uint_least64_t hash, size_t row) {
+    const uint_least64_t h1 = hash & 0xffffffff;
+    // Odd, so that rows differ.
+    const uint_least64_t h2 = (hash >> 32) | 1;
+
+    return row * h->width + ((h1 + row * h2) & (h->width - 1));
+}
+
+/* Smallest counter of a hash in a sketch.
+ */
+static uint_least64_t
+estimate(const struct hot *h,
+         const uint_least64_t *sketch,
+         uint_least64_t hash) {
+    uint_least64_t min = UINT_LEAST64_MAX;
+    for (size_t row = 0; row < h->depth; row++) {
+        const uint_least64_t c = sketch[counter(h, hash, row)];
+        if (c < min)
+            min = c;
+    }
+
+    return min;
+}
+
+/* Count a call to a thread's sketches and candidates.
+ * A counted expression already a candidate has its count updated. Otherwise
+ * it replaces the coldest candidate if it's hotter, or if there's room.
+ */
+static void
+count(struct hot *h,
+      struct tracker *t,
+      uint_least64_t hash,
+      const char *expr,
+      uint_least64_t nanoseconds) {
+    for (size_t row = 0; row < h->depth; row++) {
+        const size_t c = counter(h, hash, row);
+        t->counts[c]++;
+        t->nanoseconds[c] += nanoseconds;
+    }
+    const uint_least64_t n = estimate(h, t->counts, hash);
+
+    for (size_t i = 0; i < t->nheap; i++) {
+        if (t->heap[i].hash == hash) {
+            t->heap[i].count = n;
+            sift_down(t->heap, t->nheap, i);
+            return;
+        }
+    }
+
+    size_t i;
+    if (t->nheap < h->k) {
+        // Moved up to keep the heap.
+        i = t->nheap++;
+        while (i > 0 && t->heap[(i - 1) / 2].count > n) {
+            t->heap[i] = t->heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+    }
+    else if (n > t->heap[0].count)
+        i = 0;
+    else
+        return;
+    t->heap[i].hash = hash;
+    t->heap[i].count = n;
+    memcpy(t->heap[i].expr, expr, DE_HOT_EXPR);
+    if (i == 0)
+        sift_down(t->heap, t->nheap, 0);
+}
+
+/* Move an entry of a min-heap down until its children are larger.
+ */
+static void
+sift_down(struct entry *heap, size_t n, size_t i) {
+    for (;;) {
+        size_t smallest = i;
+        const size_t left = 2 * i + 1;
+        const size_t right = left + 1;
+        if (left < n && heap[left].count < heap[smallest].count)
+            smallest = left;
+        if (right < n && heap[right].count < heap[smallest].count)
+            smallest = right;
+        if (smallest == i)
+            return;
+        struct entry temp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = temp;
+        i = smallest;
+    }
+}
+
+/* Compare entries by count, largest first.
+ */
+static int
+hotter(const void *a, const void *b) {
+    const struct entry *x = a;
+    const struct entry *y = b;
+
+    return (x->count < y->count) - (x->count > y->count);
+}
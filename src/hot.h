@@ -0,0 +1,21 @@
+#ifndef HOT_H
+    #define HOT_H
+
+/** @file
+ * Counting calls for tracking hot expressions, see de_hot_start().
+ */
+
+/** Start timing a call, if hot expressions are tracked.
+ * @return void
+ */
+void
+hot_start(void);
+
+/** Stop timing a call and count it to the thread's sketches.
+ * @param expr Expression of the call, can't be NULL.
+ * @return void
+ */
+void
+hot_finish(const char *expr);
+
+#endif // HOT_H
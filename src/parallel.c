@@ -0,0 +1,462 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "str.h"
+#include "eval.h"
+#include "parallel.h"
+#include "diceexpr.h"
+#include "numflow.h"
+
+#define DEFAULT_MIN_ROLLS 1000000
+#define DEFAULT_CHUNK 65536
+// Rolls are counted per face, so larger dices are rolled by one thread.
+#define MAX_DICE 65536
+// A face of at most MAX_DICE and '+'.
+#define MAX_ROLL_LEN 6
+// Increment of the state of splitmix64.
+#define GAMMA UINT64_C(0x9e3779b97f4a7c15)
+
+/* A dice term rolled in two phases. First, chunks of rolls are rolled and
+ * their faces counted by each thread. Then the counts are merged, ignored
+ * rolls removed and chunks of kept rolls formatted by each thread straight
+ * to the rolled expression, because the place of each roll is known from
+ * the counts.
+ */
+struct job {
+    int_least64_t nrolls;
+    int_least64_t dice;
+    // Roll i is generated from state seed + (i + 1) * GAMMA, so rolls don't
+    // depend on the number of threads or the size of chunks.
+    uint_least64_t seed;
+    int_least64_t chunk;
+    // Next chunk to take and number of chunks in the phase.
+    int_least64_t next;
+    int_least64_t nchunks;
+    // Counts of faces, a row for each of nthreads threads.
+    uint_least64_t *counts;
+    size_t nthreads;
+    // Number of kept rolls with a smaller face than face i + 1, and their
+    // length in the rolled expression. dice + 1 members.
+    int_least64_t *kept_before;
+    size_t *bytes_before;
+    int_least64_t nkept;
+    // Where the first kept roll is formatted to.
+    char *output;
+};
+
+struct helper {
+    pthread_t thread;
+    struct parallel *p;
+    // Index of the thread's row in counts, caller of parallel_roll() has 0.
+    size_t index;
+};
+
+struct parallel {
+    struct de_parallel_config config;
+    struct helper *helpers;
+    size_t nhelpers;
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    // Incremented when a phase starts.
+    uint_least64_t generation;
+    // Helpers still working on the phase.
+    size_t running;
+    int stopping;
+    void (*work)(struct job *job, size_t index);
+    struct job *job;
+    // Only one term is rolled at a time, others are rolled by one thread.
+    pthread_mutex_t busy;
+};
+
+// NULL if not started.
+static struct parallel *parallel;
+
+static void* help(void *arg);
+static void run_phase(struct parallel *p,
+                      struct job *job,
+                      void (*work)(struct job *job, size_t index));
+static void roll_chunks(struct job *job, size_t index);
+static void format_chunks(struct job *job, size_t index);
+static enum parse_error keep(struct job *job,
+                             int_least64_t small,
+                             int_least64_t large,
+                             int_least64_t *sum);
+static enum parse_error format_counts(str *rolled_expr,
+                                      const struct job *job);
+static size_t format_roll(int_least64_t face, char *s);
+static void stop_helpers(struct parallel *p, size_t nhelpers);
+
+enum parse_error
+de_parallel_start(const struct de_parallel_config *config) {
+    assert(parallel == NULL);
+
+    struct parallel *p = malloc(sizeof(*p));
+    if (p == NULL)
+        return DE_MEMORY;
+    p->config.nthreads = config != NULL ? config->nthreads : 0;
+    if (p->config.nthreads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        p->config.nthreads = n > 0 ? n : 1;
+    }
+    p->config.min_rolls = config != NULL && config->min_rolls > 0 ?
+        config->min_rolls : DEFAULT_MIN_ROLLS;
+    p->config.chunk = config != NULL && config->chunk > 0 ?
+        config->chunk : DEFAULT_CHUNK;
+
+    p->nhelpers = p->config.nthreads - 1;
+    p->generation = 0;
+    p->running = 0;
+    p->stopping = 0;
+    p->work = NULL;
+    p->job = NULL;
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_cond_init(&p->start, NULL);
+    pthread_cond_init(&p->done, NULL);
+    pthread_mutex_init(&p->busy, NULL);
+    if ((p->helpers = malloc(p->nhelpers * sizeof(*p->helpers))) == NULL &&
+        p->nhelpers > 0) {
+        stop_helpers(p, 0);
+        return DE_MEMORY;
+    }
+    for (size_t i = 0; i < p->nhelpers; i++) {
+        p->helpers[i].p = p;
+        p->helpers[i].index = i + 1;
+        if (pthread_create(&p->helpers[i].thread, NULL, help,
+                           &p->helpers[i]) != 0) {
+            stop_helpers(p, i);
+            return DE_MEMORY;
+        }
+    }
+
+    __atomic_store_n(&parallel, p, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void
+de_parallel_stop(void) {
+    struct parallel *p = parallel;
+    if (p == NULL)
+        return;
+
+    __atomic_store_n(&parallel, NULL, __ATOMIC_RELEASE);
+    stop_helpers(p, p->nhelpers);
+}
+
+enum parse_error
+parallel_roll(str *rolled_expr,
+              int_least64_t nrolls,
+              int_least64_t dice,
+              int_least64_t small,
+              int_least64_t large,
+              int_least64_t *dice_sum,
+              int *rolled) {
+    *rolled = 0;
+    struct parallel *p = __atomic_load_n(&parallel, __ATOMIC_ACQUIRE);
+    // Counts of faces must not take more memory than the rolls would.
+    if (p == NULL || nrolls < p->config.min_rolls || dice > MAX_DICE ||
+        dice > nrolls)
+        return 0;
+    if (pthread_mutex_trylock(&p->busy) != 0)
+        return 0;
+
+    struct job job = {
+        .nrolls = nrolls,
+        .dice = dice,
+        .chunk = p->config.chunk,
+        .nthreads = p->nhelpers + 1
+    };
+    job.counts = calloc(job.nthreads * dice, sizeof(*job.counts));
+    job.kept_before = malloc((dice + 1) * sizeof(*job.kept_before));
+    job.bytes_before = malloc((dice + 1) * sizeof(*job.bytes_before));
+    enum parse_error retval = 0;
+    if (job.counts == NULL || job.kept_before == NULL ||
+        job.bytes_before == NULL)
+        goto end;
+    *rolled = 1;
+
+    // Seed from rand(), so srand() makes the rolls repeatable.
+    for (int i = 0; i < 3; i++)
+        job.seed = job.seed << 31 ^ (uint_least64_t) rand();
+    job.nchunks = (nrolls - 1) / job.chunk + 1;
+    run_phase(p, &job, roll_chunks);
+
+    int_least64_t sum;
+    if ((retval = keep(&job, small, large, &sum)) != 0)
+        goto end;
+
+    if (eval_style(nrolls) != DE_OUTPUT_FULL) {
+        retval = eval_summary_counts(rolled_expr, job.counts, nrolls, dice,
+                                     small, large, sum);
+        if (retval == 0)
+            *dice_sum = sum;
+        goto end;
+    }
+
+    // The whole term would be passed to a sink at once, so streamed rolls
+    // are formatted by this thread in chunks of the sink.
+    if (rolled_expr->sink != NULL) {
+        retval = format_counts(rolled_expr, &job);
+        if (retval == 0)
+            *dice_sum = sum;
+        goto end;
+    }
+
+    // Rolls are formatted with '+' after each, and the last '+' is replaced
+    // with ')'.
+    size_t len = 1 + job.bytes_before[dice];
+    if (str_reserve(rolled_expr, len) != 0) {
+        retval = DE_MEMORY;
+        goto end;
+    }
+    rolled_expr->str[rolled_expr->len] = '(';
+    job.output = rolled_expr->str + rolled_expr->len + 1;
+    job.next = 0;
+    job.nchunks = (job.nkept - 1) / job.chunk + 1;
+    run_phase(p, &job, format_chunks);
+    rolled_expr->len += len;
+    rolled_expr->str[rolled_expr->len - 1] = ')';
+    rolled_expr->str[rolled_expr->len] = '\0';
+
+    *dice_sum = sum;
+
+    end:
+        free(job.counts);
+        free(job.kept_before);
+        free(job.bytes_before);
+        pthread_mutex_unlock(&p->busy);
+
+    return retval;
+}
+
+/* Wait for phases and work on them until stopped.
+ */
+static void*
+help(void *arg) {
+    struct helper *h = arg;
+    struct parallel *p = h->p;
+    uint_least64_t generation = 0;
+
+    pthread_mutex_lock(&p->mutex);
+    for (;;) {
+        while (!p->stopping && p->generation == generation)
+            pthread_cond_wait(&p->start, &p->mutex);
+        if (p->stopping)
+            break;
+        generation = p->generation;
+        pthread_mutex_unlock(&p->mutex);
+
+        p->work(p->job, h->index);
+
+        pthread_mutex_lock(&p->mutex);
+        if (--p->running == 0)
+            pthread_cond_signal(&p->done);
+    }
+    pthread_mutex_unlock(&p->mutex);
+
+    return NULL;
+}
+
+/* Run work on all threads and wait until it's done.
+ */
+static void
+run_phase(struct parallel *p,
+          struct job *job,
+          void (*work)(struct job *job, size_t index)) {
+    pthread_mutex_lock(&p->mutex);
+    p->work = work;
+    p->job = job;
+    p->running = p->nhelpers;
+    p->generation++;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->mutex);
+
+    work(job, 0);
+
+    pthread_mutex_lock(&p->mutex);
+    while (p->running > 0)
+        pthread_cond_wait(&p->done, &p->mutex);
+    pthread_mutex_unlock(&p->mutex);
+}
+
+/* Roll chunks and count faces to the row of the thread.
+ */
+static void
+roll_chunks(struct job *job, size_t index) {
+    uint_least64_t *counts = job->counts + index * job->dice;
+    const uint_least64_t dice = job->dice;
+
+    int_least64_t c;
+    while ((c = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+           job->nchunks) {
+        int_least64_t begin = c * job->chunk;
+        int_least64_t end = job->nrolls - begin < job->chunk ?
+            job->nrolls : begin + job->chunk;
+        uint_least64_t state = job->seed + (uint_least64_t) begin * GAMMA;
+        for (int_least64_t i = begin; i < end; i++) {
+            // splitmix64
+            state += GAMMA;
+            uint_least64_t z = state;
+            z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+            z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+            z ^= z >> 31;
+            // Upper 32 bits scaled to [0, dice).
+            counts[(z >> 32) * dice >> 32]++;
+        }
+    }
+}
+
+/* Format chunks of kept rolls to their places in the output.
+ */
+static void
+format_chunks(struct job *job, size_t index) {
+    (void) index;
+
+    int_least64_t c;
+    while ((c = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+           job->nchunks) {
+        int_least64_t begin = c * job->chunk;
+        int_least64_t end = job->nkept - begin < job->chunk ?
+            job->nkept : begin + job->chunk;
+
+        // Largest face whose rolls start at or before begin.
+        int_least64_t low = 0, high = job->dice - 1;
+        while (low < high) {
+            int_least64_t middle = low + (high - low + 1) / 2;
+            if (job->kept_before[middle] <= begin)
+                low = middle;
+            else
+                high = middle - 1;
+        }
+        int_least64_t f = low;
+        char roll[MAX_ROLL_LEN];
+        size_t len = format_roll(f + 1, roll);
+        char *p = job->output + job->bytes_before[f] +
+            (begin - job->kept_before[f]) * len;
+
+        for (int_least64_t i = begin; i < end; i++) {
+            if (i >= job->kept_before[f + 1]) {
+                while (i >= job->kept_before[f + 1])
+                    f++;
+                len = format_roll(f + 1, roll);
+            }
+            memcpy(p, roll, len);
+            p += len;
+        }
+    }
+}
+
+/* Merge counts, remove ignored rolls and compute sum of kept rolls, and
+ * places of the rolls in the output.
+ * @return Zero on success, DE_OVERFLOW on error.
+ */
+static enum parse_error
+keep(struct job *job,
+     int_least64_t small,
+     int_least64_t large,
+     int_least64_t *sum) {
+    uint_least64_t *counts = job->counts;
+    for (size_t t = 1; t < job->nthreads; t++) {
+        for (int_least64_t f = 0; f < job->dice; f++)
+            counts[f] += counts[t * job->dice + f];
+    }
+
+    for (int_least64_t f = 0; small > 0; f++) {
+        uint_least64_t n = (uint_least64_t) small < counts[f] ?
+            (uint_least64_t) small : counts[f];
+        counts[f] -= n;
+        small -= n;
+    }
+    for (int_least64_t f = job->dice - 1; large > 0; f--) {
+        uint_least64_t n = (uint_least64_t) large < counts[f] ?
+            (uint_least64_t) large : counts[f];
+        counts[f] -= n;
+        large -= n;
+    }
+
+    *sum = 0;
+    job->kept_before[0] = 0;
+    job->bytes_before[0] = 0;
+    for (int_least64_t f = 0; f < job->dice; f++) {
+        int_least64_t face = f + 1;
+        int_least64_t n = counts[f];
+        enum flow_type overflow;
+        NF_MULTIPLY(face, n, INT_LEAST64, overflow);
+        if (overflow != 0)
+            return DE_OVERFLOW;
+        NF_PLUS(*sum, face * n, INT_LEAST64, overflow);
+        if (overflow != 0)
+            return DE_OVERFLOW;
+        *sum += face * n;
+
+        char roll[MAX_ROLL_LEN];
+        job->kept_before[f + 1] = job->kept_before[f] + n;
+        job->bytes_before[f + 1] = job->bytes_before[f] +
+            n * format_roll(face, roll);
+    }
+    job->nkept = job->kept_before[job->dice];
+
+    return 0;
+}
+
+/* Append kept rolls from the merged counts of faces, one roll at a time.
+ * @return Zero on success, DE_MEMORY on error.
+ */
+static enum parse_error
+format_counts(str *rolled_expr, const struct job *job) {
+    if (str_append_char(rolled_expr, '(') != 0)
+        return DE_MEMORY;
+    int_least64_t n = 0;
+    for (int_least64_t f = 0; f < job->dice; f++) {
+        char roll[MAX_ROLL_LEN + 1];
+        const size_t len = format_roll(f + 1, roll);
+        for (uint_least64_t i = 0; i < job->counts[f]; i++) {
+            // '+' after the last roll is replaced with ')'.
+            if (++n == job->nkept)
+                roll[len - 1] = ')';
+            roll[len] = '\0';
+            if (str_append_chars(rolled_expr, roll) != 0)
+                return DE_MEMORY;
+        }
+    }
+
+    return 0;
+}
+
+/* Write face and '+' to s, without '\0'.
+ * @return Number of characters written.
+ */
+static size_t
+format_roll(int_least64_t face, char *s) {
+    char digits[MAX_ROLL_LEN];
+    size_t n = 0;
+    for (; face > 0; face /= 10)
+        digits[n++] = '0' + face % 10;
+    for (size_t i = 0; i < n; i++)
+        s[i] = digits[n - 1 - i];
+    s[n] = '+';
+
+    return n + 1;
+}
+
+/* Stop the first nhelpers helpers and free p.
+ */
+static void
+stop_helpers(struct parallel *p, size_t nhelpers) {
+    pthread_mutex_lock(&p->mutex);
+    p->stopping = 1;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->mutex);
+    for (size_t i = 0; i < nhelpers; i++)
+        pthread_join(p->helpers[i].thread, NULL);
+
+    pthread_mutex_destroy(&p->busy);
+    pthread_cond_destroy(&p->done);
+    pthread_cond_destroy(&p->start);
+    pthread_mutex_destroy(&p->mutex);
+    free(p->helpers);
+    free(p);
+}
@@ -0,0 +1,32 @@
+#ifndef PARALLEL_H
+    #define PARALLEL_H
+#include <stdint.h>
+#include "str.h"
+#include "diceexpr.h"
+
+/** @file
+ * Rolling a large dice term with many threads, see de_parallel_start().
+ */
+
+/** Roll a dice with many threads, if it's large enough.
+ * Takes the same arguments as rolling a dice in eval.c.
+ * @param rolled_expr Rolls are appended to this.
+ * @param nrolls Number of rolls for a dice. Must be > 0.
+ * @param dice Number of sides in a dice. Must be > 0.
+ * @param small Ignore this many smallest rolls.
+ * @param large Ignore this many largest rolls.
+ * @param dice_sum Sum of dices rolled.
+ * @param rolled Set to non-zero if the dice was rolled, zero if the caller
+ * should roll it.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+parallel_roll(str *rolled_expr,
+              int_least64_t nrolls,
+              int_least64_t dice,
+              int_least64_t small,
+              int_least64_t large,
+              int_least64_t *dice_sum,
+              int *rolled);
+
+#endif // PARALLEL_H
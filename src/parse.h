@@ -0,0 +1,43 @@
+#ifndef PARSE_H
+    #define PARSE_H
+#include "expr.h"
+#include "diceexpr.h"
+
+/** @file
+ * Scanner and parser of dice expressions. A scanner can be given new input,
+ * so many expressions can be compiled with one scanner.
+ */
+
+/** Create a scanner with dice expression as input.
+ * @param expr Can't be NULL.
+ * @param scanner Used to store the scanner.
+ * @return Zero on success, non-zero on error.
+ */
+int
+scanner_new(const char *expr, void **scanner);
+
+/** Replace input of a scanner with another dice expression.
+ * @param scanner Can't be NULL.
+ * @param expr Can't be NULL.
+ * @return void
+ */
+void
+scanner_reset(void *scanner, const char *expr);
+
+/** Free scanner and its buffer.
+ * @param scanner Can't be NULL.
+ * @return void
+ */
+void
+scanner_free(void *scanner);
+
+/** Compile dice expression read from scanner.
+ * @param scanner Can't be NULL.
+ * @param compiled Terms are appended to this, can't be NULL. On error, it
+ * may have some of the terms.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+enum parse_error
+parse_compile(void *scanner, struct de_expr *compiled);
+
+#endif // PARSE_H
@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include "pool.h"
+#include "diceexpr.h"
+
+#define DEFAULT_SHARDS 1
+#define DEFAULT_POOL_SIZE 4096
+#define CACHE_LINE 64
+
+/* Single producer, multiple consumer ring of random numbers.
+ *
+ * head and tail only grow, words from head to tail are available. The
+ * producer writes a word and then publishes it by incrementing tail.
+ * Consumers read the word at head and then claim it by incrementing head
+ * with compare and swap. The producer can't overwrite a word before head has
+ * passed it, so a consumer whose compare and swap succeeds has read a valid
+ * word.
+ */
+struct shard {
+    // Written by consumers. Also the number of words taken.
+    size_t head __attribute__((aligned(CACHE_LINE)));
+    uint_least64_t misses;
+    // Written by the producer.
+    size_t tail __attribute__((aligned(CACHE_LINE)));
+    uint_least64_t wakeups;
+    // Producer waits for consumers to take words down to the watermark.
+    int sleeping __attribute__((aligned(CACHE_LINE)));
+    int running;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int *words;
+    const struct pool *pool;
+};
+
+struct pool {
+    struct shard *shards;
+    size_t nshards;
+    size_t size;
+    size_t watermark;
+};
+
+// NULL if the pool isn't started.
+static struct pool *pool;
+// Threads are assigned to shards in turns.
+static size_t next_shard;
+static __thread size_t thread_shard;
+static __thread int thread_has_shard;
+
+static void* produce(void *arg);
+static size_t available(struct shard *s);
+static void wake(struct shard *s);
+static void stop_shards(struct pool *p, size_t nshards);
+
+enum parse_error
+de_pool_start(const struct de_pool_config *config) {
+    assert(pool == NULL);
+    assert(config == NULL || config->size == 0 ||
+           config->watermark < config->size);
+
+    struct pool *p = malloc(sizeof(*p));
+    if (p == NULL)
+        return DE_MEMORY;
+    p->nshards = config != NULL && config->nshards > 0 ?
+        config->nshards : DEFAULT_SHARDS;
+    size_t size = config != NULL && config->size > 0 ?
+        config->size : DEFAULT_POOL_SIZE;
+    // Power of two, so that an index to words is a mask of head or tail.
+    for (p->size = 1; p->size < size; p->size *= 2)
+        ;
+    p->watermark = config != NULL && config->size > 0 ?
+        config->watermark : p->size / 2;
+
+    if (posix_memalign((void**) &p->shards, CACHE_LINE,
+                       p->nshards * sizeof(*p->shards)) != 0) {
+        free(p);
+        return DE_MEMORY;
+    }
+    size_t started = 0;
+    for (; started < p->nshards; started++) {
+        struct shard *s = &p->shards[started];
+        s->head = 0;
+        s->misses = 0;
+        s->tail = 0;
+        s->wakeups = 0;
+        s->sleeping = 0;
+        s->running = 1;
+        s->pool = p;
+        if ((s->words = malloc(p->size * sizeof(*s->words))) == NULL)
+            break;
+        pthread_mutex_init(&s->mutex, NULL);
+        pthread_cond_init(&s->cond, NULL);
+        if (pthread_create(&s->thread, NULL, produce, s) != 0) {
+            pthread_cond_destroy(&s->cond);
+            pthread_mutex_destroy(&s->mutex);
+            free(s->words);
+            break;
+        }
+    }
+    if (started < p->nshards) {
+        stop_shards(p, started);
+        return DE_MEMORY;
+    }
+
+    __atomic_store_n(&pool, p, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void
+de_pool_stop(void) {
+    struct pool *p = pool;
+    if (p == NULL)
+        return;
+
+    __atomic_store_n(&pool, NULL, __ATOMIC_RELEASE);
+    stop_shards(p, p->nshards);
+}
+
+void
+de_pool_stats(struct de_pool_stats *stats) {
+    assert(stats != NULL);
+
+    stats->nshards = 0;
+    stats->size = 0;
+    stats->watermark = 0;
+    stats->available = 0;
+    stats->hits = 0;
+    stats->misses = 0;
+    stats->wakeups = 0;
+
+    struct pool *p = __atomic_load_n(&pool, __ATOMIC_ACQUIRE);
+    if (p == NULL)
+        return;
+    stats->nshards = p->nshards;
+    stats->size = p->size;
+    stats->watermark = p->watermark;
+    for (size_t i = 0; i < p->nshards; i++) {
+        struct shard *s = &p->shards[i];
+        stats->available += available(s);
+        stats->hits += __atomic_load_n(&s->head, __ATOMIC_RELAXED);
+        stats->misses += __atomic_load_n(&s->misses, __ATOMIC_RELAXED);
+        stats->wakeups += __atomic_load_n(&s->wakeups, __ATOMIC_RELAXED);
+    }
+}
+
+int
+pool_take(int *word) {
+    const struct pool *p = __atomic_load_n(&pool, __ATOMIC_ACQUIRE);
+    if (p == NULL)
+        return 0;
+
+    if (!thread_has_shard) {
+        thread_shard = __atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED);
+        thread_has_shard = 1;
+    }
+    struct shard *s = &p->shards[thread_shard % p->nshards];
+
+    size_t head = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+    size_t tail;
+    do {
+        tail = __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            __atomic_fetch_add(&s->misses, 1, __ATOMIC_RELAXED);
+            wake(s);
+            return 0;
+        }
+        *word = __atomic_load_n(&s->words[head & (p->size - 1)],
+                                __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&s->head, &head, head + 1, 1,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE));
+
+    if (tail - head - 1 <= p->watermark)
+        wake(s);
+
+    return 1;
+}
+
+/* Fill the ring of a shard until it's stopped.
+ */
+static void*
+produce(void *arg) {
+    struct shard *s = arg;
+    const size_t size = s->pool->size;
+
+    while (__atomic_load_n(&s->running, __ATOMIC_RELAXED)) {
+        size_t tail = s->tail;
+        if (tail - __atomic_load_n(&s->head, __ATOMIC_ACQUIRE) < size) {
+            __atomic_store_n(&s->words[tail & (size - 1)], rand(),
+                             __ATOMIC_RELAXED);
+            __atomic_store_n(&s->tail, tail + 1, __ATOMIC_RELEASE);
+            continue;
+        }
+
+        // Full. sleeping is set before checking the number of words, and
+        // consumers check sleeping after taking a word, so either the
+        // producer sees the taken word or a consumer sees sleeping.
+        pthread_mutex_lock(&s->mutex);
+        __atomic_store_n(&s->sleeping, 1, __ATOMIC_SEQ_CST);
+        while (s->running && __atomic_load_n(&s->sleeping, __ATOMIC_SEQ_CST) &&
+               available(s) > s->pool->watermark)
+            pthread_cond_wait(&s->cond, &s->mutex);
+        __atomic_store_n(&s->sleeping, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&s->mutex);
+    }
+
+    return NULL;
+}
+
+static size_t
+available(struct shard *s) {
+    return __atomic_load_n(&s->tail, __ATOMIC_SEQ_CST) -
+        __atomic_load_n(&s->head, __ATOMIC_SEQ_CST);
+}
+
+/* Wake the producer of a shard if it's sleeping.
+ */
+static void
+wake(struct shard *s) {
+    if (!__atomic_load_n(&s->sleeping, __ATOMIC_SEQ_CST) ||
+        !__atomic_exchange_n(&s->sleeping, 0, __ATOMIC_SEQ_CST))
+        return;
+
+    pthread_mutex_lock(&s->mutex);
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+    __atomic_fetch_add(&s->wakeups, 1, __ATOMIC_RELAXED);
+}
+
+/* Stop producers of the first nshards shards and free the pool.
+ */
+static void
+stop_shards(struct pool *p, size_t nshards) {
+    for (size_t i = 0; i < nshards; i++) {
+        struct shard *s = &p->shards[i];
+        pthread_mutex_lock(&s->mutex);
+        __atomic_store_n(&s->running, 0, __ATOMIC_RELAXED);
+        pthread_cond_signal(&s->cond);
+        pthread_mutex_unlock(&s->mutex);
+        pthread_join(s->thread, NULL);
+        pthread_cond_destroy(&s->cond);
+        pthread_mutex_destroy(&s->mutex);
+        free(s->words);
+    }
+    free(p->shards);
+    free(p);
+}
@@ -0,0 +1,16 @@
+#ifndef POOL_H
+    #define POOL_H
+
+/** @file
+ * Pool of random numbers generated in the background, see de_pool_start().
+ */
+
+/** Take a random number from the pool of the calling thread.
+ * @param word Used to store a value of rand().
+ * @return Non-zero if a number was taken, zero if the pool isn't started or
+ * it's empty.
+ */
+int
+pool_take(int *word);
+
+#endif // POOL_H
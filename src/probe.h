@@ -0,0 +1,40 @@
+#ifndef PROBE_H
+    #define PROBE_H
+
+/** @file
+ * Static probes for tracing the library with perf or bpftrace, see
+ * tools/probes/.
+ *
+ * Probes are compiled in if DE_PROBES is defined, which the Makefile does
+ * when sys/sdt.h is installed. A probe is a single nop until a tracer
+ * attaches to it, otherwise probes are left out altogether. Stages fire a
+ * start and a done probe, the tracer measures the time between them.
+ */
+
+/** @enum probe_roll How a dice term was rolled, argument of roll__done.
+ */
+enum probe_roll {
+    // Count of successes was sampled, no dices were rolled.
+    PROBE_ROLL_SAMPLED,
+    // Rolled with many threads, see parallel_roll().
+    PROBE_ROLL_PARALLEL,
+    // Rolled one at a time and sorted by counting faces.
+    PROBE_ROLL_COUNTED,
+    // Rolled one at a time and sorted with qsort().
+    PROBE_ROLL_QSORT
+};
+
+#ifdef DE_PROBES
+    #include <sys/sdt.h>
+    #define PROBE(name) DTRACE_PROBE(diceexpr, name)
+    #define PROBE1(name, a) DTRACE_PROBE1(diceexpr, name, a)
+    #define PROBE2(name, a, b) DTRACE_PROBE2(diceexpr, name, a, b)
+    #define PROBE3(name, a, b, c) DTRACE_PROBE3(diceexpr, name, a, b, c)
+#else
+    #define PROBE(name) do { } while (0)
+    #define PROBE1(name, a) do { } while (0)
+    #define PROBE2(name, a, b) do { } while (0)
+    #define PROBE3(name, a, b, c) do { } while (0)
+#endif
+
+#endif // PROBE_H
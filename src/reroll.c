@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "str.h"
+#include "expr.h"
+#include "eval.h"
+#include "diceexpr.h"
+#include "numflow.h"
+
+struct de_roll {
+    const struct de_expr *expr;
+    // Rolled expression of each term.
+    str **terms;
+    // Value of each term, negated if the term is subtracted.
+    int_least64_t *values;
+    // Value of the whole expression.
+    int_least64_t value;
+    // Sum of absolute values of terms. If it fits to int_least64_t, no partial
+    // sum of terms can overflow either, and a term can be changed without
+    // summing all terms again.
+    int_least64_t abs_sum;
+    int abs_sum_overflow;
+};
+
+static enum parse_error sum_terms(const de_roll *r,
+                                  size_t changed,
+                                  int_least64_t changed_value,
+                                  int_least64_t *sum);
+static void sum_abs_terms(de_roll *r);
+static int_least64_t abs_value(int_least64_t value);
+
+size_t
+de_nterms(const de_expr *e) {
+    assert(e != NULL);
+
+    return e->nterms;
+}
+
+enum parse_error
+de_roll_new(const de_expr *e, de_roll **roll) {
+    assert(e != NULL);
+    assert(*roll == NULL);
+
+    enum parse_error retval = de_check_limits(e, NULL);
+    if (retval != 0)
+        return retval;
+
+    de_roll *r = malloc(sizeof(*r));
+    if (r == NULL)
+        return DE_MEMORY;
+    r->expr = e;
+    r->terms = calloc(e->nterms, sizeof(*r->terms));
+    r->values = malloc(e->nterms * sizeof(*r->values));
+    if (r->terms == NULL || r->values == NULL) {
+        de_roll_free(r);
+        return DE_MEMORY;
+    }
+
+    r->value = 0;
+    for (size_t i = 0; i < e->nterms; i++) {
+        if ((r->terms[i] = str_new(NULL)) == NULL) {
+            retval = DE_MEMORY;
+            goto error;
+        }
+        retval = eval_term(e, &e->terms[i], r->terms[i], &r->values[i]);
+        if (retval != 0)
+            goto error;
+
+        enum flow_type overflow;
+        NF_PLUS(r->value, r->values[i], INT_LEAST64, overflow);
+        if (overflow != 0) {
+            retval = DE_OVERFLOW;
+            goto error;
+        }
+        r->value += r->values[i];
+    }
+    sum_abs_terms(r);
+
+    *roll = r;
+
+    return 0;
+
+    error:
+        de_roll_free(r);
+
+    return retval;
+}
+
+void
+de_roll_free(de_roll *roll) {
+    if (roll == NULL)
+        return;
+
+    if (roll->terms != NULL) {
+        for (size_t i = 0; i < roll->expr->nterms; i++) {
+            if (roll->terms[i] != NULL)
+                str_free(roll->terms[i]);
+        }
+    }
+    free(roll->terms);
+    free(roll->values);
+    free(roll);
+}
+
+enum parse_error
+de_reroll(de_roll *roll, size_t term) {
+    assert(roll != NULL);
+    assert(term < roll->expr->nterms);
+
+    str *rolled_term = str_new(NULL);
+    if (rolled_term == NULL)
+        return DE_MEMORY;
+    int_least64_t new_value;
+    enum parse_error retval = eval_term(roll->expr, &roll->expr->terms[term],
+                                        rolled_term, &new_value);
+    if (retval != 0)
+        goto error;
+
+    const int_least64_t old_value = roll->values[term];
+    int fast = 0;
+    if (!roll->abs_sum_overflow) {
+        // Can't overflow, because absolute value of old_value is part of
+        // abs_sum.
+        int_least64_t abs_sum = roll->abs_sum - abs_value(old_value);
+        enum flow_type overflow;
+        NF_PLUS(abs_sum, abs_value(new_value), INT_LEAST64, overflow);
+        if (overflow == 0) {
+            roll->abs_sum = abs_sum + abs_value(new_value);
+            // Absolute value of every partial sum is at most abs_sum.
+            roll->value = roll->value - old_value + new_value;
+            fast = 1;
+        }
+    }
+    if (!fast) {
+        int_least64_t value;
+        if ((retval = sum_terms(roll, term, new_value, &value)) != 0)
+            goto error;
+        roll->value = value;
+    }
+
+    str_free(roll->terms[term]);
+    roll->terms[term] = rolled_term;
+    roll->values[term] = new_value;
+    if (!fast)
+        sum_abs_terms(roll);
+
+    return 0;
+
+    error:
+        str_free(rolled_term);
+
+    return retval;
+}
+
+int_least64_t
+de_roll_value(const de_roll *roll) {
+    assert(roll != NULL);
+
+    return roll->value;
+}
+
+const char*
+de_roll_term_expression(const de_roll *roll, size_t term) {
+    assert(roll != NULL);
+    assert(term < roll->expr->nterms);
+
+    return roll->terms[term]->str;
+}
+
+enum parse_error
+de_roll_expression(const de_roll *roll, char **rolled_expression) {
+    assert(roll != NULL);
+    assert(*rolled_expression == NULL);
+
+    size_t len = 0;
+    for (size_t i = 0; i < roll->expr->nterms; i++)
+        len += roll->terms[i]->len;
+
+    char *chars = malloc(len + 1);
+    if (chars == NULL)
+        return DE_MEMORY;
+    char *end = chars;
+    for (size_t i = 0; i < roll->expr->nterms; i++) {
+        memcpy(end, roll->terms[i]->str, roll->terms[i]->len);
+        end += roll->terms[i]->len;
+    }
+    *end = '\0';
+    *rolled_expression = chars;
+
+    return 0;
+}
+
+/* Sum terms from left to right like de_eval() does.
+ * @param r Can't be NULL.
+ * @param changed Index of a term to use changed_value for.
+ * @param changed_value Value of the term at changed.
+ * @param sum Used to store the sum.
+ * @return Zero on success, DE_OVERFLOW if a partial sum overflows.
+ */
+static enum parse_error
+sum_terms(const de_roll *r,
+          size_t changed,
+          int_least64_t changed_value,
+          int_least64_t *sum) {
+    int_least64_t result = 0;
+    for (size_t i = 0; i < r->expr->nterms; i++) {
+        int_least64_t value = i == changed ? changed_value : r->values[i];
+        enum flow_type overflow;
+        NF_PLUS(result, value, INT_LEAST64, overflow);
+        if (overflow != 0)
+            return DE_OVERFLOW;
+        result += value;
+    }
+    *sum = result;
+
+    return 0;
+}
+
+/* Set abs_sum and abs_sum_overflow of r.
+ * @param r Can't be NULL.
+ * @return void
+ */
+static void
+sum_abs_terms(de_roll *r) {
+    r->abs_sum = 0;
+    r->abs_sum_overflow = 0;
+    for (size_t i = 0; i < r->expr->nterms; i++) {
+        int_least64_t value = abs_value(r->values[i]);
+        enum flow_type overflow;
+        NF_PLUS(r->abs_sum, value, INT_LEAST64, overflow);
+        if (overflow != 0) {
+            r->abs_sum_overflow = 1;
+            return;
+        }
+        r->abs_sum += value;
+    }
+}
+
+/* Absolute value of a term.
+ * Values of terms are never INT_LEAST64_MIN, so this can't overflow.
+ */
+static int_least64_t
+abs_value(int_least64_t value) {
+    return value < 0 ? -value : value;
+}
@@ -0,0 +1,366 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <inttypes.h>
+#include "clock.h"
+#include "str.h"
+#include "expr.h"
+#include "eval.h"
+#include "diceexpr.h"
+#include "numflow.h"
+
+// Units of work done between checking the time.
+#define CLOCK_INTERVAL 4096
+
+/* Phases of evaluating a term. Rolls are sorted with heapsort, because
+ * unlike qsort() it can be stopped and continued.
+ */
+enum phase {
+    PHASE_START,
+    PHASE_ROLL,
+    PHASE_HEAPIFY,
+    PHASE_SORT,
+    PHASE_SUM
+};
+
+/* Loops over rolls stored in one of the widths of eval_roll_width(), see
+ * HEAP_LOOPS.
+ */
+struct heap_loops {
+    // Roll dices of t to rolls from begin to end.
+    enum parse_error (*roll)(const struct term *t,
+                             void *rolls,
+                             int_least64_t begin,
+                             int_least64_t end);
+    // Restore max-heap order of rolls[0..n) below root.
+    void (*sift_down)(void *rolls, int_least64_t root, int_least64_t n);
+    // Move the largest roll of the heap rolls[0..n) after the heap.
+    void (*pop)(void *rolls, int_least64_t n);
+};
+
+struct de_eval_state {
+    const struct de_expr *expr;
+    str *rolled_expr;
+    int_least64_t value;
+    // Non-zero after an error.
+    enum parse_error error;
+    // Term being evaluated.
+    size_t term;
+    enum phase phase;
+    // Rolls of the term, in the width of eval_roll_width().
+    void *rolls;
+    size_t width;
+    // Progress in the phase.
+    int_least64_t i;
+    int_least64_t term_sum;
+};
+
+static enum parse_error step(de_eval_state *s,
+                             uint_least64_t units,
+                             uint_least64_t *done);
+static enum parse_error end_term(de_eval_state *s, int_least64_t term_value);
+static const struct heap_loops* heap_loops(size_t width);
+
+enum parse_error
+de_eval_start(const de_expr *e, de_eval_state **state) {
+    assert(e != NULL);
+    assert(*state == NULL);
+
+    enum parse_error retval = de_check_limits(e, NULL);
+    if (retval != 0)
+        return retval;
+
+    de_eval_state *s = malloc(sizeof(*s));
+    if (s == NULL)
+        return DE_MEMORY;
+    if ((s->rolled_expr = str_new(NULL)) == NULL) {
+        free(s);
+        return DE_MEMORY;
+    }
+    s->expr = e;
+    s->value = 0;
+    s->error = 0;
+    s->term = 0;
+    s->phase = PHASE_START;
+    s->rolls = NULL;
+    s->width = 0;
+    s->i = 0;
+    s->term_sum = 0;
+    *state = s;
+
+    return 0;
+}
+
+enum parse_error
+de_eval_continue(de_eval_state *state,
+                 const struct de_budget *budget,
+                 int_least64_t *value,
+                 char **rolled_expression) {
+    assert(state != NULL);
+    assert(*rolled_expression == NULL);
+
+    if (state->error != 0)
+        return state->error;
+
+    const uint_least64_t work = budget != NULL ? budget->work : 0;
+    const uint_least64_t nanoseconds = budget != NULL ?
+        budget->nanoseconds : 0;
+    const uint_least64_t start = nanoseconds != 0 ? clock_now() : 0;
+    uint_least64_t worked = 0;
+    while (state->term < state->expr->nterms) {
+        uint_least64_t units = UINT_LEAST64_MAX;
+        if (work != 0) {
+            if (worked >= work)
+                return DE_IN_PROGRESS;
+            units = work - worked;
+        }
+        if (nanoseconds != 0 && units > CLOCK_INTERVAL)
+            units = CLOCK_INTERVAL;
+
+        uint_least64_t done = 0;
+        enum parse_error retval = step(state, units, &done);
+        if (retval != 0) {
+            state->error = retval;
+            return retval;
+        }
+        worked += done;
+        // Checked after every step, so each call makes progress.
+        if (nanoseconds != 0 && state->term < state->expr->nterms &&
+            clock_now() - start >= nanoseconds)
+            return DE_IN_PROGRESS;
+    }
+
+    if (str_copy_to_chars(state->rolled_expr, rolled_expression) != 0) {
+        state->error = DE_MEMORY;
+        return DE_MEMORY;
+    }
+    *value = state->value;
+
+    return 0;
+}
+
+void
+de_eval_free(de_eval_state *state) {
+    if (state == NULL)
+        return;
+
+    str_free(state->rolled_expr);
+    free(state->rolls);
+    free(state);
+}
+
+/* Do at most units of work on the current term.
+ * @param s Can't be NULL.
+ * @param units Must be > 0.
+ * @param done Used to store units of work done.
+ * @return Zero on success, enum parse_error otherwise.
+ */
+static enum parse_error
+step(de_eval_state *s, uint_least64_t units, uint_least64_t *done) {
+    const struct term *t = &s->expr->terms[s->term];
+    uint_least64_t n = 0;
+
+    switch (s->phase) {
+    case PHASE_START: {
+        // Every term is one unit of work, and so is each of its signs.
+        const size_t len = s->rolled_expr->len;
+        if (eval_signs(s->expr, t, s->rolled_expr) != 0)
+            return DE_MEMORY;
+        *done = 1 + (s->rolled_expr->len - len);
+        if (t->type == TERM_CONSTANT) {
+            if (str_append_int(s->rolled_expr, t->constant) != 0)
+                return DE_MEMORY;
+            return end_term(s, t->constant);
+        }
+        if (eval_samples_count(t)) {
+            int_least64_t count;
+            if (eval_count(s->rolled_expr, t, NULL, 0, &count) != 0)
+                return DE_MEMORY;
+            return end_term(s, count);
+        }
+        // Rolled at once with many threads, as de_eval() rolls it.
+        int rolled;
+        int_least64_t sum;
+        enum parse_error retval = eval_roll_parallel(s->rolled_expr, t, &sum,
+                                                     &rolled);
+        if (retval != 0)
+            return retval;
+        if (rolled) {
+            *done += t->nrolls;
+            return end_term(s, sum);
+        }
+        // Rolls are stored in the narrowest type that fits, as de_eval()
+        // stores them.
+        s->width = eval_roll_width(eval_max_roll(t));
+        if ((s->rolls = malloc(t->nrolls * s->width)) == NULL)
+            return DE_MEMORY;
+        s->i = 0;
+        s->phase = PHASE_ROLL;
+        return 0;
+    }
+    case PHASE_ROLL: {
+        n = (uint_least64_t) (t->nrolls - s->i) < units ?
+            (uint_least64_t) (t->nrolls - s->i) : units;
+        enum parse_error retval = heap_loops(s->width)->roll(t, s->rolls,
+                                                             s->i, s->i + n);
+        if (retval != 0)
+            return retval;
+        s->i += n;
+        if (s->i == t->nrolls) {
+            s->i = t->nrolls / 2;
+            s->phase = PHASE_HEAPIFY;
+        }
+        break;
+    }
+    case PHASE_HEAPIFY:
+        for (; s->i > 0 && n < units; n++)
+            heap_loops(s->width)->sift_down(s->rolls, --s->i, t->nrolls);
+        if (s->i == 0) {
+            s->i = t->nrolls;
+            s->phase = PHASE_SORT;
+        }
+        break;
+    case PHASE_SORT:
+        // Move the largest roll of the heap after the heap.
+        for (; s->i > 1 && n < units; n++)
+            heap_loops(s->width)->pop(s->rolls, s->i--);
+        if (s->i <= 1 && (t->count != COUNT_NONE ||
+                          eval_style(t->nrolls) != DE_OUTPUT_FULL)) {
+            // Counted and summarized dices are written at once.
+            int_least64_t sum;
+            enum parse_error retval = t->count != COUNT_NONE ?
+                eval_count(s->rolled_expr, t, s->rolls, s->width, &sum) :
+                eval_summary(s->rolled_expr, s->rolls, s->width, t, &sum);
+            if (retval != 0)
+                return retval;
+            free(s->rolls);
+            s->rolls = NULL;
+            *done = n;
+            return end_term(s, sum);
+        }
+        if (s->i <= 1) {
+            if (str_append_char(s->rolled_expr, '(') != 0)
+                return DE_MEMORY;
+            s->i = t->small;
+            s->term_sum = 0;
+            s->phase = PHASE_SUM;
+        }
+        break;
+    case PHASE_SUM: {
+        int_least64_t end = t->nrolls - t->large;
+        if ((uint_least64_t) (end - s->i) < units)
+            n = end - s->i;
+        else
+            n = units;
+        enum parse_error retval = eval_rolls(s->rolled_expr, s->rolls,
+                                             s->width, s->i, s->i + n,
+                                             t->small, &s->term_sum);
+        if (retval != 0)
+            return retval;
+        s->i += n;
+        if (s->i == end) {
+            if (str_append_char(s->rolled_expr, ')') != 0)
+                return DE_MEMORY;
+            free(s->rolls);
+            s->rolls = NULL;
+            return end_term(s, s->term_sum);
+        }
+        break;
+    }
+    }
+    *done = n;
+
+    return 0;
+}
+
+/* Add value of the current term and move to the next term.
+ * @param s Can't be NULL.
+ * @param term_value Value of the term before its sign.
+ * @return Zero on success, DE_OVERFLOW on error.
+ */
+static enum parse_error
+end_term(de_eval_state *s, int_least64_t term_value) {
+    const struct term *t = &s->expr->terms[s->term];
+    // Values of terms are never negative, so negating can't overflow.
+    if (t->negative)
+        term_value = -term_value;
+
+    enum flow_type overflow;
+    NF_PLUS(s->value, term_value, INT_LEAST64, overflow);
+    if (overflow != 0)
+        return DE_OVERFLOW;
+    s->value += term_value;
+
+    s->term++;
+    s->phase = PHASE_START;
+
+    return 0;
+}
+
+/* Define the loops of struct heap_loops for rolls of type, with names ending
+ * in suffix.
+ */
+#define HEAP_LOOPS(suffix, type) \
+    static enum parse_error \
+    roll_##suffix(const struct term *t, \
+                  void *rolls, \
+                  int_least64_t begin, \
+                  int_least64_t end) { \
+        type *r = rolls; \
+        for (int_least64_t i = begin; i < end; i++) { \
+            int_least64_t roll; \
+            enum parse_error retval = eval_roll_die(t, &roll); \
+            if (retval != 0) \
+                return retval; \
+            r[i] = roll; \
+        } \
+    \
+        return 0; \
+    } \
+    \
+    static void \
+    sift_down_##suffix(void *rolls, int_least64_t root, int_least64_t n) { \
+        type *r = rolls; \
+        const type value = r[root]; \
+        for (;;) { \
+            int_least64_t child = 2 * root + 1; \
+            if (child >= n) \
+                break; \
+            if (child + 1 < n && r[child + 1] > r[child]) \
+                child++; \
+            if (r[child] <= value) \
+                break; \
+            r[root] = r[child]; \
+            root = child; \
+        } \
+        r[root] = value; \
+    } \
+    \
+    static void \
+    pop_##suffix(void *rolls, int_least64_t n) { \
+        type *r = rolls; \
+        const type largest = r[0]; \
+        r[0] = r[n - 1]; \
+        r[n - 1] = largest; \
+        sift_down_##suffix(rolls, 0, n - 1); \
+    } \
+    \
+    static const struct heap_loops loops_##suffix = { \
+        roll_##suffix, sift_down_##suffix, pop_##suffix \
+    };
+
+HEAP_LOOPS(u8, uint8_t)
+HEAP_LOOPS(u16, uint16_t)
+HEAP_LOOPS(u32, uint32_t)
+HEAP_LOOPS(i64, int_least64_t)
+
+/* Loops over rolls of width bytes.
+ */
+static const struct heap_loops*
+heap_loops(size_t width) {
+    switch (width) {
+    case sizeof(uint8_t):  return &loops_u8;
+    case sizeof(uint16_t): return &loops_u16;
+    case sizeof(uint32_t): return &loops_u32;
+    default:               return &loops_i64;
+    }
+}
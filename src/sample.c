@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+#include "sample.h"
+#include "pool.h"
+#include "audit.h"
+
+/* Mean below which successes are counted by inversion, which takes time
+ * linear in the mean. Above it, BTRD is used.
+ */
+#define INVERSION_MEAN 10
+// Largest distance from mode for which BTRD's density ratio is multiplied.
+#define RECURSION_DISTANCE 15
+
+static int_least64_t inversion(int_least64_t n, double p);
+static int_least64_t btrd(int_least64_t n, double p);
+static double stirling_correction(int_least64_t k);
+
+int_least64_t
+sample_binomial(int_least64_t n, double p) {
+    assert(n >= 0);
+    assert(p >= 0 && p <= 1);
+
+    if (n == 0 || p == 0)
+        return 0;
+    if (p == 1)
+        return n;
+    // Both algorithms expect p <= 0.5, failures are counted otherwise.
+    if (p > 0.5)
+        return n - sample_binomial(n, 1 - p);
+
+    return n * p < INVERSION_MEAN ? inversion(n, p) : btrd(n, p);
+}
+
+int_least64_t
+sample_geometric(double p, int_least64_t max) {
+    assert(p >= 0 && p <= 1);
+    assert(max >= 0);
+
+    if (p == 0)
+        return 0;
+    if (p == 1)
+        return max;
+    // P(k >= j) = p^j, so invert it.
+    double k = floor(log(sample_uniform()) / log(p));
+
+    return k < max ? (int_least64_t) k : max;
+}
+
+double
+sample_uniform(void) {
+    int word;
+    if (!audit_take(&word) && !pool_take(&word))
+        word = rand();
+
+    return (word + 0.5) / ((double) RAND_MAX + 1);
+}
+
+/* Sample by walking the probabilities from zero successes up.
+ * @param p <= 0.5.
+ */
+static int_least64_t
+inversion(int_least64_t n, double p) {
+    const double s = p / (1 - p);
+    const double a = (n + 1) * s;
+    for (;;) {
+        double probability = exp(n * log1p(-p));
+        double u = sample_uniform();
+        int_least64_t k = 0;
+        while (u > probability) {
+            u -= probability;
+            if (++k > n)
+                break;
+            probability *= a / k - s;
+        }
+        // Rounding may leave some u after the last k, try again then.
+        if (k <= n)
+            return k;
+    }
+}
+
+/* Sample with transformed rejection with decomposition, see W. Hörmann,
+ * The generation of binomial random variates, Journal of Statistical
+ * Computation and Simulation 46, 1993.
+ * @param p <= 0.5 and n * p >= INVERSION_MEAN.
+ */
+static int_least64_t
+btrd(int_least64_t n, double p) {
+    const double q = 1 - p;
+    const double m = floor((n + 1) * p);
+    const double r = p / q;
+    const double nr = (n + 1) * r;
+    const double npq = n * p * q;
+    const double sqrt_npq = sqrt(npq);
+    const double b = 1.15 + 2.53 * sqrt_npq;
+    const double a = -0.0873 + 0.0248 * b + 0.01 * p;
+    const double c = n * p + 0.5;
+    const double alpha = (2.83 + 5.1 / b) * sqrt_npq;
+    const double v_r = 0.92 - 4.2 / b;
+    const double u_rv_r = 0.86 * v_r;
+
+    for (;;) {
+        double u, v = sample_uniform();
+        // Most samples come from the triangle in the middle.
+        if (v <= u_rv_r) {
+            u = v / v_r - 0.43;
+            return floor((2 * a / (0.5 - fabs(u)) + b) * u + c);
+        }
+        if (v >= v_r)
+            u = sample_uniform() - 0.5;
+        else {
+            u = v / v_r - 0.93;
+            u = (u < 0 ? -0.5 : 0.5) - u;
+            v = sample_uniform() * v_r;
+        }
+
+        const double us = 0.5 - fabs(u);
+        const double k = floor((2 * a / us + b) * u + c);
+        if (k < 0 || k > n)
+            continue;
+        v = v * alpha / (a / (us * us) + b);
+        const double km = fabs(k - m);
+
+        if (km <= RECURSION_DISTANCE) {
+            // Multiply ratios of densities from the mode to k.
+            double f = 1;
+            if (m < k) {
+                for (double i = m + 1; i <= k; i++)
+                    f *= nr / i - r;
+            }
+            else if (m > k) {
+                for (double i = k + 1; i <= m; i++)
+                    v *= nr / i - r;
+            }
+            if (v <= f)
+                return k;
+            continue;
+        }
+
+        // Squeeze with bounds of the logarithm of the density.
+        v = log(v);
+        const double rho =
+            km / npq * (((km / 3 + 0.625) * km + 1.0 / 6) / npq + 0.5);
+        const double t = -km * km / (2 * npq);
+        if (v < t - rho)
+            return k;
+        if (v > t + rho)
+            continue;
+
+        const double nm = n - m + 1;
+        const double h = (m + 0.5) * log((m + 1) / (r * nm)) +
+            stirling_correction((int_least64_t) m) +
+        stirling_correction(n - (int_least64_t) m);
+        const double nk = n - k + 1;
+        if (v <= h + (n + 1) * log(nm / nk) +
+                 (k + 0.5) * log(nk * r / (k + 1)) -
+                 stirling_correction((int_least64_t) k) -
+                 stirling_correction(n - (int_least64_t) k))
+            return k;
+    }
+}
+
+/* Error of Stirling's approximation of log(k!).
+ */
+static double
+stirling_correction(int_least64_t k) {
+    static const double table[] = {
+        0.08106146679532726, 0.04134069595540929, 0.02767792568499834,
+        0.02079067210376509, 0.01664469118982119, 0.01387612882307075,
+        0.01189670994589177, 0.01041126526197209, 0.009255462182712733,
+        0.008330563433362871
+    };
+    if (k < (int_least64_t) (sizeof(table) / sizeof(table[0])))
+        return table[k];
+
+    const double k1 = k + 1;
+    const double k2 = k1 * k1;
+
+    return (1.0 / 12 - (1.0 / 360 - 1.0 / 1260 / k2) / k2) / k1;
+}
@@ -0,0 +1,34 @@
+#ifndef SAMPLE_H
+    #define SAMPLE_H
+#include <stdint.h>
+
+/** @file
+ * Sampling from distributions of dices. Random numbers come from the same
+ * source as de_roll_die()'s, so srand() makes the samples repeatable.
+ */
+
+/** Number of successes in n trials with probability p of success.
+ * Takes constant expected time.
+ * @param n Number of trials, >= 0.
+ * @param p Probability of success, between 0 and 1, inclusive.
+ * @return Number of successes between 0 and n, inclusive.
+ */
+int_least64_t
+sample_binomial(int_least64_t n, double p);
+
+/** Number of successes before the first failure, with probability p of
+ * success, but at most max.
+ * @param p Probability of success, between 0 and 1, inclusive.
+ * @param max Largest number to return, >= 0.
+ * @return Number of successes between 0 and max, inclusive.
+ */
+int_least64_t
+sample_geometric(double p, int_least64_t max);
+
+/** Uniform random number.
+ * @return Number between 0 and 1, exclusive.
+ */
+double
+sample_uniform(void);
+
+#endif // SAMPLE_H
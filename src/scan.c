@@ -0,0 +1,86 @@
+#include <assert.h>
+#include <string.h>
+#include "scan.h"
+
+// Digits in INT64_MAX, the most digits that always fit in uint64_t. UINT64_MAX
+// has 20, but not every number of 20 digits fits.
+#define MAX_DIGITS 19
+#define ONES 0x0101010101010101
+// Characters in the longest LEB128 integer of 64 bits.
+#define MAX_VARINT 10
+
+static uint_fast64_t digits8(const char *digits);
+
+int
+scan_int(const char *digits, size_t len, int_least64_t *value) {
+    assert(digits != NULL);
+    assert(len > 0);
+
+    // Leading zeros can't overflow.
+    while (len > 1 && *digits == '0') {
+        digits++;
+        len--;
+    }
+    if (len > MAX_DIGITS)
+        return 1;
+
+    uint_fast64_t n = 0;
+    for (; len >= 8; digits += 8, len -= 8)
+        n = n * 100000000 + digits8(digits);
+    for (; len > 0; digits++, len--)
+        n = n * 10 + (*digits - '0');
+    if (n > INT_LEAST64_MAX)
+        return 1;
+    *value = n;
+
+    return 0;
+}
+
+int
+scan_varint(const char *chars,
+            size_t size,
+            size_t *offset,
+            uint_least64_t *value) {
+    assert(chars != NULL);
+    assert(offset != NULL);
+
+    uint_least64_t v = 0;
+    size_t o = *offset;
+    for (int shift = 0; shift < 7 * MAX_VARINT; shift += 7) {
+        if (o >= size)
+            return 1;
+        const unsigned char byte = chars[o++];
+        v |= (uint_least64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *offset = o;
+            *value = v;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Convert eight digits to an integer.
+ * On little-endian machines the digits are loaded to one word, and pairs of
+ * digits, pairs of those and so on are combined with three multiplications.
+ */
+static uint_fast64_t
+digits8(const char *digits) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t word;
+    memcpy(&word, digits, sizeof(word));
+    word -= '0' * ONES;
+    word = (word * 10 + (word >> 8)) & 0x00ff00ff00ff00ff;
+    word = (word * 100 + (word >> 16)) & 0x0000ffff0000ffff;
+    word = (word * 10000 + (word >> 32)) & 0x00000000ffffffff;
+
+    return word;
+#else
+    uint_fast64_t n = 0;
+    for (int i = 0; i < 8; i++)
+        n = n * 10 + (digits[i] - '0');
+
+    return n;
+#endif
+}
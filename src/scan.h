@@ -0,0 +1,37 @@
+#ifndef SCAN_H
+    #define SCAN_H
+#include <stddef.h>
+#include <stdint.h>
+
+/** @file
+ * Scanning integers of dice expressions and binary logs.
+ */
+
+/** Convert decimal digits to an integer.
+ * Digits are converted eight at a time where possible, and overflow is
+ * checked once after converting.
+ * @param digits len characters '0'-'9', not necessarily null terminated.
+ * Can't be NULL.
+ * @param len Number of digits, > 0.
+ * @param value Used to store the integer.
+ * @return Zero on success, non-zero if the integer doesn't fit in
+ * int_least64_t.
+ */
+int
+scan_int(const char *digits, size_t len, int_least64_t *value);
+
+/** Read an unsigned LEB128 integer, see str_append_varint().
+ * @param chars Can't be NULL.
+ * @param size Number of characters.
+ * @param offset Offset of the integer, advanced past it on success.
+ * @param value Used to store the integer.
+ * @return Zero on success, non-zero if the integer is truncated or longer
+ * than 64 bits.
+ */
+int
+scan_varint(const char *chars,
+            size_t size,
+            size_t *offset,
+            uint_least64_t *value);
+
+#endif // SCAN_H
@@ -0,0 +1,458 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <assert.h>
+#include "audit.h"
+#include "str.h"
+#include "scan.h"
+#include "expr.h"
+#include "diceexpr.h"
+
+#define MAGIC "DESM"
+#define MAGIC_LEN 4
+#define VERSION 1
+#define DEFAULT_TABLE_SIZE 256
+#define FNV_OFFSET UINT64_C(14695981039346656037)
+#define FNV_PRIME UINT64_C(1099511628211)
+#define GOLDEN UINT64_C(0x9e3779b97f4a7c15)
+
+struct de_sim {
+    uint_least64_t fingerprint;
+    uint_least64_t seed;
+    uint_least64_t begin;
+    uint_least64_t end;
+    uint_least64_t nerrors;
+    // Mean of the values and sums of their differences from it to the
+    // second, third and fourth power.
+    double mean;
+    double m2;
+    double m3;
+    double m4;
+    // Values in ascending order.
+    struct de_sim_bin *bins;
+    size_t nbins;
+};
+
+// Open addressing hash table of values rolled, size is a power of two.
+struct table {
+    // Empty slots have zero count.
+    struct de_sim_bin *slots;
+    size_t size;
+    size_t nvalues;
+};
+
+static uint_least64_t fingerprint(const struct de_expr *e);
+static uint_least64_t hash_int(uint_least64_t hash, int_least64_t i);
+static int table_add(struct table *t, int_least64_t value);
+static int compare_bins(const void *a, const void *b);
+static void set_moments(de_sim *sim);
+static uint_least64_t ncounted(const de_sim *sim);
+static int append_fixed(str *s, uint_least64_t i);
+static int append_double(str *s, double d);
+static uint_least64_t read_fixed(const char *chars);
+static double read_double(const char *chars);
+
+enum parse_error
+de_sim_run(const de_expr *compiled_expression,
+           uint_least64_t seed,
+           uint_least64_t begin,
+           uint_least64_t end,
+           de_sim **sim) {
+    assert(compiled_expression != NULL);
+    assert(begin <= end);
+    assert(*sim == NULL);
+
+    enum parse_error retval = DE_MEMORY;
+    struct table t = { .size = DEFAULT_TABLE_SIZE };
+    str *rolled = str_new(NULL);
+    de_sim *s = calloc(1, sizeof(*s));
+    t.slots = calloc(t.size, sizeof(*t.slots));
+    if (rolled == NULL || s == NULL || t.slots == NULL)
+        goto free;
+    s->fingerprint = fingerprint(compiled_expression);
+    s->seed = seed;
+    s->begin = begin;
+    s->end = end;
+
+    for (uint_least64_t c = begin; c != end; c++) {
+        str_erase(rolled);
+        int_least64_t value;
+        enum parse_error error = audit_eval(compiled_expression, rolled, seed,
+                                            c, &value);
+        if (error == DE_MEMORY || (error == 0 && table_add(&t, value) != 0))
+            goto free;
+        if (error != 0)
+            s->nerrors++;
+    }
+
+    // Pack the values to the start of the table and sort them.
+    s->nbins = 0;
+    for (size_t i = 0; i < t.size; i++) {
+        if (t.slots[i].count > 0)
+            t.slots[s->nbins++] = t.slots[i];
+    }
+    qsort(t.slots, s->nbins, sizeof(*t.slots), compare_bins);
+    s->bins = t.slots;
+    t.slots = NULL;
+    set_moments(s);
+    *sim = s;
+    s = NULL;
+    retval = 0;
+
+    free:
+        free(t.slots);
+        de_sim_free(s);
+        if (rolled != NULL)
+            str_free(rolled);
+
+    return retval;
+}
+
+enum parse_error
+de_sim_merge(de_sim *sim, const de_sim *other) {
+    assert(sim != NULL);
+    assert(other != NULL);
+
+    if (sim->fingerprint != other->fingerprint || sim->seed != other->seed ||
+        (other->end != sim->begin && other->begin != sim->end))
+        return DE_MISMATCH;
+
+    struct de_sim_bin *bins = malloc((sim->nbins + other->nbins) *
+                                     sizeof(*bins) + 1);
+    if (bins == NULL)
+        return DE_MEMORY;
+    size_t i = 0, j = 0, n = 0;
+    while (i < sim->nbins || j < other->nbins) {
+        if (j == other->nbins ||
+            (i < sim->nbins && sim->bins[i].value < other->bins[j].value))
+            bins[n++] = sim->bins[i++];
+        else if (i == sim->nbins || other->bins[j].value < sim->bins[i].value)
+            bins[n++] = other->bins[j++];
+        else {
+            bins[n] = sim->bins[i++];
+            bins[n++].count += other->bins[j++].count;
+        }
+    }
+
+    // Moments of the union of two sets, see Pébay: "Formulas for robust,
+    // one-pass parallel computation of covariances and arbitrary-order
+    // statistical moments".
+    const double a = ncounted(sim), b = ncounted(other);
+    if (b > 0 && a == 0) {
+        sim->mean = other->mean;
+        sim->m2 = other->m2;
+        sim->m3 = other->m3;
+        sim->m4 = other->m4;
+    }
+    else if (b > 0) {
+        const double ab = a + b, d = other->mean - sim->mean, d2 = d * d;
+        sim->m4 += other->m4 + d2 * d2 * a * b * (a * a - a * b + b * b) /
+            (ab * ab * ab) + 6 * d2 * (a * a * other->m2 + b * b * sim->m2) /
+            (ab * ab) + 4 * d * (a * other->m3 - b * sim->m3) / ab;
+        sim->m3 += other->m3 + d2 * d * a * b * (a - b) / (ab * ab) +
+            3 * d * (a * other->m2 - b * sim->m2) / ab;
+        sim->m2 += other->m2 + d2 * a * b / ab;
+        sim->mean += d * b / ab;
+    }
+
+    free(sim->bins);
+    sim->bins = bins;
+    sim->nbins = n;
+    sim->nerrors += other->nerrors;
+    if (other->begin < sim->begin)
+        sim->begin = other->begin;
+    if (other->end > sim->end)
+        sim->end = other->end;
+
+    return 0;
+}
+
+void
+de_sim_stats(const de_sim *sim, struct de_sim_stats *stats) {
+    assert(sim != NULL);
+    assert(stats != NULL);
+
+    stats->fingerprint = sim->fingerprint;
+    stats->seed = sim->seed;
+    stats->begin = sim->begin;
+    stats->end = sim->end;
+    stats->nerrors = sim->nerrors;
+    stats->nbins = sim->nbins;
+    stats->min = sim->nbins > 0 ? sim->bins[0].value : 0;
+    stats->max = sim->nbins > 0 ? sim->bins[sim->nbins - 1].value : 0;
+    const double n = ncounted(sim);
+    stats->mean = sim->mean;
+    stats->variance = n > 0 ? sim->m2 / n : 0;
+    stats->skewness = sim->m2 > 0 ? sqrt(n) * sim->m3 / pow(sim->m2, 1.5) : 0;
+    stats->kurtosis = sim->m2 > 0 ? n * sim->m4 / (sim->m2 * sim->m2) - 3 : 0;
+}
+
+const struct de_sim_bin*
+de_sim_histogram(const de_sim *sim, size_t *nbins) {
+    assert(sim != NULL);
+    assert(nbins != NULL);
+
+    *nbins = sim->nbins;
+
+    return sim->bins;
+}
+
+enum parse_error
+de_sim_write(const de_sim *sim, de_sink sink, void *data) {
+    assert(sim != NULL);
+    assert(sink != NULL);
+
+    str *s = str_new(NULL);
+    if (s == NULL)
+        return DE_MEMORY;
+    str_set_sink(s, sink, data, DE_SINK_CHUNK);
+
+    int retval = str_append_chars(s, MAGIC);
+    if (retval == 0)
+        retval = str_append_char(s, VERSION);
+    if (retval == 0)
+        retval = append_fixed(s, sim->fingerprint);
+    if (retval == 0)
+        retval = append_fixed(s, sim->seed);
+    const uint_least64_t varints[] = {
+        sim->begin, sim->end, sim->nerrors, sim->nbins
+    };
+    for (size_t i = 0; i < sizeof(varints) / sizeof(varints[0]) &&
+         retval == 0; i++)
+        retval = str_append_varint(s, varints[i]);
+    const double moments[] = { sim->mean, sim->m2, sim->m3, sim->m4 };
+    for (size_t i = 0; i < sizeof(moments) / sizeof(moments[0]) &&
+         retval == 0; i++)
+        retval = append_double(s, moments[i]);
+    for (size_t i = 0; i < sim->nbins && retval == 0; i++) {
+        const uint_least64_t v = sim->bins[i].value;
+        if (i == 0)
+            retval = str_append_varint(s, v << 1 ^ -(v >> 63));
+        else
+            retval = str_append_varint(s, v - sim->bins[i - 1].value);
+        if (retval == 0)
+            retval = str_append_varint(s, sim->bins[i].count);
+    }
+    if (retval == 0)
+        retval = str_flush(s);
+    str_free(s);
+
+    return retval == 0 ? 0 : retval == EIO ? DE_OUTPUT : DE_MEMORY;
+}
+
+enum parse_error
+de_sim_read(const char *chars, size_t size, de_sim **sim) {
+    assert(chars != NULL);
+    assert(*sim == NULL);
+
+    // Magic, version, fingerprint and seed.
+    size_t offset = MAGIC_LEN + 1 + 2 * 8;
+    if (size < offset || memcmp(chars, MAGIC, MAGIC_LEN) != 0 ||
+        chars[MAGIC_LEN] != VERSION)
+        return DE_SYNTAX_ERROR;
+    de_sim *s = calloc(1, sizeof(*s));
+    if (s == NULL)
+        return DE_MEMORY;
+    s->fingerprint = read_fixed(chars + MAGIC_LEN + 1);
+    s->seed = read_fixed(chars + MAGIC_LEN + 1 + 8);
+
+    enum parse_error retval = DE_SYNTAX_ERROR;
+    uint_least64_t nbins;
+    if (scan_varint(chars, size, &offset, &s->begin) != 0 ||
+        scan_varint(chars, size, &offset, &s->end) != 0 ||
+        scan_varint(chars, size, &offset, &s->nerrors) != 0 ||
+        scan_varint(chars, size, &offset, &nbins) != 0 ||
+        s->begin > s->end || s->nerrors > s->end - s->begin ||
+        size - offset < 4 * 8)
+        goto free;
+    double *moments[] = { &s->mean, &s->m2, &s->m3, &s->m4 };
+    for (size_t i = 0; i < sizeof(moments) / sizeof(moments[0]); i++) {
+        *moments[i] = read_double(chars + offset);
+        offset += 8;
+    }
+
+    // A bin takes two characters at least.
+    if (nbins > (size - offset) / 2)
+        goto free;
+    if ((s->bins = malloc(nbins * sizeof(*s->bins) + 1)) == NULL) {
+        retval = DE_MEMORY;
+        goto free;
+    }
+    uint_least64_t remaining = s->end - s->begin - s->nerrors;
+    for (; s->nbins < nbins; s->nbins++) {
+        uint_least64_t v;
+        struct de_sim_bin *bin = &s->bins[s->nbins];
+        if (scan_varint(chars, size, &offset, &v) != 0 ||
+            scan_varint(chars, size, &offset, &bin->count) != 0 ||
+            bin->count == 0 || bin->count > remaining)
+            goto free;
+        remaining -= bin->count;
+        if (s->nbins == 0)
+            bin->value = (int_least64_t) (v >> 1 ^ -(v & 1));
+        else {
+            const int_least64_t previous = s->bins[s->nbins - 1].value;
+            if (v == 0 || v > (uint_least64_t) INT_LEAST64_MAX - previous)
+                goto free;
+            bin->value = (int_least64_t) ((uint_least64_t) previous + v);
+        }
+    }
+    if (remaining != 0 || offset != size)
+        goto free;
+    *sim = s;
+    s = NULL;
+    retval = 0;
+
+    free:
+        de_sim_free(s);
+
+    return retval;
+}
+
+void
+de_sim_free(de_sim *sim) {
+    if (sim == NULL)
+        return;
+
+    free(sim->bins);
+    free(sim);
+}
+
+/* Hash of the terms of an expression, ignoring how they are written.
+ */
+static uint_least64_t
+fingerprint(const struct de_expr *e) {
+    uint_least64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < e->nterms; i++) {
+        const struct term *t = &e->terms[i];
+        const int_least64_t fields[] = {
+            t->type, t->negative, t->constant, t->nrolls, t->dice, t->small,
+            t->large, t->reroll, t->explode, t->count, t->threshold
+        };
+        for (size_t j = 0; j < sizeof(fields) / sizeof(fields[0]); j++)
+            hash = hash_int(hash, fields[j]);
+    }
+
+    return hash;
+}
+
+/* FNV-1a of the bytes of an integer, lowest first.
+ */
+static uint_least64_t
+hash_int(uint_least64_t hash, int_least64_t i) {
+    const uint_least64_t u = i;
+    for (int j = 0; j < 8; j++)
+        hash = (hash ^ (u >> 8 * j & 0xff)) * FNV_PRIME;
+
+    return hash;
+}
+
+/* Count a value, growing the table when it's half full.
+ * @return Zero on success, non-zero if memory can't be allocated.
+ */
+static int
+table_add(struct table *t, int_least64_t value) {
+    if (2 * (t->nvalues + 1) > t->size) {
+        struct de_sim_bin *slots = calloc(2 * t->size, sizeof(*slots));
+        if (slots == NULL)
+            return -1;
+        struct table grown = { slots, 2 * t->size, 0 };
+        for (size_t i = 0; i < t->size; i++) {
+            if (t->slots[i].count == 0)
+                continue;
+            size_t j = ((uint_least64_t) t->slots[i].value * GOLDEN >> 32) &
+                (grown.size - 1);
+            while (slots[j].count > 0)
+                j = (j + 1) & (grown.size - 1);
+            slots[j] = t->slots[i];
+        }
+        grown.nvalues = t->nvalues;
+        free(t->slots);
+        *t = grown;
+    }
+
+    size_t i = ((uint_least64_t) value * GOLDEN >> 32) & (t->size - 1);
+    while (t->slots[i].count > 0 && t->slots[i].value != value)
+        i = (i + 1) & (t->size - 1);
+    if (t->slots[i].count++ == 0) {
+        t->slots[i].value = value;
+        t->nvalues++;
+    }
+
+    return 0;
+}
+
+static int
+compare_bins(const void *a, const void *b) {
+    const int_least64_t x = ((const struct de_sim_bin*) a)->value,
+        y = ((const struct de_sim_bin*) b)->value;
+
+    return (x > y) - (x < y);
+}
+
+/* Compute moments of a simulation from its histogram.
+ */
+static void
+set_moments(de_sim *sim) {
+    const double n = ncounted(sim);
+    sim->mean = sim->m2 = sim->m3 = sim->m4 = 0;
+    if (n == 0)
+        return;
+
+    for (size_t i = 0; i < sim->nbins; i++)
+        sim->mean += (double) sim->bins[i].value * sim->bins[i].count;
+    sim->mean /= n;
+    for (size_t i = 0; i < sim->nbins; i++) {
+        const double d = sim->bins[i].value - sim->mean, d2 = d * d,
+            c = sim->bins[i].count;
+        sim->m2 += c * d2;
+        sim->m3 += c * d2 * d;
+        sim->m4 += c * d2 * d2;
+    }
+}
+
+/* Number of calls in the histogram.
+ */
+static uint_least64_t
+ncounted(const de_sim *sim) {
+    return sim->end - sim->begin - sim->nerrors;
+}
+
+/* Append an 8-byte little-endian integer.
+ */
+static int
+append_fixed(str *s, uint_least64_t i) {
+    for (int j = 0; j < 8; j++) {
+        int retval = str_append_char(s, i >> 8 * j & 0xff);
+        if (retval != 0)
+            return retval;
+    }
+
+    return 0;
+}
+
+static int
+append_double(str *s, double d) {
+    uint64_t i;
+    memcpy(&i, &d, sizeof(i));
+
+    return append_fixed(s, i);
+}
+
+static uint_least64_t
+read_fixed(const char *chars) {
+    uint_least64_t i = 0;
+    for (int j = 0; j < 8; j++)
+        i |= (uint_least64_t) (unsigned char) chars[j] << 8 * j;
+
+    return i;
+}
+
+static double
+read_double(const char *chars) {
+    const uint64_t i = read_fixed(chars);
+    double d;
+    memcpy(&d, &i, sizeof(d));
+
+    return d;
+}
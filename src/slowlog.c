@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "clock.h"
+#include "slowlog.h"
+#include "expr.h"
+#include "diceexpr.h"
+
+#define DEFAULT_SIZE 64
+
+/* A call in the ring.
+ *
+ * Writers take the next ticket from the ring and write the call to slot
+ * ticket % size. seq is odd while the call is written and 2 * (ticket + 1)
+ * after it, so a reader copying the call of a ticket knows that it wasn't
+ * being written if seq is the same before and after copying.
+ */
+struct slot {
+    uint_least64_t seq;
+    struct de_slow_call call;
+};
+
+struct slow_log {
+    // Thresholds, zero if not used.
+    uint_least64_t nanoseconds;
+    uint_least64_t dice;
+    // Power of two.
+    size_t size;
+    // Tickets taken by writers.
+    uint_least64_t next;
+    struct slot *slots;
+};
+
+// Timed call of a thread.
+struct timer {
+    // NULL if the call isn't timed.
+    struct slow_log *log;
+    uint_least64_t start;
+    // Rolls of dices in the expression.
+    uint_least64_t dice;
+    // Clock when each stage ended, zero if it wasn't reached.
+    uint_least64_t ends[DE_SLOW_STAGES];
+};
+
+// NULL if the log isn't started.
+static struct slow_log *slow_log;
+static __thread struct timer timer;
+
+static uint_least64_t count_dice(const de_expr *e);
+static void write_call(struct slow_log *log, const struct de_slow_call *call);
+
+enum parse_error
+de_slow_log_start(const struct de_slow_log_config *config) {
+    assert(slow_log == NULL);
+
+    struct slow_log *log = malloc(sizeof(*log));
+    if (log == NULL)
+        return DE_MEMORY;
+    log->nanoseconds = config != NULL ? config->nanoseconds : 0;
+    log->dice = config != NULL ? config->dice : 0;
+    size_t size = config != NULL && config->size > 0 ?
+        config->size : DEFAULT_SIZE;
+    // Power of two, so that a slot is a mask of a ticket.
+    for (log->size = 1; log->size < size; log->size *= 2)
+        ;
+    log->next = 0;
+    if ((log->slots = calloc(log->size, sizeof(*log->slots))) == NULL) {
+        free(log);
+        return DE_MEMORY;
+    }
+
+    __atomic_store_n(&slow_log, log, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void
+de_slow_log_stop(void) {
+    struct slow_log *log = slow_log;
+    if (log == NULL)
+        return;
+
+    __atomic_store_n(&slow_log, NULL, __ATOMIC_RELEASE);
+    free(log->slots);
+    free(log);
+}
+
+size_t
+de_slow_log_dump(struct de_slow_call *calls, size_t ncalls) {
+    assert(calls != NULL || ncalls == 0);
+
+    struct slow_log *log = __atomic_load_n(&slow_log, __ATOMIC_ACQUIRE);
+    if (log == NULL)
+        return 0;
+
+    const uint_least64_t next = __atomic_load_n(&log->next, __ATOMIC_ACQUIRE);
+    uint_least64_t ticket = next > log->size ? next - log->size : 0;
+    if (next - ticket > ncalls)
+        ticket = next - ncalls;
+
+    size_t n = 0;
+    for (; ticket < next; ticket++) {
+        const struct slot *s = &log->slots[ticket & (log->size - 1)];
+        const uint_least64_t seq = 2 * (ticket + 1);
+        if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != seq)
+            continue;
+        memcpy(&calls[n], &s->call, sizeof(calls[n]));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq)
+            n++;
+    }
+
+    return n;
+}
+
+void
+slowlog_start(void) {
+    timer.log = __atomic_load_n(&slow_log, __ATOMIC_ACQUIRE);
+    if (timer.log == NULL)
+        return;
+
+    timer.start = clock_now();
+    timer.dice = 0;
+    for (int i = 0; i < DE_SLOW_STAGES; i++)
+        timer.ends[i] = 0;
+}
+
+void
+slowlog_compiled(const de_expr *e) {
+    if (timer.log == NULL)
+        return;
+
+    timer.dice = count_dice(e);
+    slowlog_stage(DE_SLOW_PARSE);
+}
+
+void
+slowlog_stage(enum de_slow_stage stage) {
+    if (timer.log == NULL)
+        return;
+
+    // Whether the call is logged is known only when it finishes.
+    timer.ends[stage] = clock_now();
+}
+
+void
+slowlog_finish(const char *expr, enum parse_error error) {
+    assert(expr != NULL);
+
+    struct slow_log *log = timer.log;
+    if (log == NULL)
+        return;
+    timer.log = NULL;
+
+    const uint_least64_t nanoseconds = clock_now() - timer.start;
+    // Without thresholds every call is logged.
+    const int logged = (log->nanoseconds == 0 && log->dice == 0) ||
+        (log->dice != 0 && timer.dice >= log->dice) ||
+        (log->nanoseconds != 0 && nanoseconds >= log->nanoseconds);
+    if (!logged)
+        return;
+
+    struct de_slow_call call;
+    call.len = strlen(expr);
+    const size_t len = call.len < DE_SLOW_EXPR ? call.len : DE_SLOW_EXPR - 1;
+    memcpy(call.expr, expr, len);
+    call.expr[len] = '\0';
+    call.error = error;
+    call.dice = timer.dice;
+    call.nanoseconds = nanoseconds;
+    // A stage takes the time since the previous stage ended or the call
+    // started.
+    uint_least64_t last = timer.start;
+    for (int i = 0; i < DE_SLOW_STAGES; i++) {
+        call.stages[i] = timer.ends[i] != 0 ? timer.ends[i] - last : 0;
+        if (timer.ends[i] != 0)
+            last = timer.ends[i];
+    }
+    write_call(log, &call);
+}
+
+/* Number of dices rolled by an expression.
+ * @param e Can be NULL.
+ * @return Sum of rolls of dice terms, zero if e is NULL.
+ */
+static uint_least64_t
+count_dice(const de_expr *e) {
+    if (e == NULL)
+        return 0;
+
+    uint_least64_t dice = 0;
+    for (size_t i = 0; i < e->nterms; i++) {
+        if (e->terms[i].type == TERM_DICE)
+            dice += e->terms[i].nrolls;
+    }
+
+    return dice;
+}
+
+/* Write a call to the next slot of the ring.
+ */
+static void
+write_call(struct slow_log *log, const struct de_slow_call *call) {
+    const uint_least64_t ticket = __atomic_fetch_add(&log->next, 1,
+                                                     __ATOMIC_RELAXED);
+    struct slot *s = &log->slots[ticket & (log->size - 1)];
+    __atomic_store_n(&s->seq, 2 * ticket + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&s->call, call, sizeof(s->call));
+    __atomic_store_n(&s->seq, 2 * (ticket + 1), __ATOMIC_RELEASE);
+}
@@ -0,0 +1,41 @@
+#ifndef SLOWLOG_H
+    #define SLOWLOG_H
+#include "diceexpr.h"
+
+/** @file
+ * Timing calls for the slow log, see de_slow_log_start(). A call is timed
+ * by the thread making it. The clock is read when each stage ends, but the
+ * stages are compared to the thresholds and copied only when the call
+ * finishes, so that calls logged for their time have their stages too.
+ */
+
+/** Start timing a call, if the slow log is started.
+ * @return void
+ */
+void
+slowlog_start(void);
+
+/** End compiling the expression of the timed call, and count its dices.
+ * @param e Compiled expression, NULL if it didn't compile.
+ * @return void
+ */
+void
+slowlog_compiled(const de_expr *e);
+
+/** End a stage of the timed call. The stage takes the time since the
+ * previous stage ended or the call started.
+ * @param stage Stage ended.
+ * @return void
+ */
+void
+slowlog_stage(enum de_slow_stage stage);
+
+/** Stop timing a call and log it, if it's slow.
+ * @param expr Expression of the call, can't be NULL.
+ * @param error Zero or enum parse_error of the call.
+ * @return void
+ */
+void
+slowlog_finish(const char *expr, enum parse_error error);
+
+#endif // SLOWLOG_H
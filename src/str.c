@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdint.h>
 #define DEFAULT_STR_SIZE 10
 #define SIZE_MULTIPLIER 2
 
@@ -16,6 +17,13 @@
 static int
 resize_str(str *s, size_t size);
 
+/* Write the string to the sink if it's long enough.
+ * @param s Can't be NULL.
+ * @return Zero on success, EIO on error.
+ */
+static int
+flush_full(str *s);
+
 str*
 str_new(const char *chars) {
     str *s = malloc(sizeof(*s));
@@ -23,6 +31,9 @@ str_new(const char *chars) {
         return NULL;
     s->len = 0;
     s->str = NULL;
+    s->sink = NULL;
+    s->sink_data = NULL;
+    s->sink_len = 0;
 
     // New size will always be at least DEFAULT_STR_SIZE.
     if (chars != NULL && strlen(chars) + 1 > DEFAULT_STR_SIZE) 
@@ -76,7 +87,7 @@ str_append_char(str *s, int c) {
     }
     s->str[s->len] = '\0';
 
-    return 0;
+    return flush_full(s);
 }
 
 int
@@ -94,7 +105,7 @@ str_append_chars(str *s, const char *chars) {
     strcpy(s->str + s->len, chars);
     s->len += len;
 
-    return 0;
+    return flush_full(s);
 }
 
 int
@@ -110,7 +121,8 @@ str_append_format(str *s, const char *format, ...) {
         retval = -1;
         goto end;
     }
-    str_append_chars(s, temp);
+    if (str_append_chars(s, temp) != 0)
+        retval = -1;
     free(temp);
 
     end:
@@ -119,6 +131,84 @@ str_append_format(str *s, const char *format, ...) {
     return retval;
 }
 
+int
+str_append_int(str *s, int_least64_t i) {
+    assert(s != NULL);
+
+    // Enough for any 64-bit integer, its sign and '\0'.
+    char digits[21];
+    char *d = digits + sizeof(digits);
+    *--d = '\0';
+    // Negative values are negated as unsigned integers, so that the smallest
+    // integer can't overflow.
+    uint_least64_t u = i < 0 ? -(uint_least64_t) i : (uint_least64_t) i;
+    do {
+        *--d = '0' + u % 10;
+        u /= 10;
+    } while (u > 0);
+    if (i < 0)
+        *--d = '-';
+
+    return str_append_chars(s, d);
+}
+
+int
+str_append_varint(str *s, uint_least64_t i) {
+    assert(s != NULL);
+
+    for (; i >= 0x80; i >>= 7) {
+        int retval = str_append_char(s, (i & 0x7f) | 0x80);
+        if (retval != 0)
+            return retval;
+    }
+
+    return str_append_char(s, i);
+}
+
+int
+str_reserve(str *s, size_t len) {
+    assert(s != NULL);
+
+    if (str_flush(s) != 0)
+        return EIO;
+    if (len > SIZE_MAX - s->len - 1)
+        return ENOMEM;
+    size_t size = s->size;
+    while (size < s->len + len + 1)
+        size = size > SIZE_MAX / SIZE_MULTIPLIER ?
+            s->len + len + 1 : size * SIZE_MULTIPLIER;
+    if (size != s->size) {
+        if (resize_str(s, size) != 0)
+            return ENOMEM;
+        s->size = size;
+    }
+
+    return 0;
+}
+
+void
+str_set_sink(str *s, str_sink sink, void *data, size_t len) {
+    assert(s != NULL);
+    assert(sink != NULL);
+    assert(len > 0);
+
+    s->sink = sink;
+    s->sink_data = data;
+    s->sink_len = len;
+}
+
+int
+str_flush(str *s) {
+    assert(s != NULL);
+
+    if (s->sink == NULL || s->len == 0)
+        return 0;
+    int retval = s->sink(s->sink_data, s->str, s->len);
+    str_erase(s);
+
+    return retval != 0 ? EIO : 0;
+}
+
 int
 str_copy_to_chars(str *s, char **chars) {
     assert(s != NULL);
@@ -132,6 +222,14 @@ str_copy_to_chars(str *s, char **chars) {
     return 0;
 }
 
+static int
+flush_full(str *s) {
+    if (s->sink == NULL || s->len < s->sink_len)
+        return 0;
+
+    return str_flush(s);
+}
+
 static int
 resize_str(str *s, size_t size) {
     assert(s != NULL);
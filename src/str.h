@@ -1,12 +1,21 @@
 #ifndef STR_H
     #define STR_H
 #include <stddef.h>
+#include <stdint.h>
 
 /** A string library.
  * The data of the strings are handled as bytes, so the length of a string may not
  * be the same as the number of characters in it.
  */
 
+/** Function a str writes its data to, see str_set_sink().
+ * @param data Data given to str_set_sink().
+ * @param chars Characters to write, not null terminated.
+ * @param len Number of characters, > 0.
+ * @return Zero on success, non-zero on error.
+ */
+typedef int (*str_sink)(void *data, const char *chars, size_t len);
+
 /** String struct.
  * Will be null terminated at all times.
  */
@@ -17,6 +26,10 @@ typedef struct {
     size_t len;
     // Amount of memory allocated.
     size_t size;
+    // If not NULL, data is written here and erased when it's this long.
+    str_sink sink;
+    void *sink_data;
+    size_t sink_len;
 } str;
 
 /** Create new str on the heap.
@@ -43,7 +56,7 @@ str_erase(str *s);
 /** Append a character.
  * @param s Can't be NULL.
  * @param c
- * @return Zero on success, ENOMEM on error.
+ * @return Zero on success, ENOMEM or EIO on error.
  */
 int
 str_append_char(str *s, int c);
@@ -51,7 +64,7 @@ str_append_char(str *s, int c);
 /** Append a string.
  * @param s Can't be NULL.
  * @param chars String to append, can't be NULL.
- * @return Zero on success, ENOMEM on error.
+ * @return Zero on success, ENOMEM or EIO on error.
  */
 int
 str_append_chars(str *s, const char *chars);
@@ -65,6 +78,57 @@ str_append_chars(str *s, const char *chars);
 int
 str_append_format(str *s, const char *format, ...);
 
+/** Append a decimal integer.
+ * Faster than str_append_format(), because nothing is allocated for the
+ * digits.
+ * @param s Can't be NULL.
+ * @param i Integer to append.
+ * @return Zero on success, ENOMEM or EIO on error.
+ */
+int
+str_append_int(str *s, int_least64_t i);
+
+/** Append an unsigned LEB128 integer, seven bits to a character starting
+ * from the lowest, see scan_varint().
+ * @param s Can't be NULL.
+ * @param i Integer to append.
+ * @return Zero on success, ENOMEM or EIO on error.
+ */
+int
+str_append_varint(str *s, uint_least64_t i);
+
+/** Make room for characters without changing the string.
+ * After this, len characters can be written after s->str + s->len, before
+ * increasing s->len and terminating the string.
+ * @param s Can't be NULL.
+ * @param len Number of characters to make room for.
+ * @return Zero on success, ENOMEM or EIO on error.
+ */
+int
+str_reserve(str *s, size_t len);
+
+/** Write data to a sink instead of keeping it.
+ * After this, whenever appending makes the string at least len characters
+ * long, the string is written to sink and erased. Making room with
+ * str_reserve() writes the string first, so the characters written after it
+ * are written together. Call str_flush() to write the rest.
+ * @param s Can't be NULL.
+ * @param sink Can't be NULL.
+ * @param data Passed to sink.
+ * @param len Length to write at, must be > 0.
+ * @return void
+ */
+void
+str_set_sink(str *s, str_sink sink, void *data, size_t len);
+
+/** Write the string to the sink and erase it.
+ * Does nothing if there's no sink.
+ * @param s Can't be NULL.
+ * @return Zero on success, EIO if the sink fails.
+ */
+int
+str_flush(str *s);
+
 /** Copy str's data to a string.
  * Memory for chars is allocated, so free it after use. chars will be
  * s->len + 1 of size. chars is nul terminated.
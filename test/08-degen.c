@@ -0,0 +1,81 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <stdlib.h>
+#include <inttypes.h>
+#include "degen-hot.h"
+
+#define NSEEDS 100
+
+static char *rolled_expr;
+
+static void
+setup() {
+    rolled_expr = NULL;
+}
+
+static void
+teardown() {
+    free(rolled_expr);
+}
+
+START_TEST(same_as_de_parse) {
+    for (size_t i = 0; degen_hot[i].name != NULL; i++) {
+        for (unsigned seed = 1; seed <= NSEEDS; seed++) {
+            int_least64_t parsed_value = 0, generated_value = 0;
+
+            srand(seed);
+            enum parse_error parsed_error =
+                de_parse(degen_hot[i].expr, &parsed_value, &rolled_expr);
+            free(rolled_expr);
+            rolled_expr = NULL;
+
+            srand(seed);
+            enum parse_error generated_error =
+                degen_hot[i].function(&generated_value);
+
+            ck_assert_msg(parsed_error == generated_error,
+                "%s with seed %u: error %d != %d", degen_hot[i].expr, seed,
+                parsed_error, generated_error);
+            ck_assert_msg(parsed_value == generated_value,
+                "%s with seed %u: %" PRIdLEAST64 " != %" PRIdLEAST64,
+                degen_hot[i].expr, seed, parsed_value, generated_value);
+        }
+    }
+}
+END_TEST
+
+START_TEST(rolls_same_dices) {
+    // Generated functions must roll as many dices as de_parse(), so that the
+    // next roll after them is the same.
+    for (size_t i = 0; degen_hot[i].name != NULL; i++) {
+        int_least64_t value;
+
+        srand(1);
+        if (de_parse(degen_hot[i].expr, &value, &rolled_expr) != 0)
+            continue;
+        int_least64_t parsed_next = de_roll_die(INT_LEAST64_MAX);
+        free(rolled_expr);
+        rolled_expr = NULL;
+
+        srand(1);
+        degen_hot[i].function(&value);
+        int_least64_t generated_next = de_roll_die(INT_LEAST64_MAX);
+
+        ck_assert_msg(parsed_next == generated_next,
+            "%s rolls different number of dices", degen_hot[i].expr);
+    }
+}
+END_TEST
+
+Suite*
+suite_degen() {
+    Suite *suite = suite_create("degen");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, same_as_de_parse);
+    tcase_add_test(tcase, rolls_same_dices);
+
+    return suite;
+}
@@ -0,0 +1,127 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <regex.h>
+
+static de_expr *compiled;
+static de_roll *roll;
+static char *rolled_expr;
+static int_least64_t value;
+static regex_t regexp;
+#define EXPR_SIZE 100
+static char expr_buffer[EXPR_SIZE];
+
+static void
+setup() {
+    compiled = NULL;
+    roll = NULL;
+    rolled_expr = NULL;
+    value = 0;
+    memset(&regexp, 0, sizeof(regexp));
+}
+
+static void
+teardown() {
+    de_roll_free(roll);
+    de_free(compiled);
+    free(rolled_expr);
+    regfree(&regexp);
+}
+
+START_TEST(same_as_eval) {
+    ck_assert_int_eq(de_compile("3d6<+2d10>-d4+2", &compiled), 0);
+
+    for (unsigned seed = 1; seed < 100; seed++) {
+        srand(seed);
+        ck_assert_int_eq(de_eval(compiled, &value, &rolled_expr), 0);
+        srand(seed);
+        ck_assert_int_eq(de_roll_new(compiled, &roll), 0);
+
+        char *roll_expr = NULL;
+        ck_assert_int_eq(de_roll_expression(roll, &roll_expr), 0);
+        ck_assert_int_eq(de_roll_value(roll), value);
+        ck_assert_str_eq(roll_expr, rolled_expr);
+
+        free(roll_expr);
+        free(rolled_expr);
+        rolled_expr = NULL;
+        de_roll_free(roll);
+        roll = NULL;
+    }
+}
+END_TEST
+
+START_TEST(terms) {
+    ck_assert_int_eq(de_compile("-3d1+4d1-1", &compiled), 0);
+    ck_assert_uint_eq(de_nterms(compiled), 3);
+    ck_assert_int_eq(de_roll_new(compiled, &roll), 0);
+
+    ck_assert_str_eq(de_roll_term_expression(roll, 0), "-(1+1+1)");
+    ck_assert_str_eq(de_roll_term_expression(roll, 1), "+(1+1+1+1)");
+    ck_assert_str_eq(de_roll_term_expression(roll, 2), "-1");
+    ck_assert_int_eq(de_roll_value(roll), 0);
+}
+END_TEST
+
+START_TEST(reroll_dice) {
+    ck_assert_int_eq(de_compile("d20+2d1+5", &compiled), 0);
+    ck_assert_int_eq(de_roll_new(compiled, &roll), 0);
+    if (regcomp(&regexp, "^\\(([1-9]|1[0-9]|20)\\)$",
+                REG_EXTENDED | REG_NOSUB) != 0) {
+        ck_abort_msg("failed to compile regex");
+    }
+
+    for (int i = 0; i < 100; i++) {
+        ck_assert_int_eq(de_reroll(roll, 0), 0);
+
+        const char *term = de_roll_term_expression(roll, 0);
+        ck_assert_int_eq(regexec(&regexp, term, 0, NULL, 0), 0);
+        ck_assert_int_eq(de_roll_value(roll), strtol(term + 1, NULL, 10) + 7);
+        ck_assert_str_eq(de_roll_term_expression(roll, 1), "+(1+1)");
+        ck_assert_str_eq(de_roll_term_expression(roll, 2), "+5");
+    }
+}
+END_TEST
+
+START_TEST(reroll_constant) {
+    ck_assert_int_eq(de_compile("1-+2", &compiled), 0);
+    ck_assert_int_eq(de_roll_new(compiled, &roll), 0);
+    ck_assert_int_eq(de_reroll(roll, 1), 0);
+
+    ck_assert_int_eq(de_roll_value(roll), -1);
+    ck_assert_int_eq(de_roll_expression(roll, &rolled_expr), 0);
+    ck_assert_str_eq(rolled_expr, "1-+2");
+}
+END_TEST
+
+START_TEST(reroll_large_terms) {
+    // Sum of absolute values of the terms overflows, so all terms are summed
+    // again.
+    sprintf(expr_buffer, "%" PRIdLEAST64 "-%" PRIdLEAST64 "+d1", INT_LEAST64_MAX,
+            INT_LEAST64_MAX);
+    ck_assert_int_eq(de_compile(expr_buffer, &compiled), 0);
+    ck_assert_int_eq(de_roll_new(compiled, &roll), 0);
+    ck_assert_int_eq(de_reroll(roll, 2), 0);
+
+    ck_assert_int_eq(de_roll_value(roll), 1);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_reroll() {
+    Suite *suite = suite_create("diceexpr_reroll");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, same_as_eval);
+    tcase_add_test(tcase, terms);
+    tcase_add_test(tcase, reroll_dice);
+    tcase_add_test(tcase, reroll_constant);
+    tcase_add_test(tcase, reroll_large_terms);
+
+    return suite;
+}
@@ -0,0 +1,125 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+static de_expr *compiled;
+static char *rolled_expr;
+static int_least64_t value;
+static enum parse_error error;
+static struct de_cost cost;
+
+static void
+setup() {
+    compiled = NULL;
+    rolled_expr = NULL;
+    value = 0;
+    error = 0;
+}
+
+static void
+teardown() {
+    de_set_limits(NULL);
+    de_free(compiled);
+    free(rolled_expr);
+}
+
+START_TEST(estimate) {
+    ck_assert_int_eq(de_compile("3d6<+2", &compiled), 0);
+    de_estimate(compiled, &cost);
+
+    ck_assert_uint_eq(cost.dice, 3);
+    // One byte for each roll of d6.
+    ck_assert_uint_eq(cost.memory, 3);
+    // "(a+b)+2"
+    ck_assert_uint_eq(cost.output, 7);
+
+    ck_assert_int_eq(de_eval(compiled, &value, &rolled_expr), 0);
+    ck_assert_uint_eq(strlen(rolled_expr), cost.output);
+}
+END_TEST
+
+START_TEST(estimate_term) {
+    ck_assert_int_eq(de_compile("-10-4d100>2", &compiled), 0);
+
+    de_estimate_term(compiled, 0, &cost);
+    ck_assert_uint_eq(cost.dice, 0);
+    ck_assert_uint_eq(cost.memory, 0);
+    ck_assert_uint_eq(cost.output, 3);
+
+    de_estimate_term(compiled, 1, &cost);
+    ck_assert_uint_eq(cost.dice, 4);
+    ck_assert_uint_eq(cost.memory, 4);
+    // "-(a+b)" with three digit rolls.
+    ck_assert_uint_eq(cost.output, 10);
+}
+END_TEST
+
+START_TEST(estimate_overflow) {
+    ck_assert_int_eq(de_compile("999999999999999999d9223372036854775807",
+                                &compiled), 0);
+    de_estimate(compiled, &cost);
+
+    ck_assert_uint_eq(cost.dice, 999999999999999999);
+    ck_assert_uint_eq(cost.memory, 999999999999999999 * sizeof(int_least64_t));
+    ck_assert_uint_eq(cost.output, UINT_LEAST64_MAX);
+}
+END_TEST
+
+START_TEST(limit_dice) {
+    struct de_cost limits = { .dice = 1000 };
+    error = de_parse_limited("99999999999d6", &limits, &value, &rolled_expr);
+
+    ck_assert_int_eq(error, DE_LIMIT);
+    ck_assert_ptr_eq(rolled_expr, NULL);
+
+    error = de_parse_limited("1000d6", &limits, &value, &rolled_expr);
+    ck_assert_int_eq(error, 0);
+}
+END_TEST
+
+START_TEST(limit_memory_and_output) {
+    // 100 rolls and counts of 6 faces.
+    struct de_cost limits = { .memory = 100 + 6 * sizeof(size_t) - 1 };
+    error = de_parse_limited("100d6", &limits, &value, &rolled_expr);
+    ck_assert_int_eq(error, DE_LIMIT);
+
+    limits.memory = 0;
+    limits.output = 4;
+    error = de_parse_limited("2d6", &limits, &value, &rolled_expr);
+    ck_assert_int_eq(error, DE_LIMIT);
+}
+END_TEST
+
+START_TEST(default_limits) {
+    struct de_cost limits = { .dice = 10 };
+    de_set_limits(&limits);
+
+    ck_assert_int_eq(de_parse("5d6+6d6", &value, &rolled_expr), DE_LIMIT);
+    ck_assert_int_eq(de_compile("11d6", &compiled), 0);
+    ck_assert_int_eq(de_check_limits(compiled, NULL), DE_LIMIT);
+
+    // Zero limits mean no limits.
+    struct de_cost no_limits = { 0 };
+    ck_assert_int_eq(de_eval_limited(compiled, &no_limits, &value,
+                                     &rolled_expr), 0);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_cost() {
+    Suite *suite = suite_create("diceexpr_cost");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, estimate);
+    tcase_add_test(tcase, estimate_term);
+    tcase_add_test(tcase, estimate_overflow);
+    tcase_add_test(tcase, limit_dice);
+    tcase_add_test(tcase, limit_memory_and_output);
+    tcase_add_test(tcase, default_limits);
+
+    return suite;
+}
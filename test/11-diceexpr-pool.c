@@ -0,0 +1,148 @@
+// nanosleep()
+#define _POSIX_C_SOURCE 200809L
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#define NTHREADS 4
+#define THREAD_ROLLS 1000
+
+static char *rolled_expr;
+static char *expected;
+static int_least64_t value;
+static struct de_pool_stats stats;
+
+static void
+setup() {
+    rolled_expr = NULL;
+    expected = NULL;
+    value = 0;
+}
+
+static void
+teardown() {
+    de_pool_stop();
+    free(rolled_expr);
+    free(expected);
+}
+
+/* Wait until all rings of the pool are full.
+ */
+static void
+wait_full() {
+    struct timespec ms = { .tv_nsec = 1000000 };
+    for (int i = 0; i < 10000; i++) {
+        de_pool_stats(&stats);
+        if (stats.available == stats.nshards * stats.size)
+            return;
+        nanosleep(&ms, NULL);
+    }
+    ck_abort_msg("pool not filled");
+}
+
+static void*
+roll_many(void *arg) {
+    (void) arg;
+    for (int i = 0; i < THREAD_ROLLS; i++) {
+        int_least64_t v;
+        char *r = NULL;
+        if (de_parse("3d20", &v, &r) != 0 || v < 3 || v > 60)
+            return "roll failed";
+        free(r);
+    }
+
+    return NULL;
+}
+
+START_TEST(same_rolls) {
+    srand(7);
+    ck_assert_int_eq(de_parse("100d20<", &value, &expected), 0);
+
+    srand(7);
+    struct de_pool_config config = { .nshards = 1, .size = 256,
+                                     .watermark = 64 };
+    ck_assert_int_eq(de_pool_start(&config), 0);
+    wait_full();
+    ck_assert_int_eq(de_parse("100d20<", &value, &rolled_expr), 0);
+
+    ck_assert_str_eq(rolled_expr, expected);
+    de_pool_stats(&stats);
+    ck_assert_uint_eq(stats.hits, 100);
+    ck_assert_uint_eq(stats.misses, 0);
+}
+END_TEST
+
+START_TEST(config) {
+    de_pool_stats(&stats);
+    ck_assert_uint_eq(stats.nshards, 0);
+    ck_assert_uint_eq(stats.size, 0);
+
+    struct de_pool_config config = { .nshards = 2, .size = 100,
+                                     .watermark = 10 };
+    ck_assert_int_eq(de_pool_start(&config), 0);
+    de_pool_stats(&stats);
+    ck_assert_uint_eq(stats.nshards, 2);
+    ck_assert_uint_eq(stats.size, 128);
+    ck_assert_uint_eq(stats.watermark, 10);
+    de_pool_stop();
+
+    ck_assert_int_eq(de_pool_start(NULL), 0);
+    de_pool_stats(&stats);
+    ck_assert_uint_eq(stats.nshards, 1);
+    ck_assert_uint_eq(stats.size, 4096);
+    ck_assert_uint_eq(stats.watermark, 2048);
+}
+END_TEST
+
+START_TEST(runs_dry) {
+    struct de_pool_config config = { .size = 4, .watermark = 1 };
+    ck_assert_int_eq(de_pool_start(&config), 0);
+    wait_full();
+
+    ck_assert_int_eq(de_parse("10000d6", &value, &rolled_expr), 0);
+    ck_assert_int_ge(value, 10000);
+    ck_assert_int_le(value, 60000);
+
+    de_pool_stats(&stats);
+    ck_assert_uint_eq(stats.hits + stats.misses, 10000);
+    ck_assert_uint_ge(stats.hits, 4);
+}
+END_TEST
+
+START_TEST(threads) {
+    struct de_pool_config config = { .nshards = 2, .size = 64,
+                                     .watermark = 32 };
+    ck_assert_int_eq(de_pool_start(&config), 0);
+
+    pthread_t threads[NTHREADS];
+    for (int i = 0; i < NTHREADS; i++)
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, roll_many, NULL),
+                         0);
+    for (int i = 0; i < NTHREADS; i++) {
+        void *failure;
+        pthread_join(threads[i], &failure);
+        ck_assert_ptr_eq(failure, NULL);
+    }
+
+    de_pool_stats(&stats);
+    ck_assert_uint_eq(stats.hits + stats.misses, NTHREADS * THREAD_ROLLS * 3);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_pool() {
+    Suite *suite = suite_create("diceexpr_pool");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, same_rolls);
+    tcase_add_test(tcase, config);
+    tcase_add_test(tcase, runs_dry);
+    tcase_add_test(tcase, threads);
+
+    return suite;
+}
@@ -0,0 +1,182 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+
+static de_expr *compiled;
+static de_eval_state *state;
+static char *rolled_expr;
+static char *expected;
+static int_least64_t value;
+static int_least64_t expected_value;
+
+static void
+setup() {
+    compiled = NULL;
+    state = NULL;
+    rolled_expr = NULL;
+    expected = NULL;
+    value = 0;
+    expected_value = 0;
+}
+
+static void
+teardown() {
+    de_set_limits(NULL);
+    de_eval_free(state);
+    de_free(compiled);
+    free(rolled_expr);
+    free(expected);
+}
+
+/* Evaluate compiled with budget until done.
+ * @return Number of calls to de_eval_continue().
+ */
+static int
+eval_in_parts(const struct de_budget *budget) {
+    ck_assert_int_eq(de_eval_start(compiled, &state), 0);
+    int calls = 1;
+    enum parse_error e;
+    while ((e = de_eval_continue(state, budget, &value, &rolled_expr)) ==
+           DE_IN_PROGRESS)
+        calls++;
+    ck_assert_int_eq(e, 0);
+    de_eval_free(state);
+    state = NULL;
+
+    return calls;
+}
+
+START_TEST(same_as_eval) {
+    const char *exprs[] = {
+        "3d6<+2d10>-d4+2", "-100d100<<>>>+5-3d1", "7",
+        "20d1000<-5d100000>+3d5000000000<<"
+    };
+    const uint_least64_t works[] = { 1, 2, 7, 1000, 0 };
+
+    for (size_t i = 0; i < sizeof(exprs) / sizeof(exprs[0]); i++) {
+        ck_assert_int_eq(de_compile(exprs[i], &compiled), 0);
+        for (size_t j = 0; j < sizeof(works) / sizeof(works[0]); j++) {
+            unsigned seed = i * 10 + j;
+            srand(seed);
+            ck_assert_int_eq(de_eval(compiled, &expected_value, &expected),
+                             0);
+            srand(seed);
+            struct de_budget budget = { .work = works[j] };
+            eval_in_parts(&budget);
+
+            ck_assert_int_eq(value, expected_value);
+            ck_assert_str_eq(rolled_expr, expected);
+            free(rolled_expr);
+            free(expected);
+            rolled_expr = NULL;
+            expected = NULL;
+        }
+        de_free(compiled);
+        compiled = NULL;
+    }
+}
+END_TEST
+
+START_TEST(budget) {
+    ck_assert_int_eq(de_compile("1000d6", &compiled), 0);
+
+    // 1000 rolls, 500 + 999 steps of heapsort and 1000 sums.
+    struct de_budget budget = { .work = 100 };
+    ck_assert_int_eq(eval_in_parts(&budget), 35);
+    free(rolled_expr);
+    rolled_expr = NULL;
+
+    ck_assert_int_eq(eval_in_parts(NULL), 1);
+}
+END_TEST
+
+START_TEST(time_budget) {
+    ck_assert_int_eq(de_compile("2000000d100<100", &compiled), 0);
+    ck_assert_int_eq(de_eval_start(compiled, &state), 0);
+
+    struct de_budget budget = { .nanoseconds = 1000 };
+    ck_assert_int_eq(de_eval_continue(state, &budget, &value, &rolled_expr),
+                     DE_IN_PROGRESS);
+    ck_assert_ptr_eq(rolled_expr, NULL);
+
+    ck_assert_int_eq(de_eval_continue(state, NULL, &value, &rolled_expr), 0);
+    ck_assert_int_ge(value, 2000000 - 100);
+}
+END_TEST
+
+START_TEST(many_terms) {
+    // Each term and sign is work, so constants don't run over the budget.
+    const size_t nterms = 100000;
+    char *expr = malloc(2 * nterms);
+    ck_assert_ptr_ne(expr, NULL);
+    for (size_t i = 0; i < nterms; i++) {
+        expr[2 * i] = '1';
+        expr[2 * i + 1] = '+';
+    }
+    expr[2 * nterms - 1] = '\0';
+    ck_assert_int_eq(de_compile(expr, &compiled), 0);
+    free(expr);
+
+    struct de_budget budget = { .work = 1000 };
+    ck_assert_int_gt(eval_in_parts(&budget), 100);
+    ck_assert_int_eq(value, nterms);
+    free(rolled_expr);
+    rolled_expr = NULL;
+
+    budget = (struct de_budget) { .nanoseconds = 1000 };
+    ck_assert_int_gt(eval_in_parts(&budget), 1);
+    ck_assert_int_eq(value, nterms);
+}
+END_TEST
+
+START_TEST(cancel) {
+    ck_assert_int_eq(de_compile("1000d6+1000d6", &compiled), 0);
+    ck_assert_int_eq(de_eval_start(compiled, &state), 0);
+
+    struct de_budget budget = { .work = 1500 };
+    ck_assert_int_eq(de_eval_continue(state, &budget, &value, &rolled_expr),
+                     DE_IN_PROGRESS);
+    // Teardown frees the unfinished evaluation.
+}
+END_TEST
+
+START_TEST(error) {
+    ck_assert_int_eq(de_compile("9223372036854775807+1d1", &compiled), 0);
+    ck_assert_int_eq(de_eval_start(compiled, &state), 0);
+
+    ck_assert_int_eq(de_eval_continue(state, NULL, &value, &rolled_expr),
+                     DE_OVERFLOW);
+    ck_assert_int_eq(de_eval_continue(state, NULL, &value, &rolled_expr),
+                     DE_OVERFLOW);
+    ck_assert_ptr_eq(rolled_expr, NULL);
+}
+END_TEST
+
+START_TEST(limits) {
+    struct de_cost limits = { .dice = 10 };
+    de_set_limits(&limits);
+
+    ck_assert_int_eq(de_compile("11d6", &compiled), 0);
+    ck_assert_int_eq(de_eval_start(compiled, &state), DE_LIMIT);
+    ck_assert_ptr_eq(state, NULL);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_resume() {
+    Suite *suite = suite_create("diceexpr_resume");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, same_as_eval);
+    tcase_add_test(tcase, budget);
+    tcase_add_test(tcase, time_budget);
+    tcase_add_test(tcase, many_terms);
+    tcase_add_test(tcase, cancel);
+    tcase_add_test(tcase, error);
+    tcase_add_test(tcase, limits);
+
+    return suite;
+}
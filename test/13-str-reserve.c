@@ -0,0 +1,57 @@
+#include "str.h"
+#include "test.h"
+#include <string.h>
+#include <stdint.h>
+
+static str *s;
+
+static
+void teardown() {
+    str_free(s);
+}
+
+START_TEST(reserve_keeps_string) {
+    s = str_new("abc");
+
+    ck_assert_int_eq(str_reserve(s, 1000), 0);
+    ck_assert_str_eq(s->str, "abc");
+    ck_assert_uint_eq(s->len, 3);
+    ck_assert_uint_ge(s->size, 1004);
+}
+END_TEST
+
+START_TEST(reserve_and_write) {
+    s = str_new("a");
+
+    ck_assert_int_eq(str_reserve(s, 20), 0);
+    memset(s->str + s->len, 'b', 20);
+    s->len += 20;
+    s->str[s->len] = '\0';
+
+    ck_assert_str_eq(s->str, "abbbbbbbbbbbbbbbbbbbb");
+    str_append_char(s, 'c');
+    ck_assert_uint_eq(s->len, 22);
+}
+END_TEST
+
+START_TEST(reserve_too_much) {
+    s = str_new("a");
+
+    ck_assert_int_ne(str_reserve(s, SIZE_MAX), 0);
+    ck_assert_str_eq(s->str, "a");
+}
+END_TEST
+
+Suite*
+suite_str_reserve() {
+    Suite *suite = suite_create("str_reserve");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, NULL, teardown);
+
+    tcase_add_test(tcase, reserve_keeps_string);
+    tcase_add_test(tcase, reserve_and_write);
+    tcase_add_test(tcase, reserve_too_much);
+
+    return suite;
+}
@@ -0,0 +1,127 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+static char *rolled_expr;
+static char *expected;
+static int_least64_t value;
+static int_least64_t expected_value;
+
+static void
+setup() {
+    rolled_expr = NULL;
+    expected = NULL;
+    value = 0;
+    expected_value = 0;
+}
+
+static void
+teardown() {
+    de_parallel_stop();
+    free(rolled_expr);
+    free(expected);
+}
+
+START_TEST(rolls) {
+    struct de_parallel_config config = { .nthreads = 4, .min_rolls = 1000,
+                                         .chunk = 100 };
+    ck_assert_int_eq(de_parallel_start(&config), 0);
+
+    ck_assert_int_eq(de_parse("10000d6<<>", &value, &rolled_expr), 0);
+    ck_assert_int_eq(check_rolls(rolled_expr, 6, value), 9997);
+    free(rolled_expr);
+    rolled_expr = NULL;
+
+    ck_assert_int_eq(de_parse("3-5000d1000>", &value, &rolled_expr), 0);
+    ck_assert_int_eq(strncmp(rolled_expr, "3-", 2), 0);
+    ck_assert_int_eq(check_rolls(rolled_expr + 2, 1000, 3 - value), 4999);
+}
+END_TEST
+
+START_TEST(same_for_threads) {
+    struct de_parallel_config config = { .nthreads = 1, .min_rolls = 1000 };
+    ck_assert_int_eq(de_parallel_start(&config), 0);
+    srand(3);
+    ck_assert_int_eq(de_parse("100000d20<+2d20", &expected_value, &expected),
+                     0);
+    de_parallel_stop();
+
+    config.nthreads = 3;
+    config.chunk = 77;
+    ck_assert_int_eq(de_parallel_start(&config), 0);
+    srand(3);
+    ck_assert_int_eq(de_parse("100000d20<+2d20", &value, &rolled_expr), 0);
+
+    ck_assert_int_eq(value, expected_value);
+    ck_assert_str_eq(rolled_expr, expected);
+}
+END_TEST
+
+START_TEST(small_dices) {
+    srand(5);
+    ck_assert_int_eq(de_parse("999d6+2000d5000", &expected_value, &expected),
+                     0);
+
+    // Too few rolls or too many sides.
+    struct de_parallel_config config = { .nthreads = 2, .min_rolls = 1000 };
+    ck_assert_int_eq(de_parallel_start(&config), 0);
+    srand(5);
+    ck_assert_int_eq(de_parse("999d6+2000d5000", &value, &rolled_expr), 0);
+
+    ck_assert_int_eq(value, expected_value);
+    ck_assert_str_eq(rolled_expr, expected);
+}
+END_TEST
+
+START_TEST(resumed) {
+    struct de_parallel_config config = { .nthreads = 3, .min_rolls = 1000,
+                                         .chunk = 100 };
+    ck_assert_int_eq(de_parallel_start(&config), 0);
+    de_expr *e = NULL;
+    ck_assert_int_eq(de_compile("5000d6<+3d6-2000d20>", &e), 0);
+    srand(9);
+    ck_assert_int_eq(de_eval(e, &expected_value, &expected), 0);
+
+    // Resumed evaluation rolls the same dices with many threads.
+    srand(9);
+    de_eval_state *state = NULL;
+    ck_assert_int_eq(de_eval_start(e, &state), 0);
+    struct de_budget budget = { .work = 100 };
+    enum parse_error error;
+    while ((error = de_eval_continue(state, &budget, &value, &rolled_expr)) ==
+           DE_IN_PROGRESS)
+        ;
+    ck_assert_int_eq(error, 0);
+    ck_assert_int_eq(value, expected_value);
+    ck_assert_str_eq(rolled_expr, expected);
+    de_eval_free(state);
+    de_free(e);
+}
+END_TEST
+
+START_TEST(mean) {
+    ck_assert_int_eq(de_parallel_start(NULL), 0);
+
+    ck_assert_int_eq(de_parse("1000000d6", &value, &rolled_expr), 0);
+    ck_assert_int_ge(value, 3490000);
+    ck_assert_int_le(value, 3510000);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_parallel() {
+    Suite *suite = suite_create("diceexpr_parallel");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, rolls);
+    tcase_add_test(tcase, same_for_threads);
+    tcase_add_test(tcase, small_dices);
+    tcase_add_test(tcase, resumed);
+    tcase_add_test(tcase, mean);
+
+    return suite;
+}
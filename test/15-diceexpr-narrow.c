@@ -0,0 +1,82 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+#define EXPR_SIZE 100
+
+static de_expr *compiled;
+static char *rolled_expr;
+static int_least64_t value;
+static struct de_cost cost;
+static char expr[EXPR_SIZE];
+
+static void
+setup() {
+    compiled = NULL;
+    rolled_expr = NULL;
+    value = 0;
+}
+
+static void
+teardown() {
+    de_free(compiled);
+    free(rolled_expr);
+}
+
+START_TEST(boundaries) {
+    const int_least64_t dices[] = {
+        255, 256, 65535, 65536, UINT32_MAX, (int_least64_t) UINT32_MAX + 1
+    };
+    const uint_least64_t widths[] = { 1, 2, 2, 4, 4, 8 };
+
+    for (size_t i = 0; i < sizeof(dices) / sizeof(dices[0]); i++) {
+        snprintf(expr, EXPR_SIZE, "200d%" PRIdLEAST64 "<>", dices[i]);
+        ck_assert_int_eq(de_compile(expr, &compiled), 0);
+        de_estimate(compiled, &cost);
+        ck_assert_uint_eq(cost.memory, 200 * widths[i]);
+
+        // Large rolls must survive narrowing.
+        int_least64_t largest = 0;
+        for (int j = 0; j < 20; j++) {
+            ck_assert_int_eq(de_eval(compiled, &value, &rolled_expr), 0);
+            ck_assert_int_eq(check_rolls(rolled_expr, dices[i], value), 198);
+            const char *last = strrchr(rolled_expr, '+') + 1;
+            int_least64_t roll = strtoimax(last, NULL, 10);
+            if (roll > largest)
+                largest = roll;
+            free(rolled_expr);
+            rolled_expr = NULL;
+        }
+        ck_assert_int_gt(largest, dices[i] / 2);
+
+        de_free(compiled);
+        compiled = NULL;
+    }
+}
+END_TEST
+
+START_TEST(counted) {
+    ck_assert_int_eq(de_compile("10000d6<", &compiled), 0);
+    de_estimate(compiled, &cost);
+    ck_assert_uint_eq(cost.memory, 10000 + 6 * sizeof(size_t));
+
+    ck_assert_int_eq(de_eval(compiled, &value, &rolled_expr), 0);
+    ck_assert_int_eq(check_rolls(rolled_expr, 6, value), 9999);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_narrow() {
+    Suite *suite = suite_create("diceexpr_narrow");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, boundaries);
+    tcase_add_test(tcase, counted);
+
+    return suite;
+}
@@ -0,0 +1,163 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+static de_expr *compiled;
+static de_eval_state *state;
+static char *rolled_expr;
+static char *expected;
+static int_least64_t value;
+static int_least64_t expected_value;
+static struct de_cost cost;
+
+static void
+setup() {
+    compiled = NULL;
+    state = NULL;
+    rolled_expr = NULL;
+    expected = NULL;
+    value = 0;
+    expected_value = 0;
+}
+
+static void
+teardown() {
+    de_set_output(NULL);
+    de_parallel_stop();
+    de_eval_free(state);
+    de_free(compiled);
+    free(rolled_expr);
+    free(expected);
+}
+
+/* Check "facexcount ..." up to ')' and return the number of rolls. Faces
+ * must be increasing and their sum value.
+ */
+static int_least64_t
+check_histogram(const char *s, int_least64_t dice, int_least64_t sum) {
+    int_least64_t n = 0, previous = 0;
+    for (;;) {
+        char *end;
+        int_least64_t face = strtoimax(s, &end, 10);
+        ck_assert_int_eq(*end, 'x');
+        int_least64_t count = strtoimax(end + 1, &end, 10);
+        ck_assert_int_gt(face, previous);
+        ck_assert_int_le(face, dice);
+        ck_assert_int_gt(count, 0);
+        sum -= face * count;
+        n += count;
+        previous = face;
+        if (*end == ')')
+            break;
+        ck_assert_int_eq(*end, ' ');
+        s = end + 1;
+    }
+    ck_assert_int_eq(sum, 0);
+
+    return n;
+}
+
+START_TEST(threshold) {
+    struct de_output output = { DE_OUTPUT_HISTOGRAM, 10 };
+    de_set_output(&output);
+
+    ck_assert_int_eq(de_parse("10d6", &value, &rolled_expr), 0);
+    ck_assert_int_eq(rolled_expr[0], '(');
+    ck_assert_ptr_eq(strchr(rolled_expr, ':'), NULL);
+    free(rolled_expr);
+    rolled_expr = NULL;
+
+    ck_assert_int_eq(de_parse("11d6", &value, &rolled_expr), 0);
+    ck_assert_int_eq(strncmp(rolled_expr, "(11d6: ", 7), 0);
+    ck_assert_int_eq(check_histogram(rolled_expr + 7, 6, value), 11);
+}
+END_TEST
+
+START_TEST(histogram) {
+    struct de_output output = { DE_OUTPUT_HISTOGRAM, 100 };
+    de_set_output(&output);
+
+    ck_assert_int_eq(de_parse("2-10000d6<<>", &value, &rolled_expr), 0);
+    ck_assert_int_eq(strncmp(rolled_expr, "2-(10000d6<2>1: ", 16), 0);
+    ck_assert_int_eq(check_histogram(rolled_expr + 16, 6, 2 - value), 9997);
+    ck_assert_int_lt(strlen(rolled_expr), 100);
+}
+END_TEST
+
+START_TEST(summary) {
+    struct de_output output = { DE_OUTPUT_SUMMARY, 100 };
+    de_set_output(&output);
+
+    ck_assert_int_eq(de_parse("1000d20<", &value, &rolled_expr), 0);
+    char buffer[100];
+    snprintf(buffer, sizeof(buffer),
+             "(1000d20<1: 999 kept, 1 dropped, sum %" PRIdLEAST64 ")", value);
+    ck_assert_str_eq(rolled_expr, buffer);
+}
+END_TEST
+
+START_TEST(estimate) {
+    const struct de_output outputs[] = {
+        { DE_OUTPUT_HISTOGRAM, 0 }, { DE_OUTPUT_SUMMARY, 0 }
+    };
+    ck_assert_int_eq(de_compile("1+5000d1000<3>+2d6", &compiled), 0);
+
+    for (size_t i = 0; i < sizeof(outputs) / sizeof(outputs[0]); i++) {
+        de_set_output(&outputs[i]);
+        de_estimate(compiled, &cost);
+        ck_assert_int_eq(de_eval(compiled, &value, &rolled_expr), 0);
+        ck_assert_uint_le(strlen(rolled_expr), cost.output);
+        free(rolled_expr);
+        rolled_expr = NULL;
+    }
+    de_estimate(compiled, &cost);
+    ck_assert_uint_lt(cost.output, 200);
+}
+END_TEST
+
+START_TEST(resume_and_parallel) {
+    struct de_output output = { DE_OUTPUT_HISTOGRAM, 100 };
+    de_set_output(&output);
+    ck_assert_int_eq(de_compile("3000d12>>", &compiled), 0);
+
+    srand(11);
+    ck_assert_int_eq(de_eval(compiled, &expected_value, &expected), 0);
+    srand(11);
+    ck_assert_int_eq(de_eval_start(compiled, &state), 0);
+    struct de_budget budget = { .work = 100 };
+    enum parse_error e;
+    while ((e = de_eval_continue(state, &budget, &value, &rolled_expr)) ==
+           DE_IN_PROGRESS)
+        ;
+    ck_assert_int_eq(e, 0);
+    ck_assert_int_eq(value, expected_value);
+    ck_assert_str_eq(rolled_expr, expected);
+    free(rolled_expr);
+    rolled_expr = NULL;
+
+    struct de_parallel_config config = { .nthreads = 2, .min_rolls = 1000 };
+    ck_assert_int_eq(de_parallel_start(&config), 0);
+    ck_assert_int_eq(de_eval(compiled, &value, &rolled_expr), 0);
+    ck_assert_int_eq(strncmp(rolled_expr, "(3000d12>2: ", 12), 0);
+    ck_assert_int_eq(check_histogram(rolled_expr + 12, 12, value), 2998);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_output() {
+    Suite *suite = suite_create("diceexpr_output");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, threshold);
+    tcase_add_test(tcase, histogram);
+    tcase_add_test(tcase, summary);
+    tcase_add_test(tcase, estimate);
+    tcase_add_test(tcase, resume_and_parallel);
+
+    return suite;
+}
@@ -0,0 +1,173 @@
+// fileno()
+#define _POSIX_C_SOURCE 200809L
+#include "test.h"
+#include "diceexpr.h"
+#include "str.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// Parts written to a sink.
+struct parts {
+    str *chars;
+    size_t nparts;
+    size_t longest;
+    // Fail after this many parts, if non-zero.
+    size_t fail_after;
+};
+
+static struct parts parts;
+static char *expected;
+static int_least64_t value;
+static int_least64_t expected_value;
+
+static void
+setup() {
+    parts.chars = str_new(NULL);
+    parts.nparts = 0;
+    parts.longest = 0;
+    parts.fail_after = 0;
+    expected = NULL;
+}
+
+static void
+teardown() {
+    de_parallel_stop();
+    str_free(parts.chars);
+    free(expected);
+}
+
+static int
+collect(void *data, const char *chars, size_t len) {
+    struct parts *p = data;
+    ck_assert_uint_gt(len, 0);
+    if (p->fail_after != 0 && p->nparts == p->fail_after)
+        return -1;
+    for (size_t i = 0; i < len; i++)
+        str_append_char(p->chars, chars[i]);
+    p->nparts++;
+    if (len > p->longest)
+        p->longest = len;
+
+    return 0;
+}
+
+START_TEST(same_as_parse) {
+    const char *exprs[] = { "3d6<+2d10>-d4+2", "-20000d100<<>+5-3d1", "7" };
+
+    for (size_t i = 0; i < sizeof(exprs) / sizeof(exprs[0]); i++) {
+        srand(i);
+        ck_assert_int_eq(de_parse(exprs[i], &expected_value, &expected), 0);
+        srand(i);
+        str_erase(parts.chars);
+        ck_assert_int_eq(de_parse_sink(exprs[i], collect, &parts, &value), 0);
+
+        ck_assert_int_eq(value, expected_value);
+        ck_assert_str_eq(parts.chars->str, expected);
+        free(expected);
+        expected = NULL;
+    }
+}
+END_TEST
+
+START_TEST(parts_are_bounded) {
+    ck_assert_int_eq(de_parse_sink("50000d1000", collect, &parts, &value), 0);
+
+    // Every roll is at least two characters with its '+'.
+    ck_assert_uint_ge(parts.nparts, 50000 * 2 / DE_SINK_CHUNK);
+    // A part is written as soon as it's long enough.
+    ck_assert_uint_lt(parts.longest, DE_SINK_CHUNK + 100);
+}
+END_TEST
+
+START_TEST(parallel_parts_are_bounded) {
+    struct de_parallel_config config = { .nthreads = 3, .min_rolls = 1000 };
+    ck_assert_int_eq(de_parallel_start(&config), 0);
+    srand(2);
+    ck_assert_int_eq(de_parse("50000d1000<", &expected_value, &expected), 0);
+    srand(2);
+    ck_assert_int_eq(de_parse_sink("50000d1000<", collect, &parts, &value),
+                     0);
+
+    ck_assert_int_eq(value, expected_value);
+    ck_assert_str_eq(parts.chars->str, expected);
+    ck_assert_uint_lt(parts.longest, DE_SINK_CHUNK + 100);
+}
+END_TEST
+
+START_TEST(sink_fails) {
+    parts.fail_after = 2;
+
+    ck_assert_int_eq(de_parse_sink("50000d1000", collect, &parts, &value),
+                     DE_OUTPUT);
+    ck_assert_uint_eq(parts.nparts, 2);
+}
+END_TEST
+
+START_TEST(errors) {
+    ck_assert_int_eq(de_parse_sink("1d", collect, &parts, &value),
+                     DE_SYNTAX_ERROR);
+    ck_assert_int_eq(de_parse_sink("9223372036854775807+1d1", collect,
+                                   &parts, &value), DE_OVERFLOW);
+}
+END_TEST
+
+START_TEST(fd) {
+    FILE *f = tmpfile();
+    ck_assert_ptr_ne(f, NULL);
+    int fd = fileno(f);
+
+    srand(1);
+    ck_assert_int_eq(de_parse("2000d6>", &expected_value, &expected), 0);
+    srand(1);
+    ck_assert_int_eq(de_parse_sink("2000d6>", de_sink_fd, &fd, &value), 0);
+
+    size_t len = strlen(expected);
+    char *written = malloc(len + 1);
+    ck_assert_ptr_ne(written, NULL);
+    ck_assert_int_eq(lseek(fd, 0, SEEK_SET), 0);
+    ck_assert_int_eq(read(fd, written, len + 1), len);
+    written[len] = '\0';
+    ck_assert_str_eq(written, expected);
+    free(written);
+    fclose(f);
+}
+END_TEST
+
+START_TEST(str_set_sink_and_flush) {
+    str *s = str_new(NULL);
+    str_set_sink(s, collect, &parts, 4);
+
+    str_append_chars(s, "ab");
+    ck_assert_uint_eq(parts.nparts, 0);
+    str_append_char(s, 'c');
+    str_append_format(s, "%d", 12);
+    ck_assert_uint_eq(parts.nparts, 1);
+    ck_assert_uint_eq(s->len, 0);
+    str_append_char(s, 'd');
+    ck_assert_int_eq(str_flush(s), 0);
+    ck_assert_int_eq(str_flush(s), 0);
+    ck_assert_uint_eq(parts.nparts, 2);
+    ck_assert_str_eq(parts.chars->str, "abc12d");
+    str_free(s);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_sink() {
+    Suite *suite = suite_create("diceexpr_sink");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, same_as_parse);
+    tcase_add_test(tcase, parts_are_bounded);
+    tcase_add_test(tcase, parallel_parts_are_bounded);
+    tcase_add_test(tcase, sink_fails);
+    tcase_add_test(tcase, errors);
+    tcase_add_test(tcase, fd);
+    tcase_add_test(tcase, str_set_sink_and_flush);
+
+    return suite;
+}
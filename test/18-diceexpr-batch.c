@@ -0,0 +1,185 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define NEXPRS 1000
+
+static const char *exprs[NEXPRS];
+static int_least64_t values[NEXPRS];
+static enum parse_error errors[NEXPRS];
+static size_t offsets[NEXPRS];
+static struct de_batch batch;
+static de_expr *compiled[NEXPRS];
+static char *expected;
+
+// Expressions of a batch and their errors, repeated to NEXPRS.
+static const char *some_exprs[] = {
+    "3d6<+2d10>-d4+2", "1d", "-5", "d1+d1+d1", "9223372036854775807+1d1",
+    "4d6<"
+};
+static const enum parse_error some_errors[] = {
+    0, DE_SYNTAX_ERROR, 0, 0, DE_OVERFLOW, 0
+};
+#define NSOME (sizeof(some_exprs) / sizeof(some_exprs[0]))
+
+static void
+setup() {
+    for (size_t i = 0; i < NEXPRS; i++) {
+        exprs[i] = some_exprs[i % NSOME];
+        compiled[i] = NULL;
+    }
+    batch = (struct de_batch) {
+        .n = NEXPRS,
+        .values = values,
+        .errors = errors,
+        .offsets = offsets
+    };
+    expected = NULL;
+}
+
+static void
+teardown() {
+    for (size_t i = 0; i < NEXPRS; i++)
+        de_free(compiled[i]);
+    free(batch.rolled);
+    free(expected);
+}
+
+/* Check results of the batch of exprs.
+ */
+static void
+check_batch() {
+    for (size_t i = 0; i < NEXPRS; i++) {
+        const char *rolled = batch.rolled + offsets[i];
+        ck_assert_int_eq(errors[i], some_errors[i % NSOME]);
+        if (errors[i] != 0) {
+            ck_assert_int_eq(values[i], 0);
+            ck_assert_str_eq(rolled, "");
+        }
+        else if (strcmp(exprs[i], "d1+d1+d1") == 0) {
+            ck_assert_int_eq(values[i], 3);
+            ck_assert_str_eq(rolled, "(1)+(1)+(1)");
+        }
+        else if (strcmp(exprs[i], "-5") == 0) {
+            ck_assert_int_eq(values[i], -5);
+            ck_assert_str_eq(rolled, "-5");
+        }
+        else if (strcmp(exprs[i], "4d6<") == 0) {
+            ck_assert_int_ge(values[i], 3);
+            ck_assert_int_le(values[i], 18);
+            ck_assert_int_eq(rolled[0], '(');
+        }
+    }
+}
+
+START_TEST(same_as_parse) {
+    srand(3);
+    ck_assert_int_eq(de_parse_batch(exprs, &batch), 0);
+    check_batch();
+
+    // With one thread, rolls are the same as with de_parse().
+    srand(3);
+    for (size_t i = 0; i < NEXPRS; i++) {
+        int_least64_t value;
+        enum parse_error e = de_parse(exprs[i], &value, &expected);
+        ck_assert_int_eq(e, errors[i]);
+        if (e == 0) {
+            ck_assert_int_eq(value, values[i]);
+            ck_assert_str_eq(expected, batch.rolled + offsets[i]);
+        }
+        free(expected);
+        expected = NULL;
+    }
+}
+END_TEST
+
+START_TEST(threads) {
+    const size_t nthreads[] = { 2, 3, 7, NEXPRS + 1 };
+    for (size_t i = 0; i < sizeof(nthreads) / sizeof(nthreads[0]); i++) {
+        batch.nthreads = nthreads[i];
+        ck_assert_int_eq(de_parse_batch(exprs, &batch), 0);
+        check_batch();
+        free(batch.rolled);
+        batch.rolled = NULL;
+    }
+}
+END_TEST
+
+START_TEST(compiled_batch) {
+    for (size_t i = 0; i < NEXPRS; i++) {
+        // Use a valid expression for the syntax error.
+        const char *expr = some_errors[i % NSOME] == DE_SYNTAX_ERROR ?
+            "1d1" : exprs[i];
+        ck_assert_int_eq(de_compile(expr, &compiled[i]), 0);
+    }
+    batch.nthreads = 4;
+    ck_assert_int_eq(de_eval_batch((const de_expr *const *) compiled,
+                                   &batch), 0);
+
+    for (size_t i = 0; i < NEXPRS; i++) {
+        if (some_errors[i % NSOME] == DE_SYNTAX_ERROR) {
+            ck_assert_int_eq(errors[i], 0);
+            ck_assert_int_eq(values[i], 1);
+            ck_assert_str_eq(batch.rolled + offsets[i], "(1)");
+        }
+        else
+            ck_assert_int_eq(errors[i], some_errors[i % NSOME]);
+    }
+}
+END_TEST
+
+START_TEST(without_rolled) {
+    batch.offsets = NULL;
+    batch.nthreads = 2;
+    ck_assert_int_eq(de_parse_batch(exprs, &batch), 0);
+
+    ck_assert_ptr_eq(batch.rolled, NULL);
+    for (size_t i = 0; i < NEXPRS; i++) {
+        ck_assert_int_eq(errors[i], some_errors[i % NSOME]);
+        if (strcmp(exprs[i], "d1+d1+d1") == 0)
+            ck_assert_int_eq(values[i], 3);
+        if (strcmp(exprs[i], "-5") == 0)
+            ck_assert_int_eq(values[i], -5);
+    }
+}
+END_TEST
+
+START_TEST(limits) {
+    struct de_cost limits = { .dice = 3 };
+    de_set_limits(&limits);
+    ck_assert_int_eq(de_parse_batch(exprs, &batch), 0);
+    de_set_limits(NULL);
+
+    for (size_t i = 0; i < NSOME; i++) {
+        if (strcmp(exprs[i], "3d6<+2d10>-d4+2") == 0 ||
+            strcmp(exprs[i], "4d6<") == 0)
+            ck_assert_int_eq(errors[i], DE_LIMIT);
+    }
+}
+END_TEST
+
+START_TEST(empty) {
+    batch.n = 0;
+    batch.nthreads = 4;
+    ck_assert_int_eq(de_parse_batch(exprs, &batch), 0);
+    ck_assert_str_eq(batch.rolled, "");
+}
+END_TEST
+
+Suite*
+suite_diceexpr_batch() {
+    Suite *suite = suite_create("diceexpr_batch");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, same_as_parse);
+    tcase_add_test(tcase, threads);
+    tcase_add_test(tcase, compiled_batch);
+    tcase_add_test(tcase, without_rolled);
+    tcase_add_test(tcase, limits);
+    tcase_add_test(tcase, empty);
+
+    return suite;
+}
@@ -0,0 +1,83 @@
+#include "scan.h"
+#include "test.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+static int_least64_t value;
+
+static int
+scan(const char *digits) {
+    value = -1;
+    return scan_int(digits, strlen(digits), &value);
+}
+
+START_TEST(short_integers) {
+    ck_assert_int_eq(scan("0"), 0);
+    ck_assert_int_eq(value, 0);
+    ck_assert_int_eq(scan("7"), 0);
+    ck_assert_int_eq(value, 7);
+    ck_assert_int_eq(scan("1234567"), 0);
+    ck_assert_int_eq(value, 1234567);
+}
+END_TEST
+
+START_TEST(eight_digits_at_a_time) {
+    ck_assert_int_eq(scan("12345678"), 0);
+    ck_assert_int_eq(value, 12345678);
+    ck_assert_int_eq(scan("90000001"), 0);
+    ck_assert_int_eq(value, 90000001);
+    ck_assert_int_eq(scan("1234567890123456"), 0);
+    ck_assert_int_eq(value, 1234567890123456);
+    ck_assert_int_eq(scan("99999999999999999"), 0);
+    ck_assert_int_eq(value, 99999999999999999);
+}
+END_TEST
+
+START_TEST(same_as_strtoimax) {
+    char digits[32];
+    srand(5);
+    for (int i = 0; i < 10000; i++) {
+        uint_least64_t bits = (uint_least64_t) rand() << 32 ^
+            (uint_least64_t) rand() << 16 ^ rand();
+        int_least64_t n = (bits & INT_LEAST64_MAX) >> rand() % 63;
+        snprintf(digits, sizeof(digits), "%" PRIdLEAST64, n);
+        ck_assert_int_eq(scan(digits), 0);
+        ck_assert_int_eq(value, strtoimax(digits, NULL, 10));
+    }
+}
+END_TEST
+
+START_TEST(not_terminated) {
+    ck_assert_int_eq(scan_int("123456789d6", 9, &value), 0);
+    ck_assert_int_eq(value, 123456789);
+}
+END_TEST
+
+START_TEST(overflow) {
+    ck_assert_int_eq(scan("9223372036854775807"), 0);
+    ck_assert_int_eq(value, INT_LEAST64_MAX);
+    ck_assert_int_ne(scan("9223372036854775808"), 0);
+    ck_assert_int_ne(scan("9999999999999999999"), 0);
+    ck_assert_int_ne(scan("10000000000000000000"), 0);
+    ck_assert_int_ne(scan("123456789012345678901234567890"), 0);
+    ck_assert_int_eq(scan("0009223372036854775807"), 0);
+    ck_assert_int_eq(value, INT_LEAST64_MAX);
+}
+END_TEST
+
+Suite*
+suite_scan_int() {
+    Suite *suite = suite_create("scan_int");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+
+    tcase_add_test(tcase, short_integers);
+    tcase_add_test(tcase, eight_digits_at_a_time);
+    tcase_add_test(tcase, same_as_strtoimax);
+    tcase_add_test(tcase, not_terminated);
+    tcase_add_test(tcase, overflow);
+
+    return suite;
+}
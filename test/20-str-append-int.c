@@ -0,0 +1,44 @@
+#include "str.h"
+#include "test.h"
+#include <stdint.h>
+
+static str *s;
+
+static
+void teardown() {
+    str_free(s);
+}
+
+START_TEST(append_int) {
+    s = str_new("a");
+
+    str_append_int(s, 0);
+    str_append_int(s, 7);
+    str_append_int(s, -12);
+    str_append_int(s, 1234567890);
+    ck_assert_str_eq(s->str, "a07-121234567890");
+}
+END_TEST
+
+START_TEST(append_int_limits) {
+    s = str_new(NULL);
+
+    str_append_int(s, INT_LEAST64_MAX);
+    str_append_char(s, ' ');
+    str_append_int(s, INT_LEAST64_MIN);
+    ck_assert_str_eq(s->str, "9223372036854775807 -9223372036854775808");
+}
+END_TEST
+
+Suite*
+suite_str_append_int() {
+    Suite *suite = suite_create("str_append_int");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, NULL, teardown);
+
+    tcase_add_test(tcase, append_int);
+    tcase_add_test(tcase, append_int_limits);
+
+    return suite;
+}
@@ -0,0 +1,116 @@
+// clock_gettime()
+#define _POSIX_C_SOURCE 200809L
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Terms in a long expression, and seconds evaluating it may take.
+#define NTERMS 1000000
+#define SECONDS 10
+
+static char *expr;
+static char *rolled_expr;
+static int_least64_t value;
+
+static void
+setup() {
+    expr = NULL;
+    rolled_expr = NULL;
+    value = 0;
+}
+
+static void
+teardown() {
+    free(expr);
+    free(rolled_expr);
+}
+
+/* Make an expression of n copies of term separated by separator, followed
+ * by last.
+ */
+static char*
+repeat(const char *term, const char *separator, size_t n, const char *last) {
+    size_t term_len = strlen(term), separator_len = strlen(separator);
+    char *s = malloc(n * (term_len + separator_len) + strlen(last) + 1);
+    ck_assert_ptr_ne(s, NULL);
+    char *p = s;
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0) {
+            memcpy(p, separator, separator_len);
+            p += separator_len;
+        }
+        memcpy(p, term, term_len);
+        p += term_len;
+    }
+    strcpy(p, last);
+
+    return s;
+}
+
+static double
+seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+START_TEST(million_dices) {
+    expr = repeat("d6", "+", NTERMS, "");
+
+    double start = seconds();
+    ck_assert_int_eq(de_parse(expr, &value, &rolled_expr), 0);
+    ck_assert_double_le(seconds() - start, SECONDS);
+
+    ck_assert_int_ge(value, NTERMS);
+    ck_assert_int_le(value, 6 * NTERMS);
+    // "(N)+" for each dice.
+    ck_assert_uint_eq(strlen(rolled_expr), 4 * NTERMS - 1);
+}
+END_TEST
+
+START_TEST(million_constants) {
+    expr = repeat("1", "-", NTERMS, "");
+
+    double start = seconds();
+    ck_assert_int_eq(de_parse(expr, &value, &rolled_expr), 0);
+    ck_assert_double_le(seconds() - start, SECONDS);
+
+    ck_assert_int_eq(value, 2 - NTERMS);
+    ck_assert_str_eq(rolled_expr, expr);
+}
+END_TEST
+
+START_TEST(million_signs) {
+    // Even number of minus signs.
+    expr = repeat("-", "+", NTERMS, "5");
+
+    ck_assert_int_eq(de_parse(expr, &value, &rolled_expr), 0);
+    ck_assert_int_eq(value, 5);
+    ck_assert_str_eq(rolled_expr, expr);
+    free(expr);
+    free(rolled_expr);
+    rolled_expr = NULL;
+
+    expr = repeat("-", "-", NTERMS + 1, "d1");
+    ck_assert_int_eq(de_parse(expr, &value, &rolled_expr), 0);
+    ck_assert_int_eq(value, -1);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_long() {
+    Suite *suite = suite_create("diceexpr_long");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+    tcase_set_timeout(tcase, 2 * SECONDS);
+
+    tcase_add_test(tcase, million_dices);
+    tcase_add_test(tcase, million_constants);
+    tcase_add_test(tcase, million_signs);
+
+    return suite;
+}
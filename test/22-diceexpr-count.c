@@ -0,0 +1,229 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+static de_expr *compiled;
+static de_eval_state *state;
+static char *rolled_expr;
+static char *expected;
+static int_least64_t value;
+static int_least64_t expected_value;
+static struct de_cost cost;
+
+static void
+setup() {
+    compiled = NULL;
+    state = NULL;
+    rolled_expr = NULL;
+    expected = NULL;
+    value = 0;
+}
+
+static void
+teardown() {
+    de_set_output(NULL);
+    de_eval_free(state);
+    de_free(compiled);
+    free(rolled_expr);
+    free(expected);
+}
+
+/* Count rolls in "(a+b+c>=t: n)" meeting the threshold and check that n is
+ * the same.
+ * @return n.
+ */
+static int_least64_t
+check_count(const char *s, int at_least) {
+    ck_assert_int_eq(*s, '(');
+    const char *threshold = strstr(s, at_least ? ">=" : "<=");
+    ck_assert_ptr_ne(threshold, NULL);
+    int_least64_t t = strtoll(threshold + 2, NULL, 10);
+    int_least64_t n = 0;
+    char *end = (char*) s;
+    while (end < threshold) {
+        int_least64_t roll = strtoll(end + 1, &end, 10);
+        n += at_least ? roll >= t : roll <= t;
+    }
+    const char *colon = strstr(threshold, ": ");
+    ck_assert_ptr_ne(colon, NULL);
+    ck_assert_int_eq(strtoll(colon + 2, NULL, 10), n);
+
+    return n;
+}
+
+START_TEST(count) {
+    for (int i = 0; i < 100; i++) {
+        ck_assert_int_eq(de_parse("10d10>=8", &value, &rolled_expr), 0);
+        ck_assert_int_eq(check_count(rolled_expr, 1), value);
+        free(rolled_expr);
+        rolled_expr = NULL;
+
+        ck_assert_int_eq(de_parse("6d6<=2", &value, &rolled_expr), 0);
+        ck_assert_int_eq(check_count(rolled_expr, 0), value);
+        free(rolled_expr);
+        rolled_expr = NULL;
+
+        // Ignored rolls aren't shown or counted.
+        ck_assert_int_eq(de_parse("5d6<>>=4", &value, &rolled_expr), 0);
+        ck_assert_int_eq(check_count(rolled_expr, 1), value);
+        ck_assert_int_le(value, 3);
+        free(rolled_expr);
+        rolled_expr = NULL;
+    }
+}
+END_TEST
+
+START_TEST(thresholds) {
+    ck_assert_int_eq(de_parse("4d6>=7", &value, &rolled_expr), 0);
+    ck_assert_int_eq(value, 0);
+    free(rolled_expr);
+    rolled_expr = NULL;
+    ck_assert_int_eq(de_parse("4d6>=0", &value, &rolled_expr), 0);
+    ck_assert_int_eq(value, 4);
+    free(rolled_expr);
+    rolled_expr = NULL;
+    ck_assert_int_eq(de_parse("4d6<=6", &value, &rolled_expr), 0);
+    ck_assert_int_eq(value, 4);
+    free(rolled_expr);
+    rolled_expr = NULL;
+    ck_assert_int_eq(de_parse("2-3d1 >= 1+1", &value, &rolled_expr), 0);
+    ck_assert_int_eq(value, 0);
+    ck_assert_str_eq(rolled_expr, "2-(1+1+1>=1: 3)+1");
+}
+END_TEST
+
+START_TEST(syntax) {
+    ck_assert_int_eq(de_parse("d6>=", &value, &rolled_expr), DE_SYNTAX_ERROR);
+    ck_assert_int_eq(de_parse("1>=2", &value, &rolled_expr), DE_SYNTAX_ERROR);
+    ck_assert_int_eq(de_parse("d6>=2>=3", &value, &rolled_expr),
+                     DE_SYNTAX_ERROR);
+    ck_assert_int_eq(de_parse("d6>=2<", &value, &rolled_expr),
+                     DE_SYNTAX_ERROR);
+    ck_assert_int_eq(de_parse("d6=2", &value, &rolled_expr),
+                     DE_SYNTAX_ERROR);
+}
+END_TEST
+
+START_TEST(sampled) {
+    struct de_output output = { DE_OUTPUT_SUMMARY, 100 };
+    de_set_output(&output);
+
+    // Not sampled when the rolls are shown.
+    ck_assert_int_eq(de_parse("100d10>=8", &value, &rolled_expr), 0);
+    ck_assert_int_eq(check_count(rolled_expr, 1), value);
+    free(rolled_expr);
+    rolled_expr = NULL;
+
+    ck_assert_int_eq(de_parse("1000000d10>=8", &value, &rolled_expr), 0);
+    char buffer[100];
+    snprintf(buffer, sizeof(buffer), "(1000000d10>=8: %lld)",
+             (long long) value);
+    ck_assert_str_eq(rolled_expr, buffer);
+    // Standard deviation is about 458.
+    ck_assert_int_gt(value, 300000 - 5000);
+    ck_assert_int_lt(value, 300000 + 5000);
+    free(rolled_expr);
+    rolled_expr = NULL;
+
+    // Rolls with ignored rolls are rolled.
+    ck_assert_int_eq(de_parse("1000d10<>=8", &value, &rolled_expr), 0);
+    ck_assert_int_eq(strncmp(rolled_expr, "(1000d10<1>=8: ", 15), 0);
+
+    ck_assert_int_eq(de_compile("1000000000000d6<=1", &compiled), 0);
+    de_estimate(compiled, &cost);
+    ck_assert_uint_eq(cost.dice, 0);
+    ck_assert_uint_eq(cost.memory, 0);
+}
+END_TEST
+
+START_TEST(distribution) {
+    struct de_output output = { DE_OUTPUT_SUMMARY, 0 };
+    de_set_output(&output);
+    // Mean and variance of n trials with probability of success p, by
+    // inversion, by BTRD and by counting failures.
+    const char *exprs[] = { "20d10>=10", "50d10<=3", "40d10>=2" };
+    const double n[] = { 20, 50, 40 };
+    const double p[] = { 0.1, 0.3, 0.9 };
+    const int samples = 20000;
+
+    for (size_t i = 0; i < sizeof(exprs) / sizeof(exprs[0]); i++) {
+        ck_assert_int_eq(de_compile(exprs[i], &compiled), 0);
+        double sum = 0, squares = 0;
+        for (int j = 0; j < samples; j++) {
+            ck_assert_int_eq(de_eval(compiled, &value, &rolled_expr), 0);
+            ck_assert_int_ge(value, 0);
+            ck_assert_int_le(value, n[i]);
+            sum += value;
+            squares += (double) value * value;
+            free(rolled_expr);
+            rolled_expr = NULL;
+        }
+        double mean = sum / samples;
+        double variance = squares / samples - mean * mean;
+        ck_assert_double_eq_tol(mean, n[i] * p[i], 0.05 * n[i] * p[i]);
+        ck_assert_double_eq_tol(variance, n[i] * p[i] * (1 - p[i]),
+                                0.1 * n[i] * p[i] * (1 - p[i]));
+        de_free(compiled);
+        compiled = NULL;
+    }
+}
+END_TEST
+
+START_TEST(estimate_and_resume) {
+    const struct de_output outputs[] = {
+        { DE_OUTPUT_FULL, 0 }, { DE_OUTPUT_HISTOGRAM, 0 }
+    };
+    const char *exprs[] = { "1+300d20>=15-d6<=2", "2000d6<<>=5" };
+
+    for (size_t i = 0; i < sizeof(outputs) / sizeof(outputs[0]); i++) {
+        de_set_output(&outputs[i]);
+        for (size_t j = 0; j < sizeof(exprs) / sizeof(exprs[0]); j++) {
+            ck_assert_int_eq(de_compile(exprs[j], &compiled), 0);
+            de_estimate(compiled, &cost);
+
+            srand(j);
+            ck_assert_int_eq(de_eval(compiled, &expected_value, &expected),
+                             0);
+            ck_assert_uint_le(strlen(expected), cost.output);
+            srand(j);
+            ck_assert_int_eq(de_eval_start(compiled, &state), 0);
+            struct de_budget budget = { .work = 100 };
+            enum parse_error e;
+            while ((e = de_eval_continue(state, &budget, &value,
+                                         &rolled_expr)) == DE_IN_PROGRESS)
+                ;
+            ck_assert_int_eq(e, 0);
+            ck_assert_int_eq(value, expected_value);
+            ck_assert_str_eq(rolled_expr, expected);
+
+            de_eval_free(state);
+            state = NULL;
+            de_free(compiled);
+            compiled = NULL;
+            free(rolled_expr);
+            rolled_expr = NULL;
+            free(expected);
+            expected = NULL;
+        }
+    }
+}
+END_TEST
+
+Suite*
+suite_diceexpr_count() {
+    Suite *suite = suite_create("diceexpr_count");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, count);
+    tcase_add_test(tcase, thresholds);
+    tcase_add_test(tcase, syntax);
+    tcase_add_test(tcase, sampled);
+    tcase_add_test(tcase, distribution);
+    tcase_add_test(tcase, estimate_and_resume);
+
+    return suite;
+}
@@ -0,0 +1,195 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+static de_expr *compiled;
+static de_eval_state *state;
+static char *rolled_expr;
+static char *expected;
+static int_least64_t value;
+static int_least64_t expected_value;
+static struct de_cost cost;
+
+static void
+setup() {
+    compiled = NULL;
+    state = NULL;
+    rolled_expr = NULL;
+    expected = NULL;
+    value = 0;
+}
+
+static void
+teardown() {
+    de_set_explode_depth(0);
+    de_set_output(NULL);
+    de_eval_free(state);
+    de_free(compiled);
+    free(rolled_expr);
+    free(expected);
+}
+
+START_TEST(reroll) {
+    ck_assert_int_eq(de_compile("4d6r1", &compiled), 0);
+    for (int i = 0; i < 1000; i++) {
+        ck_assert_int_eq(de_eval(compiled, &value, &rolled_expr), 0);
+        ck_assert_int_ge(value, 8);
+        ck_assert_int_le(value, 24);
+        // Every roll is at least two.
+        for (const char *s = rolled_expr + 1; *s != '\0'; ) {
+            char *end;
+            ck_assert_int_ge(strtoll(s, &end, 10), 2);
+            s = end + 1;
+        }
+        free(rolled_expr);
+        rolled_expr = NULL;
+    }
+
+    ck_assert_int_eq(de_parse("3d6r5", &value, &rolled_expr), 0);
+    ck_assert_str_eq(rolled_expr, "(6+6+6)");
+    ck_assert_int_eq(value, 18);
+    free(rolled_expr);
+    rolled_expr = NULL;
+    ck_assert_int_eq(de_parse("d6r6", &value, &rolled_expr), DE_DICE);
+    ck_assert_int_eq(de_parse("d6r7", &value, &rolled_expr), DE_DICE);
+    ck_assert_int_eq(de_parse("d6r", &value, &rolled_expr), DE_SYNTAX_ERROR);
+    ck_assert_int_eq(de_parse("d6r1r2", &value, &rolled_expr),
+                     DE_SYNTAX_ERROR);
+}
+END_TEST
+
+START_TEST(explode) {
+    de_set_explode_depth(2);
+    ck_assert_int_eq(de_compile("d6!", &compiled), 0);
+
+    // Rolls 1-5 have probability 1/6 each, 7-11 1/36 and 13-18 1/216.
+    const int samples = 216000;
+    int counts[19] = { 0 };
+    for (int i = 0; i < samples; i++) {
+        ck_assert_int_eq(de_eval(compiled, &value, &rolled_expr), 0);
+        ck_assert_int_ge(value, 1);
+        ck_assert_int_le(value, 18);
+        counts[value]++;
+        free(rolled_expr);
+        rolled_expr = NULL;
+    }
+    ck_assert_int_eq(counts[6], 0);
+    ck_assert_int_eq(counts[12], 0);
+    for (int roll = 1; roll <= 18; roll++) {
+        if (roll % 6 == 0 && roll < 18)
+            continue;
+        const double p = roll < 6 ? 1.0 / 6 : roll < 12 ? 1.0 / 36 :
+            1.0 / 216;
+        ck_assert_double_eq_tol(counts[roll], samples * p,
+                                0.1 * samples * p);
+    }
+}
+END_TEST
+
+START_TEST(depth) {
+    ck_assert_int_eq(de_parse("d1!", &value, &rolled_expr), 0);
+    ck_assert_int_eq(value, DE_EXPLODE_DEPTH + 1);
+    free(rolled_expr);
+    rolled_expr = NULL;
+
+    de_set_explode_depth(3);
+    ck_assert_int_eq(de_parse("2d1!", &value, &rolled_expr), 0);
+    ck_assert_str_eq(rolled_expr, "(4+4)");
+    ck_assert_int_eq(value, 8);
+    free(rolled_expr);
+    rolled_expr = NULL;
+
+    // Only the sides left after rerolls explode.
+    ck_assert_int_eq(de_parse("d6r5!", &value, &rolled_expr), 0);
+    ck_assert_int_eq(value, 24);
+    free(rolled_expr);
+    rolled_expr = NULL;
+
+    de_set_explode_depth(INT_LEAST64_MAX);
+    ck_assert_int_eq(de_parse("d4611686018427387904!", &value, &rolled_expr),
+                     0);
+    free(rolled_expr);
+    rolled_expr = NULL;
+    ck_assert_int_eq(de_parse("d4611686018427387904r4611686018427387903!",
+                              &value, &rolled_expr), DE_OVERFLOW);
+    ck_assert_int_eq(de_parse("d6!!", &value, &rolled_expr), DE_SYNTAX_ERROR);
+}
+END_TEST
+
+START_TEST(summary) {
+    struct de_output output = { DE_OUTPUT_HISTOGRAM, 10 };
+    de_set_output(&output);
+    de_set_explode_depth(1);
+
+    ck_assert_int_eq(de_parse("20d1r0!<", &value, &rolled_expr), 0);
+    ck_assert_str_eq(rolled_expr, "(20d1!<1: 2x19)");
+    ck_assert_int_eq(value, 38);
+    free(rolled_expr);
+    rolled_expr = NULL;
+
+    ck_assert_int_eq(de_parse("20d6r5!>=7", &value, &rolled_expr), 0);
+    ck_assert_str_eq(rolled_expr, "(20d6r5!>=7: 20)");
+    ck_assert_int_eq(value, 20);
+}
+END_TEST
+
+START_TEST(estimate_and_resume) {
+    const struct de_output outputs[] = {
+        { DE_OUTPUT_FULL, 0 }, { DE_OUTPUT_HISTOGRAM, 0 },
+        { DE_OUTPUT_SUMMARY, 0 }
+    };
+    const char *exprs[] = {
+        "1+30d6r2!-d20!", "200d10r3<>", "300d4!>=6", "10d8r7!<<=9"
+    };
+
+    for (size_t i = 0; i < sizeof(outputs) / sizeof(outputs[0]); i++) {
+        de_set_output(&outputs[i]);
+        for (size_t j = 0; j < sizeof(exprs) / sizeof(exprs[0]); j++) {
+            ck_assert_int_eq(de_compile(exprs[j], &compiled), 0);
+            de_estimate(compiled, &cost);
+
+            srand(j);
+            ck_assert_int_eq(de_eval(compiled, &expected_value, &expected),
+                             0);
+            ck_assert_uint_le(strlen(expected), cost.output);
+            srand(j);
+            ck_assert_int_eq(de_eval_start(compiled, &state), 0);
+            struct de_budget budget = { .work = 100 };
+            enum parse_error e;
+            while ((e = de_eval_continue(state, &budget, &value,
+                                         &rolled_expr)) == DE_IN_PROGRESS)
+                ;
+            ck_assert_int_eq(e, 0);
+            ck_assert_int_eq(value, expected_value);
+            ck_assert_str_eq(rolled_expr, expected);
+
+            de_eval_free(state);
+            state = NULL;
+            de_free(compiled);
+            compiled = NULL;
+            free(rolled_expr);
+            rolled_expr = NULL;
+            free(expected);
+            expected = NULL;
+        }
+    }
+}
+END_TEST
+
+Suite*
+suite_diceexpr_explode() {
+    Suite *suite = suite_create("diceexpr_explode");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, reroll);
+    tcase_add_test(tcase, explode);
+    tcase_add_test(tcase, depth);
+    tcase_add_test(tcase, summary);
+    tcase_add_test(tcase, estimate_and_resume);
+
+    return suite;
+}
@@ -0,0 +1,218 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#define NCALLS 16
+#define NTHREADS 4
+
+static char *rolled_expr;
+static int_least64_t value;
+static struct de_slow_call calls[NCALLS];
+
+static void
+setup() {
+    rolled_expr = NULL;
+    value = 0;
+    memset(calls, 0, sizeof(calls));
+}
+
+static void
+teardown() {
+    de_slow_log_stop();
+    free(rolled_expr);
+}
+
+static void
+parse(const char *expr, enum parse_error error) {
+    ck_assert_int_eq(de_parse(expr, &value, &rolled_expr), error);
+    free(rolled_expr);
+    rolled_expr = NULL;
+}
+
+START_TEST(stopped) {
+    parse("d6", 0);
+    ck_assert_uint_eq(de_slow_log_dump(calls, NCALLS), 0);
+}
+END_TEST
+
+START_TEST(every_call) {
+    ck_assert_int_eq(de_slow_log_start(NULL), 0);
+    parse("3d6<+2", 0);
+    parse("d0", DE_DICE);
+    ck_assert_int_eq(de_parse_sink("10d4", de_sink_fd, &(int){ -1 }, &value),
+                     DE_OUTPUT);
+
+    ck_assert_uint_eq(de_slow_log_dump(calls, NCALLS), 3);
+    ck_assert_str_eq(calls[0].expr, "3d6<+2");
+    ck_assert_uint_eq(calls[0].len, 6);
+    ck_assert_int_eq(calls[0].error, 0);
+    ck_assert_uint_eq(calls[0].dice, 3);
+    uint_least64_t stages = 0;
+    for (int i = 0; i < DE_SLOW_STAGES; i++)
+        stages += calls[0].stages[i];
+    ck_assert_uint_le(stages, calls[0].nanoseconds);
+    ck_assert_uint_gt(calls[0].stages[DE_SLOW_PARSE], 0);
+    ck_assert_uint_gt(calls[0].stages[DE_SLOW_EVAL], 0);
+
+    // Stages after an error aren't timed.
+    ck_assert_str_eq(calls[1].expr, "d0");
+    ck_assert_int_eq(calls[1].error, DE_DICE);
+    ck_assert_uint_eq(calls[1].dice, 0);
+    ck_assert_uint_eq(calls[1].stages[DE_SLOW_EVAL], 0);
+    ck_assert_uint_eq(calls[1].stages[DE_SLOW_COPY], 0);
+
+    ck_assert_str_eq(calls[2].expr, "10d4");
+    ck_assert_int_eq(calls[2].error, DE_OUTPUT);
+    ck_assert_uint_eq(calls[2].dice, 10);
+
+    // Only the newest are copied.
+    ck_assert_uint_eq(de_slow_log_dump(calls, 1), 1);
+    ck_assert_str_eq(calls[0].expr, "10d4");
+}
+END_TEST
+
+START_TEST(thresholds) {
+    const struct de_slow_log_config config = {
+        .nanoseconds = UINT64_C(60000000000), .dice = 1000
+    };
+    ck_assert_int_eq(de_slow_log_start(&config), 0);
+    parse("999d6+1", 0);
+    parse("d6+1000", 0);
+    parse("500d6+500d6", 0);
+    parse("1000000d6>=5", 0);
+
+    ck_assert_uint_eq(de_slow_log_dump(calls, NCALLS), 2);
+    ck_assert_str_eq(calls[0].expr, "500d6+500d6");
+    ck_assert_uint_eq(calls[0].dice, 1000);
+    ck_assert_str_eq(calls[1].expr, "1000000d6>=5");
+}
+END_TEST
+
+START_TEST(dice_only) {
+    const struct de_slow_log_config config = { .dice = 1000 };
+    ck_assert_int_eq(de_slow_log_start(&config), 0);
+    parse("999d6", 0);
+    parse("1000d6", 0);
+
+    ck_assert_uint_eq(de_slow_log_dump(calls, NCALLS), 1);
+    ck_assert_str_eq(calls[0].expr, "1000d6");
+    ck_assert_uint_gt(calls[0].stages[DE_SLOW_EVAL], 0);
+}
+END_TEST
+
+START_TEST(time_only) {
+    const struct de_slow_log_config config = { .nanoseconds = 1 };
+    ck_assert_int_eq(de_slow_log_start(&config), 0);
+    parse("3d6", 0);
+
+    // Logged for its time, stages are timed too.
+    ck_assert_uint_eq(de_slow_log_dump(calls, NCALLS), 1);
+    ck_assert_uint_eq(calls[0].dice, 3);
+    ck_assert_uint_gt(calls[0].nanoseconds, 0);
+    uint_least64_t sum = 0;
+    for (int i = 0; i < DE_SLOW_STAGES; i++) {
+        ck_assert_uint_gt(calls[0].stages[i], 0);
+        sum += calls[0].stages[i];
+    }
+    ck_assert_uint_le(sum, calls[0].nanoseconds);
+}
+END_TEST
+
+START_TEST(truncated) {
+    ck_assert_int_eq(de_slow_log_start(NULL), 0);
+    char expr[2 * DE_SLOW_EXPR];
+    size_t len = 0;
+    while (len + 3 < sizeof(expr)) {
+        memcpy(expr + len, "+d6", 3);
+        len += 3;
+    }
+    expr[len] = '\0';
+    parse(expr, 0);
+
+    ck_assert_uint_eq(de_slow_log_dump(calls, NCALLS), 1);
+    ck_assert_uint_eq(calls[0].len, len);
+    ck_assert_uint_eq(strlen(calls[0].expr), DE_SLOW_EXPR - 1);
+    ck_assert_int_eq(strncmp(calls[0].expr, expr, DE_SLOW_EXPR - 1), 0);
+}
+END_TEST
+
+START_TEST(wraps) {
+    const struct de_slow_log_config config = { .size = 3 };
+    ck_assert_int_eq(de_slow_log_start(&config), 0);
+    char expr[32];
+    for (int i = 1; i <= 10; i++) {
+        snprintf(expr, sizeof(expr), "%d", i);
+        parse(expr, 0);
+    }
+
+    // Size is rounded up to four.
+    ck_assert_uint_eq(de_slow_log_dump(calls, NCALLS), 4);
+    for (int i = 0; i < 4; i++) {
+        snprintf(expr, sizeof(expr), "%d", 7 + i);
+        ck_assert_str_eq(calls[i].expr, expr);
+    }
+}
+END_TEST
+
+static void*
+parse_many(void *arg) {
+    const char *expr = arg;
+    for (int i = 0; i < 2000; i++) {
+        int_least64_t v;
+        char *rolled = NULL;
+        if (de_parse(expr, &v, &rolled) == 0)
+            free(rolled);
+    }
+
+    return NULL;
+}
+
+START_TEST(threads) {
+    const struct de_slow_log_config config = { .size = 8 };
+    ck_assert_int_eq(de_slow_log_start(&config), 0);
+    const char *exprs[NTHREADS] = { "d4", "2d6", "3d8", "4d10" };
+    pthread_t threads[NTHREADS];
+    for (int i = 0; i < NTHREADS; i++) {
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, parse_many,
+                                        (void*) exprs[i]), 0);
+    }
+    // Dumps while calls are written only copy whole calls.
+    for (int i = 0; i < 1000; i++) {
+        size_t n = de_slow_log_dump(calls, NCALLS);
+        ck_assert_uint_le(n, 8);
+        for (size_t j = 0; j < n; j++) {
+            int k = 0;
+            while (k < NTHREADS && strcmp(calls[j].expr, exprs[k]) != 0)
+                k++;
+            ck_assert_int_lt(k, NTHREADS);
+            ck_assert_uint_eq(calls[j].dice, k + 1);
+        }
+    }
+    for (int i = 0; i < NTHREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    ck_assert_uint_eq(de_slow_log_dump(calls, NCALLS), 8);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_slow_log() {
+    Suite *suite = suite_create("diceexpr_slow_log");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, stopped);
+    tcase_add_test(tcase, every_call);
+    tcase_add_test(tcase, thresholds);
+    tcase_add_test(tcase, dice_only);
+    tcase_add_test(tcase, time_only);
+    tcase_add_test(tcase, truncated);
+    tcase_add_test(tcase, wraps);
+    tcase_add_test(tcase, threads);
+
+    return suite;
+}
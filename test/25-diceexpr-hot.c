@@ -0,0 +1,159 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#define NTOP 8
+#define NTHREADS 4
+
+static char *rolled_expr;
+static int_least64_t value;
+static struct de_hot_expr top[NTOP];
+
+static void
+setup() {
+    rolled_expr = NULL;
+    value = 0;
+    memset(top, 0, sizeof(top));
+}
+
+static void
+teardown() {
+    de_hot_stop();
+    free(rolled_expr);
+}
+
+static void
+parse(const char *expr, int times) {
+    for (int i = 0; i < times; i++) {
+        de_parse(expr, &value, &rolled_expr);
+        free(rolled_expr);
+        rolled_expr = NULL;
+    }
+}
+
+START_TEST(stopped) {
+    parse("d6", 1);
+    ck_assert_uint_eq(de_hot_top(top, NTOP), 0);
+}
+END_TEST
+
+START_TEST(hottest) {
+    ck_assert_int_eq(de_hot_start(NULL), 0);
+    parse("3d6", 30);
+    parse("d20", 20);
+    parse("d0", 10);
+    // Normalized to the same as "4d6<".
+    parse("4D6 <", 6);
+    parse("4d6<", 6);
+
+    ck_assert_uint_eq(de_hot_top(top, NTOP), 4);
+    ck_assert_str_eq(top[0].expr, "3d6");
+    ck_assert_uint_ge(top[0].count, 30);
+    ck_assert_str_eq(top[1].expr, "d20");
+    ck_assert_uint_ge(top[1].count, 20);
+    ck_assert_str_eq(top[2].expr, "4d6<");
+    ck_assert_uint_ge(top[2].count, 12);
+    ck_assert_str_eq(top[3].expr, "d0");
+    for (int i = 0; i < 4; i++)
+        ck_assert_uint_gt(top[i].nanoseconds, 0);
+
+    ck_assert_uint_eq(de_hot_top(top, 1), 1);
+    ck_assert_str_eq(top[0].expr, "3d6");
+}
+END_TEST
+
+START_TEST(evicted) {
+    // Two candidates, the coldest is replaced by hotter expressions.
+    const struct de_hot_config config = { .k = 2, .width = 4096 };
+    ck_assert_int_eq(de_hot_start(&config), 0);
+    char expr[32];
+    for (int i = 1; i <= 50; i++) {
+        snprintf(expr, sizeof(expr), "%d", i);
+        parse(expr, 1);
+    }
+    parse("d4", 10);
+    parse("d8", 20);
+
+    ck_assert_uint_eq(de_hot_top(top, NTOP), 2);
+    ck_assert_str_eq(top[0].expr, "d8");
+    ck_assert_str_eq(top[1].expr, "d4");
+}
+END_TEST
+
+START_TEST(truncated) {
+    ck_assert_int_eq(de_hot_start(NULL), 0);
+    char expr[2 * DE_HOT_EXPR];
+    size_t len = 0;
+    while (len + 2 < sizeof(expr)) {
+        memcpy(expr + len, "+1", 2);
+        len += 2;
+    }
+    expr[len] = '\0';
+    parse(expr, 2);
+    // Different after the kept characters.
+    expr[len - 1] = '2';
+    parse(expr, 1);
+
+    ck_assert_uint_eq(de_hot_top(top, NTOP), 2);
+    ck_assert_uint_eq(strlen(top[0].expr), DE_HOT_EXPR - 1);
+    ck_assert_uint_ge(top[0].count, 2);
+    ck_assert_str_eq(top[0].expr, top[1].expr);
+}
+END_TEST
+
+static void*
+parse_many(void *arg) {
+    const char *expr = arg;
+    for (int i = 0; i < 1000; i++) {
+        int_least64_t v;
+        char *rolled = NULL;
+        if (de_parse(expr, &v, &rolled) == 0)
+            free(rolled);
+        rolled = NULL;
+        if (de_parse("d100", &v, &rolled) == 0)
+            free(rolled);
+    }
+
+    return NULL;
+}
+
+START_TEST(threads) {
+    ck_assert_int_eq(de_hot_start(NULL), 0);
+    const char *exprs[NTHREADS] = { "d4", "2d6", "3d8", "4d10" };
+    pthread_t threads[NTHREADS];
+    for (int i = 0; i < NTHREADS; i++) {
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, parse_many,
+                                        (void*) exprs[i]), 0);
+    }
+    for (int i = 0; i < 100; i++)
+        ck_assert_uint_le(de_hot_top(top, NTOP), NTHREADS + 1);
+    for (int i = 0; i < NTHREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    // Counts of all threads are merged.
+    ck_assert_uint_eq(de_hot_top(top, NTOP), NTHREADS + 1);
+    ck_assert_str_eq(top[0].expr, "d100");
+    ck_assert_uint_ge(top[0].count, NTHREADS * 1000);
+    for (int i = 1; i <= NTHREADS; i++)
+        ck_assert_uint_ge(top[i].count, 1000);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_hot() {
+    Suite *suite = suite_create("diceexpr_hot");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, stopped);
+    tcase_add_test(tcase, hottest);
+    tcase_add_test(tcase, evicted);
+    tcase_add_test(tcase, truncated);
+    tcase_add_test(tcase, threads);
+
+    return suite;
+}
@@ -0,0 +1,203 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define SEED 12345
+
+static de_audit *audit;
+static de_expr *compiled;
+static struct buffer buffer;
+static int_least64_t value;
+
+static void
+setup() {
+    audit = NULL;
+    compiled = NULL;
+    buffer.chars = NULL;
+    buffer.len = 0;
+    buffer.max = 0;
+    value = 0;
+}
+
+static void
+teardown() {
+    de_set_output(NULL);
+    de_set_explode_depth(0);
+    de_audit_close(audit);
+    de_free(compiled);
+    free(buffer.chars);
+}
+
+START_TEST(replay) {
+    const char *exprs[] = {
+        "3d6<+2", "d0", "1000000d10>=8", "d20-30", "3d6<+2"
+    };
+    const size_t nexprs = sizeof(exprs) / sizeof(exprs[0]);
+    int_least64_t values[sizeof(exprs) / sizeof(exprs[0])];
+    enum parse_error errors[sizeof(exprs) / sizeof(exprs[0])];
+
+    ck_assert_int_eq(de_audit_open(SEED, write_buffer, &buffer, &audit), 0);
+    for (size_t i = 0; i < nexprs; i++) {
+        values[i] = 0;
+        errors[i] = de_audit_parse(audit, exprs[i], &values[i]);
+    }
+    ck_assert_int_eq(de_audit_close(audit), 0);
+    audit = NULL;
+    ck_assert_int_eq(errors[1], DE_DICE);
+    ck_assert_int_eq(errors[0], 0);
+    ck_assert_int_ge(values[0], 4);
+    ck_assert_int_le(values[0], 14);
+
+    struct de_audit_reader reader;
+    ck_assert_int_eq(de_audit_reader_init(&reader, buffer.chars, buffer.len),
+                     0);
+    ck_assert_uint_eq(reader.seed, SEED);
+    for (size_t i = 0; i < nexprs; i++) {
+        ck_assert_uint_lt(reader.offset, reader.size);
+        struct de_audit_record record;
+        ck_assert_int_eq(de_audit_read(&reader, &record), 0);
+        ck_assert_uint_eq(record.counter, i);
+        ck_assert_int_eq(record.error, errors[i]);
+        ck_assert_int_eq(record.value, values[i]);
+        if (i < 4) {
+            ck_assert_uint_eq(record.id, i);
+            ck_assert_uint_eq(record.len, strlen(exprs[i]));
+            ck_assert_int_eq(memcmp(record.expr, exprs[i], record.len), 0);
+        }
+        else {
+            // Seen before, only the id is written.
+            ck_assert_uint_eq(record.id, 0);
+            ck_assert_ptr_eq(record.expr, NULL);
+        }
+
+        if (errors[i] == 0) {
+            ck_assert_int_eq(de_compile(exprs[i], &compiled), 0);
+            int_least64_t v;
+            ck_assert_int_eq(de_audit_eval(compiled, reader.seed,
+                                           record.counter, &v), 0);
+            ck_assert_int_eq(v, values[i]);
+            de_free(compiled);
+            compiled = NULL;
+        }
+    }
+    ck_assert_uint_eq(reader.offset, reader.size);
+}
+END_TEST
+
+START_TEST(independent) {
+    // Calls don't depend on rand(), the pool or threads rolling large dices.
+    ck_assert_int_eq(de_compile("10d100+2000000d6", &compiled), 0);
+    srand(1);
+    int_least64_t expected;
+    ck_assert_int_eq(de_audit_eval(compiled, SEED, 7, &expected), 0);
+
+    srand(2);
+    ck_assert_int_eq(de_pool_start(NULL), 0);
+    ck_assert_int_eq(de_parallel_start(NULL), 0);
+    ck_assert_int_eq(de_audit_eval(compiled, SEED, 7, &value), 0);
+    de_parallel_stop();
+    de_pool_stop();
+    ck_assert_int_eq(value, expected);
+
+    // Other counters and seeds roll differently.
+    ck_assert_int_eq(de_audit_eval(compiled, SEED, 8, &value), 0);
+    ck_assert_int_ne(value, expected);
+    ck_assert_int_eq(de_audit_eval(compiled, SEED + 1, 7, &value), 0);
+    ck_assert_int_ne(value, expected);
+}
+END_TEST
+
+START_TEST(settings) {
+    // Calls don't depend on the output style or the explode depth.
+    ck_assert_int_eq(de_compile("3d6!+100d6>=5", &compiled), 0);
+    int_least64_t expected;
+    ck_assert_int_eq(de_audit_eval(compiled, SEED, 3, &expected), 0);
+
+    const struct de_output output = { DE_OUTPUT_SUMMARY, 1 };
+    de_set_output(&output);
+    de_set_explode_depth(1);
+    ck_assert_int_eq(de_audit_eval(compiled, SEED, 3, &value), 0);
+    ck_assert_int_eq(value, expected);
+}
+END_TEST
+
+START_TEST(compact) {
+    ck_assert_int_eq(de_audit_open(SEED, write_buffer, &buffer, &audit), 0);
+    ck_assert_int_eq(de_audit_parse(audit, "100d100", &value), 0);
+    ck_assert_int_eq(de_audit_close(audit), 0);
+    audit = NULL;
+    const size_t first = buffer.len;
+
+    free(buffer.chars);
+    buffer.chars = NULL;
+    buffer.len = 0;
+    ck_assert_int_eq(de_audit_open(SEED, write_buffer, &buffer, &audit), 0);
+    for (int i = 0; i < 1000; i++)
+        ck_assert_int_eq(de_audit_parse(audit, "100d100", &value), 0);
+    ck_assert_int_eq(de_audit_close(audit), 0);
+    audit = NULL;
+
+    // Error byte, id and a value of at most 10000 in three bytes.
+    ck_assert_uint_le(buffer.len, first + 999 * 5);
+}
+END_TEST
+
+START_TEST(corrupted) {
+    struct de_audit_reader reader;
+    ck_assert_int_eq(de_audit_reader_init(&reader, "DEAX", 4),
+                     DE_SYNTAX_ERROR);
+
+    ck_assert_int_eq(de_audit_open(SEED, write_buffer, &buffer, &audit), 0);
+    ck_assert_int_eq(de_audit_parse(audit, "d6", &value), 0);
+    ck_assert_int_eq(de_audit_close(audit), 0);
+    audit = NULL;
+
+    // Truncated record.
+    ck_assert_int_eq(de_audit_reader_init(&reader, buffer.chars,
+                                          buffer.len - 2), 0);
+    struct de_audit_record record;
+    ck_assert_int_eq(de_audit_read(&reader, &record), DE_SYNTAX_ERROR);
+
+    // Id of an expression not seen yet.
+    buffer.chars[buffer.len - 5] = 0;
+    buffer.chars[buffer.len - 4] = 1;
+    ck_assert_int_eq(de_audit_reader_init(&reader, buffer.chars, buffer.len),
+                     0);
+    ck_assert_int_eq(de_audit_read(&reader, &record), DE_SYNTAX_ERROR);
+}
+END_TEST
+
+START_TEST(sink_fails) {
+    buffer.max = 4;
+    ck_assert_int_eq(de_audit_open(SEED, write_buffer, &buffer, &audit), 0);
+    ck_assert_int_eq(de_audit_close(audit), DE_OUTPUT);
+    audit = NULL;
+
+    buffer.len = 0;
+    buffer.max = DE_SINK_CHUNK;
+    ck_assert_int_eq(de_audit_open(SEED, write_buffer, &buffer, &audit), 0);
+    enum parse_error e = 0;
+    for (int i = 0; i < 10000 && e == 0; i++)
+        e = de_audit_parse(audit, "d6", &value);
+    ck_assert_int_eq(e, DE_OUTPUT);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_audit() {
+    Suite *suite = suite_create("diceexpr_audit");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, replay);
+    tcase_add_test(tcase, independent);
+    tcase_add_test(tcase, settings);
+    tcase_add_test(tcase, compact);
+    tcase_add_test(tcase, corrupted);
+    tcase_add_test(tcase, sink_fails);
+
+    return suite;
+}
@@ -0,0 +1,200 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define SEED 777
+#define NCALLS 3000
+
+static de_expr *compiled;
+static de_sim *sim, *part1, *part2, *part3;
+static struct buffer buffer;
+
+static void
+setup() {
+    compiled = NULL;
+    sim = part1 = part2 = part3 = NULL;
+    buffer.chars = NULL;
+    buffer.len = 0;
+    buffer.max = 0;
+}
+
+static void
+teardown() {
+    de_free(compiled);
+    de_sim_free(sim);
+    de_sim_free(part1);
+    de_sim_free(part2);
+    de_sim_free(part3);
+    free(buffer.chars);
+}
+
+static void
+assert_same(const de_sim *a, const de_sim *b) {
+    struct de_sim_stats x, y;
+    de_sim_stats(a, &x);
+    de_sim_stats(b, &y);
+    ck_assert_uint_eq(x.fingerprint, y.fingerprint);
+    ck_assert_uint_eq(x.seed, y.seed);
+    ck_assert_uint_eq(x.begin, y.begin);
+    ck_assert_uint_eq(x.end, y.end);
+    ck_assert_uint_eq(x.nerrors, y.nerrors);
+    ck_assert_double_eq_tol(x.mean, y.mean, 1e-9);
+    ck_assert_double_eq_tol(x.variance, y.variance, 1e-9);
+    ck_assert_double_eq_tol(x.skewness, y.skewness, 1e-9);
+    ck_assert_double_eq_tol(x.kurtosis, y.kurtosis, 1e-9);
+
+    size_t n, m;
+    const struct de_sim_bin *p = de_sim_histogram(a, &n),
+        *q = de_sim_histogram(b, &m);
+    ck_assert_uint_eq(n, m);
+    for (size_t i = 0; i < n; i++) {
+        ck_assert_int_eq(p[i].value, q[i].value);
+        ck_assert_uint_eq(p[i].count, q[i].count);
+    }
+}
+
+START_TEST(run) {
+    ck_assert_int_eq(de_compile("3d6-4", &compiled), 0);
+    ck_assert_int_eq(de_sim_run(compiled, SEED, 100, 100 + NCALLS, &sim), 0);
+
+    // Same calls as an audit log with the seed.
+    uint_least64_t counts[16] = { 0 };
+    for (uint_least64_t c = 100; c < 100 + NCALLS; c++) {
+        int_least64_t value;
+        ck_assert_int_eq(de_audit_eval(compiled, SEED, c, &value), 0);
+        counts[value + 1]++;
+    }
+    size_t nbins;
+    const struct de_sim_bin *bins = de_sim_histogram(sim, &nbins);
+    ck_assert_uint_eq(nbins, 16);
+    for (size_t i = 0; i < nbins; i++) {
+        ck_assert_int_eq(bins[i].value, (int_least64_t) i - 1);
+        ck_assert_uint_eq(bins[i].count, counts[i]);
+    }
+
+    struct de_sim_stats stats;
+    de_sim_stats(sim, &stats);
+    ck_assert_uint_eq(stats.nerrors, 0);
+    ck_assert_int_eq(stats.min, -1);
+    ck_assert_int_eq(stats.max, 14);
+    ck_assert_double_eq_tol(stats.mean, 6.5, 0.2);
+    ck_assert_double_eq_tol(stats.variance, 8.75, 0.6);
+    ck_assert_double_eq_tol(stats.skewness, 0, 0.1);
+    ck_assert_double_eq_tol(stats.kurtosis, -0.23, 0.2);
+}
+END_TEST
+
+START_TEST(errors) {
+    ck_assert_int_eq(de_compile("9223372036854775806+d2", &compiled), 0);
+    ck_assert_int_eq(de_sim_run(compiled, SEED, 0, 1000, &sim), 0);
+
+    struct de_sim_stats stats;
+    de_sim_stats(sim, &stats);
+    ck_assert_uint_gt(stats.nerrors, 0);
+    ck_assert_uint_lt(stats.nerrors, 1000);
+    ck_assert_uint_eq(stats.nbins, 1);
+    ck_assert_int_eq(stats.min, INT_LEAST64_MAX);
+    ck_assert_double_eq(stats.variance, 0);
+}
+END_TEST
+
+START_TEST(merge) {
+    ck_assert_int_eq(de_compile("2d20>+d100!", &compiled), 0);
+    ck_assert_int_eq(de_sim_run(compiled, SEED, 0, NCALLS, &sim), 0);
+    ck_assert_int_eq(de_sim_run(compiled, SEED, 0, 1000, &part1), 0);
+    ck_assert_int_eq(de_sim_run(compiled, SEED, 1000, 1001, &part2), 0);
+    ck_assert_int_eq(de_sim_run(compiled, SEED, 1001, NCALLS, &part3), 0);
+
+    // Parts merged in any order give the same as one simulation.
+    ck_assert_int_eq(de_sim_merge(part2, part3), 0);
+    ck_assert_int_eq(de_sim_merge(part2, part1), 0);
+    assert_same(part2, sim);
+}
+END_TEST
+
+START_TEST(mismatch) {
+    ck_assert_int_eq(de_compile("d6", &compiled), 0);
+    ck_assert_int_eq(de_sim_run(compiled, SEED, 0, 100, &sim), 0);
+    // Overlapping and with a gap.
+    ck_assert_int_eq(de_sim_run(compiled, SEED, 50, 150, &part1), 0);
+    ck_assert_int_eq(de_sim_merge(sim, part1), DE_MISMATCH);
+    de_sim_free(part1);
+    part1 = NULL;
+    ck_assert_int_eq(de_sim_run(compiled, SEED, 101, 150, &part1), 0);
+    ck_assert_int_eq(de_sim_merge(sim, part1), DE_MISMATCH);
+    // Another seed.
+    ck_assert_int_eq(de_sim_run(compiled, SEED + 1, 100, 150, &part2), 0);
+    ck_assert_int_eq(de_sim_merge(sim, part2), DE_MISMATCH);
+    // Another expression, but the same one written differently merges.
+    de_free(compiled);
+    compiled = NULL;
+    ck_assert_int_eq(de_compile("d8", &compiled), 0);
+    ck_assert_int_eq(de_sim_run(compiled, SEED, 100, 150, &part3), 0);
+    ck_assert_int_eq(de_sim_merge(sim, part3), DE_MISMATCH);
+    de_sim_free(part3);
+    part3 = NULL;
+    de_free(compiled);
+    compiled = NULL;
+    ck_assert_int_eq(de_compile("1D6", &compiled), 0);
+    ck_assert_int_eq(de_sim_run(compiled, SEED, 100, 150, &part3), 0);
+    ck_assert_int_eq(de_sim_merge(sim, part3), 0);
+
+    struct de_sim_stats stats;
+    de_sim_stats(sim, &stats);
+    ck_assert_uint_eq(stats.begin, 0);
+    ck_assert_uint_eq(stats.end, 150);
+}
+END_TEST
+
+START_TEST(write_read) {
+    ck_assert_int_eq(de_compile("-10d10<<+5", &compiled), 0);
+    ck_assert_int_eq(de_sim_run(compiled, SEED, 5, 5 + NCALLS, &sim), 0);
+    ck_assert_int_eq(de_sim_write(sim, write_buffer, &buffer), 0);
+    // Bins are a few bytes each.
+    ck_assert_uint_lt(buffer.len, 100 + 4 * 64);
+    ck_assert_int_eq(de_sim_read(buffer.chars, buffer.len, &part1), 0);
+    assert_same(part1, sim);
+
+    // Empty simulation.
+    ck_assert_int_eq(de_sim_run(compiled, SEED, 5, 5, &part2), 0);
+    buffer.len = 0;
+    ck_assert_int_eq(de_sim_write(part2, write_buffer, &buffer), 0);
+    ck_assert_int_eq(de_sim_read(buffer.chars, buffer.len, &part3), 0);
+    assert_same(part3, part2);
+}
+END_TEST
+
+START_TEST(corrupted) {
+    ck_assert_int_eq(de_compile("3d6", &compiled), 0);
+    ck_assert_int_eq(de_sim_run(compiled, SEED, 0, 100, &sim), 0);
+    ck_assert_int_eq(de_sim_write(sim, write_buffer, &buffer), 0);
+
+    ck_assert_int_eq(de_sim_read("DESX", 4, &part1), DE_SYNTAX_ERROR);
+    ck_assert_int_eq(de_sim_read(buffer.chars, buffer.len - 1, &part1),
+                     DE_SYNTAX_ERROR);
+    // Counts don't add up to the number of calls.
+    buffer.chars[buffer.len - 1]++;
+    ck_assert_int_eq(de_sim_read(buffer.chars, buffer.len, &part1),
+                     DE_SYNTAX_ERROR);
+    ck_assert_ptr_eq(part1, NULL);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_sim() {
+    Suite *suite = suite_create("diceexpr_sim");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, run);
+    tcase_add_test(tcase, errors);
+    tcase_add_test(tcase, merge);
+    tcase_add_test(tcase, mismatch);
+    tcase_add_test(tcase, write_read);
+    tcase_add_test(tcase, corrupted);
+
+    return suite;
+}
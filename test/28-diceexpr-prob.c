@@ -0,0 +1,184 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define TOLERANCE 1e-12
+
+static de_expr *a, *b;
+
+static void
+setup() {
+    a = b = NULL;
+}
+
+static void
+teardown() {
+    de_free(a);
+    de_free(b);
+    de_set_explode_depth(0);
+}
+
+/* Probability of a value at least threshold, counted from every outcome of
+ * nrolls rolls of a dice with sides, summing or counting the kept rolls
+ * as the expression does.
+ */
+static double
+enumerate(int nrolls,
+          int sides,
+          int reroll,
+          int small,
+          int large,
+          int at_least,
+          int threshold) {
+    int rolls[8], sorted[8];
+    int outcomes = 1, hits = 0;
+    for (int i = 0; i < nrolls; i++)
+        outcomes *= sides - reroll;
+    for (int o = 0; o < outcomes; o++) {
+        for (int i = 0, rest = o; i < nrolls; i++, rest /= sides - reroll)
+            rolls[i] = reroll + 1 + rest % (sides - reroll);
+        // Insertion sort.
+        for (int i = 0; i < nrolls; i++) {
+            int j = i;
+            for (; j > 0 && sorted[j - 1] > rolls[i]; j--)
+                sorted[j] = sorted[j - 1];
+            sorted[j] = rolls[i];
+        }
+        int value = 0;
+        for (int i = small; i < nrolls - large; i++)
+            value += at_least > 0 ? sorted[i] >= at_least : sorted[i];
+        hits += value >= threshold;
+    }
+
+    return (double) hits / outcomes;
+}
+
+static double
+at_least(const char *expr, int_least64_t threshold) {
+    de_free(a);
+    a = NULL;
+    ck_assert_int_eq(de_compile(expr, &a), 0);
+    double p = -1;
+    ck_assert_int_eq(de_prob_at_least(a, threshold, &p), 0);
+
+    return p;
+}
+
+START_TEST(sums) {
+    ck_assert_double_eq_tol(at_least("d6", 4), 0.5, TOLERANCE);
+    ck_assert_double_eq_tol(at_least("d6", 7), 0, TOLERANCE);
+    ck_assert_double_eq_tol(at_least("d6", -5), 1, TOLERANCE);
+    ck_assert_double_eq_tol(at_least("2d6", 7), 21.0 / 36, TOLERANCE);
+    ck_assert_double_eq_tol(at_least("2d6+3-1", 9), 21.0 / 36, TOLERANCE);
+    ck_assert_double_eq_tol(at_least("7-d6", 6), 1.0 / 6, TOLERANCE);
+    ck_assert_double_eq_tol(at_least("--d6", 6), 1.0 / 6, TOLERANCE);
+    for (int t = 3; t <= 19; t++) {
+        ck_assert_double_eq_tol(at_least("3d6", t),
+                                enumerate(3, 6, 0, 0, 0, 0, t), TOLERANCE);
+        ck_assert_double_eq_tol(at_least("3d6r2", t),
+                                enumerate(3, 6, 2, 0, 0, 0, t), TOLERANCE);
+    }
+    // 30 rolls of a 10 sided dice, 10^30 outcomes.
+    ck_assert_double_eq_tol(at_least("30d10", 300), 1e-30, 1e-40);
+}
+END_TEST
+
+START_TEST(ignored) {
+    for (int t = 2; t <= 19; t++) {
+        ck_assert_double_eq_tol(at_least("4d6<", t),
+                                enumerate(4, 6, 0, 1, 0, 0, t), TOLERANCE);
+        ck_assert_double_eq_tol(at_least("5d6<>2", t),
+                                enumerate(5, 6, 0, 1, 2, 0, t), TOLERANCE);
+        ck_assert_double_eq_tol(at_least("4d6r1>", t),
+                                enumerate(4, 6, 1, 0, 1, 0, t), TOLERANCE);
+    }
+    // Advantage.
+    for (int t = 1; t <= 20; t++) {
+        const double p = (t - 1) / 20.0;
+        ck_assert_double_eq_tol(at_least("2d20<", t), 1 - p * p, TOLERANCE);
+    }
+}
+END_TEST
+
+START_TEST(counted) {
+    for (int t = 0; t <= 6; t++) {
+        ck_assert_double_eq_tol(at_least("5d6>=5", t),
+                                enumerate(5, 6, 0, 0, 0, 5, t), TOLERANCE);
+        ck_assert_double_eq_tol(at_least("5d6<<>=5", t),
+                                enumerate(5, 6, 0, 2, 0, 5, t), TOLERANCE);
+    }
+    ck_assert_double_eq_tol(at_least("10d10<=3", 1), 1 - 0.7 * 0.7 * 0.7 *
+                            0.7 * 0.7 * 0.7 * 0.7 * 0.7 * 0.7 * 0.7,
+                            TOLERANCE);
+}
+END_TEST
+
+START_TEST(exploded) {
+    ck_assert_double_eq_tol(at_least("d6!", 6), 1.0 / 6, TOLERANCE);
+    ck_assert_double_eq_tol(at_least("d6!", 7), 1.0 / 6, TOLERANCE);
+    ck_assert_double_eq_tol(at_least("d6!", 8), 1.0 / 6 - 1.0 / 36,
+                            TOLERANCE);
+    ck_assert_double_eq_tol(at_least("d6!", 13), 1.0 / 36, TOLERANCE);
+    // The last roll isn't rolled again.
+    de_set_explode_depth(1);
+    ck_assert_double_eq_tol(at_least("d6!", 12), 1.0 / 36, TOLERANCE);
+    ck_assert_double_eq_tol(at_least("d6!", 13), 0, TOLERANCE);
+    de_set_explode_depth(0);
+    // Only 6 is left after rerolls, it explodes as long as it can.
+    ck_assert_double_eq_tol(at_least("d6r5!", 6 * (DE_EXPLODE_DEPTH + 1)),
+                            1, TOLERANCE);
+}
+END_TEST
+
+START_TEST(versus) {
+    ck_assert_int_eq(de_compile("d6", &a), 0);
+    ck_assert_int_eq(de_compile("1d6", &b), 0);
+    struct de_versus v;
+    ck_assert_int_eq(de_prob_versus(a, b, &v), 0);
+    ck_assert_double_eq_tol(v.win, 15.0 / 36, TOLERANCE);
+    ck_assert_double_eq_tol(v.tie, 6.0 / 36, TOLERANCE);
+    ck_assert_double_eq_tol(v.loss, 15.0 / 36, TOLERANCE);
+
+    // Attack against a defence, the cached distribution of b is used again.
+    de_free(a);
+    a = NULL;
+    ck_assert_int_eq(de_compile("d20+5", &a), 0);
+    ck_assert_int_eq(de_prob_versus(a, b, &v), 0);
+    ck_assert_double_eq_tol(v.win, 1 - 1.0 / 120, TOLERANCE);
+    ck_assert_double_eq_tol(v.tie, 1.0 / 120, TOLERANCE);
+    ck_assert_double_eq_tol(v.loss, 0, TOLERANCE);
+    ck_assert_int_eq(de_prob_versus(b, a, &v), 0);
+    ck_assert_double_eq_tol(v.loss, 1 - 1.0 / 120, TOLERANCE);
+}
+END_TEST
+
+START_TEST(errors) {
+    double p;
+    ck_assert_int_eq(de_compile("1000000d1000<", &a), 0);
+    ck_assert_int_eq(de_compile("9223372036854775807+d2", &b), 0);
+    ck_assert_int_eq(de_prob_at_least(b, 1, &p), DE_OVERFLOW);
+    // Failure is kept.
+    ck_assert_int_eq(de_prob_at_least(b, 1, &p), DE_OVERFLOW);
+    struct de_versus v;
+    ck_assert_int_eq(de_prob_versus(b, a, &v), DE_OVERFLOW);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_prob() {
+    Suite *suite = suite_create("diceexpr_prob");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, sums);
+    tcase_add_test(tcase, ignored);
+    tcase_add_test(tcase, counted);
+    tcase_add_test(tcase, exploded);
+    tcase_add_test(tcase, versus);
+    tcase_add_test(tcase, errors);
+
+    return suite;
+}
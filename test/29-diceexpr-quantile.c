@@ -0,0 +1,102 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <stdlib.h>
+
+#define TOLERANCE 1e-12
+
+static de_expr *compiled;
+
+static void
+setup() {
+    compiled = NULL;
+}
+
+static void
+teardown() {
+    de_free(compiled);
+}
+
+static int_least64_t
+quantile(double q) {
+    int_least64_t x = INT_LEAST64_MIN;
+    ck_assert_int_eq(de_quantile(compiled, q, &x), 0);
+
+    return x;
+}
+
+START_TEST(cdf) {
+    ck_assert_int_eq(de_compile("2d6", &compiled), 0);
+    double p = -1;
+    ck_assert_int_eq(de_cdf(compiled, 1, &p), 0);
+    ck_assert_double_eq_tol(p, 0, TOLERANCE);
+    ck_assert_int_eq(de_cdf(compiled, 2, &p), 0);
+    ck_assert_double_eq_tol(p, 1.0 / 36, TOLERANCE);
+    ck_assert_int_eq(de_cdf(compiled, 7, &p), 0);
+    ck_assert_double_eq_tol(p, 21.0 / 36, TOLERANCE);
+    ck_assert_int_eq(de_cdf(compiled, 12, &p), 0);
+    ck_assert_double_eq_tol(p, 1, TOLERANCE);
+    ck_assert_int_eq(de_cdf(compiled, INT_LEAST64_MAX, &p), 0);
+    ck_assert_double_eq_tol(p, 1, TOLERANCE);
+
+    // Complements de_prob_at_least().
+    for (int x = 0; x <= 13; x++) {
+        double at_least;
+        ck_assert_int_eq(de_cdf(compiled, x, &p), 0);
+        ck_assert_int_eq(de_prob_at_least(compiled, x + 1, &at_least), 0);
+        ck_assert_double_eq_tol(p + at_least, 1, TOLERANCE);
+    }
+}
+END_TEST
+
+START_TEST(quantiles) {
+    ck_assert_int_eq(de_compile("2d6", &compiled), 0);
+    ck_assert_int_eq(quantile(0), 2);
+    ck_assert_int_eq(quantile(1.0 / 36), 2);
+    ck_assert_int_eq(quantile(1.5 / 36), 3);
+    ck_assert_int_eq(quantile(0.5), 7);
+    ck_assert_int_eq(quantile(21.0 / 36), 7);
+    ck_assert_int_eq(quantile(0.9), 10);
+    ck_assert_int_eq(quantile(1), 12);
+    de_free(compiled);
+    compiled = NULL;
+
+    // Percentiles of a damage expression.
+    ck_assert_int_eq(de_compile("-8d6-3", &compiled), 0);
+    ck_assert_int_eq(quantile(0), -51);
+    ck_assert_int_eq(quantile(0.5), -31);
+    ck_assert_int_eq(quantile(1), -11);
+    const int_least64_t p10 = quantile(0.1), p90 = quantile(0.9);
+    ck_assert_int_eq(p10 + p90, -62);
+    double p;
+    ck_assert_int_eq(de_cdf(compiled, p10, &p), 0);
+    ck_assert_double_le(0.1, p);
+    ck_assert_int_eq(de_cdf(compiled, p10 - 1, &p), 0);
+    ck_assert_double_le(p, 0.1);
+}
+END_TEST
+
+START_TEST(too_large) {
+    // Rolls ignored of a huge dice are approximated.
+    ck_assert_int_eq(de_compile("1000000d1000<", &compiled), 0);
+    int_least64_t x;
+    ck_assert_int_eq(de_quantile(compiled, 0.5, &x), 0);
+    ck_assert_int_gt(x, 500000000);
+    double p;
+    ck_assert_int_eq(de_cdf(compiled, 0, &p), 0);
+    ck_assert_double_eq(p, 0);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_quantile() {
+    Suite *suite = suite_create("diceexpr_quantile");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, cdf);
+    tcase_add_test(tcase, quantiles);
+    tcase_add_test(tcase, too_large);
+
+    return suite;
+}
@@ -0,0 +1,202 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <stdlib.h>
+#include <math.h>
+
+#define TOLERANCE 1e-12
+
+static de_expr *exact, *approximate;
+
+static void
+setup() {
+    exact = approximate = NULL;
+}
+
+static void
+teardown() {
+    de_free(exact);
+    de_free(approximate);
+    de_set_exact_values(0);
+}
+
+/* Compile an expression twice, building its distribution exactly and
+ * approximately.
+ */
+static void
+compile_both(const char *expr) {
+    de_free(exact);
+    de_free(approximate);
+    exact = approximate = NULL;
+    double error = -1;
+    ck_assert_int_eq(de_compile(expr, &exact), 0);
+    ck_assert_int_eq(de_prob_error(exact, &error), 0);
+    ck_assert_double_eq(error, 0);
+    de_set_exact_values(1);
+    ck_assert_int_eq(de_compile(expr, &approximate), 0);
+    ck_assert_int_eq(de_prob_error(approximate, &error), 0);
+    ck_assert_double_gt(error, 0);
+    de_set_exact_values(0);
+}
+
+START_TEST(huge) {
+    ck_assert_int_eq(de_compile("1000000d1000", &approximate), 0);
+    double error = -1, p;
+    ck_assert_int_eq(de_prob_error(approximate, &error), 0);
+    ck_assert_double_gt(error, 0);
+    ck_assert_double_lt(error, 0.01);
+
+    int_least64_t x;
+    ck_assert_int_eq(de_quantile(approximate, 0.5, &x), 0);
+    ck_assert_int_eq(x, 500500000);
+    ck_assert_int_eq(de_quantile(approximate, 0, &x), 0);
+    ck_assert_int_eq(x, 1000000);
+    ck_assert_int_eq(de_cdf(approximate, 999999, &p), 0);
+    ck_assert_double_eq(p, 0);
+    ck_assert_int_eq(de_cdf(approximate, 1000000000, &p), 0);
+    ck_assert_double_eq(p, 1);
+    // Standard deviation is about 288675.
+    ck_assert_int_eq(de_prob_at_least(approximate, 500500000 + 288675, &p),
+                     0);
+    ck_assert_double_eq_tol(p, 0.158655, 1e-4);
+}
+END_TEST
+
+START_TEST(bound) {
+    const char *exprs[] = {
+        "100d6", "50d6!", "200d10>=8", "30d20-10d6+7", "4d6<+40d8",
+        "20d4r1", "-60d2<=1", "d100"
+    };
+    for (size_t i = 0; i < sizeof(exprs) / sizeof(*exprs); i++) {
+        compile_both(exprs[i]);
+        double error, largest = 0;
+        ck_assert_int_eq(de_prob_error(approximate, &error), 0);
+        int_least64_t low, high;
+        ck_assert_int_eq(de_quantile(exact, 0, &low), 0);
+        ck_assert_int_eq(de_quantile(exact, 1, &high), 0);
+        for (int_least64_t x = low - 1; x <= high && x <= low + 5000; x++) {
+            double p, q;
+            ck_assert_int_eq(de_cdf(exact, x, &p), 0);
+            ck_assert_int_eq(de_cdf(approximate, x, &q), 0);
+            if (fabs(p - q) > largest)
+                largest = fabs(p - q);
+        }
+        ck_assert_double_le(largest, error);
+    }
+    // Sums of many rolls are close.
+    compile_both("100d6");
+    double p, q;
+    ck_assert_int_eq(de_cdf(exact, 330, &p), 0);
+    ck_assert_int_eq(de_cdf(approximate, 330, &q), 0);
+    ck_assert_double_eq_tol(p, q, 1e-4);
+}
+END_TEST
+
+START_TEST(versus) {
+    ck_assert_int_eq(de_compile("1000000d6", &exact), 0);
+    ck_assert_int_eq(de_compile("1000000d6", &approximate), 0);
+    struct de_versus v;
+    ck_assert_int_eq(de_prob_versus(exact, approximate, &v), 0);
+    ck_assert_double_eq_tol(v.win, v.loss, TOLERANCE);
+    ck_assert_double_eq_tol(v.win + v.tie + v.loss, 1, TOLERANCE);
+    ck_assert_double_gt(v.error, 0);
+
+    // Against exact probabilities.
+    de_free(exact);
+    de_free(approximate);
+    exact = approximate = NULL;
+    ck_assert_int_eq(de_compile("40d6", &exact), 0);
+    ck_assert_int_eq(de_compile("35d6+20", &approximate), 0);
+    struct de_versus w;
+    ck_assert_int_eq(de_prob_versus(exact, approximate, &w), 0);
+    ck_assert_double_eq(w.error, 0);
+    de_free(approximate);
+    approximate = NULL;
+    de_set_exact_values(1);
+    ck_assert_int_eq(de_compile("35d6+20", &approximate), 0);
+    ck_assert_int_eq(de_prob_versus(exact, approximate, &v), 0);
+    ck_assert_double_le(fabs(v.win - w.win), v.error);
+    ck_assert_double_le(fabs(v.tie - w.tie), v.error);
+    ck_assert_double_le(fabs(v.loss - w.loss), v.error);
+    ck_assert_double_eq_tol(v.win, w.win, 1e-3);
+}
+END_TEST
+
+START_TEST(ignored) {
+    // Terms ignoring rolls too large to build exactly are approximated too.
+    ck_assert_int_eq(de_compile("1000000d1000<", &approximate), 0);
+    double error = -1, p;
+    ck_assert_int_eq(de_prob_error(approximate, &error), 0);
+    ck_assert_double_gt(error, 0);
+    ck_assert_double_lt(error, 0.01);
+    int_least64_t x;
+    // Smallest roll is almost always one.
+    ck_assert_int_eq(de_quantile(approximate, 0.5, &x), 0);
+    ck_assert_int_ge(x, 500500000 - 2);
+    ck_assert_int_le(x, 500500000);
+    ck_assert_int_eq(de_cdf(approximate, 999998, &p), 0);
+    ck_assert_double_eq(p, 0);
+
+    de_free(approximate);
+    approximate = NULL;
+    ck_assert_int_eq(de_compile("200000000d6>", &approximate), 0);
+    ck_assert_int_eq(de_prob_error(approximate, &error), 0);
+    ck_assert_double_gt(error, 0);
+    // Largest roll is six.
+    ck_assert_int_eq(de_cdf(approximate, 700000000 - 6, &p), 0);
+    ck_assert_double_eq_tol(p, 0.5, 1e-3);
+
+    // Half of the rolls are kept, and all rolls at least 8 are among them.
+    de_free(approximate);
+    approximate = NULL;
+    ck_assert_int_eq(de_compile("1000000d10<500000>=8", &approximate), 0);
+    ck_assert_int_eq(de_quantile(approximate, 0.5, &x), 0);
+    ck_assert_int_ge(x, 300000 - 1);
+    ck_assert_int_le(x, 300000 + 1);
+    // Standard deviation is about 458.
+    ck_assert_int_eq(de_prob_at_least(approximate, 300000 + 458, &p), 0);
+    ck_assert_double_eq_tol(p, 0.158655, 1e-2);
+}
+END_TEST
+
+START_TEST(threshold) {
+    // Distributions are built when they are first queried.
+    de_set_exact_values(10);
+    ck_assert_int_eq(de_compile("3d6", &approximate), 0);
+    de_set_exact_values(0);
+    ck_assert_int_eq(de_compile("3d6", &exact), 0);
+    double error;
+    ck_assert_int_eq(de_prob_error(exact, &error), 0);
+    ck_assert_double_eq(error, 0);
+    de_set_exact_values(10);
+    ck_assert_int_eq(de_prob_error(approximate, &error), 0);
+    ck_assert_double_gt(error, 0);
+    // Kept once built.
+    de_set_exact_values(0);
+    ck_assert_int_eq(de_prob_error(approximate, &error), 0);
+    ck_assert_double_gt(error, 0);
+
+    // Sums too costly to build exactly are approximated too.
+    de_free(exact);
+    exact = NULL;
+    de_set_exact_values(SIZE_MAX);
+    ck_assert_int_eq(de_compile("5000d1000", &exact), 0);
+    ck_assert_int_eq(de_prob_error(exact, &error), 0);
+    ck_assert_double_gt(error, 0);
+}
+END_TEST
+
+Suite*
+suite_diceexpr_approx() {
+    Suite *suite = suite_create("diceexpr_approx");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, huge);
+    tcase_add_test(tcase, bound);
+    tcase_add_test(tcase, versus);
+    tcase_add_test(tcase, ignored);
+    tcase_add_test(tcase, threshold);
+
+    return suite;
+}
@@ -0,0 +1,144 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define NEXPRS 6
+
+static const char *exprs[NEXPRS] = {
+    "3d6<+2", "-d20", "1000d10>=8", "4d6r1!>-+-5", "--7", "3d20<<+d4-d8"
+};
+static de_expr *compiled[NEXPRS];
+static de_catalog *catalog;
+static struct buffer buffer;
+
+static void
+setup() {
+    for (int i = 0; i < NEXPRS; i++) {
+        compiled[i] = NULL;
+        ck_assert_int_eq(de_compile(exprs[i], &compiled[i]), 0);
+    }
+    catalog = NULL;
+    buffer.chars = NULL;
+    buffer.len = 0;
+    buffer.max = 0;
+}
+
+static void
+teardown() {
+    for (int i = 0; i < NEXPRS; i++)
+        de_free(compiled[i]);
+    de_catalog_free(catalog);
+    free(buffer.chars);
+}
+
+static void
+write_catalog() {
+    ck_assert_int_eq(de_catalog_write((const de_expr *const*) compiled,
+                                      NEXPRS, write_buffer, &buffer), 0);
+}
+
+START_TEST(evaluate) {
+    write_catalog();
+    ck_assert_uint_eq(buffer.len % 8, 0);
+    ck_assert_int_eq(de_catalog_open(buffer.chars, buffer.len, &catalog), 0);
+    ck_assert_uint_eq(de_catalog_size(catalog), NEXPRS);
+
+    // Same rolls and rolled expressions as the compiled expressions.
+    for (int i = 0; i < NEXPRS; i++) {
+        const de_expr *loaded = de_catalog_get(catalog, i);
+        ck_assert_uint_eq(de_nterms(loaded), de_nterms(compiled[i]));
+        for (uint_least64_t c = 0; c < 100; c++) {
+            int_least64_t x, y;
+            ck_assert_int_eq(de_audit_eval(compiled[i], 1, c, &x), 0);
+            ck_assert_int_eq(de_audit_eval(loaded, 1, c, &y), 0);
+            ck_assert_int_eq(x, y);
+        }
+        char *rolled = NULL, *rolled_loaded = NULL;
+        int_least64_t x, y;
+        srand(i);
+        ck_assert_int_eq(de_eval(compiled[i], &x, &rolled), 0);
+        srand(i);
+        ck_assert_int_eq(de_eval(loaded, &y, &rolled_loaded), 0);
+        ck_assert_int_eq(x, y);
+        ck_assert_str_eq(rolled, rolled_loaded);
+        free(rolled);
+        free(rolled_loaded);
+
+        double p, q;
+        ck_assert_int_eq(de_prob_at_least(compiled[i], 5, &p), 0);
+        ck_assert_int_eq(de_prob_at_least(loaded, 5, &q), 0);
+        ck_assert_double_eq_tol(p, q, 1e-12);
+    }
+}
+END_TEST
+
+START_TEST(empty) {
+    ck_assert_int_eq(de_catalog_write(NULL, 0, write_buffer, &buffer), 0);
+    ck_assert_int_eq(de_catalog_open(buffer.chars, buffer.len, &catalog), 0);
+    ck_assert_uint_eq(de_catalog_size(catalog), 0);
+}
+END_TEST
+
+START_TEST(corrupted) {
+    write_catalog();
+    ck_assert_int_eq(de_catalog_open(buffer.chars, 20, &catalog),
+                     DE_SYNTAX_ERROR);
+    ck_assert_int_eq(de_catalog_open(buffer.chars, buffer.len - 8, &catalog),
+                     DE_SYNTAX_ERROR);
+    // Another version.
+    buffer.chars[4]++;
+    ck_assert_int_eq(de_catalog_open(buffer.chars, buffer.len, &catalog),
+                     DE_SYNTAX_ERROR);
+    buffer.chars[4]--;
+    // Another byte order.
+    char c = buffer.chars[8];
+    buffer.chars[8] = buffer.chars[11];
+    buffer.chars[11] = c;
+    ck_assert_int_eq(de_catalog_open(buffer.chars, buffer.len, &catalog),
+                     DE_SYNTAX_ERROR);
+    buffer.chars[11] = buffer.chars[8];
+    buffer.chars[8] = c;
+    ck_assert_int_eq(de_catalog_open(buffer.chars, buffer.len, &catalog), 0);
+    de_catalog_free(catalog);
+    catalog = NULL;
+
+    // Any changed byte after the header either is rejected or leaves the
+    // expressions valid.
+    for (size_t i = 24; i < buffer.len; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            buffer.chars[i] ^= 1 << bit;
+            enum parse_error e = de_catalog_open(buffer.chars, buffer.len,
+                                                 &catalog);
+            ck_assert(e == 0 || e == DE_SYNTAX_ERROR);
+            for (size_t j = 0; e == 0 && j < de_catalog_size(catalog); j++) {
+                const de_expr *loaded = de_catalog_get(catalog, j);
+                struct de_cost cost;
+                de_estimate(loaded, &cost);
+                if (cost.dice > 100000)
+                    continue;
+                int_least64_t value;
+                enum parse_error eval_e = de_audit_eval(loaded, 1, 0, &value);
+                ck_assert(eval_e == 0 || eval_e == DE_OVERFLOW);
+            }
+            de_catalog_free(catalog);
+            catalog = NULL;
+            buffer.chars[i] ^= 1 << bit;
+        }
+    }
+}
+END_TEST
+
+Suite*
+suite_diceexpr_catalog() {
+    Suite *suite = suite_create("diceexpr_catalog");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, evaluate);
+    tcase_add_test(tcase, empty);
+    tcase_add_test(tcase, corrupted);
+
+    return suite;
+}
@@ -0,0 +1,94 @@
+#include "test.h"
+#include "diceexpr.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define NRANDOM 20000
+#define MAX_RANDOM_LEN 12
+
+static de_expr *compiled;
+
+static void
+setup() {
+    compiled = NULL;
+}
+
+static void
+teardown() {
+    de_free(compiled);
+}
+
+/* Check that validating an expression gives what compiling it gives.
+ */
+static enum parse_error
+validate(const char *expr) {
+    de_free(compiled);
+    compiled = NULL;
+    enum parse_error e = de_validate(expr);
+    ck_assert_msg(e == de_compile(expr, &compiled),
+                  "expr \"%s\" validates as it compiles", expr);
+
+    return e;
+}
+
+START_TEST(errors) {
+    ck_assert_int_eq(validate("3d6<+2"), 0);
+    ck_assert_int_eq(validate(" -d20 + 4d6r1!>>=5 -- 7 "), 0);
+    ck_assert_int_eq(validate("10D10<=3"), 0);
+    ck_assert_int_eq(validate(""), DE_SYNTAX_ERROR);
+    ck_assert_int_eq(validate("1+"), DE_SYNTAX_ERROR);
+    ck_assert_int_eq(validate("012"), DE_SYNTAX_ERROR);
+    ck_assert_int_eq(validate("d6d6"), DE_SYNTAX_ERROR);
+    ck_assert_int_eq(validate("x1"), DE_INVALID_CHARACTER);
+    ck_assert_int_eq(validate("d6+\r"), DE_INVALID_CHARACTER);
+    ck_assert_int_eq(validate("0d6"), DE_NROLLS);
+    ck_assert_int_eq(validate("d0"), DE_DICE);
+    ck_assert_int_eq(validate("d6r6"), DE_DICE);
+    ck_assert_int_eq(validate("3d6<<>"), DE_IGNORE);
+    ck_assert_int_eq(validate("1d1<"), DE_IGNORE);
+    ck_assert_int_eq(validate("99999999999999999999"), DE_OVERFLOW);
+    ck_assert_int_eq(validate("d6<9223372036854775807<"), DE_OVERFLOW);
+    // Rolls wouldn't fit in memory.
+    ck_assert_int_eq(validate("4611686018427387904d6"), DE_OVERFLOW);
+}
+END_TEST
+
+START_TEST(no_rolls) {
+    // Compiling and evaluating would allocate memory for all rolls.
+    ck_assert_int_eq(de_validate("1000000000000d6<+1000000000000d6"), 0);
+    // Random numbers aren't taken.
+    srand(5);
+    const int expected = rand();
+    srand(5);
+    ck_assert_int_eq(de_validate("3d6+2d20<"), 0);
+    ck_assert_int_eq(rand(), expected);
+}
+END_TEST
+
+START_TEST(random_input) {
+    const char chars[] = "0123456789ddDr!<>=+- \tx";
+    char expr[MAX_RANDOM_LEN + 1];
+    srand(7);
+    for (int i = 0; i < NRANDOM; i++) {
+        const int len = rand() % (MAX_RANDOM_LEN + 1);
+        for (int j = 0; j < len; j++)
+            expr[j] = chars[rand() % (sizeof(chars) - 1)];
+        expr[len] = '\0';
+        validate(expr);
+    }
+}
+END_TEST
+
+Suite*
+suite_diceexpr_validate() {
+    Suite *suite = suite_create("diceexpr_validate");
+    TCase *tcase = tcase_create("Core");
+    suite_add_tcase(suite, tcase);
+    tcase_add_checked_fixture(tcase, setup, teardown);
+
+    tcase_add_test(tcase, errors);
+    tcase_add_test(tcase, no_rolls);
+    tcase_add_test(tcase, random_input);
+
+    return suite;
+}
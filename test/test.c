@@ -1,6 +1,8 @@
 #include "test.h"
 #include <stdlib.h>
 #include <time.h>
+#include <string.h>
+#include <inttypes.h>
 
 int
 main() {
@@ -17,6 +19,31 @@ main() {
     srunner_add_suite(sr, suite_diceexpr_valid());
     srunner_add_suite(sr, suite_diceexpr_invalid());
     srunner_add_suite(sr, suite_diceexpr_overflow());
+    srunner_add_suite(sr, suite_degen());
+    srunner_add_suite(sr, suite_diceexpr_reroll());
+    srunner_add_suite(sr, suite_diceexpr_cost());
+    srunner_add_suite(sr, suite_diceexpr_pool());
+    srunner_add_suite(sr, suite_diceexpr_resume());
+    srunner_add_suite(sr, suite_str_reserve());
+    srunner_add_suite(sr, suite_diceexpr_parallel());
+    srunner_add_suite(sr, suite_diceexpr_narrow());
+    srunner_add_suite(sr, suite_diceexpr_output());
+    srunner_add_suite(sr, suite_diceexpr_sink());
+    srunner_add_suite(sr, suite_diceexpr_batch());
+    srunner_add_suite(sr, suite_scan_int());
+    srunner_add_suite(sr, suite_str_append_int());
+    srunner_add_suite(sr, suite_diceexpr_long());
+    srunner_add_suite(sr, suite_diceexpr_count());
+    srunner_add_suite(sr, suite_diceexpr_explode());
+    srunner_add_suite(sr, suite_diceexpr_slow_log());
+    srunner_add_suite(sr, suite_diceexpr_hot());
+    srunner_add_suite(sr, suite_diceexpr_audit());
+    srunner_add_suite(sr, suite_diceexpr_sim());
+    srunner_add_suite(sr, suite_diceexpr_prob());
+    srunner_add_suite(sr, suite_diceexpr_quantile());
+    srunner_add_suite(sr, suite_diceexpr_approx());
+    srunner_add_suite(sr, suite_diceexpr_catalog());
+    srunner_add_suite(sr, suite_diceexpr_validate());
 
     srunner_run_all(sr, CK_NORMAL);
     int number_failed = srunner_ntests_failed(sr);
@@ -25,3 +52,38 @@ main() {
 
     exit(number_failed > 0 ? number_failed : EXIT_SUCCESS);
 }
+
+int
+write_buffer(void *data, const char *chars, size_t len) {
+    struct buffer *b = data;
+    if (b->max != 0 && b->len + len > b->max)
+        return -1;
+    char *temp = realloc(b->chars, b->len + len);
+    if (temp == NULL)
+        return -1;
+    b->chars = temp;
+    memcpy(b->chars + b->len, chars, len);
+    b->len += len;
+
+    return 0;
+}
+
+int_least64_t
+check_rolls(const char *s, int_least64_t dice, int_least64_t sum) {
+    ck_assert_int_eq(*s, '(');
+    int_least64_t n = 0, previous = 1;
+    do {
+        char *end;
+        int_least64_t roll = strtoimax(s + 1, &end, 10);
+        ck_assert_int_ge(roll, previous);
+        ck_assert_int_le(roll, dice);
+        sum -= roll;
+        previous = roll;
+        n++;
+        s = end;
+    } while (*s == '+');
+    ck_assert_str_eq(s, ")");
+    ck_assert_int_eq(sum, 0);
+
+    return n;
+}
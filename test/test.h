@@ -1,6 +1,30 @@
 #ifndef TEST_H
     #define TEST_H
 #include <check.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Output written to memory by write_buffer(), aligned as malloc() aligns it.
+struct buffer {
+    char *chars;
+    size_t len;
+    // Sink fails after this many characters, zero means no limit.
+    size_t max;
+};
+
+/** Sink appending to a struct buffer, see de_sink.
+ * @param data struct buffer.
+ * @return Zero on success, -1 if max is exceeded or on error.
+ */
+int
+write_buffer(void *data, const char *chars, size_t len);
+
+/** Check that rolls in "(a+b+...)" are sorted, between 1 and dice, and sum
+ * to value.
+ * @return Number of rolls.
+ */
+int_least64_t
+check_rolls(const char *s, int_least64_t dice, int_least64_t sum);
 
 Suite*
 suite_str_new();
@@ -29,4 +53,79 @@ suite_diceexpr_invalid();
 Suite*
 suite_diceexpr_overflow();
 
+Suite*
+suite_degen();
+
+Suite*
+suite_diceexpr_reroll();
+
+Suite*
+suite_diceexpr_cost();
+
+Suite*
+suite_diceexpr_pool();
+
+Suite*
+suite_diceexpr_resume();
+
+Suite*
+suite_str_reserve();
+
+Suite*
+suite_diceexpr_parallel();
+
+Suite*
+suite_diceexpr_narrow();
+
+Suite*
+suite_diceexpr_output();
+
+Suite*
+suite_diceexpr_sink();
+
+Suite*
+suite_diceexpr_batch();
+
+Suite*
+suite_scan_int();
+
+Suite*
+suite_str_append_int();
+
+Suite*
+suite_diceexpr_long();
+
+Suite*
+suite_diceexpr_count();
+
+Suite*
+suite_diceexpr_explode();
+
+Suite*
+suite_diceexpr_slow_log();
+
+Suite*
+suite_diceexpr_hot();
+
+Suite*
+suite_diceexpr_audit();
+
+Suite*
+suite_diceexpr_sim();
+
+Suite*
+suite_diceexpr_prob();
+
+Suite*
+suite_diceexpr_quantile();
+
+Suite*
+suite_diceexpr_approx();
+
+Suite*
+suite_diceexpr_catalog();
+
+Suite*
+suite_diceexpr_validate();
+
 #endif // TEST_H
@@ -0,0 +1,197 @@
+/* Compile dice expressions to a catalog and check catalogs.
+ *
+ * Usage: decat build [-o file] [expressions]
+ *        decat check file
+ *
+ * build reads expressions one per line from a file, or standard input, and
+ * writes them as a catalog, see de_catalog_write(). The expression on line
+ * n is expression n - 1 of the catalog. Nothing is written if an
+ * expression doesn't compile.
+ *
+ * check maps a catalog to memory and opens it, as a process loading the
+ * catalog would, and prints the number of expressions and the time opening
+ * took.
+ *
+ * -o file   Default standard output.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "diceexpr.h"
+
+static int build(int argc, char **argv);
+static int check(int argc, char **argv);
+static int usage(const char *name);
+static char* read_line(FILE *f);
+
+int
+main(int argc, char **argv) {
+    if (argc < 2)
+        return usage(argv[0]);
+
+    if (strcmp(argv[1], "build") == 0)
+        return build(argc - 1, argv + 1);
+    if (strcmp(argv[1], "check") == 0)
+        return check(argc - 1, argv + 1);
+
+    return usage(argv[0]);
+}
+
+/* Compile the expressions of each line and write the catalog.
+ */
+static int
+build(int argc, char **argv) {
+    const char *output = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:")) != -1) {
+        switch (opt) {
+            case 'o': output = optarg; break;
+            default: return usage("decat");
+        }
+    }
+    if (optind < argc - 1)
+        return usage("decat");
+    FILE *f = optind == argc ? stdin : fopen(argv[optind], "r");
+    if (f == NULL) {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    int retval = EXIT_FAILURE;
+    de_expr **exprs = NULL;
+    size_t n = 0, size = 0;
+    char *line;
+    while ((line = read_line(f)) != NULL) {
+        if (n == size) {
+            size = size == 0 ? 64 : size * 2;
+            de_expr **temp = realloc(exprs, size * sizeof(*temp));
+            if (temp == NULL) {
+                perror("realloc");
+                free(line);
+                goto free;
+            }
+            exprs = temp;
+        }
+        exprs[n] = NULL;
+        enum parse_error e = de_compile(line, &exprs[n]);
+        if (e != 0) {
+            fprintf(stderr, "line %zu: can't compile %s: error %d\n", n + 1,
+                    line, e);
+            free(line);
+            goto free;
+        }
+        free(line);
+        n++;
+    }
+    if (ferror(f)) {
+        perror("read");
+        goto free;
+    }
+
+    int fd = STDOUT_FILENO;
+    if (output != NULL &&
+        (fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        perror(output);
+        goto free;
+    }
+    enum parse_error e = de_catalog_write((const de_expr *const*) exprs, n,
+                                          de_sink_fd, &fd);
+    if (output != NULL && close(fd) != 0 && e == 0)
+        e = DE_OUTPUT;
+    if (e != 0)
+        fprintf(stderr, "%s: can't write\n", output != NULL ? output :
+                "stdout");
+    else
+        retval = EXIT_SUCCESS;
+
+    free:
+        for (size_t i = 0; i < n; i++)
+            de_free(exprs[i]);
+        free(exprs);
+        if (f != stdin)
+            fclose(f);
+
+    return retval;
+}
+
+/* Map a catalog and open it.
+ */
+static int
+check(int argc, char **argv) {
+    if (argc != 2)
+        return usage("decat");
+
+    int fd = open(argv[1], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(argv[1]);
+        if (fd >= 0)
+            close(fd);
+        return EXIT_FAILURE;
+    }
+    if (st.st_size == 0) {
+        fprintf(stderr, "%s: not a catalog\n", argv[1]);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    char *chars = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (chars == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    de_catalog *catalog = NULL;
+    enum parse_error e = de_catalog_open(chars, st.st_size, &catalog);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    int retval = EXIT_SUCCESS;
+    if (e != 0) {
+        fprintf(stderr, "%s: %s\n", argv[1], e == DE_SYNTAX_ERROR ?
+                "not a catalog of this version and host" : "out of memory");
+        retval = EXIT_FAILURE;
+    }
+    else {
+        printf("%zu expressions, opened in %.1f us\n",
+               de_catalog_size(catalog),
+               (end.tv_sec - start.tv_sec) * 1e6 +
+               (end.tv_nsec - start.tv_nsec) / 1e3);
+    }
+    de_catalog_free(catalog);
+    munmap(chars, st.st_size);
+
+    return retval;
+}
+
+static int
+usage(const char *name) {
+    fprintf(stderr, "usage: %s build [-o file] [expressions]\n"
+            "       %s check file\n", name, name);
+
+    return EXIT_FAILURE;
+}
+
+/* Read a line without the newline.
+ * @return Line, free it after use. NULL at the end of the file or on error.
+ */
+static char*
+read_line(FILE *f) {
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len = getline(&line, &size, f);
+    if (len < 0) {
+        free(line);
+        return NULL;
+    }
+    if (len > 0 && line[len - 1] == '\n')
+        line[len - 1] = '\0';
+
+    return line;
+}
@@ -0,0 +1,499 @@
+/* Generate specialized C functions for dice expressions.
+ *
+ * Usage: degen [-s] [-u unroll] [-t table] [file]
+ *
+ * Reads lines of form "name expression" from file or standard input and
+ * writes C code to standard output. For each line, a function
+ *
+ *     enum parse_error name(int_least64_t *value);
+ *
+ * is generated, which evaluates the expression like de_parse() does, but
+ * without parsing or rolled expression. Dices are rolled with de_roll_die()
+ * in the same order as de_parse() rolls them, so with the same seed given to
+ * srand() the function gives the same value as de_parse().
+ *
+ * Empty lines and lines starting with '#' are ignored. Counted dices with
+ * ignored rolls, rerolled dices and exploding dices aren't supported.
+ *
+ * -s         Make generated functions static.
+ * -u unroll  Unroll rolls of dices with at most this many rolls, default 8.
+ * -t table   Also generate an array called table of { name, expression,
+ *            function } structs of all functions, terminated by NULLs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include "diceexpr.h"
+#include "expr.h"
+#include "numflow.h"
+
+#define DEFAULT_UNROLL 8
+#define DEFAULT_LINE_SIZE 256
+
+// A function to generate.
+struct function {
+    // Line the function was read from, name and expr point to it.
+    char *line;
+    char *name;
+    char *expr;
+    de_expr *compiled;
+};
+
+static char* read_line(FILE *f);
+static int is_identifier(const char *s);
+static int_least64_t term_max(const struct term *t);
+static int needs_sort(const struct term *t, int_least64_t unroll);
+static int is_supported(const struct de_expr *e);
+static void generate_function(const struct function *fn,
+                              int_least64_t unroll,
+                              int make_static);
+static void generate_dice(const struct term *t, int_least64_t unroll);
+static void generate_table(const char *table,
+                           const struct function *fns,
+                           size_t nfns);
+
+int
+main(int argc, char **argv) {
+    int make_static = 0;
+    int_least64_t unroll = DEFAULT_UNROLL;
+    const char *table = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "su:t:")) != -1) {
+        switch (opt) {
+            case 's': make_static = 1; break;
+            case 'u': unroll = strtoimax(optarg, NULL, 10); break;
+            case 't': table = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-s] [-u unroll] [-t table] [file]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (table != NULL && !is_identifier(table)) {
+        fprintf(stderr, "invalid table name: %s\n", table);
+        return EXIT_FAILURE;
+    }
+
+    FILE *in = stdin;
+    if (optind < argc && (in = fopen(argv[optind], "r")) == NULL) {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    struct function *fns = NULL;
+    size_t nfns = 0;
+    int retval = EXIT_SUCCESS;
+    char *line;
+    for (size_t lineno = 1; (line = read_line(in)) != NULL; lineno++) {
+        char *name = line;
+        while (isspace((unsigned char) *name))
+            name++;
+        if (*name == '\0' || *name == '#') {
+            free(line);
+            continue;
+        }
+        char *expr = name;
+        while (*expr != '\0' && !isspace((unsigned char) *expr))
+            expr++;
+        if (*expr != '\0')
+            *expr++ = '\0';
+
+        struct function fn = {
+            .line = line,
+            .name = name,
+            .expr = expr,
+            .compiled = NULL
+        };
+        enum parse_error e;
+        if (!is_identifier(name)) {
+            fprintf(stderr, "%zu: invalid function name: %s\n", lineno, name);
+            retval = EXIT_FAILURE;
+        }
+        else if ((e = de_compile(expr, &fn.compiled)) != 0) {
+            fprintf(stderr, "%zu: invalid expression, error %d: %s\n", lineno,
+                    e, expr);
+            retval = EXIT_FAILURE;
+        }
+        else if (!is_supported(fn.compiled)) {
+            fprintf(stderr, "%zu: unsupported dice: %s\n", lineno, expr);
+            de_free(fn.compiled);
+            retval = EXIT_FAILURE;
+        }
+        if (retval != EXIT_SUCCESS) {
+            free(line);
+            break;
+        }
+
+        struct function *temp = realloc(fns, (nfns + 1) * sizeof(*fns));
+        if (temp == NULL) {
+            perror("realloc");
+            de_free(fn.compiled);
+            free(line);
+            retval = EXIT_FAILURE;
+            break;
+        }
+        fns = temp;
+        fns[nfns++] = fn;
+    }
+
+    if (retval == EXIT_SUCCESS) {
+        printf("/* Generated by degen. Do not edit. */\n"
+               "#include <stdlib.h>\n"
+               "#include <stdint.h>\n"
+               "#include \"diceexpr.h\"\n\n");
+
+        for (size_t i = 0; i < nfns; i++) {
+            const struct de_expr *e = fns[i].compiled;
+            int sort = 0;
+            for (size_t j = 0; j < e->nterms; j++)
+                sort |= needs_sort(&e->terms[j], unroll);
+            if (sort) {
+                printf("#ifndef DEGEN_ASCENDING\n"
+                       "#define DEGEN_ASCENDING\n"
+                       "static int\n"
+                       "degen_ascending(const void *a, const void *b) {\n"
+                       "    const int_least64_t *x = a;\n"
+                       "    const int_least64_t *y = b;\n\n"
+                       "    return (*x > *y) - (*x < *y);\n"
+                       "}\n"
+                       "#endif\n\n");
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < nfns; i++)
+            generate_function(&fns[i], unroll, make_static);
+        if (table != NULL)
+            generate_table(table, fns, nfns);
+    }
+
+    for (size_t i = 0; i < nfns; i++) {
+        de_free(fns[i].compiled);
+        free(fns[i].line);
+    }
+    free(fns);
+    if (in != stdin)
+        fclose(in);
+
+    if (fflush(stdout) != 0) {
+        perror("stdout");
+        retval = EXIT_FAILURE;
+    }
+
+    return retval;
+}
+
+/* Read a line without '\n'.
+ * @param f Can't be NULL.
+ * @return Line, free it after use. NULL on end of file or error.
+ */
+static char*
+read_line(FILE *f) {
+    size_t size = DEFAULT_LINE_SIZE;
+    size_t len = 0;
+    char *line = malloc(size);
+    if (line == NULL)
+        return NULL;
+
+    while (fgets(line + len, size - len, f) != NULL) {
+        len += strlen(line + len);
+        if (len > 0 && line[len - 1] == '\n') {
+            line[len - 1] = '\0';
+            return line;
+        }
+        char *temp = realloc(line, size * 2);
+        if (temp == NULL)
+            break;
+        line = temp;
+        size *= 2;
+    }
+    if (len > 0 && !ferror(f))
+        return line;
+
+    free(line);
+    return NULL;
+}
+
+static int
+is_identifier(const char *s) {
+    if (!isalpha((unsigned char) *s) && *s != '_')
+        return 0;
+    for (s++; *s != '\0'; s++) {
+        if (!isalnum((unsigned char) *s) && *s != '_')
+            return 0;
+    }
+
+    return 1;
+}
+
+/* Get largest possible value of a term.
+ * @param t Can't be NULL.
+ * @return Largest value or -1 if it doesn't fit to int_least64_t.
+ */
+static int_least64_t
+term_max(const struct term *t) {
+    if (t->type == TERM_CONSTANT)
+        return t->constant;
+
+    int_least64_t kept = t->nrolls - t->small - t->large;
+    if (t->count != COUNT_NONE)
+        return kept;
+    enum flow_type overflow;
+    NF_MULTIPLY(kept, t->dice, INT_LEAST64, overflow);
+
+    return overflow == 0 ? kept * t->dice : -1;
+}
+
+/* Whether rolls of a dice term are kept in memory and sorted.
+ * Rolls aren't sorted if they are unrolled, no rolls are ignored or only a
+ * few rolls are ignored and sum of all rolls fits to int_least64_t.
+ */
+static int
+needs_sort(const struct term *t, int_least64_t unroll) {
+    if (t->type != TERM_DICE || t->nrolls <= unroll)
+        return 0;
+    if (t->small == 0 && t->large == 0)
+        return 0;
+
+    enum flow_type overflow;
+    NF_MULTIPLY(t->nrolls, t->dice, INT_LEAST64, overflow);
+
+    return t->small > unroll || t->large > unroll || overflow != 0;
+}
+
+/* Whether code can be generated for all terms of an expression.
+ * Counted dices are only supported without ignored rolls, rerolled and
+ * exploding dices aren't supported.
+ */
+static int
+is_supported(const struct de_expr *e) {
+    for (size_t i = 0; i < e->nterms; i++) {
+        const struct term *t = &e->terms[i];
+        if (t->count != COUNT_NONE && (t->small > 0 || t->large > 0))
+            return 0;
+        if (t->reroll > 0 || t->explode)
+            return 0;
+    }
+
+    return 1;
+}
+
+static void
+generate_function(const struct function *fn,
+                  int_least64_t unroll,
+                  int make_static) {
+    const struct de_expr *e = fn->compiled;
+
+    // If sum of largest values of all terms fits, no overflow checks are
+    // needed for the result.
+    int check_result = 0;
+    int_least64_t max_result = 0;
+    for (size_t i = 0; i < e->nterms; i++) {
+        int_least64_t max = term_max(&e->terms[i]);
+        enum flow_type overflow = 0;
+        if (max >= 0)
+            NF_PLUS(max_result, max, INT_LEAST64, overflow);
+        if (max < 0 || overflow != 0) {
+            check_result = 1;
+            break;
+        }
+        max_result += max;
+    }
+
+    printf("/* %s */\n"
+           "%senum parse_error\n"
+           "%s(int_least64_t *value) {\n"
+           "    int_least64_t result = 0;\n"
+           "    int_least64_t t;\n",
+           fn->expr, make_static ? "static " : "", fn->name);
+
+    for (size_t i = 0; i < e->nterms; i++) {
+        const struct term *t = &e->terms[i];
+        if (t->type == TERM_CONSTANT)
+            printf("\n    t = INT64_C(%" PRIdLEAST64 ");\n", t->constant);
+        else
+            generate_dice(t, unroll);
+
+        if (!check_result)
+            printf("    result %s= t;\n", t->negative ? "-" : "+");
+        else if (t->negative)
+            printf("    if (result < 0 && t > result - INT_LEAST64_MIN)\n"
+                   "        return DE_OVERFLOW;\n"
+                   "    result -= t;\n");
+        else
+            printf("    if (result > 0 && t > INT_LEAST64_MAX - result)\n"
+                   "        return DE_OVERFLOW;\n"
+                   "    result += t;\n");
+    }
+
+    printf("\n"
+           "    *value = result;\n\n"
+           "    return 0;\n"
+           "}\n\n");
+}
+
+/* Generate code setting t to the sum of a dice term.
+ * @param t Term of type TERM_DICE, can't be NULL.
+ * @param unroll Unroll rolls if there are at most this many.
+ */
+static void
+generate_dice(const struct term *t, int_least64_t unroll) {
+    const int_least64_t n = t->nrolls;
+    const int_least64_t end = t->nrolls - t->large;
+    const int check_sum = term_max(t) < 0;
+
+    printf("\n    /* %" PRIdLEAST64 "d%" PRIdLEAST64, n, t->dice);
+    if (t->small > 0 || t->large > 0)
+        printf(" ignoring %" PRIdLEAST64 " smallest and %" PRIdLEAST64
+               " largest", t->small, t->large);
+    if (t->count != COUNT_NONE)
+        printf(" counting rolls %s %" PRIdLEAST64,
+               t->count == COUNT_AT_LEAST ? ">=" : "<=", t->threshold);
+    printf(". */\n");
+
+    if (t->count != COUNT_NONE) {
+        printf("    t = 0;\n"
+               "    for (int_least64_t i = 0; i < INT64_C(%" PRIdLEAST64
+               "); i++)\n"
+               "        t += de_roll_die(INT64_C(%" PRIdLEAST64 ")) %s INT64_C(%"
+               PRIdLEAST64 ");\n", n, t->dice,
+               t->count == COUNT_AT_LEAST ? ">=" : "<=", t->threshold);
+    }
+    else if (n <= unroll) {
+        printf("    {\n"
+               "        int_least64_t r[%" PRIdLEAST64 "];\n", n);
+        for (int_least64_t i = 0; i < n; i++)
+            printf("        r[%" PRIdLEAST64 "] = de_roll_die(INT64_C(%"
+                   PRIdLEAST64 "));\n", i, t->dice);
+        if (t->small > 0 || t->large > 0) {
+            // Sorting network, which moves the largest remaining roll to the
+            // end on each round.
+            printf("        int_least64_t x;\n");
+            for (int_least64_t i = n - 1; i > 0; i--) {
+                for (int_least64_t j = 0; j < i; j++)
+                    printf("        if (r[%" PRIdLEAST64 "] > r[%" PRIdLEAST64
+                           "]) { x = r[%" PRIdLEAST64 "]; r[%" PRIdLEAST64
+                           "] = r[%" PRIdLEAST64 "]; r[%" PRIdLEAST64
+                           "] = x; }\n", j, j + 1, j, j, j + 1, j + 1);
+            }
+        }
+        printf("        t = r[%" PRIdLEAST64 "];\n", t->small);
+        for (int_least64_t i = t->small + 1; i < end; i++) {
+            if (check_sum)
+                printf("        if (r[%" PRIdLEAST64 "] > INT_LEAST64_MAX - t)\n"
+                       "            return DE_OVERFLOW;\n", i);
+            printf("        t += r[%" PRIdLEAST64 "];\n", i);
+        }
+        printf("    }\n");
+    }
+    else if (t->small == 0 && t->large == 0) {
+        printf("    t = 0;\n"
+               "    for (int_least64_t i = 0; i < INT64_C(%" PRIdLEAST64
+               "); i++) {\n"
+               "        int_least64_t r = de_roll_die(INT64_C(%" PRIdLEAST64
+               "));\n", n, t->dice);
+        if (check_sum)
+            printf("        if (r > INT_LEAST64_MAX - t)\n"
+                   "            return DE_OVERFLOW;\n");
+        printf("        t += r;\n"
+               "    }\n");
+    }
+    else if (!needs_sort(t, unroll)) {
+        // Keep the smallest and largest rolls in arrays sorted from the
+        // outermost roll inwards and subtract them from the sum of all rolls,
+        // which can't overflow.
+        printf("    {\n");
+        if (t->small > 0)
+            printf("        int_least64_t small[%" PRIdLEAST64 "];\n"
+                   "        for (int_least64_t i = 0; i < %" PRIdLEAST64 "; i++)\n"
+                   "            small[i] = INT64_C(%" PRIdLEAST64 ");\n",
+                   t->small, t->small, t->dice + 1);
+        if (t->large > 0)
+            printf("        int_least64_t large[%" PRIdLEAST64 "];\n"
+                   "        for (int_least64_t i = 0; i < %" PRIdLEAST64 "; i++)\n"
+                   "            large[i] = 0;\n",
+                   t->large, t->large);
+        printf("        t = 0;\n"
+               "        for (int_least64_t i = 0; i < INT64_C(%" PRIdLEAST64
+               "); i++) {\n"
+               "            int_least64_t r = de_roll_die(INT64_C(%"
+               PRIdLEAST64 "));\n"
+               "            t += r;\n", n, t->dice);
+        if (t->small > 0)
+            printf("            if (r < small[%" PRIdLEAST64 "]) {\n"
+                   "                int_least64_t j = %" PRIdLEAST64 ";\n"
+                   "                for (; j > 0 && small[j - 1] > r; j--)\n"
+                   "                    small[j] = small[j - 1];\n"
+                   "                small[j] = r;\n"
+                   "            }\n", t->small - 1, t->small - 1);
+        if (t->large > 0)
+            printf("            if (r > large[%" PRIdLEAST64 "]) {\n"
+                   "                int_least64_t j = %" PRIdLEAST64 ";\n"
+                   "                for (; j > 0 && large[j - 1] < r; j--)\n"
+                   "                    large[j] = large[j - 1];\n"
+                   "                large[j] = r;\n"
+                   "            }\n", t->large - 1, t->large - 1);
+        printf("        }\n");
+        if (t->small > 0)
+            printf("        for (int_least64_t i = 0; i < %" PRIdLEAST64 "; i++)\n"
+                   "            t -= small[i];\n", t->small);
+        if (t->large > 0)
+            printf("        for (int_least64_t i = 0; i < %" PRIdLEAST64 "; i++)\n"
+                   "            t -= large[i];\n", t->large);
+        printf("    }\n");
+    }
+    else {
+        printf("    {\n"
+               "        int_least64_t *r = malloc(INT64_C(%" PRIdLEAST64
+               ") * sizeof(*r));\n"
+               "        if (r == NULL)\n"
+               "            return DE_MEMORY;\n"
+               "        for (int_least64_t i = 0; i < INT64_C(%" PRIdLEAST64
+               "); i++)\n"
+               "            r[i] = de_roll_die(INT64_C(%" PRIdLEAST64 "));\n"
+               "        qsort(r, INT64_C(%" PRIdLEAST64 "), sizeof(*r), "
+               "degen_ascending);\n"
+               "        t = 0;\n"
+               "        for (int_least64_t i = INT64_C(%" PRIdLEAST64
+               "); i < INT64_C(%" PRIdLEAST64 "); i++) {\n",
+               n, n, t->dice, n, t->small, end);
+        if (check_sum)
+            printf("            if (r[i] > INT_LEAST64_MAX - t) {\n"
+                   "                free(r);\n"
+                   "                return DE_OVERFLOW;\n"
+                   "            }\n");
+        printf("            t += r[i];\n"
+               "        }\n"
+               "        free(r);\n"
+               "    }\n");
+    }
+}
+
+static void
+generate_table(const char *table,
+               const struct function *fns,
+               size_t nfns) {
+    printf("static const struct {\n"
+           "    const char *name;\n"
+           "    const char *expr;\n"
+           "    enum parse_error (*function)(int_least64_t *value);\n"
+           "} %s[] = {\n", table);
+    for (size_t i = 0; i < nfns; i++) {
+        printf("    { \"%s\", \"", fns[i].name);
+        // Valid expressions can't have characters that need escaping in a
+        // string literal, except whitespace.
+        for (const char *c = fns[i].expr; *c != '\0'; c++) {
+            if (isspace((unsigned char) *c))
+                putchar(' ');
+            else
+                putchar(*c);
+        }
+        printf("\", %s },\n", fns[i].name);
+    }
+    printf("    { NULL, NULL, NULL }\n"
+           "};\n");
+}
@@ -0,0 +1,227 @@
+/* Verify an audit log by replaying its calls.
+ *
+ * Usage: dereplay [-t threads] file
+ *
+ * Reads an audit log written with de_audit_open(), compiles each of its
+ * expressions once and evaluates every call again with its seed and counter
+ * on all threads. Calls whose value or error differ from the log are
+ * printed. Exits with failure if any call differs or the log is corrupted.
+ *
+ * -t threads  Default number of online processors.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "diceexpr.h"
+#include "file.h"
+
+// Calls a thread takes at a time.
+#define CHUNK 4096
+// Differing calls printed at most.
+#define MAX_PRINTED 10
+
+// A call of the log.
+struct call {
+    uint_least64_t id;
+    uint_least64_t counter;
+    enum parse_error error;
+    int_least64_t value;
+    // Set if replaying gave something else.
+    int differs;
+};
+
+// An expression of the log.
+struct expression {
+    char *text;
+    // NULL if the expression didn't compile.
+    de_expr *compiled;
+    enum parse_error error;
+};
+
+struct replay {
+    uint_least64_t seed;
+    struct call *calls;
+    size_t ncalls;
+    struct expression *exprs;
+    size_t nexprs;
+    // Next chunk to take.
+    size_t next;
+};
+
+static int read_log(const char *log, size_t size, struct replay *r);
+static void* replay_calls(void *arg);
+
+int
+main(int argc, char **argv) {
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+            case 't': nthreads = atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-t threads] file\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-t threads] file\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (nthreads < 1)
+        nthreads = 1;
+
+    size_t size;
+    char *log = read_file(argv[optind], &size);
+    if (log == NULL)
+        return EXIT_FAILURE;
+    struct replay r = { 0 };
+    int retval = EXIT_FAILURE;
+    pthread_t *threads = NULL;
+    if (read_log(log, size, &r) != 0)
+        goto free;
+    if ((threads = malloc(nthreads * sizeof(*threads))) == NULL) {
+        perror("malloc");
+        goto free;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long started = 0;
+    for (; started < nthreads; started++) {
+        if (pthread_create(&threads[started], NULL, replay_calls, &r) != 0)
+            break;
+    }
+    // Replay alone if no thread could be created.
+    if (started == 0)
+        replay_calls(&r);
+    for (long i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = end.tv_sec - start.tv_sec +
+        (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    size_t ndiffering = 0;
+    for (size_t i = 0; i < r.ncalls; i++) {
+        if (!r.calls[i].differs)
+            continue;
+        if (ndiffering++ < MAX_PRINTED) {
+            const struct call *c = &r.calls[i];
+            printf("call %" PRIuLEAST64 " differs: %s, logged value %"
+                   PRIdLEAST64 " error %d\n", c->counter,
+                   r.exprs[c->id].text, c->value, c->error);
+        }
+    }
+    printf("%zu calls, %zu expressions, %zu differ, %.0f calls/s with "
+           "%ld threads\n", r.ncalls, r.nexprs, ndiffering,
+           seconds > 0 ? r.ncalls / seconds : 0, started > 0 ? started : 1);
+    retval = ndiffering == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    free:
+        free(threads);
+        for (size_t i = 0; i < r.nexprs; i++) {
+            free(r.exprs[i].text);
+            de_free(r.exprs[i].compiled);
+        }
+        free(r.exprs);
+        free(r.calls);
+        free(log);
+
+    return retval;
+}
+
+/* Read calls of a log and compile its expressions.
+ * @return Zero on success, non-zero on error.
+ */
+static int
+read_log(const char *log, size_t size, struct replay *r) {
+    struct de_audit_reader reader;
+    if (de_audit_reader_init(&reader, log, size) != 0) {
+        fprintf(stderr, "not an audit log\n");
+        return -1;
+    }
+    r->seed = reader.seed;
+
+    size_t calls_size = 0, exprs_size = 0;
+    while (reader.offset < reader.size) {
+        struct de_audit_record record;
+        if (de_audit_read(&reader, &record) != 0) {
+            fprintf(stderr, "corrupted record after call %zu\n", r->ncalls);
+            return -1;
+        }
+
+        if (r->ncalls == calls_size) {
+            calls_size = calls_size > 0 ? 2 * calls_size : CHUNK;
+            struct call *temp = realloc(r->calls,
+                                        calls_size * sizeof(*temp));
+            if (temp == NULL) {
+                perror("realloc");
+                return -1;
+            }
+            r->calls = temp;
+        }
+        struct call *c = &r->calls[r->ncalls++];
+        c->id = record.id;
+        c->counter = record.counter;
+        c->error = record.error;
+        c->value = record.value;
+        c->differs = 0;
+        if (record.expr == NULL)
+            continue;
+
+        if (r->nexprs == exprs_size) {
+            exprs_size = exprs_size > 0 ? 2 * exprs_size : 64;
+            struct expression *temp = realloc(r->exprs,
+                                              exprs_size * sizeof(*temp));
+            if (temp == NULL) {
+                perror("realloc");
+                return -1;
+            }
+            r->exprs = temp;
+        }
+        struct expression *e = &r->exprs[r->nexprs];
+        if ((e->text = malloc(record.len + 1)) == NULL) {
+            perror("malloc");
+            return -1;
+        }
+        r->nexprs++;
+        memcpy(e->text, record.expr, record.len);
+        e->text[record.len] = '\0';
+        e->compiled = NULL;
+        e->error = de_compile(e->text, &e->compiled);
+    }
+
+    return 0;
+}
+
+/* Replay chunks of calls until all are taken.
+ * @param arg Pointer to struct replay.
+ * @return NULL.
+ */
+static void*
+replay_calls(void *arg) {
+    struct replay *r = arg;
+    size_t begin;
+    while ((begin = __atomic_fetch_add(&r->next, CHUNK, __ATOMIC_RELAXED)) <
+           r->ncalls) {
+        size_t end = r->ncalls - begin < CHUNK ? r->ncalls : begin + CHUNK;
+        for (size_t i = begin; i < end; i++) {
+            struct call *c = &r->calls[i];
+            const struct expression *e = &r->exprs[c->id];
+            int_least64_t value = 0;
+            enum parse_error error = e->error;
+            if (e->compiled != NULL) {
+                error = de_audit_eval(e->compiled, r->seed, c->counter, &value);
+                if (error != 0)
+                    value = 0;
+            }
+            c->differs = error != c->error || value != c->value;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,243 @@
+/* Run simulations of a dice expression in parts and merge them.
+ *
+ * Usage: desim run [-s seed] [-b begin] [-n calls] [-o file] expression
+ *        desim merge [-o file] partial...
+ *        desim print file
+ *
+ * run simulates calls with counters from begin to begin + calls and writes
+ * the partial result, see de_sim_write(). Workers given the same seed and
+ * disjoint ranges of counters can run on any processes or hosts.
+ *
+ * merge combines partial results of the same expression and seed, given in
+ * any order, to the result of one simulation of all their calls. The ranges
+ * must leave no gaps between them.
+ *
+ * print writes the summary and the histogram of a result as text.
+ *
+ * -s seed   Default 0.
+ * -b begin  Default 0.
+ * -n calls  Default 1000000.
+ * -o file   Default standard output.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "diceexpr.h"
+#include "file.h"
+
+#define DEFAULT_CALLS 1000000
+
+static int run(int argc, char **argv);
+static int merge(int argc, char **argv);
+static int print(int argc, char **argv);
+static int usage(const char *name);
+static de_sim* read_sim(const char *path);
+static int write_sim(const de_sim *sim, const char *path);
+static int compare_begin(const void *a, const void *b);
+
+int
+main(int argc, char **argv) {
+    if (argc < 2)
+        return usage(argv[0]);
+
+    if (strcmp(argv[1], "run") == 0)
+        return run(argc - 1, argv + 1);
+    if (strcmp(argv[1], "merge") == 0)
+        return merge(argc - 1, argv + 1);
+    if (strcmp(argv[1], "print") == 0)
+        return print(argc - 1, argv + 1);
+
+    return usage(argv[0]);
+}
+
+/* Simulate a range of calls and write the partial result.
+ */
+static int
+run(int argc, char **argv) {
+    uint_least64_t seed = 0, begin = 0, calls = DEFAULT_CALLS;
+    const char *output = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:b:n:o:")) != -1) {
+        switch (opt) {
+            case 's': seed = strtoull(optarg, NULL, 0); break;
+            case 'b': begin = strtoull(optarg, NULL, 0); break;
+            case 'n': calls = strtoull(optarg, NULL, 0); break;
+            case 'o': output = optarg; break;
+            default: return usage("desim");
+        }
+    }
+    if (optind != argc - 1)
+        return usage("desim");
+    if (calls > UINT64_MAX - begin) {
+        fprintf(stderr, "begin + calls is too large\n");
+        return EXIT_FAILURE;
+    }
+
+    de_expr *compiled = NULL;
+    enum parse_error e = de_compile(argv[optind], &compiled);
+    if (e != 0) {
+        fprintf(stderr, "can't compile %s: error %d\n", argv[optind], e);
+        return EXIT_FAILURE;
+    }
+    de_sim *sim = NULL;
+    e = de_sim_run(compiled, seed, begin, begin + calls, &sim);
+    de_free(compiled);
+    if (e != 0) {
+        fprintf(stderr, "can't simulate: error %d\n", e);
+        return EXIT_FAILURE;
+    }
+    int retval = write_sim(sim, output);
+    de_sim_free(sim);
+
+    return retval;
+}
+
+/* Merge partial results in the order of their calls.
+ */
+static int
+merge(int argc, char **argv) {
+    const char *output = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:")) != -1) {
+        switch (opt) {
+            case 'o': output = optarg; break;
+            default: return usage("desim");
+        }
+    }
+    if (optind == argc)
+        return usage("desim");
+
+    const int nsims = argc - optind;
+    de_sim **sims = calloc(nsims, sizeof(*sims));
+    if (sims == NULL) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+    int retval = EXIT_FAILURE;
+    for (int i = 0; i < nsims; i++) {
+        if ((sims[i] = read_sim(argv[optind + i])) == NULL)
+            goto free;
+    }
+    qsort(sims, nsims, sizeof(*sims), compare_begin);
+    for (int i = 1; i < nsims; i++) {
+        enum parse_error e = de_sim_merge(sims[0], sims[i]);
+        if (e != 0) {
+            struct de_sim_stats stats;
+            de_sim_stats(sims[i], &stats);
+            fprintf(stderr, "can't merge calls %" PRIuLEAST64 "-%"
+                    PRIuLEAST64 ": %s\n", stats.begin, stats.end,
+                    e == DE_MISMATCH ? "different expression or seed, or "
+                    "calls overlap or leave a gap" : "out of memory");
+            goto free;
+        }
+    }
+    retval = write_sim(sims[0], output);
+
+    free:
+        for (int i = 0; i < nsims; i++)
+            de_sim_free(sims[i]);
+        free(sims);
+
+    return retval;
+}
+
+/* Print the summary and the histogram of a result.
+ */
+static int
+print(int argc, char **argv) {
+    if (argc != 2)
+        return usage("desim");
+    de_sim *sim = read_sim(argv[1]);
+    if (sim == NULL)
+        return EXIT_FAILURE;
+
+    struct de_sim_stats stats;
+    de_sim_stats(sim, &stats);
+    const uint_least64_t ncounted = stats.end - stats.begin - stats.nerrors;
+    printf("fingerprint %016" PRIxLEAST64 ", seed %" PRIuLEAST64
+           ", calls %" PRIuLEAST64 "-%" PRIuLEAST64 ", %" PRIuLEAST64
+           " failed\n", stats.fingerprint, stats.seed, stats.begin,
+           stats.end, stats.nerrors);
+    printf("min %" PRIdLEAST64 ", max %" PRIdLEAST64 ", mean %g, variance %g"
+           ", skewness %g, kurtosis %g\n", stats.min, stats.max, stats.mean,
+           stats.variance, stats.skewness, stats.kurtosis);
+    size_t nbins;
+    const struct de_sim_bin *bins = de_sim_histogram(sim, &nbins);
+    for (size_t i = 0; i < nbins; i++) {
+        printf("%" PRIdLEAST64 " %" PRIuLEAST64 " %.6f\n", bins[i].value,
+               bins[i].count, (double) bins[i].count / ncounted);
+    }
+    de_sim_free(sim);
+
+    return EXIT_SUCCESS;
+}
+
+static int
+usage(const char *name) {
+    fprintf(stderr, "usage: %s run [-s seed] [-b begin] [-n calls] "
+            "[-o file] expression\n"
+            "       %s merge [-o file] partial...\n"
+            "       %s print file\n", name, name, name);
+
+    return EXIT_FAILURE;
+}
+
+/* Read a result from a file.
+ * @return Result, or NULL on error.
+ */
+static de_sim*
+read_sim(const char *path) {
+    size_t size;
+    char *chars = read_file(path, &size);
+    if (chars == NULL)
+        return NULL;
+
+    de_sim *sim = NULL;
+    enum parse_error e = de_sim_read(chars, size, &sim);
+    free(chars);
+    if (e != 0) {
+        fprintf(stderr, "%s: %s\n", path, e == DE_SYNTAX_ERROR ?
+                "not a simulation" : "out of memory");
+        return NULL;
+    }
+
+    return sim;
+}
+
+/* Write a result to a file.
+ * @param path Standard output if NULL.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int
+write_sim(const de_sim *sim, const char *path) {
+    int fd = STDOUT_FILENO;
+    if (path != NULL &&
+        (fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    enum parse_error e = de_sim_write(sim, de_sink_fd, &fd);
+    if (path != NULL && close(fd) != 0 && e == 0)
+        e = DE_OUTPUT;
+    if (e != 0) {
+        fprintf(stderr, "%s: can't write\n", path != NULL ? path : "stdout");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int
+compare_begin(const void *a, const void *b) {
+    struct de_sim_stats x, y;
+    de_sim_stats(*(de_sim* const*) a, &x);
+    de_sim_stats(*(de_sim* const*) b, &y);
+
+    return (x.begin > y.begin) - (x.begin < y.begin);
+}
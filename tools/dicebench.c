@@ -0,0 +1,395 @@
+/* Load generator for diced.
+ *
+ * Usage: dicebench [-s socket] [-p port] [-c connections] [-w window]
+ *                  [-d seconds] [-e expression]
+ *
+ * Opens connections to diced, each from its own thread, and keeps sending an
+ * expression for the given time. Prints throughput and latencies of the
+ * requests.
+ *
+ * -s socket       Path of the Unix domain socket, default /tmp/diced.sock.
+ * -p port         Connect to this TCP port on 127.0.0.1 instead.
+ * -c connections  Number of connections, default 4.
+ * -w window       Number of requests sent without waiting for a response on
+ *                 each connection, default 16.
+ * -d seconds      Duration, default 5.
+ * -e expression   Expression to roll, default "4d6<+1d20".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "diceexpr.h"
+#include "diced.h"
+
+#define DEFAULT_CONNECTIONS 4
+#define DEFAULT_WINDOW 16
+#define DEFAULT_DURATION 5
+#define DEFAULT_EXPRESSION "4d6<+1d20"
+#define READ_SIZE 65536
+// Latencies are counted in buckets, 16 for each power of two, so the error
+// of a percentile is at most 1/16.
+#define SUB_BUCKET_BITS 4
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define NBUCKETS (64 * SUB_BUCKETS)
+
+struct client {
+    pthread_t thread;
+    int fd;
+    // Request frame.
+    unsigned char *request;
+    size_t request_len;
+    // Send times of requests waiting for a response.
+    uint_least64_t *sent;
+    // Buffered response bytes.
+    unsigned char buffer[READ_SIZE];
+    size_t start;
+    size_t len;
+    // Results.
+    uint_least64_t responses;
+    uint_least64_t errors;
+    uint_least64_t histogram[NBUCKETS];
+    int failed;
+};
+
+static const char *path = DICED_DEFAULT_SOCKET;
+static int port;
+static size_t window = DEFAULT_WINDOW;
+static uint_least64_t deadline;
+
+static void* run_client(void *arg);
+static int connect_server(void);
+static int send_all(int fd, const unsigned char *p, size_t len);
+static int read_response(struct client *c, enum parse_error *e);
+static int fill(struct client *c, size_t n);
+static uint_least64_t now(void);
+static size_t bucket(uint_least64_t ns);
+static uint_least64_t bucket_max(size_t i);
+static uint_least64_t percentile(const uint_least64_t *histogram,
+                                 uint_least64_t n,
+                                 double p);
+
+int
+main(int argc, char **argv) {
+    long nconnections = DEFAULT_CONNECTIONS;
+    long duration = DEFAULT_DURATION;
+    const char *expr = DEFAULT_EXPRESSION;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:p:c:w:d:e:")) != -1) {
+        switch (opt) {
+            case 's': path = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'c': nconnections = atol(optarg); break;
+            case 'w': window = strtoul(optarg, NULL, 10); break;
+            case 'd': duration = atol(optarg); break;
+            case 'e': expr = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-s socket] [-p port] "
+                        "[-c connections] [-w window] [-d seconds] "
+                        "[-e expression]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (nconnections < 1 || window < 1 || duration < 1) {
+        fprintf(stderr, "connections, window and duration must be positive\n");
+        return EXIT_FAILURE;
+    }
+    size_t expr_len = strlen(expr);
+    if (expr_len > DICED_MAX_REQUEST) {
+        fprintf(stderr, "expression too long\n");
+        return EXIT_FAILURE;
+    }
+
+    unsigned char *request = malloc(DICED_LENGTH_SIZE + expr_len);
+    struct client *clients = calloc(nconnections, sizeof(*clients));
+    if (request == NULL || clients == NULL) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    diced_put_u32(request, expr_len);
+    memcpy(request + DICED_LENGTH_SIZE, expr, expr_len);
+
+    int retval = EXIT_SUCCESS;
+    long started = 0;
+    uint_least64_t start = now();
+    deadline = start + (uint_least64_t) duration * 1000000000;
+    for (; started < nconnections; started++) {
+        struct client *c = &clients[started];
+        c->request = request;
+        c->request_len = DICED_LENGTH_SIZE + expr_len;
+        if ((c->sent = malloc(window * sizeof(*c->sent))) == NULL) {
+            perror("malloc");
+            break;
+        }
+        if ((c->fd = connect_server()) == -1) {
+            free(c->sent);
+            break;
+        }
+        if (pthread_create(&c->thread, NULL, run_client, c) != 0) {
+            perror("pthread_create");
+            close(c->fd);
+            free(c->sent);
+            break;
+        }
+    }
+    if (started < nconnections)
+        retval = EXIT_FAILURE;
+
+    uint_least64_t responses = 0;
+    uint_least64_t errors = 0;
+    uint_least64_t histogram[NBUCKETS] = { 0 };
+    for (long i = 0; i < started; i++) {
+        struct client *c = &clients[i];
+        pthread_join(c->thread, NULL);
+        if (c->failed)
+            retval = EXIT_FAILURE;
+        responses += c->responses;
+        errors += c->errors;
+        for (size_t j = 0; j < NBUCKETS; j++)
+            histogram[j] += c->histogram[j];
+        close(c->fd);
+        free(c->sent);
+    }
+    double seconds = (now() - start) / 1e9;
+
+    printf("%" PRIuLEAST64 " requests in %.2f s, %" PRIuLEAST64 " errors\n",
+           responses, seconds, errors);
+    printf("throughput: %.0f requests/s\n", responses / seconds);
+    if (responses > 0) {
+        printf("latency: p50 %.1f us, p99 %.1f us, p99.9 %.1f us, "
+               "max %.1f us\n",
+               percentile(histogram, responses, 0.5) / 1e3,
+               percentile(histogram, responses, 0.99) / 1e3,
+               percentile(histogram, responses, 0.999) / 1e3,
+               percentile(histogram, responses, 1) / 1e3);
+    }
+
+    free(request);
+    free(clients);
+
+    return retval;
+}
+
+/* Keep window requests in flight until deadline, then wait for the
+ * remaining responses.
+ */
+static void*
+run_client(void *arg) {
+    struct client *c = arg;
+
+    // Responses come in the order of requests, so send times are a queue.
+    size_t head = 0, tail = 0, inflight = 0;
+    for (;;) {
+        uint_least64_t t = now();
+        while (inflight < window && t < deadline) {
+            if (send_all(c->fd, c->request, c->request_len) != 0)
+                goto error;
+            c->sent[head] = t;
+            head = (head + 1) % window;
+            inflight++;
+        }
+        if (inflight == 0)
+            break;
+
+        enum parse_error e;
+        if (read_response(c, &e) != 0)
+            goto error;
+        uint_least64_t latency = now() - c->sent[tail];
+        tail = (tail + 1) % window;
+        inflight--;
+        c->histogram[bucket(latency)]++;
+        c->responses++;
+        if (e != 0)
+            c->errors++;
+    }
+
+    return NULL;
+
+    error:
+        c->failed = 1;
+
+    return NULL;
+}
+
+static int
+connect_server(void) {
+    int fd;
+    if (port != 0) {
+        struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons(port),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+        };
+        if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+            perror("socket");
+            return -1;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == -1) {
+            perror("connect");
+            close(fd);
+            return -1;
+        }
+    }
+    else {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        if (strlen(path) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "%s: path too long\n", path);
+            return -1;
+        }
+        strcpy(addr.sun_path, path);
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+            perror("socket");
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == -1) {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+static int
+send_all(int fd, const unsigned char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("send");
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* Read a response and store its error code to e.
+ * @return Zero on success, -1 on error.
+ */
+static int
+read_response(struct client *c, enum parse_error *e) {
+    if (fill(c, DICED_LENGTH_SIZE) != 0)
+        return -1;
+    size_t len = diced_get_u32(c->buffer + c->start);
+    if (len < DICED_RESPONSE_SIZE) {
+        fprintf(stderr, "invalid response\n");
+        return -1;
+    }
+    c->start += DICED_LENGTH_SIZE;
+    c->len -= DICED_LENGTH_SIZE;
+
+    if (fill(c, 1) != 0)
+        return -1;
+    *e = c->buffer[c->start];
+    // Value and rolled expression aren't needed, skip them.
+    while (len > 0) {
+        if (c->len == 0 && fill(c, 1) != 0)
+            return -1;
+        size_t n = len < c->len ? len : c->len;
+        c->start += n;
+        c->len -= n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* Read until at least n bytes are buffered.
+ * @return Zero on success, -1 on error or end of file.
+ */
+static int
+fill(struct client *c, size_t n) {
+    if (c->len >= n)
+        return 0;
+    memmove(c->buffer, c->buffer + c->start, c->len);
+    c->start = 0;
+    while (c->len < n) {
+        ssize_t r = read(c->fd, c->buffer + c->len, READ_SIZE - c->len);
+        if (r == 0) {
+            fprintf(stderr, "connection closed\n");
+            return -1;
+        }
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("read");
+            return -1;
+        }
+        c->len += r;
+    }
+
+    return 0;
+}
+
+/* Monotonic time in nanoseconds.
+ */
+static uint_least64_t
+now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint_least64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Index of the bucket of a latency. Latencies below SUB_BUCKETS have their
+ * own buckets, others are split to SUB_BUCKETS buckets per power of two.
+ */
+static size_t
+bucket(uint_least64_t ns) {
+    if (ns < SUB_BUCKETS)
+        return ns;
+    int msb = 63;
+    while (!(ns >> msb & 1))
+        msb--;
+    int shift = msb - SUB_BUCKET_BITS;
+
+    return (size_t) (shift + 1) * SUB_BUCKETS +
+        (ns >> shift & (SUB_BUCKETS - 1));
+}
+
+/* Largest latency in bucket i.
+ */
+static uint_least64_t
+bucket_max(size_t i) {
+    if (i < SUB_BUCKETS)
+        return i;
+    int shift = i / SUB_BUCKETS - 1;
+    uint_least64_t sub = i % SUB_BUCKETS;
+
+    return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+/* Latency at or below which p of n latencies in histogram are.
+ */
+static uint_least64_t
+percentile(const uint_least64_t *histogram, uint_least64_t n, double p) {
+    uint_least64_t rank = (uint_least64_t) (p * n + 0.5);
+    if (rank < 1)
+        rank = 1;
+    uint_least64_t count = 0;
+    size_t i = 0;
+    for (; i < NBUCKETS - 1; i++) {
+        count += histogram[i];
+        if (count >= rank)
+            break;
+    }
+
+    return bucket_max(i);
+}
@@ -0,0 +1,624 @@
+/* Dice rolling daemon.
+ *
+ * Usage: diced [-s socket] [-p port] [-t threads] [-m max_request]
+ *              [-d max_dice] [-o max_output] [-r pool_size]
+ *
+ * Listens on a Unix domain socket and optionally on a TCP port on the
+ * loopback interface. The protocol is described in diced.h.
+ *
+ * Each thread runs its own epoll event loop and is bound to its own
+ * processor. Requests read on an iteration of an event loop are evaluated
+ * together as a batch, after which responses are written. Requests aren't
+ * read from a connection while a megabyte of its responses waits to be
+ * written.
+ *
+ * -s socket      Path of the Unix domain socket, default /tmp/diced.sock.
+ * -p port        Also listen on this TCP port on 127.0.0.1.
+ * -t threads     Number of event loops, default number of online processors.
+ * -m max_request Maximum length of a request, default 65536. A connection
+ *                sending a longer request is closed.
+ * -d max_dice    Limit for the number of dices rolled by a request.
+ * -o max_output  Limit for the length of a rolled expression.
+ * -r pool_size   Generate random numbers in the background to a pool of this
+ *                size for each thread, see de_pool_start().
+ *
+ * Stops on SIGINT or SIGTERM, closes open connections and prints statistics
+ * of each thread.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "diceexpr.h"
+#include "diced.h"
+
+#ifndef EPOLLEXCLUSIVE
+    #define EPOLLEXCLUSIVE 0
+#endif
+
+#define MAX_EVENTS 256
+// Read at most this many bytes from a connection on an iteration, so that a
+// single client can't starve the others.
+#define MAX_READ 65536
+#define DEFAULT_BUFFER_SIZE 4096
+// Stop reading requests from a connection while this many bytes of
+// responses wait to be written, so that a client which doesn't read
+// responses can't make the daemon's memory grow without limit.
+#define MAX_OUTPUT (1 << 20)
+#define SIZE_MULTIPLIER 2
+
+enum source_type {
+    LISTENER,
+    CONNECTION,
+    STOP
+};
+
+// Listening socket.
+struct listener {
+    // Must be the first member, events point to it.
+    enum source_type type;
+    int fd;
+};
+
+// Growing byte buffer.
+struct buffer {
+    unsigned char *data;
+    size_t len;
+    size_t size;
+};
+
+struct connection {
+    // Must be the first member, events point to it.
+    enum source_type type;
+    int fd;
+    struct buffer in;
+    // Bytes of in which are parsed to requests.
+    size_t parsed;
+    struct buffer out;
+    // Bytes of out already written.
+    size_t written;
+    // Peer has closed the connection or the connection failed.
+    int eof;
+    int error;
+    // Connection is waiting for EPOLLIN and EPOLLOUT.
+    int reading;
+    int writing;
+    // Connection had events on current iteration.
+    int active;
+    struct connection *next_active;
+    // Open connections of the worker.
+    struct connection *prev;
+    struct connection *next;
+};
+
+// Request in a batch.
+struct request {
+    struct connection *c;
+    // Expression in c->in.
+    size_t offset;
+    size_t len;
+};
+
+struct worker {
+    pthread_t thread;
+    int cpu;
+    int epoll;
+    struct request *batch;
+    size_t nbatch;
+    size_t batch_size;
+    // Expression of a request with '\0'.
+    struct buffer expr;
+    struct connection *open;
+    // Statistics.
+    uint_least64_t connections;
+    uint_least64_t requests;
+    uint_least64_t batches;
+    uint_least64_t max_batch;
+};
+
+static struct listener listeners[2];
+static size_t nlisteners;
+static struct listener stop = { .type = STOP, .fd = -1 };
+static size_t max_request = DICED_MAX_REQUEST;
+
+static void* run_worker(void *arg);
+static void accept_connections(struct worker *w, struct listener *l);
+static void read_requests(struct worker *w, struct connection *c);
+static void evaluate_batch(struct worker *w);
+static void finish_connection(struct worker *w, struct connection *c);
+static void close_connection(struct worker *w, struct connection *c);
+static int reserve(struct buffer *b, size_t size);
+static int listen_unix(const char *path);
+static int listen_tcp(int port);
+
+int
+main(int argc, char **argv) {
+    const char *path = DICED_DEFAULT_SOCKET;
+    int port = 0;
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    struct de_cost limits = { 0 };
+    struct de_pool_config pool = { 0 };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:p:t:m:d:o:r:")) != -1) {
+        switch (opt) {
+            case 's': path = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 't': nthreads = atol(optarg); break;
+            case 'm': max_request = strtoul(optarg, NULL, 10); break;
+            case 'd': limits.dice = strtoull(optarg, NULL, 10); break;
+            case 'o': limits.output = strtoull(optarg, NULL, 10); break;
+            case 'r': pool.size = strtoul(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "usage: %s [-s socket] [-p port] [-t threads] "
+                        "[-m max_request] [-d max_dice] [-o max_output] "
+                        "[-r pool_size]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (nthreads < 1)
+        nthreads = 1;
+    de_set_limits(&limits);
+    srand(time(NULL));
+
+    if ((listeners[nlisteners].fd = listen_unix(path)) == -1)
+        return EXIT_FAILURE;
+    listeners[nlisteners++].type = LISTENER;
+    if (port != 0) {
+        if ((listeners[nlisteners].fd = listen_tcp(port)) == -1)
+            return EXIT_FAILURE;
+        listeners[nlisteners++].type = LISTENER;
+    }
+    if ((stop.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        perror("eventfd");
+        return EXIT_FAILURE;
+    }
+
+    // Only the main thread handles signals. Writes to closed connections
+    // fail with EPIPE instead of killing the process.
+    signal(SIGPIPE, SIG_IGN);
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    if (pool.size > 0) {
+        pool.nshards = nthreads;
+        pool.watermark = pool.size / 2;
+        if (de_pool_start(&pool) != 0) {
+            fprintf(stderr, "can't start pool\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct worker *workers = calloc(nthreads, sizeof(*workers));
+    if (workers == NULL) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    long started = 0;
+    for (; started < nthreads; started++) {
+        struct worker *w = &workers[started];
+        w->cpu = ncpus > 0 ? started % ncpus : 0;
+        if ((w->epoll = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+            perror("epoll_create1");
+            break;
+        }
+        // Only one of the event loops is woken up for a new connection.
+        struct epoll_event event = { .events = EPOLLIN | EPOLLEXCLUSIVE };
+        for (size_t i = 0; i < nlisteners; i++) {
+            event.data.ptr = &listeners[i];
+            epoll_ctl(w->epoll, EPOLL_CTL_ADD, listeners[i].fd, &event);
+        }
+        event.events = EPOLLIN;
+        event.data.ptr = &stop;
+        epoll_ctl(w->epoll, EPOLL_CTL_ADD, stop.fd, &event);
+
+        if (pthread_create(&w->thread, NULL, run_worker, w) != 0) {
+            perror("pthread_create");
+            close(w->epoll);
+            break;
+        }
+    }
+
+    int retval = EXIT_SUCCESS;
+    if (started == nthreads) {
+        int sig;
+        sigwait(&signals, &sig);
+    }
+    else
+        retval = EXIT_FAILURE;
+
+    // Readable eventfd wakes up all event loops.
+    uint64_t one = 1;
+    if (write(stop.fd, &one, sizeof(one)) != sizeof(one))
+        perror("write");
+    uint_least64_t requests = 0;
+    for (long i = 0; i < started; i++) {
+        struct worker *w = &workers[i];
+        pthread_join(w->thread, NULL);
+        close(w->epoll);
+        printf("thread %ld: cpu %d, %" PRIuLEAST64 " connections, %"
+               PRIuLEAST64 " requests, %" PRIuLEAST64 " batches, "
+               "largest batch %" PRIuLEAST64 "\n", i, w->cpu, w->connections,
+               w->requests, w->batches, w->max_batch);
+        requests += w->requests;
+    }
+    printf("%" PRIuLEAST64 " requests\n", requests);
+    struct de_pool_stats stats;
+    de_pool_stats(&stats);
+    if (stats.nshards > 0) {
+        printf("pool: %" PRIuLEAST64 " hits, %" PRIuLEAST64 " misses, %"
+               PRIuLEAST64 " wakeups\n", stats.hits, stats.misses,
+               stats.wakeups);
+    }
+    de_pool_stop();
+
+    for (size_t i = 0; i < nlisteners; i++)
+        close(listeners[i].fd);
+    close(stop.fd);
+    unlink(path);
+    free(workers);
+
+    return retval;
+}
+
+static void*
+run_worker(void *arg) {
+    struct worker *w = arg;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(w->cpu, &cpus);
+    // Not fatal, the thread just isn't bound to a processor.
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+    struct epoll_event events[MAX_EVENTS];
+    int stopping = 0;
+    while (!stopping) {
+        int n = epoll_wait(w->epoll, events, MAX_EVENTS, -1);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        struct connection *active = NULL;
+        for (int i = 0; i < n; i++) {
+            enum source_type *type = events[i].data.ptr;
+            if (*type == STOP) {
+                stopping = 1;
+                continue;
+            }
+            if (*type == LISTENER) {
+                accept_connections(w, (struct listener*) type);
+                continue;
+            }
+
+            struct connection *c = (struct connection*) type;
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                read_requests(w, c);
+            if (!c->active) {
+                c->active = 1;
+                c->next_active = active;
+                active = c;
+            }
+        }
+
+        evaluate_batch(w);
+        while (active != NULL) {
+            struct connection *c = active;
+            active = c->next_active;
+            c->active = 0;
+            finish_connection(w, c);
+        }
+    }
+
+    while (w->open != NULL)
+        close_connection(w, w->open);
+    free(w->batch);
+    free(w->expr.data);
+
+    return NULL;
+}
+
+static void
+accept_connections(struct worker *w, struct listener *l) {
+    for (;;) {
+        int fd = accept4(l->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+                errno != ECONNABORTED)
+                perror("accept4");
+            return;
+        }
+        int one = 1;
+        // Fails on Unix domain sockets, which don't delay small writes.
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        struct connection *c = calloc(1, sizeof(*c));
+        if (c == NULL) {
+            close(fd);
+            continue;
+        }
+        c->type = CONNECTION;
+        c->fd = fd;
+        c->reading = 1;
+        struct epoll_event event = { .events = EPOLLIN | EPOLLRDHUP };
+        event.data.ptr = c;
+        if (epoll_ctl(w->epoll, EPOLL_CTL_ADD, fd, &event) == -1) {
+            perror("epoll_ctl");
+            close(fd);
+            free(c);
+            continue;
+        }
+        c->next = w->open;
+        if (c->next != NULL)
+            c->next->prev = c;
+        w->open = c;
+        w->connections++;
+    }
+}
+
+/* Read from connection and add complete requests to the batch.
+ */
+static void
+read_requests(struct worker *w, struct connection *c) {
+    for (size_t nread = 0; !c->eof && nread < MAX_READ; ) {
+        if (reserve(&c->in, c->in.len + DEFAULT_BUFFER_SIZE) != 0) {
+            c->error = 1;
+            break;
+        }
+        ssize_t n = read(c->fd, c->in.data + c->in.len,
+                         c->in.size - c->in.len);
+        if (n > 0) {
+            c->in.len += n;
+            nread += n;
+        }
+        else if (n == 0)
+            c->eof = 1;
+        else if (errno == EINTR)
+            continue;
+        else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                c->eof = 1;
+                c->error = 1;
+            }
+            break;
+        }
+    }
+
+    while (!c->error && c->in.len - c->parsed >= DICED_LENGTH_SIZE) {
+        size_t len = diced_get_u32(c->in.data + c->parsed);
+        if (len > max_request) {
+            c->error = 1;
+            break;
+        }
+        if (c->in.len - c->parsed - DICED_LENGTH_SIZE < len)
+            break;
+
+        if (w->nbatch == w->batch_size) {
+            size_t size = w->batch_size == 0 ?
+                MAX_EVENTS : w->batch_size * SIZE_MULTIPLIER;
+            struct request *temp = realloc(w->batch, size * sizeof(*temp));
+            if (temp == NULL) {
+                c->error = 1;
+                break;
+            }
+            w->batch = temp;
+            w->batch_size = size;
+        }
+        struct request *r = &w->batch[w->nbatch++];
+        r->c = c;
+        r->offset = c->parsed + DICED_LENGTH_SIZE;
+        r->len = len;
+        c->parsed += DICED_LENGTH_SIZE + len;
+    }
+}
+
+/* Evaluate all requests in the batch and add responses to connections.
+ */
+static void
+evaluate_batch(struct worker *w) {
+    if (w->nbatch == 0)
+        return;
+
+    for (size_t i = 0; i < w->nbatch; i++) {
+        struct request *r = &w->batch[i];
+        struct connection *c = r->c;
+        if (c->error)
+            continue;
+
+        if (reserve(&w->expr, r->len + 1) != 0) {
+            c->error = 1;
+            continue;
+        }
+        memcpy(w->expr.data, c->in.data + r->offset, r->len);
+        w->expr.data[r->len] = '\0';
+
+        int_least64_t value = 0;
+        char *rolled_expr = NULL;
+        enum parse_error e;
+        // Expression can't contain '\0'.
+        if (memchr(w->expr.data, '\0', r->len) != NULL)
+            e = DE_INVALID_CHARACTER;
+        else
+            e = de_parse((char*) w->expr.data, &value, &rolled_expr);
+        size_t rolled_len = e == 0 ? strlen(rolled_expr) : 0;
+        size_t len = DICED_RESPONSE_SIZE + rolled_len;
+
+        if (len > UINT32_MAX ||
+            reserve(&c->out, c->out.len + DICED_LENGTH_SIZE + len) != 0) {
+            c->error = 1;
+            free(rolled_expr);
+            continue;
+        }
+        unsigned char *p = c->out.data + c->out.len;
+        diced_put_u32(p, len);
+        p[DICED_LENGTH_SIZE] = e;
+        diced_put_i64(p + DICED_LENGTH_SIZE + 1, e == 0 ? value : 0);
+        if (rolled_len > 0)
+            memcpy(p + DICED_LENGTH_SIZE + DICED_RESPONSE_SIZE, rolled_expr,
+                   rolled_len);
+        c->out.len += DICED_LENGTH_SIZE + len;
+        free(rolled_expr);
+    }
+
+    w->requests += w->nbatch;
+    w->batches++;
+    if (w->nbatch > w->max_batch)
+        w->max_batch = w->nbatch;
+    w->nbatch = 0;
+}
+
+/* Remove parsed requests, write responses and close connection if it's
+ * done.
+ */
+static void
+finish_connection(struct worker *w, struct connection *c) {
+    memmove(c->in.data, c->in.data + c->parsed, c->in.len - c->parsed);
+    c->in.len -= c->parsed;
+    c->parsed = 0;
+
+    while (!c->error && c->written < c->out.len) {
+        ssize_t n = send(c->fd, c->out.data + c->written,
+                         c->out.len - c->written, MSG_NOSIGNAL);
+        if (n >= 0)
+            c->written += n;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        else if (errno != EINTR)
+            c->error = 1;
+    }
+    if (c->written == c->out.len) {
+        c->out.len = 0;
+        c->written = 0;
+    }
+
+    if (c->error || (c->eof && c->out.len == 0)) {
+        close_connection(w, c);
+        return;
+    }
+
+    // After end of file, or while too many responses wait, only wait until
+    // responses are written.
+    int reading = !c->eof && c->out.len - c->written < MAX_OUTPUT;
+    int writing = c->out.len > 0;
+    if (reading != c->reading || writing != c->writing) {
+        struct epoll_event event = {
+            .events = (reading ? EPOLLIN | EPOLLRDHUP : 0) |
+                      (writing ? EPOLLOUT : 0)
+        };
+        event.data.ptr = c;
+        epoll_ctl(w->epoll, EPOLL_CTL_MOD, c->fd, &event);
+        c->reading = reading;
+        c->writing = writing;
+    }
+}
+
+static void
+close_connection(struct worker *w, struct connection *c) {
+    if (c->prev != NULL)
+        c->prev->next = c->next;
+    else
+        w->open = c->next;
+    if (c->next != NULL)
+        c->next->prev = c->prev;
+    epoll_ctl(w->epoll, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->in.data);
+    free(c->out.data);
+    free(c);
+}
+
+/* Make buffer at least size bytes.
+ * @return Zero on success, ENOMEM on error.
+ */
+static int
+reserve(struct buffer *b, size_t size) {
+    if (b->size >= size)
+        return 0;
+
+    size_t new_size = b->size == 0 ? DEFAULT_BUFFER_SIZE : b->size;
+    while (new_size < size)
+        new_size *= SIZE_MULTIPLIER;
+    unsigned char *temp = realloc(b->data, new_size);
+    if (temp == NULL)
+        return ENOMEM;
+    b->data = temp;
+    b->size = new_size;
+
+    return 0;
+}
+
+static int
+listen_unix(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: path too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // Remove a socket left by an earlier run, but nothing else.
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("socket");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) == -1 ||
+        listen(fd, SOMAXCONN) == -1) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int
+listen_tcp(int port) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("socket");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) == -1 ||
+        listen(fd, SOMAXCONN) == -1) {
+        perror("TCP port");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
@@ -0,0 +1,64 @@
+#ifndef DICED_H
+    #define DICED_H
+#include <stddef.h>
+#include <stdint.h>
+
+/** @file
+ * Protocol of diced, the dice rolling daemon.
+ *
+ * Requests and responses are frames: a 32-bit length in network byte order
+ * followed by that many bytes.
+ *
+ * Request is a dice expression, without '\0'.
+ *
+ * Response is enum parse_error as one byte, the value of the expression as a
+ * 64-bit two's complement integer in network byte order and the rolled
+ * expression, without '\0'. On error, value is zero and rolled expression is
+ * empty.
+ *
+ * A client can send many requests without waiting for responses. Responses
+ * are sent in the order of the requests on each connection. Requests of a
+ * connection aren't read while many of its responses are unread.
+ */
+
+// Size of frame length.
+#define DICED_LENGTH_SIZE 4
+// Size of a response without rolled expression.
+#define DICED_RESPONSE_SIZE 9
+// Default maximum length of a request.
+#define DICED_MAX_REQUEST 65536
+#define DICED_DEFAULT_SOCKET "/tmp/diced.sock"
+
+static inline void
+diced_put_u32(unsigned char *p, uint_least32_t u) {
+    p[0] = u >> 24 & 0xff;
+    p[1] = u >> 16 & 0xff;
+    p[2] = u >> 8 & 0xff;
+    p[3] = u & 0xff;
+}
+
+static inline uint_least32_t
+diced_get_u32(const unsigned char *p) {
+    return (uint_least32_t) p[0] << 24 | (uint_least32_t) p[1] << 16 |
+           (uint_least32_t) p[2] << 8 | p[3];
+}
+
+static inline void
+diced_put_i64(unsigned char *p, int_least64_t i) {
+    uint_least64_t u = (uint_least64_t) i;
+    for (int j = 7; j >= 0; j--, u >>= 8)
+        p[j] = u & 0xff;
+}
+
+static inline int_least64_t
+diced_get_i64(const unsigned char *p) {
+    uint_least64_t u = 0;
+    for (int j = 0; j < 8; j++)
+        u = u << 8 | p[j];
+    // Convert without implementation defined conversion of values larger
+    // than INT_LEAST64_MAX.
+    return u <= INT_LEAST64_MAX ? (int_least64_t) u :
+        -(int_least64_t) (UINT_LEAST64_MAX - u) - 1;
+}
+
+#endif // DICED_H
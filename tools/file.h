@@ -0,0 +1,52 @@
+#ifndef FILE_H
+    #define FILE_H
+#include <stdio.h>
+#include <stdlib.h>
+
+/** @file
+ * Reading files for the tools.
+ */
+
+/** Read a whole file.
+ * Errors are written to standard error.
+ * @param path Path of the file.
+ * @param size Used to store size of the file.
+ * @return Contents, free it after use. NULL on error.
+ */
+static inline char*
+read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+
+    size_t capacity = 1 << 16;
+    char *chars = malloc(capacity);
+    *size = 0;
+    while (chars != NULL) {
+        *size += fread(chars + *size, 1, capacity - *size, f);
+        if (*size < capacity)
+            break;
+        char *temp = realloc(chars, capacity * 2);
+        if (temp == NULL) {
+            free(chars);
+            chars = NULL;
+            break;
+        }
+        chars = temp;
+        capacity *= 2;
+    }
+    if (chars == NULL)
+        perror("malloc");
+    else if (ferror(f)) {
+        perror(path);
+        free(chars);
+        chars = NULL;
+    }
+    fclose(f);
+
+    return chars;
+}
+
+#endif // FILE_H
@@ -0,0 +1,99 @@
+/* Measure how rolling a large dice scales with threads.
+ *
+ * Usage: rollbench [-e expression] [-t max_threads] [-r repeats]
+ *
+ * Evaluates the expression first without de_parallel_start(), then with
+ * de_parallel_start() using 1 to max_threads threads, and prints the best
+ * time of repeats evaluations and the speedup compared to one thread.
+ *
+ * -e expression  Default "20000000d1000>1000".
+ * -t max_threads Default number of online processors.
+ * -r repeats     Default 3.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "diceexpr.h"
+
+#define DEFAULT_EXPRESSION "20000000d1000>1000"
+#define DEFAULT_REPEATS 3
+
+static double measure(const char *expr, int repeats);
+
+int
+main(int argc, char **argv) {
+    const char *expr = DEFAULT_EXPRESSION;
+    long max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int repeats = DEFAULT_REPEATS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "e:t:r:")) != -1) {
+        switch (opt) {
+            case 'e': expr = optarg; break;
+            case 't': max_threads = atol(optarg); break;
+            case 'r': repeats = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-e expression] [-t max_threads] "
+                        "[-r repeats]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (max_threads < 1 || repeats < 1) {
+        fprintf(stderr, "max_threads and repeats must be positive\n");
+        return EXIT_FAILURE;
+    }
+    srand(time(NULL));
+
+    double serial = measure(expr, repeats);
+    if (serial < 0)
+        return EXIT_FAILURE;
+    printf("%s\nserial:    %8.3f s\n", expr, serial);
+
+    double one = 0;
+    for (long n = 1; n <= max_threads; n++) {
+        struct de_parallel_config config = { .nthreads = n };
+        if (de_parallel_start(&config) != 0) {
+            fprintf(stderr, "can't start threads\n");
+            return EXIT_FAILURE;
+        }
+        double seconds = measure(expr, repeats);
+        de_parallel_stop();
+        if (seconds < 0)
+            return EXIT_FAILURE;
+        if (n == 1)
+            one = seconds;
+        printf("%3ld threads: %8.3f s, speedup %5.2f\n", n, seconds,
+               one / seconds);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* Best time of evaluating expr repeats times.
+ * @return Seconds, or negative on error.
+ */
+static double
+measure(const char *expr, int repeats) {
+    double best = -1;
+    for (int i = 0; i < repeats; i++) {
+        struct timespec start, end;
+        int_least64_t value;
+        char *rolled_expr = NULL;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        enum parse_error e = de_parse(expr, &value, &rolled_expr);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        free(rolled_expr);
+        if (e != 0) {
+            fprintf(stderr, "%s: error %d\n", expr, e);
+            return -1;
+        }
+
+        double seconds = end.tv_sec - start.tv_sec +
+            (end.tv_nsec - start.tv_nsec) / 1e9;
+        if (best < 0 || seconds < best)
+            best = seconds;
+    }
+
+    return best;
+}